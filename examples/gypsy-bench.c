@@ -0,0 +1,362 @@
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * gypsy-bench - Sweeps simulated device count and update rate against a
+ *               running daemon and reports its CPU use and the latency from
+ *               a fix being generated to its PositionChanged arriving.
+ *
+ * The daemon has to allow sim://* in AllowedDeviceGlobs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <gypsy/gypsy-control.h>
+#include <gypsy/gypsy-device.h>
+#include <gypsy/gypsy-position.h>
+
+static GMainLoop *mainloop;
+static GArray *latencies;
+static gboolean measuring;
+
+static void
+position_changed (GypsyPosition      *position,
+		  GypsyPositionFields fields_set,
+		  int                 timestamp,
+		  double              latitude,
+		  double              longitude,
+		  double              altitude,
+		  gpointer            userdata)
+{
+	double generated, latency;
+
+	if (!measuring || timestamp == 0) {
+		return;
+	}
+
+	/* With stamp=1 the simulator sends the fraction
+	   of the second in the altitude */
+	generated = timestamp + altitude;
+	latency = g_get_real_time () / (double) G_USEC_PER_SEC - generated;
+	latency *= 1000.0;
+
+	g_array_append_val (latencies, latency);
+}
+
+static int
+compare_doubles (gconstpointer a,
+		 gconstpointer b)
+{
+	double da = *(const double *) a, db = *(const double *) b;
+
+	return (da > db) - (da < db);
+}
+
+static int
+get_daemon_pid (void)
+{
+	GDBusConnection *connection;
+	GVariant *reply;
+	GError *error = NULL;
+	guint pid = 0;
+
+	connection = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
+	if (connection == NULL) {
+		g_printerr ("Error getting bus: %s\n", error->message);
+		g_error_free (error);
+		return 0;
+	}
+
+	reply = g_dbus_connection_call_sync (connection,
+					     "org.freedesktop.DBus",
+					     "/org/freedesktop/DBus",
+					     "org.freedesktop.DBus",
+					     "GetConnectionUnixProcessID",
+					     g_variant_new ("(s)", "org.freedesktop.Gypsy"),
+					     G_VARIANT_TYPE ("(u)"),
+					     G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+					     &error);
+	if (reply == NULL) {
+		g_printerr ("Error finding daemon: %s\n", error->message);
+		g_error_free (error);
+	} else {
+		g_variant_get (reply, "(u)", &pid);
+		g_variant_unref (reply);
+	}
+	g_object_unref (connection);
+
+	return pid;
+}
+
+/* Total user and system time of pid, in seconds */
+static double
+get_cpu_time (int pid)
+{
+	char *filename, *contents, *fields;
+	unsigned long utime = 0, stime = 0;
+
+	filename = g_strdup_printf ("/proc/%d/stat", pid);
+	if (!g_file_get_contents (filename, &contents, NULL, NULL)) {
+		g_free (filename);
+		return 0.0;
+	}
+	g_free (filename);
+
+	/* Skip past the command name, which may contain spaces */
+	fields = strrchr (contents, ')');
+	if (fields) {
+		sscanf (fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+			&utime, &stime);
+	}
+	g_free (contents);
+
+	return (double) (utime + stime) / sysconf (_SC_CLK_TCK);
+}
+
+/* Releases the daemon's device for path, which gypsy_control_create()
+   holds until the daemon is told otherwise */
+static void
+shutdown_device (const char *path)
+{
+	GDBusConnection *connection;
+	GVariant *reply;
+	GError *error = NULL;
+
+	connection = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, NULL);
+	if (connection == NULL) {
+		return;
+	}
+
+	reply = g_dbus_connection_call_sync (connection,
+					     "org.freedesktop.Gypsy",
+					     "/org/freedesktop/Gypsy",
+					     "org.freedesktop.Gypsy.Server",
+					     "Shutdown",
+					     g_variant_new ("(o)", path),
+					     NULL, G_DBUS_CALL_FLAGS_NONE,
+					     -1, NULL, &error);
+	if (reply == NULL) {
+		g_printerr ("Error shutting down %s: %s\n", path,
+			    error->message);
+		g_error_free (error);
+	} else {
+		g_variant_unref (reply);
+	}
+	g_object_unref (connection);
+}
+
+static gboolean
+stop_measuring (gpointer userdata)
+{
+	g_main_loop_quit (mainloop);
+	return FALSE;
+}
+
+static void
+run_step (GypsyControl *control,
+	  int           pid,
+	  int           count,
+	  int           rate,
+	  int           duration,
+	  const char   *extra)
+{
+	GypsyDevice **devices;
+	GypsyPosition **positions;
+	char **paths;
+	double cpu_start, cpu_time, expected;
+	int i;
+
+	devices = g_new0 (GypsyDevice *, count);
+	positions = g_new0 (GypsyPosition *, count);
+	paths = g_new0 (char *, count + 1);
+
+	for (i = 0; i < count; i++) {
+		GError *error = NULL;
+		char *device, *path;
+
+		device = g_strdup_printf ("sim://bench%d?rate=%d&stamp=1%s",
+					  i, rate, extra);
+		path = gypsy_control_create (control, device, &error);
+		if (path == NULL) {
+			g_printerr ("Error creating %s: %s\n", device,
+				    error->message);
+			g_error_free (error);
+			g_free (device);
+			break;
+		}
+
+		devices[i] = gypsy_device_new (path);
+		positions[i] = gypsy_position_new (path);
+		g_signal_connect (positions[i], "position-changed",
+				  G_CALLBACK (position_changed), NULL);
+
+		if (!gypsy_device_start (devices[i], &error)) {
+			g_printerr ("Error starting %s: %s\n", device,
+				    error->message);
+			g_error_free (error);
+		}
+
+		g_free (device);
+		paths[i] = path;
+	}
+
+	/* Let everything settle before measuring */
+	measuring = FALSE;
+	g_timeout_add (1000, stop_measuring, NULL);
+	g_main_loop_run (mainloop);
+
+	g_array_set_size (latencies, 0);
+	measuring = TRUE;
+	cpu_start = get_cpu_time (pid);
+
+	g_timeout_add (duration * 1000, stop_measuring, NULL);
+	g_main_loop_run (mainloop);
+
+	measuring = FALSE;
+	cpu_time = get_cpu_time (pid) - cpu_start;
+
+	expected = (double) count * rate * duration;
+	g_print ("%7d %5d %9.0f %9u %6.1f%%",
+		 count, rate, expected, latencies->len,
+		 100.0 * cpu_time / duration);
+
+	if (latencies->len > 0) {
+		double *values = (double *) latencies->data;
+		double total = 0.0;
+		guint n;
+
+		g_array_sort (latencies, compare_doubles);
+		for (n = 0; n < latencies->len; n++) {
+			total += values[n];
+		}
+
+		g_print (" %8.2f %8.2f %8.2f\n", total / latencies->len,
+			 values[(latencies->len * 99) / 100],
+			 values[latencies->len - 1]);
+	} else {
+		g_print (" %8s %8s %8s\n", "-", "-", "-");
+	}
+
+	for (i = 0; i < count; i++) {
+		if (devices[i]) {
+			gypsy_device_stop (devices[i], NULL);
+			g_object_unref (devices[i]);
+			g_object_unref (positions[i]);
+			shutdown_device (paths[i]);
+		}
+	}
+	g_free (devices);
+	g_free (positions);
+	g_strfreev (paths);
+}
+
+static int *
+parse_list (const char *list)
+{
+	char **items;
+	int *values;
+	int i;
+
+	items = g_strsplit (list, ",", -1);
+	values = g_new0 (int, g_strv_length (items) + 1);
+	for (i = 0; items[i] != NULL; i++) {
+		values[i] = atoi (items[i]);
+	}
+	g_strfreev (items);
+
+	return values;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+	GOptionContext *context;
+	GypsyControl *control;
+	GError *error = NULL;
+	char *device_list = NULL, *rate_list = NULL, *format = NULL;
+	char *extra;
+	gboolean pty = FALSE;
+	int duration = 10;
+	int *counts, *rates;
+	int pid, c, r;
+
+	GOptionEntry entries[] = {
+		{ "devices", 0, 0, G_OPTION_ARG_STRING, &device_list, "Comma separated device counts (default 1,10,50)", "LIST" },
+		{ "rates", 0, 0, G_OPTION_ARG_STRING, &rate_list, "Comma separated rates in Hz (default 1,10,50)", "LIST" },
+		{ "duration", 0, 0, G_OPTION_ARG_INT, &duration, "Seconds to measure each step (default 10)", "SECONDS" },
+		{ "format", 0, 0, G_OPTION_ARG_STRING, &format, "nmea (default) or garmin", "FORMAT" },
+		{ "pty", 0, 0, G_OPTION_ARG_NONE, &pty, "Go through a pty and the serial code", NULL },
+		{ NULL }
+	};
+
+	g_type_init ();
+
+	context = g_option_context_new ("- benchmark the Gypsy daemon");
+	g_option_context_add_main_entries (context, entries, NULL);
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+	g_option_context_free (context);
+
+	counts = parse_list (device_list ? device_list : "1,10,50");
+	rates = parse_list (rate_list ? rate_list : "1,10,50");
+	extra = g_strdup_printf ("%s%s%s", pty ? "&pty=1" : "",
+				 format ? "&format=" : "",
+				 format ? format : "");
+
+	pid = get_daemon_pid ();
+	if (pid == 0) {
+		return 1;
+	}
+
+	control = gypsy_control_get_default ();
+	mainloop = g_main_loop_new (NULL, FALSE);
+	latencies = g_array_new (FALSE, FALSE, sizeof (double));
+
+	g_print ("devices  rate  expected  received    cpu  lat avg  lat p99  lat max (ms)\n");
+	for (c = 0; counts[c] > 0; c++) {
+		for (r = 0; rates[r] > 0; r++) {
+			run_step (control, pid, counts[c], rates[r],
+				  duration, extra);
+		}
+	}
+
+	g_array_free (latencies, TRUE);
+	g_main_loop_unref (mainloop);
+	g_object_unref (control);
+	g_free (extra);
+	g_free (counts);
+	g_free (rates);
+
+	return 0;
+}
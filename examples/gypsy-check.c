@@ -0,0 +1,268 @@
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * gypsy-check - Runs behaviour checks against a running daemon with
+ *               simulated receivers, and exits non-zero if any fail.
+ *
+ * The daemon has to allow sim://* in AllowedDeviceGlobs. The assistance
+ * check also needs a [device sim://check-assistance*] section whose
+ * Assistance key names u-blox MGA data under the assistance directory,
+ * and has to be run as root or a member of the gypsy group.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <gypsy/gypsy-control.h>
+#include <gypsy/gypsy-device.h>
+#include <gypsy/gypsy-position.h>
+
+#define GYPSY_SERVICE "org.freedesktop.Gypsy"
+#define GYPSY_DEVICE_INTERFACE "org.freedesktop.Gypsy.Device"
+
+static GMainLoop *mainloop;
+
+static gboolean
+stop_waiting (gpointer userdata)
+{
+	g_main_loop_quit (mainloop);
+	return FALSE;
+}
+
+static void
+wait_for (guint ms)
+{
+	g_timeout_add (ms, stop_waiting, NULL);
+	g_main_loop_run (mainloop);
+}
+
+/* Creates and starts device, returning its object path or NULL */
+static char *
+start_device (GypsyControl *control,
+	      const char   *device,
+	      GypsyDevice **started)
+{
+	GError *error = NULL;
+	char *path;
+
+	path = gypsy_control_create (control, device, &error);
+	if (path == NULL) {
+		g_printerr ("Error creating %s: %s\n", device, error->message);
+		g_error_free (error);
+		return NULL;
+	}
+
+	*started = gypsy_device_new (path);
+	if (!gypsy_device_start (*started, &error)) {
+		g_printerr ("Error starting %s: %s\n", device, error->message);
+		g_error_free (error);
+		g_object_unref (*started);
+		g_free (path);
+		return NULL;
+	}
+
+	return path;
+}
+
+static void
+stop_device (GDBusConnection *connection,
+	     GypsyDevice     *device,
+	     const char      *path)
+{
+	GVariant *reply;
+
+	gypsy_device_stop (device, NULL);
+	g_object_unref (device);
+
+	reply = g_dbus_connection_call_sync (connection, GYPSY_SERVICE,
+					     "/org/freedesktop/Gypsy",
+					     "org.freedesktop.Gypsy.Server",
+					     "Shutdown",
+					     g_variant_new ("(o)", path),
+					     NULL, G_DBUS_CALL_FLAGS_NONE,
+					     -1, NULL, NULL);
+	if (reply) {
+		g_variant_unref (reply);
+	}
+}
+
+/* Every message of the configured MGA data has to be acknowledged,
+   which needs ackAiding turning on first */
+static gboolean
+check_assistance (GypsyControl    *control,
+		  GDBusConnection *connection)
+{
+	GypsyDevice *device;
+	GVariant *reply;
+	GError *error = NULL;
+	guint sent = 0, failed = 0;
+	gboolean answered = FALSE;
+	char *path;
+
+	path = start_device (control, "sim://check-assistance?pty=1",
+			     &device);
+	if (path == NULL) {
+		return FALSE;
+	}
+
+	/* The pty is opened once the main loop runs */
+	wait_for (1000);
+
+	reply = g_dbus_connection_call_sync (connection, GYPSY_SERVICE, path,
+					     GYPSY_DEVICE_INTERFACE,
+					     "InjectAssistance", NULL,
+					     G_VARIANT_TYPE ("(uu)"),
+					     G_DBUS_CALL_FLAGS_NONE, 120000,
+					     NULL, &error);
+	if (reply == NULL) {
+		g_printerr ("Error injecting assistance: %s\n",
+			    error->message);
+		g_error_free (error);
+	} else {
+		g_variant_get (reply, "(uu)", &sent, &failed);
+		g_variant_unref (reply);
+		answered = TRUE;
+	}
+
+	stop_device (connection, device, path);
+	g_free (path);
+
+	g_print ("assistance: %u sent, %u failed\n", sent, failed);
+	return (answered && sent > 0 && failed == 0);
+}
+
+static void
+position_changed (GypsyPosition      *position,
+		  GypsyPositionFields fields,
+		  int                 timestamp,
+		  double              latitude,
+		  double              longitude,
+		  double              altitude,
+		  gpointer            userdata)
+{
+	guint *count = userdata;
+
+	(*count)++;
+}
+
+/* With a minimum interval set, a 10 Hz receiver must only reach the
+   program once a second, rather than through both the broadcast and
+   the limited signal */
+static gboolean
+check_interval (GypsyControl    *control,
+		GDBusConnection *connection)
+{
+	const char *interfaces[] = { GYPSY_POSITION_DBUS_INTERFACE, NULL };
+	GypsyDevice *device;
+	GypsyPosition *position;
+	GError *error = NULL;
+	guint count = 0;
+	gboolean limited;
+	char *path;
+
+	path = start_device (control, "sim://check-interval?rate=10",
+			     &device);
+	if (path == NULL) {
+		return FALSE;
+	}
+
+	position = gypsy_position_new (path);
+
+	limited = (gypsy_device_subscribe (device, interfaces, &error) &&
+		   gypsy_device_set_minimum_interval (device, 1000, &error));
+	if (!limited) {
+		g_printerr ("Error setting the interval: %s\n", error->message);
+		g_error_free (error);
+	} else {
+		/* Let the first update through the interval before counting */
+		wait_for (1500);
+
+		g_signal_connect (position, "position-changed",
+				  G_CALLBACK (position_changed), &count);
+		wait_for (5000);
+	}
+
+	g_object_unref (position);
+	stop_device (connection, device, path);
+	g_free (path);
+
+	g_print ("interval: %u position changes in 5 s\n", count);
+	return (limited && count >= 4 && count <= 6);
+}
+
+static const struct {
+	const char *name;
+	gboolean (* run) (GypsyControl    *control,
+			  GDBusConnection *connection);
+} checks[] = {
+	{ "assistance", check_assistance },
+	{ "interval", check_interval },
+};
+
+int
+main (int    argc,
+      char **argv)
+{
+	GypsyControl *control;
+	GDBusConnection *connection;
+	GError *error = NULL;
+	int i, j, failures = 0;
+
+	g_type_init ();
+
+	connection = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
+	if (connection == NULL) {
+		g_printerr ("Error getting bus: %s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+
+	mainloop = g_main_loop_new (NULL, FALSE);
+	control = gypsy_control_get_default ();
+
+	/* The checks named on the command line, or all of them */
+	for (i = 0; i < G_N_ELEMENTS (checks); i++) {
+		gboolean wanted = (argc < 2);
+
+		for (j = 1; j < argc; j++) {
+			if (g_str_equal (argv[j], checks[i].name)) {
+				wanted = TRUE;
+			}
+		}
+
+		if (wanted && !checks[i].run (control, connection)) {
+			g_print ("FAIL: %s\n", checks[i].name);
+			failures++;
+		}
+	}
+
+	g_object_unref (control);
+	g_main_loop_unref (mainloop);
+	g_object_unref (connection);
+
+	return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,296 @@
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * gypsy-signal-bench - Measures how many signals a running daemon gets onto
+ *                      the bus per second, and the CPU it spends doing it.
+ *
+ * It only talks plain D-Bus so the same binary can be pointed at daemons
+ * built before and after a transport change. The daemon has to allow
+ * sim://* in AllowedDeviceGlobs.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#define GYPSY_SERVICE "org.freedesktop.Gypsy"
+#define GYPSY_PATH "/org/freedesktop/Gypsy"
+#define GYPSY_SERVER_INTERFACE "org.freedesktop.Gypsy.Server"
+#define GYPSY_DEVICE_INTERFACE "org.freedesktop.Gypsy.Device"
+
+static GMainLoop *mainloop;
+static GHashTable *counts;
+static guint64 received;
+static gboolean measuring;
+
+static void
+signal_received (GDBusConnection *connection,
+		 const char      *sender_name,
+		 const char      *object_path,
+		 const char      *interface_name,
+		 const char      *signal_name,
+		 GVariant        *parameters,
+		 gpointer         userdata)
+{
+	guint count;
+
+	if (!measuring) {
+		return;
+	}
+
+	received++;
+	count = GPOINTER_TO_UINT (g_hash_table_lookup (counts, signal_name));
+	g_hash_table_insert (counts, g_strdup (signal_name),
+			     GUINT_TO_POINTER (count + 1));
+}
+
+static GVariant *
+call (GDBusConnection *connection,
+      const char      *path,
+      const char      *interface,
+      const char      *method,
+      GVariant        *parameters,
+      GError         **error)
+{
+	return g_dbus_connection_call_sync (connection, GYPSY_SERVICE, path,
+					    interface, method, parameters,
+					    NULL, G_DBUS_CALL_FLAGS_NONE, -1,
+					    NULL, error);
+}
+
+static int
+get_daemon_pid (GDBusConnection *connection)
+{
+	GVariant *reply;
+	GError *error = NULL;
+	guint pid = 0;
+
+	reply = g_dbus_connection_call_sync (connection,
+					     "org.freedesktop.DBus",
+					     "/org/freedesktop/DBus",
+					     "org.freedesktop.DBus",
+					     "GetConnectionUnixProcessID",
+					     g_variant_new ("(s)", GYPSY_SERVICE),
+					     G_VARIANT_TYPE ("(u)"),
+					     G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+					     &error);
+	if (reply == NULL) {
+		g_printerr ("Error finding daemon: %s\n", error->message);
+		g_error_free (error);
+		return 0;
+	}
+
+	g_variant_get (reply, "(u)", &pid);
+	g_variant_unref (reply);
+
+	return pid;
+}
+
+/* Total user and system time of pid, in seconds */
+static double
+get_cpu_time (int pid)
+{
+	char *filename, *contents, *fields;
+	unsigned long utime = 0, stime = 0;
+
+	filename = g_strdup_printf ("/proc/%d/stat", pid);
+	if (!g_file_get_contents (filename, &contents, NULL, NULL)) {
+		g_free (filename);
+		return 0.0;
+	}
+	g_free (filename);
+
+	/* Skip past the command name, which may contain spaces */
+	fields = strrchr (contents, ')');
+	if (fields) {
+		sscanf (fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+			&utime, &stime);
+	}
+	g_free (contents);
+
+	return (double) (utime + stime) / sysconf (_SC_CLK_TCK);
+}
+
+static void
+shutdown_device (GDBusConnection *connection,
+		 const char      *path)
+{
+	GVariant *reply;
+
+	/* Every daemon takes the object path */
+	reply = call (connection, GYPSY_PATH, GYPSY_SERVER_INTERFACE,
+		      "Shutdown", g_variant_new ("(o)", path), NULL);
+
+	if (reply) {
+		g_variant_unref (reply);
+	}
+}
+
+static gboolean
+stop_measuring (gpointer userdata)
+{
+	g_main_loop_quit (mainloop);
+	return FALSE;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+	GOptionContext *context;
+	GDBusConnection *connection;
+	GError *error = NULL;
+	GHashTableIter iter;
+	gpointer key, value;
+	char **devices, **paths;
+	double cpu_start, cpu_time;
+	int count = 10, rate = 10, duration = 10;
+	int pid, i;
+
+	GOptionEntry entries[] = {
+		{ "devices", 0, 0, G_OPTION_ARG_INT, &count, "Number of simulated devices (default 10)", "N" },
+		{ "rate", 0, 0, G_OPTION_ARG_INT, &rate, "Update rate of each device in Hz (default 10)", "HZ" },
+		{ "duration", 0, 0, G_OPTION_ARG_INT, &duration, "Seconds to measure (default 10)", "SECONDS" },
+		{ NULL }
+	};
+
+	g_type_init ();
+
+	context = g_option_context_new ("- measure the Gypsy daemon's signal throughput");
+	g_option_context_add_main_entries (context, entries, NULL);
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+	g_option_context_free (context);
+
+	connection = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
+	if (connection == NULL) {
+		g_printerr ("Error getting bus: %s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+
+	pid = get_daemon_pid (connection);
+	if (pid == 0) {
+		return 1;
+	}
+
+	mainloop = g_main_loop_new (NULL, FALSE);
+	counts = g_hash_table_new_full (g_str_hash, g_str_equal,
+					g_free, NULL);
+
+	g_dbus_connection_signal_subscribe (connection, GYPSY_SERVICE,
+					    NULL, NULL, NULL, NULL,
+					    G_DBUS_SIGNAL_FLAGS_NONE,
+					    signal_received, NULL, NULL);
+
+	devices = g_new0 (char *, count + 1);
+	paths = g_new0 (char *, count + 1);
+	for (i = 0; i < count; i++) {
+		GVariant *reply;
+
+		devices[i] = g_strdup_printf ("sim://signals%d?rate=%d",
+					      i, rate);
+		reply = call (connection, GYPSY_PATH, GYPSY_SERVER_INTERFACE,
+			      "Create", g_variant_new ("(s)", devices[i]),
+			      &error);
+		if (reply == NULL) {
+			g_printerr ("Error creating %s: %s\n", devices[i],
+				    error->message);
+			g_error_free (error);
+			error = NULL;
+			continue;
+		}
+
+		g_variant_get (reply, "(o)", &paths[i]);
+		g_variant_unref (reply);
+
+		reply = call (connection, paths[i], GYPSY_DEVICE_INTERFACE,
+			      "Start", NULL, &error);
+		if (reply == NULL) {
+			g_printerr ("Error starting %s: %s\n", devices[i],
+				    error->message);
+			g_error_free (error);
+			error = NULL;
+		} else {
+			g_variant_unref (reply);
+		}
+	}
+
+	/* Let everything settle before measuring */
+	g_timeout_add (1000, stop_measuring, NULL);
+	g_main_loop_run (mainloop);
+
+	measuring = TRUE;
+	cpu_start = get_cpu_time (pid);
+
+	g_timeout_add (duration * 1000, stop_measuring, NULL);
+	g_main_loop_run (mainloop);
+
+	measuring = FALSE;
+	cpu_time = get_cpu_time (pid) - cpu_start;
+
+	g_print ("%d devices at %d Hz for %d s\n", count, rate, duration);
+	g_print ("%" G_GUINT64_FORMAT " signals, %.1f signals/s, daemon cpu %.1f%%",
+		 received, (double) received / duration,
+		 100.0 * cpu_time / duration);
+	if (cpu_time > 0.0) {
+		g_print (", %.1f signals per cpu ms",
+			 received / (cpu_time * 1000.0));
+	}
+	g_print ("\n");
+
+	g_hash_table_iter_init (&iter, counts);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		g_print ("  %-24s %u\n", (char *) key,
+			 GPOINTER_TO_UINT (value));
+	}
+
+	for (i = 0; i < count; i++) {
+		if (paths[i]) {
+			GVariant *reply;
+
+			reply = call (connection, paths[i],
+				      GYPSY_DEVICE_INTERFACE, "Stop",
+				      NULL, NULL);
+			if (reply) {
+				g_variant_unref (reply);
+			}
+			shutdown_device (connection, paths[i]);
+		}
+	}
+
+	g_strfreev (devices);
+	g_strfreev (paths);
+	g_hash_table_destroy (counts);
+	g_main_loop_unref (mainloop);
+	g_object_unref (connection);
+
+	return 0;
+}
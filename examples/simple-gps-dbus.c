@@ -11,135 +11,87 @@
  */
 
 /*
- * simple-gps-dbus: A simple gps example using pure D-Bus.
+ * simple-gps-dbus: A simple gps example using plain GDBus.
  */
 
 #include <glib.h>
-
-#define DBUS_API_SUBJECT_TO_CHANGE
-#include <dbus/dbus-glib.h>
-#include <dbus/dbus-glib-lowlevel.h>
-#include <dbus/dbus.h>
-
-static DBusHandlerResult
-parse_position_changed (DBusConnection *conn,
-			DBusMessage    *message,
-			void           *user_data)
+#include <gio/gio.h>
+
+static void
+position_changed (GDBusConnection *conn,
+		  const char      *sender_name,
+		  const char      *object_path,
+		  const char      *interface_name,
+		  const char      *signal_name,
+		  GVariant        *parameters,
+		  gpointer         user_data)
 {
 	int timestamp, fields;
 	double latitude, longitude, altitude;
-	DBusError error;
-
-	dbus_error_init (&error);
-	if (!dbus_message_get_args (message, &error,
-				    DBUS_TYPE_INT32, &fields,
-				    DBUS_TYPE_INT32, &timestamp,
-				    DBUS_TYPE_DOUBLE, &latitude,
-				    DBUS_TYPE_DOUBLE, &longitude,
-				    DBUS_TYPE_DOUBLE, &altitude,
-				    DBUS_TYPE_INVALID)) {
-		g_warning ("Could not get position: %s", error.message);
-
-		dbus_error_free (&error);
-		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(iiddd)"))) {
+		g_warning ("Could not get position: unexpected arguments %s",
+			   g_variant_get_type_string (parameters));
+		return;
 	}
 
+	g_variant_get (parameters, "(iiddd)", &fields, &timestamp,
+		       &latitude, &longitude, &altitude);
+
 	g_print ("Latitude: %f\nLongitude: %f\nAltitude: %f\n",
 		 latitude, longitude, altitude);
-
-        return DBUS_HANDLER_RESULT_HANDLED;
 }
 
-static DBusHandlerResult
-parse_course_changed (DBusConnection *conn,
-		      DBusMessage    *message,
-		      void           *user_data)
+static void
+course_changed (GDBusConnection *conn,
+		const char      *sender_name,
+		const char      *object_path,
+		const char      *interface_name,
+		const char      *signal_name,
+		GVariant        *parameters,
+		gpointer         user_data)
 {
 	int timestamp, fields;
 	double speed, direction, climb;
-	DBusError error;
-
-	dbus_error_init (&error);
-	if (!dbus_message_get_args (message, &error,
-				    DBUS_TYPE_INT32, &fields,
-				    DBUS_TYPE_INT32, &timestamp,
-				    DBUS_TYPE_DOUBLE, &speed,
-				    DBUS_TYPE_DOUBLE, &direction,
-				    DBUS_TYPE_DOUBLE, &climb,
-				    DBUS_TYPE_INVALID)) {
-		g_warning ("Could not get position: %s", error.message);
-
-		dbus_error_free (&error);
-		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(iiddd)"))) {
+		g_warning ("Could not get course: unexpected arguments %s",
+			   g_variant_get_type_string (parameters));
+		return;
 	}
 
+	g_variant_get (parameters, "(iiddd)", &fields, &timestamp,
+		       &speed, &direction, &climb);
+
 	g_print ("Speed: %f\nDirection: %f\nClimb: %f\n",
 		 speed, direction, climb);
-
-        return DBUS_HANDLER_RESULT_HANDLED;
-}
-
-static DBusHandlerResult
-signal_filter (DBusConnection *conn,
-               DBusMessage    *message,
-               void           *user_data)
-{
-        if (dbus_message_is_signal (message, "org.freedesktop.gypsy.Client",
-                                    "PositionChanged")) {
-                return parse_position_changed (conn, message, user_data);
-        } 
-
-        if (dbus_message_is_signal (message, "org.freedesktop.gypsy.Client",
-                                    "CourseChanged")) {
-                return parse_course_changed (conn, message, user_data);
-        } 
-
-        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
-static DBusConnection *
-get_connection (void)
-{
-        GError *error = NULL;
-        DBusGConnection *conn;
-
-        conn = dbus_g_bus_get (DBUS_BUS_SYSTEM, &error);
-        if (conn == NULL) {
-                g_error ("Error getting bus: %s", error->message);
-        }
-
-        return dbus_g_connection_get_connection (conn);
-}
-
-#define POSITION_CHANGED_MATCH "type='signal',interface='org.freedesktop.gypsy.Client',member='PositionChanged'"
-#define COURSE_CHANGED_MATCH "type='signal',interface='org.freedesktop.gypsy.Client',member='CourseChanged'"
-
 int
 main (int    argc,
       char **argv)
 {
-	DBusConnection *conn;
-	DBusError error;
+	GDBusConnection *conn;
+	GError *error = NULL;
 	GMainLoop *mainloop;
 
 	g_type_init ();
-	conn = get_connection ();
 
-	dbus_error_init (&error);
-	dbus_bus_add_match (conn, POSITION_CHANGED_MATCH, &error);
-	if (dbus_error_is_set (&error)) {
-		g_error ("Error adding match: %s", error.message);
+	conn = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
+	if (conn == NULL) {
+		g_error ("Error getting bus: %s", error->message);
 	}
 
-	dbus_bus_add_match (conn, COURSE_CHANGED_MATCH, &error);
-	if (dbus_error_is_set (&error)) {
-		g_error ("Error adding match: %s", error.message);
-	}
-
-	if (!dbus_connection_add_filter (conn, signal_filter,
-					 NULL, NULL)) {
-		g_error ("Error adding filter");
-	}
+	g_dbus_connection_signal_subscribe (conn, "org.freedesktop.Gypsy",
+					    "org.freedesktop.Gypsy.Position",
+					    "PositionChanged", NULL, NULL,
+					    G_DBUS_SIGNAL_FLAGS_NONE,
+					    position_changed, NULL, NULL);
+	g_dbus_connection_signal_subscribe (conn, "org.freedesktop.Gypsy",
+					    "org.freedesktop.Gypsy.Course",
+					    "CourseChanged", NULL, NULL,
+					    G_DBUS_SIGNAL_FLAGS_NONE,
+					    course_changed, NULL, NULL);
 
 	mainloop = g_main_loop_new (NULL, FALSE);
 	g_main_loop_run (mainloop);
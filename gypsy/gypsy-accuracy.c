@@ -72,14 +72,14 @@
  */
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
 #include <gypsy/gypsy-marshal.h>
+#include <gypsy/gypsy-device-private.h>
 #include <gypsy/gypsy-accuracy.h>
 
-#include "gypsy-client-bindings.h"
-
 typedef struct _GypsyAccuracyPrivate {
-	DBusGProxy *proxy;
+	GDBusProxy *proxy;
 	char *object_path;
 } GypsyAccuracyPrivate;
 
@@ -97,12 +97,11 @@ enum {
 
 G_DEFINE_TYPE (GypsyAccuracy, gypsy_accuracy, G_TYPE_OBJECT);
 
-static void accuracy_changed (DBusGProxy    *proxy,
-			      int            fields,
-			      double         pdop,
-			      double         hdop,
-			      double         vdop,
-			      GypsyAccuracy *accuracy);
+static void proxy_signal (GDBusProxy    *proxy,
+			  const char    *sender_name,
+			  const char    *signal_name,
+			  GVariant      *parameters,
+			  GypsyAccuracy *accuracy);
 
 static guint32 signals[LAST_SIGNAL] = {0, };
 static void
@@ -127,9 +126,9 @@ dispose (GObject *object)
 	priv = GET_PRIVATE (object);
 
 	if (priv->proxy) {
-		dbus_g_proxy_disconnect_signal (priv->proxy, "AccuracyChanged",
-						G_CALLBACK (accuracy_changed),
-						object);
+		g_signal_handlers_disconnect_by_func (priv->proxy,
+						      proxy_signal,
+						      object);
 		g_object_unref (priv->proxy);
 		priv->proxy = NULL;
 	}
@@ -177,36 +176,46 @@ get_property (GObject    *object,
 }
 
 static void
-accuracy_changed (DBusGProxy    *proxy,
-		  int            fields,
-		  double         pdop,
-		  double         hdop,
-		  double         vdop,
-		  GypsyAccuracy *accuracy)
+proxy_signal (GDBusProxy    *proxy,
+	      const char    *sender_name,
+	      const char    *signal_name,
+	      GVariant      *parameters,
+	      GypsyAccuracy *accuracy)
 {
+	int fields;
+	double pdop, hdop, vdop;
+
+	if (!gypsy_device_accepts_signal (proxy, sender_name, signal_name,
+					  "AccuracyChanged")) {
+		return;
+	}
+
+	g_variant_get (parameters, "(iddd)", &fields, &pdop, &hdop, &vdop);
 	g_signal_emit (accuracy, signals[ACCURACY_CHANGED], 0,
 		       fields, pdop, hdop, vdop);
 }
 
 static void
-get_accuracy_cb (DBusGProxy *proxy,
-		 int         fields, 
-		 double      pdop,
-		 double      hdop,
-		 double      vdop,
-		 GError     *error, 
-		 gpointer    userdata)
+get_accuracy_cb (GObject      *source,
+		 GAsyncResult *result,
+		 gpointer      userdata)
 {
 	GypsyAccuracy *accuracy = userdata;
+	GError *error = NULL;
+	GVariant *reply;
 
-	if (error) {
+	reply = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), result,
+					  &error);
+	if (reply == NULL) {
 		g_warning ("Cannot get accuracy: %s", error->message);
 		g_error_free (error);
-		return;
+	} else {
+		proxy_signal (G_DBUS_PROXY (source), NULL,
+			      "AccuracyChanged", reply, accuracy);
+		g_variant_unref (reply);
 	}
 
-	accuracy_changed (proxy, fields,
-			  pdop, hdop, vdop, accuracy);
+	g_object_unref (accuracy);
 }
 
 static GObject *
@@ -216,7 +225,6 @@ constructor (GType                  type,
 {
 	GypsyAccuracy *accuracy;
 	GypsyAccuracyPrivate *priv;
-	DBusGConnection *connection;
 	GError *error;
 
 	accuracy = GYPSY_ACCURACY (G_OBJECT_CLASS (gypsy_accuracy_parent_class)->constructor 
@@ -226,31 +234,27 @@ constructor (GType                  type,
 	priv = GET_PRIVATE (accuracy);
 
 	error = NULL;
-	connection = dbus_g_bus_get (DBUS_BUS_SYSTEM, &error);
-	if (connection == NULL) {
+	priv->proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
+						     G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+						     NULL,
+						     GYPSY_ACCURACY_DBUS_SERVICE,
+						     priv->object_path,
+						     GYPSY_ACCURACY_DBUS_INTERFACE,
+						     NULL, &error);
+	if (priv->proxy == NULL) {
 		g_printerr ("Failed to open connection to bus: %s\n",
 			    error->message);
 		g_error_free (error);
-		
-		priv->proxy = NULL;
 		return G_OBJECT (accuracy);
 	}
 
-	priv->proxy = dbus_g_proxy_new_for_name (connection, 
-						 GYPSY_ACCURACY_DBUS_SERVICE,
-						 priv->object_path,
-						 GYPSY_ACCURACY_DBUS_INTERFACE);
+	g_signal_connect (priv->proxy, "g-signal",
+			  G_CALLBACK (proxy_signal), accuracy);
 
-	dbus_g_proxy_add_signal (priv->proxy, "AccuracyChanged",
-				 G_TYPE_INT, G_TYPE_DOUBLE,
-				 G_TYPE_DOUBLE, G_TYPE_DOUBLE, G_TYPE_INVALID);
-	dbus_g_proxy_connect_signal (priv->proxy, "AccuracyChanged",
-				     G_CALLBACK (accuracy_changed),
-				     accuracy, NULL);
+	g_dbus_proxy_call (priv->proxy, "GetAccuracy", NULL,
+			   G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+			   get_accuracy_cb, g_object_ref (accuracy));
 
-	org_freedesktop_Gypsy_Accuracy_get_accuracy_async
-		(priv->proxy, get_accuracy_cb, accuracy);
-	
 	return G_OBJECT (accuracy);
 }
 
@@ -351,19 +355,23 @@ gypsy_accuracy_get_accuracy (GypsyAccuracy *accuracy,
 			     GError       **error)
 {
 	GypsyAccuracyPrivate *priv;
+	GVariant *reply;
 	double p, h, v;
 	int fields;
 	
 	g_return_val_if_fail (GYPSY_IS_ACCURACY (accuracy), GYPSY_ACCURACY_FIELDS_NONE);
 
 	priv = GET_PRIVATE (accuracy);
-	if (!org_freedesktop_Gypsy_Accuracy_get_accuracy (priv->proxy,
-							  &fields,
-							  &p, &h, &v,
-							  error)) {
+	reply = g_dbus_proxy_call_sync (priv->proxy, "GetAccuracy", NULL,
+					G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+					error);
+	if (reply == NULL) {
 		return GYPSY_ACCURACY_FIELDS_NONE;
 	}
 
+	g_variant_get (reply, "(iddd)", &fields, &p, &h, &v);
+	g_variant_unref (reply);
+
 	if (pdop != NULL && (fields & GYPSY_ACCURACY_FIELDS_POSITION)) {
 		*pdop = p;
 	}
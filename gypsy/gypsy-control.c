@@ -92,14 +92,12 @@
  */
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
 #include <gypsy/gypsy-control.h>
-#include <gypsy/gypsy-marshal.h>
-
-#include "gypsy-server-bindings.h"
 
 typedef struct _GypsyControlPrivate {
-	DBusGProxy *proxy;
+	GDBusProxy *proxy;
 	char *device_name;
 } GypsyControlPrivate;
 
@@ -126,14 +124,19 @@ dispose (GObject *object)
 	priv = GET_PRIVATE (object);
 
 	if (priv->device_name) {
-		GError *error = NULL;
+		GVariant *reply;
 
 		/* Shoutdown the server object when this control object
 		   is unreffed */
-		if (!org_freedesktop_Gypsy_Server_shutdown (priv->proxy,
-							    priv->device_name,
-							    &error)) {
-			g_error_free (error);
+		if (priv->proxy) {
+			reply = g_dbus_proxy_call_sync (priv->proxy,
+							"ShutdownDevice",
+							g_variant_new ("(s)", priv->device_name),
+							G_DBUS_CALL_FLAGS_NONE,
+							-1, NULL, NULL);
+			if (reply) {
+				g_variant_unref (reply);
+			}
 		}
 
 		g_free (priv->device_name);
@@ -162,39 +165,25 @@ static void
 gypsy_control_init (GypsyControl *control)
 {
 	GypsyControlPrivate *priv;
-	DBusGConnection *connection;
 	GError *error;
 
 	priv = GET_PRIVATE (control);
 
 	error = NULL;
-	connection = dbus_g_bus_get (DBUS_BUS_SYSTEM, &error);
-	if (!connection) {
+	priv->proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
+						     G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+						     G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+						     NULL,
+						     GYPSY_CONTROL_DBUS_SERVICE,
+						     GYPSY_CONTROL_DBUS_PATH,
+						     GYPSY_CONTROL_DBUS_INTERFACE,
+						     NULL, &error);
+	if (priv->proxy == NULL) {
 		g_warning ("Unable to get connection to system bus\n%s",
 			   error->message);
 		g_error_free (error);
 		return;
 	}
-
-	priv->proxy = dbus_g_proxy_new_for_name (connection,
-						 GYPSY_CONTROL_DBUS_SERVICE,
-						 GYPSY_CONTROL_DBUS_PATH,
-						 GYPSY_CONTROL_DBUS_INTERFACE);
-	dbus_g_object_register_marshaller (gypsy_marshal_VOID__INT_INT_DOUBLE_DOUBLE_DOUBLE,
-					   G_TYPE_NONE,
-					   G_TYPE_INT,
-					   G_TYPE_INT,
-					   G_TYPE_DOUBLE,
-					   G_TYPE_DOUBLE,
-					   G_TYPE_DOUBLE,
-					   G_TYPE_INVALID);
-	dbus_g_object_register_marshaller (gypsy_marshal_VOID__INT_DOUBLE_DOUBLE_DOUBLE,
-					   G_TYPE_NONE,
-					   G_TYPE_INT,
-					   G_TYPE_DOUBLE,
-					   G_TYPE_DOUBLE,
-					   G_TYPE_DOUBLE,
-					   G_TYPE_INVALID);
 }
 
 /**
@@ -239,6 +228,7 @@ gypsy_control_create (GypsyControl *control,
 		      GError      **error)
 {
 	GypsyControlPrivate *priv;
+	GVariant *reply;
 	char *path;
 
 	g_return_val_if_fail (GYPSY_IS_CONTROL (control), NULL);
@@ -246,11 +236,17 @@ gypsy_control_create (GypsyControl *control,
 
 	priv = GET_PRIVATE (control);
 
-	if (!org_freedesktop_Gypsy_Server_create (priv->proxy, device_name,
-						  &path, error)) {
+	reply = g_dbus_proxy_call_sync (priv->proxy, "Create",
+					g_variant_new ("(s)", device_name),
+					G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+					error);
+	if (reply == NULL) {
 		return NULL;
 	}
 
+	g_variant_get (reply, "(o)", &path);
+	g_variant_unref (reply);
+
 	priv->device_name = g_strdup (device_name);
 	return path;
 }
@@ -73,14 +73,14 @@
  */
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
+#include <gypsy/gypsy-device-private.h>
 #include <gypsy/gypsy-course.h>
 #include <gypsy/gypsy-marshal.h>
 
-#include "gypsy-client-bindings.h"
-
 typedef struct _GypsyCoursePrivate {
-	DBusGProxy *proxy;
+	GDBusProxy *proxy;
 	char *object_path;
 } GypsyCoursePrivate;
 
@@ -98,13 +98,11 @@ enum {
 
 G_DEFINE_TYPE (GypsyCourse, gypsy_course, G_TYPE_OBJECT);
 
-static void course_changed (DBusGProxy  *proxy,
-			    int          fields,
-			    int          timestamp,
-			    double       speed,
-			    double       direction,
-			    double       climb,
-			    GypsyCourse *course);
+static void proxy_signal (GDBusProxy  *proxy,
+			  const char  *sender_name,
+			  const char  *signal_name,
+			  GVariant    *parameters,
+			  GypsyCourse *course);
 
 static guint32 signals[LAST_SIGNAL] = {0, };
 static void
@@ -129,9 +127,9 @@ dispose (GObject *object)
 	priv = GET_PRIVATE (object);
 
 	if (priv->proxy) {
-		dbus_g_proxy_disconnect_signal (priv->proxy, "CourseChanged",
-						G_CALLBACK (course_changed),
-						object);
+		g_signal_handlers_disconnect_by_func (priv->proxy,
+						      proxy_signal,
+						      object);
 		g_object_unref (priv->proxy);
 		priv->proxy = NULL;
 	}
@@ -179,14 +177,22 @@ get_property (GObject    *object,
 }
 
 static void
-course_changed (DBusGProxy  *proxy,
-		int          fields,
-		int          timestamp,
-		double       speed,
-		double       direction,
-		double       climb,
-		GypsyCourse *course)
+proxy_signal (GDBusProxy  *proxy,
+	      const char  *sender_name,
+	      const char  *signal_name,
+	      GVariant    *parameters,
+	      GypsyCourse *course)
 {
+	int fields, timestamp;
+	double speed, direction, climb;
+
+	if (!gypsy_device_accepts_signal (proxy, sender_name, signal_name,
+					  "CourseChanged")) {
+		return;
+	}
+
+	g_variant_get (parameters, "(iiddd)", &fields, &timestamp,
+		       &speed, &direction, &climb);
 	g_signal_emit (course, signals[COURSE_CHANGED], 0,
 		       fields, timestamp, speed, direction, climb);
 }
@@ -198,7 +204,6 @@ constructor (GType                  type,
 {
 	GypsyCourse *course;
 	GypsyCoursePrivate *priv;
-	DBusGConnection *connection;
 	GError *error;
 
 	course = GYPSY_COURSE (G_OBJECT_CLASS (gypsy_course_parent_class)->constructor 
@@ -208,28 +213,23 @@ constructor (GType                  type,
 	priv = GET_PRIVATE (course);
 
 	error = NULL;
-	connection = dbus_g_bus_get (DBUS_BUS_SYSTEM, &error);
-	if (connection == NULL) {
+	priv->proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
+						     G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+						     NULL,
+						     GYPSY_COURSE_DBUS_SERVICE,
+						     priv->object_path,
+						     GYPSY_COURSE_DBUS_INTERFACE,
+						     NULL, &error);
+	if (priv->proxy == NULL) {
 		g_printerr ("Failed to open connection to bus: %s\n",
 			    error->message);
 		g_error_free (error);
-		
-		priv->proxy = NULL;
 		return G_OBJECT (course);
 	}
 
-	priv->proxy = dbus_g_proxy_new_for_name (connection, 
-						 GYPSY_COURSE_DBUS_SERVICE,
-						 priv->object_path,
-						 GYPSY_COURSE_DBUS_INTERFACE);
-
-	dbus_g_proxy_add_signal (priv->proxy, "CourseChanged",
-				 G_TYPE_INT, G_TYPE_INT, G_TYPE_DOUBLE,
-				 G_TYPE_DOUBLE, G_TYPE_DOUBLE, G_TYPE_INVALID);
-	dbus_g_proxy_connect_signal (priv->proxy, "CourseChanged",
-				     G_CALLBACK (course_changed),
-				     course, NULL);
-				     
+	g_signal_connect (priv->proxy, "g-signal",
+			  G_CALLBACK (proxy_signal), course);
+
 	return G_OBJECT (course);
 }
 
@@ -334,18 +334,24 @@ gypsy_course_get_course (GypsyCourse *course,
 			 GError     **error)
 {
 	GypsyCoursePrivate *priv;
+	GVariant *reply;
 	double sp, di, cl;
 	int fields, ts;
 
 	g_return_val_if_fail (GYPSY_IS_COURSE (course), GYPSY_COURSE_FIELDS_NONE);
 
 	priv = GET_PRIVATE (course);
-	if (!org_freedesktop_Gypsy_Course_get_course (priv->proxy, &fields,
-						      &ts, &sp, &di, 
-						      &cl, error)) {
+	reply = g_dbus_proxy_call_sync (priv->proxy, "GetCourse", NULL,
+					G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+					error);
+	if (reply == NULL) {
 		return GYPSY_COURSE_FIELDS_NONE;
 	}
 
+	g_variant_get (reply, "(iiddd)", &fields, &ts,
+		       &sp, &di, &cl);
+	g_variant_unref (reply);
+
 	if (timestamp != NULL) {
 		*timestamp = ts;
 	}
@@ -70,15 +70,17 @@
  */
 
 #include <glib-object.h>
+#include <gio/gio.h>
+
+#include <string.h>
 
 #include <gypsy/gypsy-device.h>
+#include <gypsy/gypsy-device-private.h>
 #include <gypsy/gypsy-marshal.h>
 
-#include "gypsy-client-bindings.h"
-
 typedef struct _GypsyDevicePrivate {
 	char *object_path;
-	DBusGProxy *proxy;
+	GDBusProxy *proxy;
 } GypsyDevicePrivate;
 
 enum {
@@ -86,6 +88,7 @@ enum {
 	COURSE_CHANGED,
 	CONNECTION_CHANGED,
 	FIX_STATUS_CHANGED,
+	FIX_QUALITY_CHANGED,
 	SATELLITES_CHANGED,
 	LAST_SIGNAL
 };
@@ -97,15 +100,59 @@ enum {
 
 #define GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), GYPSY_TYPE_DEVICE, GypsyDevicePrivate))
 
-static void connection_changed_cb (DBusGProxy  *proxy,
-				   gboolean     connected,
-				   GypsyDevice *device);
-static void fix_status_changed_cb (DBusGProxy  *proxy,
-				   int          fix_status,
-				   GypsyDevice *device);
+static void proxy_signal (GDBusProxy  *proxy,
+			  const char  *sender_name,
+			  const char  *signal_name,
+			  GVariant    *parameters,
+			  GypsyDevice *device);
 
 G_DEFINE_TYPE (GypsyDevice, gypsy_device, G_TYPE_OBJECT);
 
+/* The object paths this program has set a minimum interval on. The
+   daemon sends their updates to it as the *Limited signals, which are
+   used instead of the broadcast ones */
+static GHashTable *limited_paths = NULL;
+
+static void
+set_limited (const char *object_path,
+	     gboolean    limited)
+{
+	if (limited_paths == NULL) {
+		limited_paths = g_hash_table_new_full (g_str_hash, g_str_equal,
+						       g_free, NULL);
+	}
+
+	if (limited) {
+		g_hash_table_replace (limited_paths, g_strdup (object_path),
+				      GINT_TO_POINTER (TRUE));
+	} else {
+		g_hash_table_remove (limited_paths, object_path);
+	}
+}
+
+/* Whether signal_name is the signal called name that the object on proxy
+   should act on. A NULL sender_name is a reply to its Get method */
+gboolean
+gypsy_device_accepts_signal (GDBusProxy *proxy,
+			     const char *sender_name,
+			     const char *signal_name,
+			     const char *name)
+{
+	gsize length = strlen (name);
+
+	if (strncmp (signal_name, name, length) != 0) {
+		return FALSE;
+	}
+
+	if (sender_name != NULL && limited_paths != NULL &&
+	    g_hash_table_lookup (limited_paths,
+				 g_dbus_proxy_get_object_path (proxy))) {
+		return g_str_equal (signal_name + length, "Limited");
+	}
+
+	return signal_name[length] == '\0';
+}
+
 static guint32 signals[LAST_SIGNAL] = {0, };
 static void
 finalize (GObject *object)
@@ -129,12 +176,9 @@ dispose (GObject *object)
 	priv = GET_PRIVATE (object);
 
 	if (priv->proxy) {
-		dbus_g_proxy_disconnect_signal (priv->proxy, "ConnectionStatusChanged",
-						G_CALLBACK (connection_changed_cb),
-						object);
-		dbus_g_proxy_disconnect_signal (priv->proxy, "FixStatusChanged",
-						G_CALLBACK (fix_status_changed_cb),
-						object);
+		g_signal_handlers_disconnect_by_func (priv->proxy,
+						      proxy_signal,
+						      object);
 
 		g_object_unref (priv->proxy);
 		priv->proxy = NULL;
@@ -183,19 +227,54 @@ get_property (GObject    *object,
 }
 
 static void
-connection_changed_cb (DBusGProxy  *proxy,
-		       gboolean     connected,
-		       GypsyDevice *device)
+proxy_signal (GDBusProxy  *proxy,
+	      const char  *sender_name,
+	      const char  *signal_name,
+	      GVariant    *parameters,
+	      GypsyDevice *device)
 {
-	g_signal_emit (device, signals[CONNECTION_CHANGED], 0, connected);
+	if (g_str_equal (signal_name, "ConnectionStatusChanged")) {
+		gboolean connected;
+
+		g_variant_get (parameters, "(b)", &connected);
+		g_signal_emit (device, signals[CONNECTION_CHANGED], 0,
+			       connected);
+	} else if (g_str_equal (signal_name, "FixStatusChanged")) {
+		int fix_status;
+
+		g_variant_get (parameters, "(i)", &fix_status);
+		g_signal_emit (device, signals[FIX_STATUS_CHANGED], 0,
+			       fix_status);
+	} else if (g_str_equal (signal_name, "FixQualityChanged")) {
+		int quality;
+
+		g_variant_get (parameters, "(i)", &quality);
+		g_signal_emit (device, signals[FIX_QUALITY_CHANGED], 0,
+			       quality);
+	}
 }
 
-static void
-fix_status_changed_cb (DBusGProxy  *proxy,
-		       int          fix_status,
-		       GypsyDevice *device)
+/* Calls a method that takes parameters and returns nothing */
+static gboolean
+call_method (GypsyDevice *device,
+	     const char  *method,
+	     GVariant    *parameters,
+	     GError     **error)
 {
-	g_signal_emit (device, signals[FIX_STATUS_CHANGED], 0, fix_status);
+	GypsyDevicePrivate *priv;
+	GVariant *reply;
+
+	priv = GET_PRIVATE (device);
+
+	reply = g_dbus_proxy_call_sync (priv->proxy, method, parameters,
+					G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+					error);
+	if (reply == NULL) {
+		return FALSE;
+	}
+
+	g_variant_unref (reply);
+	return TRUE;
 }
 
 static GObject *
@@ -205,7 +284,6 @@ constructor (GType                  type,
 {
 	GypsyDevice *device;
 	GypsyDevicePrivate *priv;
-	DBusGConnection *connection;
 	GError *error;
 
 	device = GYPSY_DEVICE (G_OBJECT_CLASS (gypsy_device_parent_class)->constructor 
@@ -215,33 +293,23 @@ constructor (GType                  type,
 	priv = GET_PRIVATE (device);
 
 	error = NULL;
-	connection = dbus_g_bus_get (DBUS_BUS_SYSTEM, &error);
-	if (connection == NULL) {
+	priv->proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
+						     G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+						     NULL,
+						     GYPSY_DEVICE_DBUS_SERVICE,
+						     priv->object_path,
+						     GYPSY_DEVICE_DBUS_INTERFACE,
+						     NULL, &error);
+	if (priv->proxy == NULL) {
 		g_printerr ("Failed to open connection to bus: %s\n",
 			    error->message);
 		g_error_free (error);
-		
-		priv->proxy = NULL;
 		return G_OBJECT (device);
 	}
 
-	priv->proxy = dbus_g_proxy_new_for_name (connection, 
-						 GYPSY_DEVICE_DBUS_SERVICE,
-						 priv->object_path,
-						 GYPSY_DEVICE_DBUS_INTERFACE);
-
-	dbus_g_proxy_add_signal (priv->proxy, "ConnectionStatusChanged",
-				 G_TYPE_BOOLEAN, G_TYPE_INVALID);
-	dbus_g_proxy_add_signal (priv->proxy, "FixStatusChanged",
-				 G_TYPE_INT, G_TYPE_INVALID);
-
-	dbus_g_proxy_connect_signal (priv->proxy, "ConnectionStatusChanged",
-				     G_CALLBACK (connection_changed_cb),
-				     device, NULL);
-	dbus_g_proxy_connect_signal (priv->proxy, "FixStatusChanged",
-				     G_CALLBACK (fix_status_changed_cb),
-				     device, NULL);
-				     
+	g_signal_connect (priv->proxy, "g-signal",
+			  G_CALLBACK (proxy_signal), device);
+
 	return G_OBJECT (device);
 }
 
@@ -310,7 +378,26 @@ gypsy_device_class_init (GypsyDeviceClass *klass)
 						    g_cclosure_marshal_VOID__INT,
 						    G_TYPE_NONE, 
 						    1, G_TYPE_INT);
-	
+
+	/**
+	 * GypsyDevice::fix-quality-changed:
+	 * @quality: The new fix quality
+	 *
+	 * The ::fix-quality-changed signal is emitted whenever the GPS
+	 * device reports a different fix quality, such as going from an
+	 * RTK float to an RTK fixed solution. @quality is a
+	 * #GypsyDeviceFixQuality
+	 */
+	signals[FIX_QUALITY_CHANGED] = g_signal_new ("fix-quality-changed",
+						     G_TYPE_FROM_CLASS (klass),
+						     G_SIGNAL_RUN_FIRST |
+						     G_SIGNAL_NO_RECURSE,
+						     G_STRUCT_OFFSET (GypsyDeviceClass,
+								      fix_quality_changed),
+						     NULL, NULL,
+						     g_cclosure_marshal_VOID__INT,
+						     G_TYPE_NONE,
+						     1, G_TYPE_INT);
 }
 
 static void
@@ -341,7 +428,14 @@ gypsy_device_new (const char *object_path)
  * @error: A pointer to a #GError to return the error in
  *
  * Sets options on the device before calling #gypsy_device_start.
- * The only valid option currently is "BaudRate", used for serial devices.
+ * Valid options are "BaudRate" (a uint), used for serial devices, and
+ * "PruneSentences" (a boolean), which lets the daemon turn off the NMEA
+ * sentences no subscriber needs. See gypsy_device_subscribe().
+ *
+ * "MinDistance" and "MinAltitudeChange" (doubles, in metres) and
+ * "MinTime" (a uint, in milliseconds) stop the daemon sending position
+ * updates until the position has moved that far from, and that long
+ * after, the last one. "MinAltitudeChange" defaults to "MinDistance".
  *
  * Return value: #TRUE on success, #FALSE otherwise.
  */
@@ -350,17 +444,38 @@ gypsy_device_set_start_options (GypsyDevice *device,
 				GHashTable  *options,
 				GError     **error)
 {
-	GypsyDevicePrivate *priv;
+	GVariantBuilder builder;
+	GHashTableIter iter;
+	gpointer key, value;
 
 	g_return_val_if_fail (GYPSY_IS_DEVICE (device), FALSE);
 
-	priv = GET_PRIVATE (device);
-
-	if (!org_freedesktop_Gypsy_Device_set_start_options (priv->proxy, options, error)) {
-		return FALSE;
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+	g_hash_table_iter_init (&iter, options);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		GVariant *variant;
+
+		if (G_VALUE_HOLDS_UINT (value)) {
+			variant = g_variant_new_uint32 (g_value_get_uint (value));
+		} else if (G_VALUE_HOLDS_INT (value)) {
+			variant = g_variant_new_int32 (g_value_get_int (value));
+		} else if (G_VALUE_HOLDS_DOUBLE (value)) {
+			variant = g_variant_new_double (g_value_get_double (value));
+		} else if (G_VALUE_HOLDS_BOOLEAN (value)) {
+			variant = g_variant_new_boolean (g_value_get_boolean (value));
+		} else if (G_VALUE_HOLDS_STRING (value)) {
+			variant = g_variant_new_string (g_value_get_string (value));
+		} else {
+			g_warning ("Unsupported type for option '%s'",
+				   (char *) key);
+			continue;
+		}
+
+		g_variant_builder_add (&builder, "{sv}", key, variant);
 	}
 
-	return TRUE;
+	return call_method (device, "SetStartOptions",
+			    g_variant_new ("(a{sv})", &builder), error);
 }
 
 /**
@@ -377,17 +492,9 @@ gboolean
 gypsy_device_start (GypsyDevice *device,
 		    GError     **error)
 {
-	GypsyDevicePrivate *priv;
-
 	g_return_val_if_fail (GYPSY_IS_DEVICE (device), FALSE);
 
-	priv = GET_PRIVATE (device);
-
-	if (!org_freedesktop_Gypsy_Device_start (priv->proxy, error)) {
-		return FALSE;
-	}
-
-	return TRUE;
+	return call_method (device, "Start", NULL, error);
 }
 
 /**
@@ -403,16 +510,93 @@ gboolean
 gypsy_device_stop (GypsyDevice *device,
 		   GError     **error)
 {
-	GypsyDevicePrivate *priv;
+	g_return_val_if_fail (GYPSY_IS_DEVICE (device), FALSE);
+
+	return call_method (device, "Stop", NULL, error);
+}
+
+/**
+ * gypsy_device_subscribe:
+ * @device: A #GypsyDevice
+ * @interfaces: A %NULL terminated array of D-Bus interface names
+ * @error: A pointer to a #GError to return the error in
+ *
+ * Tells gypsy-daemon which interfaces of @device this program listens to,
+ * such as #GYPSY_SATELLITE_DBUS_INTERFACE. If the "PruneSentences" start
+ * option is set, the daemon only asks the GPS device for the data its
+ * subscribers need, unless gpsd clients or raw stream readers are using
+ * it too. A program reading the fix with #GypsyShm should subscribe to
+ * the interfaces whose data it reads. Calling it again replaces the
+ * previous set.
+ *
+ * Return value: #TRUE on success, #FALSE otherwise.
+ */
+gboolean
+gypsy_device_subscribe (GypsyDevice *device,
+			const char **interfaces,
+			GError     **error)
+{
+	g_return_val_if_fail (GYPSY_IS_DEVICE (device), FALSE);
 
+	return call_method (device, "Subscribe",
+			    g_variant_new ("(^as)", interfaces), error);
+}
+
+/**
+ * gypsy_device_unsubscribe:
+ * @device: A #GypsyDevice
+ * @error: A pointer to a #GError to return the error in
+ *
+ * Removes the interfaces set with gypsy_device_subscribe().
+ *
+ * Return value: #TRUE on success, #FALSE otherwise.
+ */
+gboolean
+gypsy_device_unsubscribe (GypsyDevice *device,
+			  GError     **error)
+{
 	g_return_val_if_fail (GYPSY_IS_DEVICE (device), FALSE);
 
-	priv = GET_PRIVATE (device);
+	if (!call_method (device, "Unsubscribe", NULL, error)) {
+		return FALSE;
+	}
+
+	/* The daemon forgets the interval along with the subscription */
+	set_limited (GET_PRIVATE (device)->object_path, FALSE);
+	return TRUE;
+}
+
+/**
+ * gypsy_device_set_minimum_interval:
+ * @device: A #GypsyDevice
+ * @interval: The least time between updates in milliseconds, or 0
+ * @error: A pointer to a #GError to return the error in
+ *
+ * Asks gypsy-daemon to send this program position, course, accuracy and
+ * satellite updates from @device at most once every @interval
+ * milliseconds. Updates in between are coalesced, so the latest values
+ * always arrive. From then on the #GypsyPosition, #GypsyCourse,
+ * #GypsyAccuracy and #GypsySatellite objects for @device in this program
+ * only emit these updates, while every other program keeps receiving each
+ * change. gypsy_device_subscribe() has to be called first, and
+ * gypsy_device_unsubscribe() or an @interval of 0 goes back to every
+ * change.
+ *
+ * Return value: #TRUE on success, #FALSE otherwise.
+ */
+gboolean
+gypsy_device_set_minimum_interval (GypsyDevice *device,
+				   guint        interval,
+				   GError     **error)
+{
+	g_return_val_if_fail (GYPSY_IS_DEVICE (device), FALSE);
 
-	if (!org_freedesktop_Gypsy_Device_stop (priv->proxy, error)) {
+	if (!call_method (device, "SetMinimumInterval",
+			  g_variant_new ("(u)", interval), error)) {
 		return FALSE;
 	}
 
+	set_limited (GET_PRIVATE (device)->object_path, interval > 0);
 	return TRUE;
 }
 
@@ -430,19 +614,59 @@ gypsy_device_get_fix_status (GypsyDevice *device,
 			     GError      **error)
 {
 	GypsyDevicePrivate *priv;
+	GVariant *reply;
 	int status;
 
 	g_return_val_if_fail (GYPSY_IS_DEVICE (device), GYPSY_DEVICE_FIX_STATUS_INVALID);
 	
 	priv = GET_PRIVATE (device);
-	if (!org_freedesktop_Gypsy_Device_get_fix_status (priv->proxy, &status,
-							  error)) {
+	reply = g_dbus_proxy_call_sync (priv->proxy, "GetFixStatus", NULL,
+					G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+					error);
+	if (reply == NULL) {
 		return GYPSY_DEVICE_FIX_STATUS_INVALID;
 	}
 
+	g_variant_get (reply, "(i)", &status);
+	g_variant_unref (reply);
+
 	return (GypsyDeviceFixStatus) status;
 }
 
+/**
+ * gypsy_device_get_fix_quality:
+ * @device: A #GypsyDevice
+ * @error: A pointer to a #GError to return a error in.
+ *
+ * Obtains the quality of @device's fix, which shows whether the receiver
+ * is using DGPS or RTK corrections.
+ *
+ * Return value: A #GypsyDeviceFixQuality
+ */
+GypsyDeviceFixQuality
+gypsy_device_get_fix_quality (GypsyDevice *device,
+			      GError     **error)
+{
+	GypsyDevicePrivate *priv;
+	GVariant *reply;
+	int quality;
+
+	g_return_val_if_fail (GYPSY_IS_DEVICE (device), GYPSY_DEVICE_FIX_QUALITY_INVALID);
+
+	priv = GET_PRIVATE (device);
+	reply = g_dbus_proxy_call_sync (priv->proxy, "GetFixQuality", NULL,
+					G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+					error);
+	if (reply == NULL) {
+		return GYPSY_DEVICE_FIX_QUALITY_INVALID;
+	}
+
+	g_variant_get (reply, "(i)", &quality);
+	g_variant_unref (reply);
+
+	return (GypsyDeviceFixQuality) quality;
+}
+
 /**
  * gypsy_device_get_connection_status:
  * @device: A #GypsyDevice
@@ -457,16 +681,21 @@ gypsy_device_get_connection_status (GypsyDevice *device,
 				    GError     **error)
 {
 	GypsyDevicePrivate *priv;
+	GVariant *reply;
 	gboolean status;
 
 	g_return_val_if_fail (GYPSY_IS_DEVICE (device), FALSE);
 	
 	priv = GET_PRIVATE (device);
-	if (!org_freedesktop_Gypsy_Device_get_connection_status (priv->proxy,
-								 &status,
-								 error)) {
+	reply = g_dbus_proxy_call_sync (priv->proxy, "GetConnectionStatus", NULL,
+					G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+					error);
+	if (reply == NULL) {
 		return FALSE;
 	}
 
+	g_variant_get (reply, "(b)", &status);
+	g_variant_unref (reply);
+
 	return status;
 }
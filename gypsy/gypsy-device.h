@@ -64,6 +64,33 @@ typedef enum {
 	GYPSY_DEVICE_FIX_STATUS_3D
 } GypsyDeviceFixStatus;
 
+/**
+ * GypsyDeviceFixQuality:
+ * @GYPSY_DEVICE_FIX_QUALITY_INVALID: There is no fix
+ * @GYPSY_DEVICE_FIX_QUALITY_GPS: A fix from the satellites alone
+ * @GYPSY_DEVICE_FIX_QUALITY_DGPS: A fix using differential corrections
+ * @GYPSY_DEVICE_FIX_QUALITY_PPS: A fix using the precise code
+ * @GYPSY_DEVICE_FIX_QUALITY_RTK_FIXED: An RTK fix with the ambiguities resolved
+ * @GYPSY_DEVICE_FIX_QUALITY_RTK_FLOAT: An RTK fix with the ambiguities not yet resolved
+ * @GYPSY_DEVICE_FIX_QUALITY_ESTIMATED: A dead reckoning estimate
+ * @GYPSY_DEVICE_FIX_QUALITY_MANUAL: A position entered by hand
+ * @GYPSY_DEVICE_FIX_QUALITY_SIMULATION: A simulated fix
+ *
+ * An enumeration of the fix qualities an NMEA receiver reports, which show
+ * whether it is using corrections.
+ */
+typedef enum {
+	GYPSY_DEVICE_FIX_QUALITY_INVALID = 0,
+	GYPSY_DEVICE_FIX_QUALITY_GPS,
+	GYPSY_DEVICE_FIX_QUALITY_DGPS,
+	GYPSY_DEVICE_FIX_QUALITY_PPS,
+	GYPSY_DEVICE_FIX_QUALITY_RTK_FIXED,
+	GYPSY_DEVICE_FIX_QUALITY_RTK_FLOAT,
+	GYPSY_DEVICE_FIX_QUALITY_ESTIMATED,
+	GYPSY_DEVICE_FIX_QUALITY_MANUAL,
+	GYPSY_DEVICE_FIX_QUALITY_SIMULATION
+} GypsyDeviceFixQuality;
+
 /**
  * GypsyDevice:
  *
@@ -80,6 +107,8 @@ typedef struct _GypsyDeviceClass {
 				    gboolean     connected);
 	void (*fix_status_changed) (GypsyDevice         *device,
 				    GypsyDeviceFixStatus status);
+	void (*fix_quality_changed) (GypsyDevice          *device,
+				     GypsyDeviceFixQuality quality);
 } GypsyDeviceClass;
 
 GType gypsy_device_get_type (void);
@@ -93,9 +122,19 @@ gboolean gypsy_device_start (GypsyDevice *device,
 			    GError     **error);
 gboolean gypsy_device_stop (GypsyDevice *device,
 			    GError     **error);
+gboolean gypsy_device_subscribe (GypsyDevice *device,
+				 const char **interfaces,
+				 GError     **error);
+gboolean gypsy_device_unsubscribe (GypsyDevice *device,
+				   GError     **error);
+gboolean gypsy_device_set_minimum_interval (GypsyDevice *device,
+					    guint        interval,
+					    GError     **error);
 
 GypsyDeviceFixStatus gypsy_device_get_fix_status (GypsyDevice *device,
 						  GError      **error);
+GypsyDeviceFixQuality gypsy_device_get_fix_quality (GypsyDevice *device,
+						    GError     **error);
 gboolean gypsy_device_get_connection_status (GypsyDevice *device,
 					     GError     **error);
 
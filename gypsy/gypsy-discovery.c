@@ -23,8 +23,9 @@
  * 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 
+#include <gio/gio.h>
+
 #include "gypsy-discovery.h"
-#include "gypsy-discovery-bindings.h"
 #include "gypsy-marshal.h"
 
 enum {
@@ -38,13 +39,19 @@ enum {
 };
 
 struct _GypsyDiscoveryPrivate {
-	DBusGProxy *proxy;
+	GDBusProxy *proxy;
 };
 
 #define GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), GYPSY_TYPE_DISCOVERY, GypsyDiscoveryPrivate))
 G_DEFINE_TYPE (GypsyDiscovery, gypsy_discovery, G_TYPE_OBJECT);
 static guint32 signals[LAST_SIGNAL] = {0,};
 
+static void proxy_signal (GDBusProxy     *proxy,
+			  const char     *sender_name,
+			  const char     *signal_name,
+			  GVariant       *parameters,
+			  GypsyDiscovery *discovery);
+
 static void
 gypsy_discovery_finalize (GObject *object)
 {
@@ -62,6 +69,10 @@ gypsy_discovery_dispose (GObject *object)
 	GypsyDiscoveryPrivate *priv = self->priv;
 
 	if (priv->proxy) {
+		g_signal_handlers_disconnect_by_func (priv->proxy,
+						      proxy_signal,
+						      object);
+
 		g_object_unref (priv->proxy);
 		priv->proxy = NULL;
 	}
@@ -135,56 +146,48 @@ gypsy_discovery_class_init (GypsyDiscoveryClass *klass)
 }
 
 static void
-device_added_cb (DBusGProxy     *proxy,
-                 const char     *added,
-		 const char     *type,
-                 GypsyDiscovery *discovery)
-{
-	g_signal_emit (discovery, signals[DEVICE_ADDED], 0, added, type);
-}
-
-static void
-device_removed_cb (DBusGProxy     *proxy,
-                   const char     *removed,
-		   const char     *type,
-                   GypsyDiscovery *discovery)
+proxy_signal (GDBusProxy     *proxy,
+	      const char     *sender_name,
+	      const char     *signal_name,
+	      GVariant       *parameters,
+	      GypsyDiscovery *discovery)
 {
-	g_signal_emit (discovery, signals[DEVICE_REMOVED], 0, removed, type);
+	const char *device, *type;
+
+	if (g_str_equal (signal_name, "DeviceAdded")) {
+		g_variant_get (parameters, "(&s&s)", &device, &type);
+		g_signal_emit (discovery, signals[DEVICE_ADDED], 0,
+			       device, type);
+	} else if (g_str_equal (signal_name, "DeviceRemoved")) {
+		g_variant_get (parameters, "(&s&s)", &device, &type);
+		g_signal_emit (discovery, signals[DEVICE_REMOVED], 0,
+			       device, type);
+	}
 }
 
 static void
 gypsy_discovery_init (GypsyDiscovery *self)
 {
 	GypsyDiscoveryPrivate *priv = GET_PRIVATE (self);
-	DBusGConnection *connection;
 	GError *error = NULL;
 
 	self->priv = priv;
 
-	connection = dbus_g_bus_get (DBUS_BUS_SYSTEM, &error);
-	if (connection == NULL) {
+	priv->proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
+						     G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+						     NULL,
+						     GYPSY_DISCOVERY_DBUS_SERVICE,
+						     GYPSY_DISCOVERY_DBUS_PATH,
+						     GYPSY_DISCOVERY_DBUS_INTERFACE,
+						     NULL, &error);
+	if (priv->proxy == NULL) {
 		g_warning ("Error getting bus: %s", error->message);
+		g_error_free (error);
 		return;
 	}
 
-	/* We register all the other marshallers in gypsy_control_init,
-	   but GypsyDiscovery can be created before GypsyControl */
-	dbus_g_object_register_marshaller (gypsy_marshal_VOID__STRING_STRING,
-					   G_TYPE_NONE, G_TYPE_STRING,
-					   G_TYPE_STRING, G_TYPE_INVALID);
-	priv->proxy = dbus_g_proxy_new_for_name (connection,
-						 GYPSY_DISCOVERY_DBUS_SERVICE,
-						 GYPSY_DISCOVERY_DBUS_PATH,
-						 GYPSY_DISCOVERY_DBUS_INTERFACE);
-	dbus_g_proxy_add_signal (priv->proxy, "DeviceAdded",
-				 G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INVALID);
-	dbus_g_proxy_add_signal (priv->proxy, "DeviceRemoved",
-				 G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INVALID);
-	dbus_g_proxy_connect_signal (priv->proxy, "DeviceAdded",
-				     G_CALLBACK (device_added_cb), self, NULL);
-	dbus_g_proxy_connect_signal (priv->proxy, "DeviceRemoved",
-				     G_CALLBACK (device_removed_cb),
-				     self, NULL);
+	g_signal_connect (priv->proxy, "g-signal",
+			  G_CALLBACK (proxy_signal), self);
 }
 
 GypsyDiscovery *
@@ -209,7 +212,7 @@ gypsy_discovery_list_devices (GypsyDiscovery *discovery,
                               GError        **error)
 {
 	GypsyDiscoveryPrivate *priv;
-	gboolean result;
+	GVariant *reply;
 	char **devices;
 	char **types;
 	GPtrArray *known_devices;
@@ -218,14 +221,16 @@ gypsy_discovery_list_devices (GypsyDiscovery *discovery,
 	g_return_val_if_fail (GYPSY_IS_DISCOVERY (discovery), NULL);
 	priv = discovery->priv;
 
-	result = org_freedesktop_Gypsy_Discovery_list_devices (priv->proxy,
-							       &devices,
-							       &types,
-							       error);
-	if (!result) {
+	reply = g_dbus_proxy_call_sync (priv->proxy, "ListDevices", NULL,
+					G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+					error);
+	if (reply == NULL) {
 		return NULL;
 	}
 
+	g_variant_get (reply, "(^as^as)", &devices, &types);
+	g_variant_unref (reply);
+
 	known_devices = g_ptr_array_new_with_free_func
 		((GDestroyNotify) gypsy_discovery_device_info_free);
 	for (i = 0; devices[i]; i++) {
@@ -252,14 +257,20 @@ gypsy_discovery_start_scanning (GypsyDiscovery *discovery,
                                 GError        **error)
 {
 	GypsyDiscoveryPrivate *priv;
-	gboolean result;
+	GVariant *reply;
 
 	g_return_val_if_fail (GYPSY_IS_DISCOVERY (discovery), FALSE);
 	priv = discovery->priv;
 
-	result = org_freedesktop_Gypsy_Discovery_start_scanning (priv->proxy,
-								 error);
-	return result;
+	reply = g_dbus_proxy_call_sync (priv->proxy, "StartScanning", NULL,
+					G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+					error);
+	if (reply == NULL) {
+		return FALSE;
+	}
+
+	g_variant_unref (reply);
+	return TRUE;
 }
 
 gboolean
@@ -267,14 +278,20 @@ gypsy_discovery_stop_scanning (GypsyDiscovery *discovery,
                                GError        **error)
 {
 	GypsyDiscoveryPrivate *priv;
-	gboolean result;
+	GVariant *reply;
 
 	g_return_val_if_fail (GYPSY_IS_DISCOVERY (discovery), FALSE);
 	priv = discovery->priv;
 
-	result = org_freedesktop_Gypsy_Discovery_stop_scanning (priv->proxy,
-								error);
-	return result;
+	reply = g_dbus_proxy_call_sync (priv->proxy, "StopScanning", NULL,
+					G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+					error);
+	if (reply == NULL) {
+		return FALSE;
+	}
+
+	g_variant_unref (reply);
+	return TRUE;
 }
 
 GypsyDiscoveryDeviceInfo *
@@ -71,14 +71,14 @@
  */
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
 #include <gypsy/gypsy-marshal.h>
+#include <gypsy/gypsy-device-private.h>
 #include <gypsy/gypsy-position.h>
 
-#include "gypsy-client-bindings.h"
-
 typedef struct _GypsyPositionPrivate {
-	DBusGProxy *proxy;
+	GDBusProxy *proxy;
 	char *object_path;
 } GypsyPositionPrivate;
 
@@ -96,13 +96,11 @@ enum {
 
 G_DEFINE_TYPE (GypsyPosition, gypsy_position, G_TYPE_OBJECT);
 
-static void position_changed (DBusGProxy    *proxy,
-			      int            fields,
-			      int            timestamp,
-			      double         latitude,
-			      double         longitude,
-			      double         altitude,
-			      GypsyPosition *position);
+static void proxy_signal (GDBusProxy    *proxy,
+			  const char    *sender_name,
+			  const char    *signal_name,
+			  GVariant      *parameters,
+			  GypsyPosition *position);
 
 static guint32 signals[LAST_SIGNAL] = {0, };
 static void
@@ -127,9 +125,9 @@ dispose (GObject *object)
 	priv = GET_PRIVATE (object);
 
 	if (priv->proxy) {
-		dbus_g_proxy_disconnect_signal (priv->proxy, "PositionChanged",
-						G_CALLBACK (position_changed),
-						object);
+		g_signal_handlers_disconnect_by_func (priv->proxy,
+						      proxy_signal,
+						      object);
 		g_object_unref (priv->proxy);
 		priv->proxy = NULL;
 	}
@@ -177,38 +175,47 @@ get_property (GObject    *object,
 }
 
 static void
-position_changed (DBusGProxy    *proxy,
-		  int            fields,
-		  int            timestamp,
-		  double         latitude,
-		  double         longitude,
-		  double         altitude,
-		  GypsyPosition *position)
+proxy_signal (GDBusProxy    *proxy,
+	      const char    *sender_name,
+	      const char    *signal_name,
+	      GVariant      *parameters,
+	      GypsyPosition *position)
 {
+	int fields, timestamp;
+	double latitude, longitude, altitude;
+
+	if (!gypsy_device_accepts_signal (proxy, sender_name, signal_name,
+					  "PositionChanged")) {
+		return;
+	}
+
+	g_variant_get (parameters, "(iiddd)", &fields, &timestamp,
+		       &latitude, &longitude, &altitude);
 	g_signal_emit (position, signals[POSITION_CHANGED], 0,
 		       fields, timestamp, latitude, longitude, altitude);
 }
 
 static void
-get_position_cb (DBusGProxy *proxy,
-		 int         fields, 
-		 int         timestamp,
-		 double      latitude,
-		 double      longitude,
-		 double      altitude,
-		 GError     *error, 
-		 gpointer    userdata)
+get_position_cb (GObject      *source,
+		 GAsyncResult *result,
+		 gpointer      userdata)
 {
 	GypsyPosition *position = userdata;
+	GError *error = NULL;
+	GVariant *reply;
 
-	if (error) {
+	reply = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), result,
+					  &error);
+	if (reply == NULL) {
 		g_warning ("Cannot get position: %s", error->message);
 		g_error_free (error);
-		return;
+	} else {
+		proxy_signal (G_DBUS_PROXY (source), NULL,
+			      "PositionChanged", reply, position);
+		g_variant_unref (reply);
 	}
 
-	position_changed (proxy, fields, timestamp, 
-			  latitude, longitude, altitude, position);
+	g_object_unref (position);
 }
 
 static GObject *
@@ -218,7 +225,6 @@ constructor (GType                  type,
 {
 	GypsyPosition *position;
 	GypsyPositionPrivate *priv;
-	DBusGConnection *connection;
 	GError *error;
 
 	position = GYPSY_POSITION (G_OBJECT_CLASS (gypsy_position_parent_class)->constructor 
@@ -228,31 +234,27 @@ constructor (GType                  type,
 	priv = GET_PRIVATE (position);
 
 	error = NULL;
-	connection = dbus_g_bus_get (DBUS_BUS_SYSTEM, &error);
-	if (connection == NULL) {
+	priv->proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
+						     G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+						     NULL,
+						     GYPSY_POSITION_DBUS_SERVICE,
+						     priv->object_path,
+						     GYPSY_POSITION_DBUS_INTERFACE,
+						     NULL, &error);
+	if (priv->proxy == NULL) {
 		g_printerr ("Failed to open connection to bus: %s\n",
 			    error->message);
 		g_error_free (error);
-		
-		priv->proxy = NULL;
 		return G_OBJECT (position);
 	}
 
-	priv->proxy = dbus_g_proxy_new_for_name (connection, 
-						 GYPSY_POSITION_DBUS_SERVICE,
-						 priv->object_path,
-						 GYPSY_POSITION_DBUS_INTERFACE);
+	g_signal_connect (priv->proxy, "g-signal",
+			  G_CALLBACK (proxy_signal), position);
 
-	dbus_g_proxy_add_signal (priv->proxy, "PositionChanged",
-				 G_TYPE_INT, G_TYPE_INT, G_TYPE_DOUBLE,
-				 G_TYPE_DOUBLE, G_TYPE_DOUBLE, G_TYPE_INVALID);
-	dbus_g_proxy_connect_signal (priv->proxy, "PositionChanged",
-				     G_CALLBACK (position_changed),
-				     position, NULL);
+	g_dbus_proxy_call (priv->proxy, "GetPosition", NULL,
+			   G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+			   get_position_cb, g_object_ref (position));
 
-	org_freedesktop_Gypsy_Position_get_position_async
-		(priv->proxy, get_position_cb, position);
-	
 	return G_OBJECT (position);
 }
 
@@ -358,19 +360,93 @@ gypsy_position_get_position (GypsyPosition *position,
 			     GError       **error)
 {
 	GypsyPositionPrivate *priv;
+	GVariant *reply;
 	double la, lo, al;
 	int ts, fields;
 	
 	g_return_val_if_fail (GYPSY_IS_POSITION (position), GYPSY_POSITION_FIELDS_NONE);
 
 	priv = GET_PRIVATE (position);
-	if (!org_freedesktop_Gypsy_Position_get_position (priv->proxy,
-							  &fields, &ts,
-							  &la, &lo, &al,
-							  error)) {
+	reply = g_dbus_proxy_call_sync (priv->proxy, "GetPosition", NULL,
+					G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+					error);
+	if (reply == NULL) {
+		return GYPSY_POSITION_FIELDS_NONE;
+	}
+
+	g_variant_get (reply, "(iiddd)", &fields, &ts,
+		       &la, &lo, &al);
+	g_variant_unref (reply);
+
+	if (timestamp != NULL) {
+		*timestamp = ts;
+	}
+
+	if (latitude != NULL && (fields & GYPSY_POSITION_FIELDS_LATITUDE)) {
+		*latitude = la;
+	}
+
+	if (longitude != NULL && (fields & GYPSY_POSITION_FIELDS_LONGITUDE)) {
+		*longitude = lo;
+	}
+
+	if (altitude != NULL && (fields & GYPSY_POSITION_FIELDS_ALTITUDE)) {
+		*altitude = al;
+	}
+
+	return fields;
+}
+
+/**
+ * gypsy_position_get_position_at:
+ * @position: A #GypsyPosition
+ * @monotonic_time: The time wanted, from g_get_monotonic_time(), or 0 for now
+ * @timestamp: Pointer to store the timestamp
+ * @latitude: Pointer to store the latitude
+ * @longitude: Pointer to store the longitude
+ * @altitude: Pointer to store the altitude
+ * @error: Pointer to store a #GError
+ *
+ * Obtains the position at @monotonic_time. Between the last two fixes the
+ * position is interpolated, and after the last fix it is carried on at the
+ * speed, direction and climb the GPS last reported, for up to 5 seconds.
+ * Without a fix from the GPS since it started, this is the same as
+ * gypsy_position_get_position(). A position that was interpolated or carried
+ * on has #GYPSY_POSITION_FIELDS_PREDICTED set in the returned fields.
+ * @timestamp, @latitude, @longitude and @altitude can be #NULL if the result
+ * is not required.
+ *
+ * Return value: Bitmask of #GypsyPositionFields indicating what field was set
+ */
+GypsyPositionFields
+gypsy_position_get_position_at (GypsyPosition *position,
+				gint64         monotonic_time,
+				int           *timestamp,
+				double        *latitude,
+				double        *longitude,
+				double        *altitude,
+				GError       **error)
+{
+	GypsyPositionPrivate *priv;
+	GVariant *reply;
+	double la, lo, al;
+	int ts, fields;
+
+	g_return_val_if_fail (GYPSY_IS_POSITION (position), GYPSY_POSITION_FIELDS_NONE);
+
+	priv = GET_PRIVATE (position);
+	reply = g_dbus_proxy_call_sync (priv->proxy, "GetPositionAt",
+					g_variant_new ("(x)", monotonic_time),
+					G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+					error);
+	if (reply == NULL) {
 		return GYPSY_POSITION_FIELDS_NONE;
 	}
 
+	g_variant_get (reply, "(iiddd)", &fields, &ts,
+		       &la, &lo, &al);
+	g_variant_unref (reply);
+
 	if (timestamp != NULL) {
 		*timestamp = ts;
 	}
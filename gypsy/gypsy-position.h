@@ -54,6 +54,9 @@ G_BEGIN_DECLS
  * @GYPSY_POSITION_FIELDS_LATITUDE: The latitude field is valid
  * @GYPSY_POSITION_FIELDS_LONGITUDE: The longitude field is valid
  * @GYPSY_POSITION_FIELDS_ALTITUDE: The altitude field is valid
+ * @GYPSY_POSITION_FIELDS_PREDICTED: The position was interpolated or
+ * extrapolated from the GPS's fixes rather than reported by it. Only
+ * gypsy_position_get_position_at() sets this
  *
  * A bitmask telling which fields in the position_changed callback are valid
  */
@@ -61,7 +64,8 @@ typedef enum {
 	GYPSY_POSITION_FIELDS_NONE = 0,
 	GYPSY_POSITION_FIELDS_LATITUDE = 1 << 0,
 	GYPSY_POSITION_FIELDS_LONGITUDE = 1 << 1,
-	GYPSY_POSITION_FIELDS_ALTITUDE = 1 << 2
+	GYPSY_POSITION_FIELDS_ALTITUDE = 1 << 2,
+	GYPSY_POSITION_FIELDS_PREDICTED = 1 << 3
 } GypsyPositionFields;
 
 /**
@@ -94,6 +98,13 @@ GypsyPositionFields gypsy_position_get_position (GypsyPosition *position,
 						 double        *longitude,
 						 double        *altitude,
 						 GError       **error);
+GypsyPositionFields gypsy_position_get_position_at (GypsyPosition *position,
+						    gint64         monotonic_time,
+						    int           *timestamp,
+						    double        *latitude,
+						    double        *longitude,
+						    double        *altitude,
+						    GError       **error);
 
 G_END_DECLS
 
@@ -77,19 +77,15 @@
  * </informalexample>
  */
 
-/* DBus-glib uses GValueArrays which are deprecated, so we need to
- * disable the warnings so that -Werror doesn't cry */
-#define GLIB_DISABLE_DEPRECATION_WARNINGS 1
-
 #include <glib-object.h>
+#include <gio/gio.h>
 
+#include <gypsy/gypsy-device-private.h>
 #include <gypsy/gypsy-satellite.h>
 #include <gypsy/gypsy-marshal.h>
 
-#include "gypsy-client-bindings.h"
-
 typedef struct _GypsySatellitePrivate {
-	DBusGProxy *proxy;
+	GDBusProxy *proxy;
 	char *object_path;
 } GypsySatellitePrivate;
 
@@ -105,13 +101,13 @@ enum {
 
 #define GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), GYPSY_TYPE_SATELLITE, GypsySatellitePrivate))
 
-#define GYPSY_SATELLITE_SATELLITES_CHANGED_TYPE (dbus_g_type_get_struct ("GValueArray", G_TYPE_UINT, G_TYPE_BOOLEAN, G_TYPE_UINT, G_TYPE_UINT, G_TYPE_UINT, G_TYPE_INVALID))
-
 G_DEFINE_TYPE (GypsySatellite, gypsy_satellite, G_TYPE_OBJECT);
 
-static void satellites_changed (DBusGProxy     *proxy,
-				GPtrArray      *sats,
-				GypsySatellite *satellite);
+static void proxy_signal (GDBusProxy     *proxy,
+			  const char     *sender_name,
+			  const char     *signal_name,
+			  GVariant       *parameters,
+			  GypsySatellite *satellite);
 
 static guint32 signals[LAST_SIGNAL] = {0, };
 static void
@@ -136,9 +132,9 @@ dispose (GObject *object)
 	priv = GET_PRIVATE (object);
 
 	if (priv->proxy) {
-		dbus_g_proxy_disconnect_signal (priv->proxy, "SatellitesChanged",
-						G_CALLBACK (satellites_changed),
-						object);
+		g_signal_handlers_disconnect_by_func (priv->proxy,
+						      proxy_signal,
+						      object);
 		g_object_unref (priv->proxy);
 		priv->proxy = NULL;
 	}
@@ -185,25 +181,29 @@ get_property (GObject    *object,
 	}
 }
 
+/* sats is an a(ubuuu) */
 static GPtrArray *
-make_satellite_array (GPtrArray *sats)
+make_satellite_array (GVariant *sats)
 {
 	GPtrArray *satellites;
-	int i;
-	
-	satellites = g_ptr_array_sized_new (sats->len);
-	
-	for (i = 0; i < sats->len; i++) {
+	GVariantIter iter;
+	guint32 satellite_id, elevation, azimuth, snr;
+	gboolean in_use;
+
+	satellites = g_ptr_array_sized_new (g_variant_n_children (sats));
+
+	g_variant_iter_init (&iter, sats);
+	while (g_variant_iter_next (&iter, "(ubuuu)", &satellite_id, &in_use,
+				    &elevation, &azimuth, &snr)) {
 		GypsySatelliteDetails *details;
-		GValueArray *vals = sats->pdata[i];
 
 		details = g_slice_new (GypsySatelliteDetails);
 
-		details->satellite_id = g_value_get_uint (g_value_array_get_nth (vals, 0));
-		details->in_use = g_value_get_boolean (g_value_array_get_nth (vals, 1));
-		details->elevation = g_value_get_uint (g_value_array_get_nth (vals, 2));
-		details->azimuth = g_value_get_uint (g_value_array_get_nth (vals, 3));
-		details->snr = g_value_get_uint (g_value_array_get_nth (vals, 4));
+		details->satellite_id = satellite_id;
+		details->in_use = in_use;
+		details->elevation = elevation;
+		details->azimuth = azimuth;
+		details->snr = snr;
 
 		g_ptr_array_add (satellites, details);
 	}
@@ -212,13 +212,23 @@ make_satellite_array (GPtrArray *sats)
 }
 
 static void
-satellites_changed (DBusGProxy     *proxy,
-		    GPtrArray      *sats,
-		    GypsySatellite *satellite)
+proxy_signal (GDBusProxy     *proxy,
+	      const char     *sender_name,
+	      const char     *signal_name,
+	      GVariant       *parameters,
+	      GypsySatellite *satellite)
 {
 	GPtrArray *satellites;
+	GVariant *sats;
+
+	if (!gypsy_device_accepts_signal (proxy, sender_name, signal_name,
+					  "SatellitesChanged")) {
+		return;
+	}
 
+	sats = g_variant_get_child_value (parameters, 0);
 	satellites = make_satellite_array (sats);
+	g_variant_unref (sats);
 
 	g_signal_emit (satellite, signals[SATELLITES_CHANGED], 0, satellites);
 	gypsy_satellite_free_satellite_array (satellites);
@@ -231,7 +241,6 @@ constructor (GType                  type,
 {
 	GypsySatellite *satellite;
 	GypsySatellitePrivate *priv;
-	DBusGConnection *connection;
 	GError *error;
 
 	satellite = GYPSY_SATELLITE (G_OBJECT_CLASS (gypsy_satellite_parent_class)->constructor 
@@ -241,26 +250,21 @@ constructor (GType                  type,
 	priv = GET_PRIVATE (satellite);
 
 	error = NULL;
-	connection = dbus_g_bus_get (DBUS_BUS_SYSTEM, &error);
-	if (connection == NULL) {
+	priv->proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
+						     G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+						     NULL,
+						     GYPSY_SATELLITE_DBUS_SERVICE,
+						     priv->object_path,
+						     GYPSY_SATELLITE_DBUS_INTERFACE,
+						     NULL, &error);
+	if (priv->proxy == NULL) {
 		g_printerr ("Failed to open connection to bus: %s\n",
 			    error->message);
 		g_error_free (error);
-		
-		priv->proxy = NULL;
 		return G_OBJECT (satellite);
 	}
-
-	priv->proxy = dbus_g_proxy_new_for_name (connection, 
-						 GYPSY_SATELLITE_DBUS_SERVICE,
-						 priv->object_path,
-						 GYPSY_SATELLITE_DBUS_INTERFACE);
-	dbus_g_proxy_add_signal (priv->proxy, "SatellitesChanged",
-				 dbus_g_type_get_collection ("GPtrArray", GYPSY_SATELLITE_SATELLITES_CHANGED_TYPE),
-				 G_TYPE_INVALID);
-	dbus_g_proxy_connect_signal (priv->proxy, "SatellitesChanged",
-				     G_CALLBACK (satellites_changed),
-				     satellite, NULL);
+	g_signal_connect (priv->proxy, "g-signal",
+			  G_CALLBACK (proxy_signal), satellite);
 
 	return G_OBJECT (satellite);
 }
@@ -349,18 +353,24 @@ gypsy_satellite_get_satellites (GypsySatellite *satellite,
 				GError        **error)
 {
 	GypsySatellitePrivate *priv;
-	GPtrArray *satellites, *sats;
+	GPtrArray *satellites;
+	GVariant *reply, *sats;
 
 	g_return_val_if_fail (GYPSY_IS_SATELLITE (satellite), NULL);
 
 	priv = GET_PRIVATE (satellite);
 
-	if (!org_freedesktop_Gypsy_Satellite_get_satellites (priv->proxy,
-							     &sats, error)) {
+	reply = g_dbus_proxy_call_sync (priv->proxy, "GetSatellites", NULL,
+					G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+					error);
+	if (reply == NULL) {
 		return NULL;
 	}
 
+	sats = g_variant_get_child_value (reply, 0);
 	satellites = make_satellite_array (sats);
+	g_variant_unref (sats);
+	g_variant_unref (reply);
 
 	return satellites;
 }
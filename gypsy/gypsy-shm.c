@@ -0,0 +1,238 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * SECTION:gypsy-shm
+ * @short_description: Reading the latest fix without going through D-Bus
+ *
+ * Every call to gypsy_position_get_position() and friends is a round trip
+ * through the bus daemon, which is too slow for programs that want the
+ * position many times a second. gypsy-daemon also publishes everything it
+ * knows about each device in shared memory, and #GypsyShm reads it from
+ * there without any system calls.
+ *
+ * A #GypsyShm is opened with gypsy_shm_open() using the D-Bus path of the
+ * GPS device, once the device has been started with gypsy_device_start().
+ * gypsy_shm_read() then copies out a consistent #GypsyShmFix. The
+ * generation it returns changes with every update, so a program polling
+ * the fix can tell when there is something new. Once the device is shut
+ * down, or gypsy-daemon exits, gypsy_shm_read() returns #FALSE for good,
+ * and the #GypsyShm has to be closed and opened again after the device is
+ * next started.
+ *
+ * <informalexample>
+ * <programlisting>
+ * GypsyShm *shm;
+ * GypsyShmFix fix;
+ * guint generation, last = 0;
+ * GError *error = NULL;
+ *
+ * . . .
+ *
+ * /<!-- -->* path comes from the gypsy_control_create() function *<!-- -->/
+ * shm = gypsy_shm_open (path, &amp;error);
+ *
+ * . . .
+ *
+ * if (gypsy_shm_read (shm, &amp;fix, &amp;generation) &amp;&amp; generation != last) {
+ * &nbsp;&nbsp;last = generation;
+ * &nbsp;&nbsp;g_print ("%f, %f\n", fix.latitude, fix.longitude);
+ * }
+ * </programlisting>
+ * </informalexample>
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include <gypsy/gypsy-shm.h>
+
+/* How often to retry while gypsy-daemon is writing. An update
+   takes well under a microsecond, so running out means it died
+   half way through one. */
+#define READ_RETRIES 10000
+
+struct _GypsyShm {
+	const GypsyShmSegment *segment;
+};
+
+/**
+ * gypsy_shm_open:
+ * @object_path: The D-Bus path of the GPS device
+ * @error: Pointer to store a #GError
+ *
+ * Maps the shared memory that gypsy-daemon publishes the fix of the device
+ * at @object_path in. The device has to have been started.
+ *
+ * Return value: A #GypsyShm, or #NULL if there was an error
+ */
+GypsyShm *
+gypsy_shm_open (const char *object_path,
+		GError    **error)
+{
+	GypsyShm *shm;
+	const char *device_name;
+	char *name;
+	struct stat st;
+	void *segment;
+	int fd;
+
+	g_return_val_if_fail (object_path != NULL, NULL);
+
+	device_name = strrchr (object_path, '/');
+	device_name = device_name ? device_name + 1 : object_path;
+
+	name = g_strconcat (GYPSY_SHM_PREFIX, device_name, NULL);
+	fd = shm_open (name, O_RDONLY, 0);
+	if (fd == -1) {
+		g_set_error (error, G_FILE_ERROR,
+			     g_file_error_from_errno (errno),
+			     "Error opening %s: %s", name,
+			     g_strerror (errno));
+		g_free (name);
+		return NULL;
+	}
+
+	if (fstat (fd, &st) == -1 ||
+	    st.st_size < (off_t) sizeof (GypsyShmSegment)) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+			     "%s is too small", name);
+		close (fd);
+		g_free (name);
+		return NULL;
+	}
+
+	segment = mmap (NULL, sizeof (GypsyShmSegment), PROT_READ,
+			MAP_SHARED, fd, 0);
+	close (fd);
+
+	if (segment == MAP_FAILED) {
+		g_set_error (error, G_FILE_ERROR,
+			     g_file_error_from_errno (errno),
+			     "Error mapping %s: %s", name,
+			     g_strerror (errno));
+		g_free (name);
+		return NULL;
+	}
+
+	if (((GypsyShmSegment *) segment)->magic != GYPSY_SHM_MAGIC ||
+	    ((GypsyShmSegment *) segment)->version != GYPSY_SHM_VERSION) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+			     "%s is not a version %d Gypsy segment", name,
+			     GYPSY_SHM_VERSION);
+		munmap (segment, sizeof (GypsyShmSegment));
+		g_free (name);
+		return NULL;
+	}
+	g_free (name);
+
+	shm = g_slice_new (GypsyShm);
+	shm->segment = segment;
+
+	return shm;
+}
+
+/**
+ * gypsy_shm_read:
+ * @shm: A #GypsyShm
+ * @fix: Pointer to store the #GypsyShmFix
+ * @generation: Pointer to store a number that changes with every update,
+ * or #NULL
+ *
+ * Copies the latest fix into @fix. This doesn't make any system calls,
+ * so it can be called as often as needed.
+ *
+ * Return value: #TRUE if @fix was set, #FALSE if gypsy-daemon hasn't
+ * published anything, has stopped publishing this segment, or stopped
+ * half way through an update
+ */
+gboolean
+gypsy_shm_read (GypsyShm    *shm,
+		GypsyShmFix *fix,
+		guint       *generation)
+{
+	const GypsyShmSegment *segment;
+	int retries;
+
+	g_return_val_if_fail (shm != NULL, FALSE);
+	g_return_val_if_fail (fix != NULL, FALSE);
+
+	segment = shm->segment;
+
+	for (retries = 0; retries < READ_RETRIES; retries++) {
+		gint before, after;
+
+		/* The last fix of a closed segment is no longer the latest */
+		if (g_atomic_int_get (&segment->closed)) {
+			return FALSE;
+		}
+
+		before = g_atomic_int_get (&segment->sequence);
+		if (before == 0) {
+			return FALSE;
+		}
+
+		if (before & 1) {
+			continue;
+		}
+
+		memcpy (fix, &segment->fix, sizeof (GypsyShmFix));
+
+		/* The copy has to be finished before checking
+		   nothing changed during it */
+		__sync_synchronize ();
+		after = g_atomic_int_get (&segment->sequence);
+
+		if (before == after) {
+			if (generation) {
+				*generation = (guint) before / 2;
+			}
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/**
+ * gypsy_shm_close:
+ * @shm: A #GypsyShm
+ *
+ * Unmaps @shm and frees it.
+ */
+void
+gypsy_shm_close (GypsyShm *shm)
+{
+	g_return_if_fail (shm != NULL);
+
+	munmap ((void *) shm->segment, sizeof (GypsyShmSegment));
+	g_slice_free (GypsyShm, shm);
+}
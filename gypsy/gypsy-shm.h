@@ -0,0 +1,147 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GYPSY_SHM_H__
+#define __GYPSY_SHM_H__
+
+#include <glib.h>
+
+#include <gypsy/gypsy-accuracy.h>
+#include <gypsy/gypsy-course.h>
+#include <gypsy/gypsy-device.h>
+#include <gypsy/gypsy-position.h>
+
+G_BEGIN_DECLS
+
+/**
+ * GYPSY_SHM_PREFIX:
+ *
+ * The shared memory segment of a device is named with this followed by
+ * the last element of the device's object path
+ */
+#define GYPSY_SHM_PREFIX "/gypsy-"
+
+#define GYPSY_SHM_MAGIC 0x47505359 /* "GPSY" */
+#define GYPSY_SHM_VERSION 2
+
+/**
+ * GYPSY_SHM_MAX_SATELLITES:
+ *
+ * The most satellites a #GypsyShmFix can hold
+ */
+#define GYPSY_SHM_MAX_SATELLITES 32
+
+/**
+ * GypsyShmSatellite:
+ * @satellite_id: The satellite's PRN
+ * @in_use: Whether the satellite is used in the fix
+ * @elevation: The elevation in degrees
+ * @azimuth: The azimuth in degrees
+ * @snr: The signal to noise ratio in dB
+ *
+ * A satellite in a #GypsyShmFix.
+ */
+typedef struct _GypsyShmSatellite {
+	int satellite_id;
+	gboolean in_use;
+	int elevation;
+	int azimuth;
+	int snr;
+} GypsyShmSatellite;
+
+/**
+ * GypsyShmFix:
+ * @timestamp: The time of the last update, in seconds since the epoch
+ * @fix_status: The #GypsyDeviceFixStatus
+ * @position_fields: Which of @latitude, @longitude and @altitude are valid
+ * @course_fields: Which of @speed, @direction and @climb are valid
+ * @accuracy_fields: Which of @pdop, @hdop and @vdop are valid
+ * @satellite_count: How many of @satellites are set
+ * @latitude: The latitude in degrees
+ * @longitude: The longitude in degrees
+ * @altitude: The altitude in metres
+ * @speed: The speed in knots
+ * @direction: The direction in degrees
+ * @climb: The climb in metres per second
+ * @pdop: The position dilution of precision
+ * @hdop: The horizontal dilution of precision
+ * @vdop: The vertical dilution of precision
+ * @satellites: The satellites in view
+ *
+ * Everything gypsy-daemon knows about a device at one moment, as read by
+ * gypsy_shm_read(). The fields have the same meaning as the values passed
+ * by the signals of the other objects.
+ */
+typedef struct _GypsyShmFix {
+	int timestamp;
+	GypsyDeviceFixStatus fix_status;
+	GypsyPositionFields position_fields;
+	GypsyCourseFields course_fields;
+	GypsyAccuracyFields accuracy_fields;
+	int satellite_count;
+
+	double latitude;
+	double longitude;
+	double altitude;
+
+	double speed;
+	double direction;
+	double climb;
+
+	double pdop;
+	double hdop;
+	double vdop;
+
+	GypsyShmSatellite satellites[GYPSY_SHM_MAX_SATELLITES];
+} GypsyShmFix;
+
+/* The layout of the segment. sequence is odd while
+   gypsy-daemon is writing fix. closed is set once it
+   stops publishing and has unlinked the segment. */
+typedef struct _GypsyShmSegment {
+	guint32 magic;
+	guint32 version;
+	volatile gint sequence;
+	volatile gint closed;
+
+	GypsyShmFix fix;
+} GypsyShmSegment;
+
+/**
+ * GypsyShm:
+ *
+ * There are no public fields in #GypsyShm.
+ */
+typedef struct _GypsyShm GypsyShm;
+
+GypsyShm *gypsy_shm_open (const char *object_path,
+			  GError    **error);
+gboolean gypsy_shm_read (GypsyShm    *shm,
+			 GypsyShmFix *fix,
+			 guint       *generation);
+void gypsy_shm_close (GypsyShm *shm);
+
+G_END_DECLS
+
+#endif
@@ -66,14 +66,13 @@
  */
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
 #include <gypsy/gypsy-marshal.h>
 #include <gypsy/gypsy-time.h>
 
-#include "gypsy-client-bindings.h"
-
 typedef struct _GypsyTimePrivate {
-	DBusGProxy *proxy;
+	GDBusProxy *proxy;
 	char *object_path;
 } GypsyTimePrivate;
 
@@ -91,8 +90,10 @@ enum {
 
 G_DEFINE_TYPE (GypsyTime, gypsy_time, G_TYPE_OBJECT);
 
-static void time_changed (DBusGProxy *proxy,
-			  int         timestamp,
+static void proxy_signal (GDBusProxy *proxy,
+			  const char *sender_name,
+			  const char *signal_name,
+			  GVariant   *parameters,
 			  GypsyTime  *gps_time);
 
 static guint32 signals[LAST_SIGNAL] = {0, };
@@ -119,9 +120,9 @@ dispose (GObject *object)
 	priv = GET_PRIVATE (object);
 
 	if (priv->proxy) {
-		dbus_g_proxy_disconnect_signal (priv->proxy, "TimeChanged",
-						G_CALLBACK (time_changed),
-						object);
+		g_signal_handlers_disconnect_by_func (priv->proxy,
+						      proxy_signal,
+						      object);
 		g_object_unref (priv->proxy);
 		priv->proxy = NULL;
 	}
@@ -169,10 +170,19 @@ get_property (GObject    *object,
 }
 
 static void
-time_changed (DBusGProxy *proxy,
-	      int         timestamp,
+proxy_signal (GDBusProxy *proxy,
+	      const char *sender_name,
+	      const char *signal_name,
+	      GVariant   *parameters,
 	      GypsyTime  *gps_time)
 {
+	int timestamp;
+
+	if (!g_str_equal (signal_name, "TimeChanged")) {
+		return;
+	}
+
+	g_variant_get (parameters, "(i)", &timestamp);
 	g_signal_emit (gps_time, signals[TIME_CHANGED], 0, timestamp);
 }
 
@@ -183,7 +193,6 @@ constructor (GType                  type,
 {
 	GypsyTime *gps_time;
 	GypsyTimePrivate *priv;
-	DBusGConnection *connection;
 	GError *error;
 
 	gps_time = GYPSY_TIME (G_OBJECT_CLASS (gypsy_time_parent_class)->constructor 
@@ -193,26 +202,22 @@ constructor (GType                  type,
 	priv = GET_PRIVATE (gps_time);
 
 	error = NULL;
-	connection = dbus_g_bus_get (DBUS_BUS_SYSTEM, &error);
-	if (connection == NULL) {
+	priv->proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
+						     G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+						     NULL,
+						     GYPSY_TIME_DBUS_SERVICE,
+						     priv->object_path,
+						     GYPSY_TIME_DBUS_INTERFACE,
+						     NULL, &error);
+	if (priv->proxy == NULL) {
 		g_printerr ("Failed to open connection to bus: %s\n",
 			    error->message);
 		g_error_free (error);
-		
-		priv->proxy = NULL;
 		return G_OBJECT (gps_time);
 	}
 
-	priv->proxy = dbus_g_proxy_new_for_name (connection, 
-						 GYPSY_TIME_DBUS_SERVICE,
-						 priv->object_path,
-						 GYPSY_TIME_DBUS_INTERFACE);
-
-	dbus_g_proxy_add_signal (priv->proxy, "TimeChanged",
-				 G_TYPE_INT, G_TYPE_INVALID);
-	dbus_g_proxy_connect_signal (priv->proxy, "TimeChanged",
-				     G_CALLBACK (time_changed),
-				     gps_time, NULL);
+	g_signal_connect (priv->proxy, "g-signal",
+			  G_CALLBACK (proxy_signal), gps_time);
 
 	return G_OBJECT (gps_time);
 }
@@ -302,15 +307,20 @@ gypsy_time_get_time (GypsyTime *gps_time,
 		     GError   **error)
 {
 	GypsyTimePrivate *priv;
+	GVariant *reply;
 	
 	g_return_val_if_fail (GYPSY_IS_TIME (gps_time), FALSE);
 
 	priv = GET_PRIVATE (gps_time);
-	if (!org_freedesktop_Gypsy_Time_get_time (priv->proxy,
-						  timestamp,
-						  error)) {
+	reply = g_dbus_proxy_call_sync (priv->proxy, "GetTime", NULL,
+					G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+					error);
+	if (reply == NULL) {
 		return FALSE;
 	}
 
+	g_variant_get (reply, "(i)", timestamp);
+	g_variant_unref (reply);
+
 	return TRUE;
 }
@@ -189,11 +189,13 @@ G_Packet_t;
 #pragma pack(pop)
 
 enum {
+	Pid_Ack_Byte		= 6,
 	Pid_Command_Data	= 10,
 	Pid_Xfer_Cmplt		= 12,
 	Pid_Date_Time_Data	= 14,
 	Pid_Position_Data	= 17,
 	Pid_Prx_Wpt_Data	= 19,
+	Pid_Nak_Byte		= 21,
 	Pid_Records		= 27,
 	Pid_Rte_Hdr		= 29,
 	Pid_Rte_Wpt_Data	= 30,
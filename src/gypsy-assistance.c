@@ -0,0 +1,407 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * GypsyAssistance - Loads offline assistance data and feeds it to a
+ *                   receiver through the device's command queue, which
+ *                   waits for each message to be acknowledged before
+ *                   sending the next so the receiver's input buffer never
+ *                   overflows.
+ *
+ * A path is either a file or a directory whose files are all sent, in
+ * name order. Files starting with a UBX header are u-blox AssistNow
+ * Offline or MGA data, and are sent as they are, a packet at a time.
+ * Receivers only acknowledge MGA data once told to with UBX-CFG-NAVX5,
+ * so that goes before the first MGA packet.
+ * Other files are taken as MTK EPO data, 72 byte records which are
+ * sent as PMTK721 sentences. Only files under ASSISTANCE_DIR are read,
+ * so the config can't be used to send the receiver anything else the
+ * daemon can read.
+ */
+
+#include "config.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "gypsy-assistance.h"
+#include "gypsy-debug.h"
+#include "nmea-profile.h"
+
+#define ASSISTANCE_DIR LOCALSTATEDIR "/lib/gypsy/assistance"
+
+#define EPO_RECORD_SIZE 72
+
+#define UBX_SYNC_1 0xb5
+#define UBX_SYNC_2 0x62
+#define UBX_CLASS_MGA 0x13
+
+typedef struct _AssistanceMessage {
+	GByteArray *data;
+	GypsyCommandAck ack;
+} AssistanceMessage;
+
+struct _GypsyAssistance {
+	GPtrArray *messages; /* AssistanceMessage */
+	gboolean ack_aiding; /* CFG-NAVX5 has been added */
+
+	GypsyCommandQueue *queue;
+	guint outstanding;
+	guint sent, failed;
+
+	GypsyAssistanceDone done;
+	gpointer userdata;
+};
+
+static void
+message_free (gpointer data)
+{
+	AssistanceMessage *message = data;
+
+	g_byte_array_free (message->data, TRUE);
+	g_slice_free (AssistanceMessage, message);
+}
+
+static void
+add_message (GypsyAssistance *assistance,
+	     const guint8    *data,
+	     gsize            length,
+	     GypsyCommandAck  ack)
+{
+	AssistanceMessage *message;
+
+	message = g_slice_new (AssistanceMessage);
+	message->data = g_byte_array_sized_new (length);
+	g_byte_array_append (message->data, data, length);
+	message->ack = ack;
+
+	g_ptr_array_add (assistance->messages, message);
+}
+
+static void
+add_ack_aiding (GypsyAssistance *assistance)
+{
+	GByteArray *navx5;
+
+	if (assistance->ack_aiding) {
+		return;
+	}
+
+	navx5 = nmea_profile_build_ubx_cfg_navx5_ack_aiding ();
+	add_message (assistance, navx5->data, navx5->len,
+		     GYPSY_COMMAND_ACK_UBX);
+	g_byte_array_free (navx5, TRUE);
+
+	assistance->ack_aiding = TRUE;
+}
+
+/* Only MGA messages are acknowledged, once the receiver has been told
+   to, the rest are paced by waiting for them to be written */
+static gboolean
+add_ubx_messages (GypsyAssistance *assistance,
+		  const guint8    *data,
+		  gsize            length,
+		  const char      *filename,
+		  GError         **error)
+{
+	gsize offset = 0;
+
+	while (offset + 8 <= length) {
+		gsize payload, packet;
+
+		if (data[offset] != UBX_SYNC_1 ||
+		    data[offset + 1] != UBX_SYNC_2) {
+			break;
+		}
+
+		payload = data[offset + 4] | data[offset + 5] << 8;
+		packet = payload + 8;
+		if (offset + packet > length) {
+			break;
+		}
+
+		if (data[offset + 2] == UBX_CLASS_MGA) {
+			add_ack_aiding (assistance);
+			add_message (assistance, data + offset, packet,
+				     GYPSY_COMMAND_ACK_UBX_MGA);
+		} else {
+			add_message (assistance, data + offset, packet,
+				     GYPSY_COMMAND_ACK_NONE);
+		}
+		offset += packet;
+	}
+
+	if (offset != length) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+			     "%s has a broken UBX packet at %" G_GSIZE_FORMAT,
+			     filename, offset);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Each record is 18 little endian words, the
+   satellite's PRN is the top byte of the first */
+static gboolean
+add_epo_messages (GypsyAssistance *assistance,
+		  const guint8    *data,
+		  gsize            length,
+		  const char      *filename,
+		  GError         **error)
+{
+	gsize offset;
+
+	if (length % EPO_RECORD_SIZE != 0) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+			     "%s is not a whole number of EPO records",
+			     filename);
+		return FALSE;
+	}
+
+	for (offset = 0; offset < length; offset += EPO_RECORD_SIZE) {
+		const guint8 *record = data + offset;
+		GString *sentence;
+		const char *s;
+		int i, sum = 0;
+
+		sentence = g_string_new (NULL);
+		g_string_printf (sentence, "$PMTK721,%X", record[3]);
+		for (i = 0; i < EPO_RECORD_SIZE; i += 4) {
+			g_string_append_printf (sentence, ",%02X%02X%02X%02X",
+						record[i + 3], record[i + 2],
+						record[i + 1], record[i]);
+		}
+
+		for (s = sentence->str + 1; *s; s++) {
+			sum ^= *s;
+		}
+		g_string_append_printf (sentence, "*%02X\r\n", sum);
+
+		add_message (assistance, (guint8 *) sentence->str,
+			     sentence->len, GYPSY_COMMAND_ACK_PMTK);
+		g_string_free (sentence, TRUE);
+	}
+
+	return TRUE;
+}
+
+/* Symlinks are followed first, so they can't lead out of the directory */
+static gboolean
+is_in_assistance_dir (const char *filename)
+{
+	char dir[PATH_MAX], file[PATH_MAX];
+	gsize length;
+
+	if (realpath (ASSISTANCE_DIR, dir) == NULL ||
+	    realpath (filename, file) == NULL) {
+		return FALSE;
+	}
+
+	length = strlen (dir);
+	return (strncmp (file, dir, length) == 0 && file[length] == '/');
+}
+
+static gboolean
+add_file (GypsyAssistance *assistance,
+	  const char      *filename,
+	  GypsyCommands    commands,
+	  GError         **error)
+{
+	char *contents;
+	gsize length;
+	gboolean is_ubx, ret = TRUE;
+
+	if (!is_in_assistance_dir (filename)) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_ACCES,
+			     "%s is not in %s", filename, ASSISTANCE_DIR);
+		return FALSE;
+	}
+
+	if (!g_file_get_contents (filename, &contents, &length, error)) {
+		return FALSE;
+	}
+
+	is_ubx = (length >= 2 && (guint8) contents[0] == UBX_SYNC_1 &&
+		  (guint8) contents[1] == UBX_SYNC_2);
+
+	/* Skip what the receiver won't understand */
+	if (is_ubx && (commands == GYPSY_COMMANDS_UNKNOWN ||
+		       (commands & GYPSY_COMMANDS_UBX))) {
+		ret = add_ubx_messages (assistance, (guint8 *) contents,
+					length, filename, error);
+	} else if (!is_ubx && (commands == GYPSY_COMMANDS_UNKNOWN ||
+			       (commands & GYPSY_COMMANDS_MTK))) {
+		ret = add_epo_messages (assistance, (guint8 *) contents,
+					length, filename, error);
+	} else {
+		GYPSY_NOTE (CLIENT, "Skipping %s, the receiver doesn't "
+			    "take it", filename);
+	}
+
+	g_free (contents);
+	return ret;
+}
+
+static int
+compare_strings (gconstpointer a,
+		 gconstpointer b)
+{
+	return strcmp (*(char **) a, *(char **) b);
+}
+
+GypsyAssistance *
+gypsy_assistance_new_from_path (const char   *path,
+				GypsyCommands commands,
+				GError      **error)
+{
+	GypsyAssistance *assistance;
+	GPtrArray *files;
+	int i;
+
+	files = g_ptr_array_new_with_free_func (g_free);
+	if (g_file_test (path, G_FILE_TEST_IS_DIR)) {
+		const char *name;
+		GDir *dir;
+
+		dir = g_dir_open (path, 0, error);
+		if (dir == NULL) {
+			g_ptr_array_free (files, TRUE);
+			return NULL;
+		}
+
+		while ((name = g_dir_read_name (dir))) {
+			if (name[0] != '.') {
+				g_ptr_array_add (files,
+						 g_build_filename (path, name,
+								   NULL));
+			}
+		}
+		g_dir_close (dir);
+
+		g_ptr_array_sort (files, compare_strings);
+	} else {
+		g_ptr_array_add (files, g_strdup (path));
+	}
+
+	assistance = g_slice_new0 (GypsyAssistance);
+	assistance->messages = g_ptr_array_new_with_free_func (message_free);
+
+	for (i = 0; i < files->len; i++) {
+		if (!add_file (assistance, files->pdata[i], commands, error)) {
+			g_ptr_array_free (files, TRUE);
+			gypsy_assistance_free (assistance);
+			return NULL;
+		}
+	}
+	g_ptr_array_free (files, TRUE);
+
+	GYPSY_NOTE (CLIENT, "%u assistance messages from %s",
+		    assistance->messages->len, path);
+	return assistance;
+}
+
+guint
+gypsy_assistance_get_count (GypsyAssistance *assistance)
+{
+	return assistance->messages->len;
+}
+
+static void
+finish (GypsyAssistance *assistance)
+{
+	GYPSY_NOTE (CLIENT, "Assistance done, %u sent, %u failed",
+		    assistance->sent, assistance->failed);
+
+	/* The callback may free us */
+	assistance->done (assistance, assistance->sent, assistance->failed,
+			  assistance->userdata);
+}
+
+static void
+message_done (GypsyCommandQueue *queue,
+	      GypsyCommandResult result,
+	      gpointer           userdata)
+{
+	GypsyAssistance *assistance = userdata;
+
+	if (result == GYPSY_COMMAND_OK) {
+		assistance->sent++;
+	} else {
+		assistance->failed++;
+	}
+
+	assistance->outstanding--;
+	if (assistance->outstanding == 0) {
+		finish (assistance);
+	}
+}
+
+/* Queues every message at once, the queue holds
+   each back until the one before is answered */
+void
+gypsy_assistance_start (GypsyAssistance    *assistance,
+			GypsyCommandQueue  *queue,
+			GypsyAssistanceDone done,
+			gpointer            userdata)
+{
+	int i;
+
+	g_return_if_fail (assistance->queue == NULL);
+
+	assistance->queue = queue;
+	assistance->done = done;
+	assistance->userdata = userdata;
+
+	if (assistance->messages->len == 0) {
+		finish (assistance);
+		return;
+	}
+
+	assistance->outstanding = assistance->messages->len;
+	for (i = 0; i < assistance->messages->len; i++) {
+		AssistanceMessage *message = assistance->messages->pdata[i];
+
+		gypsy_command_queue_push (queue, message->data->data,
+					  message->data->len, message->ack,
+					  message_done, assistance);
+	}
+}
+
+void
+gypsy_assistance_free (GypsyAssistance *assistance)
+{
+	if (assistance->queue && assistance->outstanding > 0) {
+		gypsy_command_queue_cancel (assistance->queue, message_done,
+					    assistance);
+	}
+
+	g_ptr_array_free (assistance->messages, TRUE);
+	g_slice_free (GypsyAssistance, assistance);
+}
@@ -0,0 +1,512 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * GypsyCapture - Timestamped captures of device reads, and replaying them
+ *                into a parser.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "gypsy-capture.h"
+#include "gypsy-debug.h"
+
+#define CAPTURE_MAGIC "GYPSYCAP"
+#define CAPTURE_MAGIC_LENGTH 8
+#define FILE_HEADER_SIZE 16
+#define RECORD_HEADER_SIZE 16
+
+/* How many chunks to feed per main loop iteration when replaying
+   as fast as possible */
+#define REPLAY_BATCH 64
+
+/* Raw logs have no timing, so they are cut into this many
+   chunks per second of the line rate */
+#define RAW_CHUNKS_PER_SECOND 10
+
+struct _GypsyCaptureReader {
+	GMappedFile *file;
+	const guint8 *data;
+	gsize length;
+	gsize offset; /* Start of the next record */
+
+	gsize raw_chunk_size; /* 0 unless reading a raw log */
+	guint64 raw_index;
+
+	GPtrArray *devices; /* Device names, by index */
+};
+
+struct _GypsyCaptureReplay {
+	GypsyCaptureReader *reader;
+	guint16 device;
+	GypsyParser *parser;
+	double speed; /* 1.0 is real time, 0 is as fast as possible */
+
+	GypsyCaptureReplayDone done;
+	gpointer userdata;
+
+	GypsyCaptureChunk next;
+	gboolean have_next;
+
+	gint64 first_timestamp; /* Capture time of the first chunk */
+	gint64 start_time; /* When we replayed the first chunk */
+
+	guint32 source_id;
+};
+
+static void
+append_record_header (GByteArray *record,
+		      guint32     length,
+		      guint16     device,
+		      guint16     type,
+		      gint64      timestamp)
+{
+	guint8 header[RECORD_HEADER_SIZE];
+	guint32 le_length;
+	guint16 le_device, le_type;
+	gint64 le_timestamp;
+
+	le_length = GUINT32_TO_LE (length);
+	le_device = GUINT16_TO_LE (device);
+	le_type = GUINT16_TO_LE (type);
+	le_timestamp = GINT64_TO_LE (timestamp);
+
+	memcpy (header, &le_length, 4);
+	memcpy (header + 4, &le_device, 2);
+	memcpy (header + 6, &le_type, 2);
+	memcpy (header + 8, &le_timestamp, 8);
+
+	g_byte_array_append (record, header, RECORD_HEADER_SIZE);
+}
+
+/* Builds the file header plus the DEVICE record for index 0. It is
+   written at the start of every log segment so each one can be replayed
+   on its own. */
+GByteArray *
+gypsy_capture_build_header (const char *device_path)
+{
+	GByteArray *header;
+	guint8 file_header[FILE_HEADER_SIZE];
+	guint16 le_version, le_size;
+
+	memset (file_header, 0, FILE_HEADER_SIZE);
+	memcpy (file_header, CAPTURE_MAGIC, CAPTURE_MAGIC_LENGTH);
+	le_version = GUINT16_TO_LE (GYPSY_CAPTURE_VERSION);
+	le_size = GUINT16_TO_LE (FILE_HEADER_SIZE);
+	memcpy (file_header + 8, &le_version, 2);
+	memcpy (file_header + 10, &le_size, 2);
+
+	header = g_byte_array_new ();
+	g_byte_array_append (header, file_header, FILE_HEADER_SIZE);
+
+	append_record_header (header, strlen (device_path), 0,
+			      GYPSY_CAPTURE_RECORD_DEVICE,
+			      g_get_monotonic_time ());
+	g_byte_array_append (header, (guint8 *) device_path,
+			     strlen (device_path));
+
+	return header;
+}
+
+/* Appends a DATA record to record, so the whole record
+   can be handed to the log in one write */
+void
+gypsy_capture_append_chunk (GByteArray *record,
+			    guint16     device,
+			    gint64      timestamp,
+			    const char *data,
+			    gsize       length)
+{
+	append_record_header (record, length, device,
+			      GYPSY_CAPTURE_RECORD_DATA, timestamp);
+	g_byte_array_append (record, (guint8 *) data, length);
+}
+
+/* Goes by the magic the writer puts at the start of every segment
+   rather than the name, which a rotated or renamed capture loses */
+gboolean
+gypsy_capture_is_capture_file (const char *filename)
+{
+	char magic[CAPTURE_MAGIC_LENGTH];
+	FILE *file;
+	gboolean ret;
+
+	file = fopen (filename, "rb");
+	if (file == NULL) {
+		return FALSE;
+	}
+
+	ret = (fread (magic, 1, CAPTURE_MAGIC_LENGTH, file) ==
+	       CAPTURE_MAGIC_LENGTH &&
+	       memcmp (magic, CAPTURE_MAGIC, CAPTURE_MAGIC_LENGTH) == 0);
+	fclose (file);
+
+	return ret;
+}
+
+GypsyCaptureReader *
+gypsy_capture_reader_new (const char *filename,
+			  GError    **error)
+{
+	GypsyCaptureReader *reader;
+	GMappedFile *file;
+	const guint8 *data;
+	gsize length;
+	guint16 version, header_size;
+
+	file = g_mapped_file_new (filename, FALSE, error);
+	if (file == NULL) {
+		return NULL;
+	}
+
+	data = (const guint8 *) g_mapped_file_get_contents (file);
+	length = g_mapped_file_get_length (file);
+
+	if (length < FILE_HEADER_SIZE ||
+	    memcmp (data, CAPTURE_MAGIC, CAPTURE_MAGIC_LENGTH) != 0) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+			     "%s is not a Gypsy capture file", filename);
+		g_mapped_file_unref (file);
+		return NULL;
+	}
+
+	memcpy (&version, data + 8, 2);
+	memcpy (&header_size, data + 10, 2);
+	version = GUINT16_FROM_LE (version);
+	header_size = GUINT16_FROM_LE (header_size);
+
+	if (version != GYPSY_CAPTURE_VERSION ||
+	    header_size < FILE_HEADER_SIZE || header_size > length) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+			     "%s has unsupported capture version %d",
+			     filename, version);
+		g_mapped_file_unref (file);
+		return NULL;
+	}
+
+	reader = g_slice_new0 (GypsyCaptureReader);
+	reader->file = file;
+	reader->data = data;
+	reader->length = length;
+	reader->offset = header_size;
+	reader->devices = g_ptr_array_new_with_free_func (g_free);
+
+	return reader;
+}
+
+/* Reads a raw NMEA or Garmin log as though it had been captured from a
+   device delivering bytes_per_second, so that it can be replayed with
+   the same timing as a serial line */
+GypsyCaptureReader *
+gypsy_capture_reader_new_raw (const char *filename,
+			      guint       bytes_per_second,
+			      GError    **error)
+{
+	GypsyCaptureReader *reader;
+	GMappedFile *file;
+
+	file = g_mapped_file_new (filename, FALSE, error);
+	if (file == NULL) {
+		return NULL;
+	}
+
+	reader = g_slice_new0 (GypsyCaptureReader);
+	reader->file = file;
+	reader->data = (const guint8 *) g_mapped_file_get_contents (file);
+	reader->length = g_mapped_file_get_length (file);
+	reader->raw_chunk_size = MAX (bytes_per_second / RAW_CHUNKS_PER_SECOND,
+				      1);
+	reader->devices = g_ptr_array_new_with_free_func (g_free);
+	g_ptr_array_add (reader->devices, g_strdup (filename));
+
+	return reader;
+}
+
+static gboolean
+raw_reader_next (GypsyCaptureReader *reader,
+		 guint16             device,
+		 GypsyCaptureChunk  *chunk)
+{
+	if ((device != 0 && device != G_MAXUINT16) ||
+	    reader->offset >= reader->length) {
+		return FALSE;
+	}
+
+	chunk->device = 0;
+	chunk->timestamp = reader->raw_index * G_USEC_PER_SEC /
+		RAW_CHUNKS_PER_SECOND;
+	chunk->data = (const char *) reader->data + reader->offset;
+	chunk->length = MIN (reader->raw_chunk_size,
+			     reader->length - reader->offset);
+
+	reader->offset += chunk->length;
+	reader->raw_index++;
+
+	return TRUE;
+}
+
+/* Finds the next DATA record for device, or for any device if device is
+   G_MAXUINT16. chunk->data points into the mapped file and stays valid
+   until the reader is freed. */
+gboolean
+gypsy_capture_reader_next (GypsyCaptureReader *reader,
+			   guint16             device,
+			   GypsyCaptureChunk  *chunk)
+{
+	if (reader->raw_chunk_size > 0) {
+		return raw_reader_next (reader, device, chunk);
+	}
+
+	while (reader->offset + RECORD_HEADER_SIZE <= reader->length) {
+		const guint8 *record = reader->data + reader->offset;
+		guint32 length;
+		guint16 index, type;
+		gint64 timestamp;
+
+		memcpy (&length, record, 4);
+		memcpy (&index, record + 4, 2);
+		memcpy (&type, record + 6, 2);
+		memcpy (&timestamp, record + 8, 8);
+		length = GUINT32_FROM_LE (length);
+		index = GUINT16_FROM_LE (index);
+		type = GUINT16_FROM_LE (type);
+		timestamp = GINT64_FROM_LE (timestamp);
+
+		/* A capture cut off mid-record ends at the last whole one */
+		if (length > reader->length - reader->offset - RECORD_HEADER_SIZE) {
+			GYPSY_NOTE (CLIENT, "Truncated capture record at %d",
+				    reader->offset);
+			reader->offset = reader->length;
+			return FALSE;
+		}
+
+		reader->offset += RECORD_HEADER_SIZE + length;
+		record += RECORD_HEADER_SIZE;
+
+		if (type == GYPSY_CAPTURE_RECORD_DEVICE) {
+			if (index >= reader->devices->len) {
+				g_ptr_array_set_size (reader->devices,
+						      index + 1);
+			}
+			g_free (reader->devices->pdata[index]);
+			reader->devices->pdata[index] =
+				g_strndup ((const char *) record, length);
+			continue;
+		}
+
+		/* An empty read carries nothing to replay, and would only
+		   have the replay reschedule itself straight away */
+		if (type != GYPSY_CAPTURE_RECORD_DATA || length == 0 ||
+		    (device != G_MAXUINT16 && index != device)) {
+			continue;
+		}
+
+		chunk->device = index;
+		chunk->timestamp = timestamp;
+		chunk->data = (const char *) record;
+		chunk->length = length;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+void
+gypsy_capture_reader_rewind (GypsyCaptureReader *reader)
+{
+	guint16 header_size;
+
+	if (reader->raw_chunk_size > 0) {
+		reader->offset = 0;
+		reader->raw_index = 0;
+		return;
+	}
+
+	memcpy (&header_size, reader->data + 10, 2);
+	reader->offset = GUINT16_FROM_LE (header_size);
+}
+
+/* Device names are only known once their DEVICE record has been read */
+const char *
+gypsy_capture_reader_get_device (GypsyCaptureReader *reader,
+				 guint16             device)
+{
+	if (device >= reader->devices->len) {
+		return NULL;
+	}
+
+	return reader->devices->pdata[device];
+}
+
+void
+gypsy_capture_reader_free (GypsyCaptureReader *reader)
+{
+	g_ptr_array_free (reader->devices, TRUE);
+	g_mapped_file_unref (reader->file);
+	g_slice_free (GypsyCaptureReader, reader);
+}
+
+/* Hands data to parser the same way gps_channel_input does,
+   in pieces no bigger than the parser's free buffer space */
+void
+gypsy_capture_feed_parser (GypsyParser *parser,
+			   const char  *data,
+			   gsize        length)
+{
+	while (length > 0) {
+		char *buffer;
+		gsize space, n;
+
+		space = gypsy_parser_get_buffer (parser, &buffer);
+		if (space == 0) {
+			GYPSY_NOTE (CLIENT, "Parser buffer full, dropping %d bytes",
+				    length);
+			return;
+		}
+
+		n = MIN (space, length);
+		memcpy (buffer, data, n);
+		gypsy_parser_received_data (parser, n, NULL);
+
+		data += n;
+		length -= n;
+	}
+}
+
+static gboolean replay_step (gpointer userdata);
+
+static void
+schedule_next_chunk (GypsyCaptureReplay *replay)
+{
+	gint64 due, now;
+
+	if (replay->speed <= 0.0) {
+		replay->source_id = g_idle_add (replay_step, replay);
+		return;
+	}
+
+	due = replay->start_time +
+		(gint64) ((replay->next.timestamp - replay->first_timestamp) /
+			  replay->speed);
+	now = g_get_monotonic_time ();
+
+	replay->source_id = g_timeout_add (due > now ? (due - now) / 1000 : 0,
+					   replay_step, replay);
+}
+
+static gboolean
+replay_step (gpointer userdata)
+{
+	GypsyCaptureReplay *replay = userdata;
+	gint64 now;
+	int fed = 0;
+
+	replay->source_id = 0;
+	now = g_get_monotonic_time ();
+
+	while (replay->have_next) {
+		if (replay->speed > 0.0) {
+			gint64 due;
+
+			due = replay->start_time +
+				(gint64) ((replay->next.timestamp -
+					   replay->first_timestamp) /
+					  replay->speed);
+			if (due > now) {
+				break;
+			}
+		} else if (fed == REPLAY_BATCH) {
+			/* Give the rest of the main loop a look in */
+			break;
+		}
+
+		gypsy_capture_feed_parser (replay->parser, replay->next.data,
+					   replay->next.length);
+		fed++;
+
+		replay->have_next = gypsy_capture_reader_next (replay->reader,
+							       replay->device,
+							       &replay->next);
+	}
+
+	if (replay->have_next == FALSE) {
+		/* done may free the replay, so don't touch it afterwards */
+		if (replay->done) {
+			replay->done (replay, replay->userdata);
+		}
+		return FALSE;
+	}
+
+	schedule_next_chunk (replay);
+	return FALSE;
+}
+
+/* Replays the DATA records for device into parser, with the gaps between
+   them divided by speed. A speed of 0 replays as fast as possible.
+   done is called once the last chunk has been fed. The reader must
+   outlive the replay. */
+GypsyCaptureReplay *
+gypsy_capture_replay_new (GypsyCaptureReader    *reader,
+			  guint16                device,
+			  GypsyParser           *parser,
+			  double                 speed,
+			  GypsyCaptureReplayDone done,
+			  gpointer               userdata)
+{
+	GypsyCaptureReplay *replay;
+
+	replay = g_slice_new0 (GypsyCaptureReplay);
+	replay->reader = reader;
+	replay->device = device;
+	replay->parser = g_object_ref (parser);
+	replay->speed = speed;
+	replay->done = done;
+	replay->userdata = userdata;
+
+	replay->have_next = gypsy_capture_reader_next (reader, device,
+						       &replay->next);
+	replay->first_timestamp = replay->next.timestamp;
+	replay->start_time = g_get_monotonic_time ();
+
+	/* Even an empty capture finishes from the main loop,
+	   so done is never called before we return */
+	replay->source_id = g_idle_add (replay_step, replay);
+
+	return replay;
+}
+
+void
+gypsy_capture_replay_free (GypsyCaptureReplay *replay)
+{
+	if (replay->source_id > 0) {
+		g_source_remove (replay->source_id);
+	}
+
+	g_object_unref (replay->parser);
+	g_slice_free (GypsyCaptureReplay, replay);
+}
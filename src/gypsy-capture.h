@@ -0,0 +1,109 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef __GYPSY_CAPTURE_H__
+#define __GYPSY_CAPTURE_H__
+
+#include <glib.h>
+
+#include "gypsy-parser.h"
+
+G_BEGIN_DECLS
+
+/* A .gypsycap file is a 16 byte file header followed by records.
+   All integers are little endian.
+
+   File header:
+     0) "GYPSYCAP" magic (8 bytes)
+     8) Format version (u16, currently 1)
+    10) Header size in bytes (u16, 16)
+    12) Reserved (u32, 0)
+
+   Record header, followed by length bytes of payload:
+     0) Payload length (u32)
+     4) Device index (u16)
+     6) Record type (u16)
+     8) Monotonic arrival time in microseconds (s64)
+
+   A DEVICE record names the device for its index and comes before any
+   DATA record for that index. Each DATA record is exactly one read from
+   the device. */
+
+#define GYPSY_CAPTURE_SUFFIX ".gypsycap"
+#define GYPSY_CAPTURE_VERSION 1
+
+typedef enum {
+	GYPSY_CAPTURE_RECORD_DEVICE = 0,
+	GYPSY_CAPTURE_RECORD_DATA = 1
+} GypsyCaptureRecordType;
+
+typedef struct _GypsyCaptureChunk {
+	guint16 device;
+	gint64 timestamp; /* Microseconds */
+	const char *data; /* Points into the mapped file */
+	gsize length;
+} GypsyCaptureChunk;
+
+typedef struct _GypsyCaptureReader GypsyCaptureReader;
+typedef struct _GypsyCaptureReplay GypsyCaptureReplay;
+
+typedef void (* GypsyCaptureReplayDone) (GypsyCaptureReplay *replay,
+					 gpointer            userdata);
+
+/* Writing */
+GByteArray *gypsy_capture_build_header (const char *device_path);
+void gypsy_capture_append_chunk (GByteArray *record,
+				 guint16     device,
+				 gint64      timestamp,
+				 const char *data,
+				 gsize       length);
+
+/* Reading */
+gboolean gypsy_capture_is_capture_file (const char *filename);
+GypsyCaptureReader *gypsy_capture_reader_new (const char *filename,
+					      GError    **error);
+gboolean gypsy_capture_reader_next (GypsyCaptureReader *reader,
+				    guint16             device,
+				    GypsyCaptureChunk  *chunk);
+void gypsy_capture_reader_rewind (GypsyCaptureReader *reader);
+const char *gypsy_capture_reader_get_device (GypsyCaptureReader *reader,
+					     guint16             device);
+void gypsy_capture_reader_free (GypsyCaptureReader *reader);
+
+/* Replaying */
+void gypsy_capture_feed_parser (GypsyParser *parser,
+				const char  *data,
+				gsize        length);
+GypsyCaptureReplay *gypsy_capture_replay_new (GypsyCaptureReader    *reader,
+					      guint16                device,
+					      GypsyParser           *parser,
+					      double                 speed,
+					      GypsyCaptureReplayDone done,
+					      gpointer               userdata);
+void gypsy_capture_replay_free (GypsyCaptureReplay *replay);
+
+G_END_DECLS
+
+#endif
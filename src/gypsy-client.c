@@ -35,6 +35,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <math.h>
 #include <errno.h>
 #include <termios.h>
 
@@ -55,44 +56,142 @@
 #endif
 
 #include <glib.h>
+#include <gio/gio.h>
 
-#include <dbus/dbus-glib.h>
-#include <dbus/dbus-glib-bindings.h>
-
+#include "gypsy-assistance.h"
 #include "gypsy-client.h"
+#include "gypsy-command-queue.h"
+#include "gypsy-corrections.h"
 #include "gypsy-debug.h"
 #include "gypsy-marshal-internal.h"
 #include "gypsy-parser.h"
 #include "gypsy-garmin-parser.h"
+#include "gypsy-kalman.h"
+#include "gypsy-capture.h"
+#include "gypsy-nmea-log.h"
+#include "gypsy-network.h"
 #include "gypsy-nmea-parser.h"
+#include "gypsy-raw-stream.h"
+#include "gypsy-shm-publisher.h"
+#include "gypsy-simulator.h"
+#include "gypsy-warm-start.h"
 
 #include "garmin.h"
+#include "nmea-profile.h"
 
 #define GYPSY_ERROR g_quark_from_static_string ("gypsy-error")
 
+#define GYPSY_ACCURACY_INTERFACE "org.freedesktop.Gypsy.Accuracy"
+#define GYPSY_COURSE_INTERFACE "org.freedesktop.Gypsy.Course"
+#define GYPSY_DEVICE_INTERFACE "org.freedesktop.Gypsy.Device"
+#define GYPSY_POSITION_INTERFACE "org.freedesktop.Gypsy.Position"
+#define GYPSY_SATELLITE_INTERFACE "org.freedesktop.Gypsy.Satellite"
+#define GYPSY_SMOOTHED_INTERFACE "org.freedesktop.Gypsy.Smoothed"
+#define GYPSY_TIME_INTERFACE "org.freedesktop.Gypsy.Time"
+
 typedef enum {
 	GYPSY_DEVICE_TYPE_UNKNOWN = -1,
 	GYPSY_DEVICE_TYPE_SERIAL,
 	GYPSY_DEVICE_TYPE_GARMIN,
 	GYPSY_DEVICE_TYPE_FIFO,
-	GYPSY_DEVICE_TYPE_BLUETOOTH
+	GYPSY_DEVICE_TYPE_BLUETOOTH,
+	GYPSY_DEVICE_TYPE_REPLAY,
+	GYPSY_DEVICE_TYPE_SIMULATOR,
+	GYPSY_DEVICE_TYPE_TCP,
+	GYPSY_DEVICE_TYPE_UDP
 } GypsyDeviceType;
 
 /* Defined in main.c */
 extern char* nmea_log;
+extern GypsyNmeaLogSettings nmea_log_settings;
+extern char *raw_stream_dir;
 
 #define READ_BUFFER_SIZE 1024
 #define SPEED_TIMEOUT 1000
 
+#define REPLAY_SCHEME "replay://"
+#define REPLAY_DEFAULT_BAUD 4800
+
+#define SIMULATOR_SCHEME "sim://"
+
+/* How far a receiver is told it may have moved since its last fix,
+   in metres, when it is given that fix to start from */
+#define AIDING_ACCURACY 100000
+
+/* Network devices retry with the delay doubling between these */
+#define RECONNECT_MIN 1000
+#define RECONNECT_MAX 60000
+
+/* The largest UDP payload, so a datagram is never cut short */
+#define MAX_DATAGRAM_SIZE 65535
+
+/* Mean radius for distances between fixes, in metres */
+#define EARTH_MEAN_RADIUS 6371008.8
+#define deg2rad(x) ((x) * G_PI / 180.0)
+
+/* The signals that are sent at a subscriber's own rate */
+typedef enum {
+	LIMITED_POSITION,
+	LIMITED_COURSE,
+	LIMITED_ACCURACY,
+	LIMITED_SATELLITES,
+	LIMITED_LAST
+} LimitedSignal;
+
+typedef struct _GypsyClientSubscriber {
+	GypsyClient *client;
+	char *sender;
+
+	GypsyClientInterest interests;
+
+	/* The least time in ms between two of each of the limited signals,
+	   or 0 to get them all. Changes in between are coalesced and the
+	   latest values sent once the interval is up */
+	guint min_interval;
+	gint64 last_sent[LIMITED_LAST];
+	guint pending; /* Bitmask of LimitedSignal */
+	guint32 flush_id;
+} GypsyClientSubscriber;
+
+/* Climb is the slope through the altitudes of the last CLIMB_WINDOW
+   seconds, to smooth out the receiver's noise, or between the last two
+   for a receiver slower than that. After CLIMB_MAX_GAP seconds without
+   an altitude the old ones say nothing about the climb now */
+#define CLIMB_SAMPLES 32
+#define CLIMB_WINDOW 2.0
+#define CLIMB_MAX_GAP 10.0
+
+typedef struct _ClimbSample {
+	double time; /* seconds */
+	double altitude;
+} ClimbSample;
+
+/* The measurements in an epoch that go into the smoothing filter */
+typedef enum {
+	SMOOTHED_POSITION = 1 << 0,
+	SMOOTHED_ALTITUDE = 1 << 1,
+	SMOOTHED_VELOCITY = 1 << 2
+} SmoothedInputs;
+
 typedef struct _GypsyClientPrivate {
 
 	char *device_path; /* Device path of our GPS */
+
+	/* Where we are on the bus, or NULL when not registered */
+	GDBusConnection *connection;
+	char *object_path;
+	GArray *registration_ids;
+
 	int fd;	/* File descriptor used to read from the GPS */
 	GypsyDeviceType type;
 
 	GIOChannel *channel; /* The channel we talk to the GPS on */
-	GIOChannel *debug_log; /* The channel to write the NMEA to,
-				  or NULL if debugging is off */
+	GypsyCommandQueue *queue; /* What we write to it, once connected */
+	GypsyNmeaLog *debug_log; /* The log to write the NMEA to,
+				    or NULL if debugging is off */
+	GByteArray *capture_record; /* Scratch space for capture records */
+	GypsyRawStream *raw_stream; /* Readers of the raw data, or NULL */
+	GypsyShmPublisher *shm; /* Where the fix is published for libgypsy */
 
 	guint32 error_id, connect_id, input_id;
 
@@ -101,18 +200,107 @@ typedef struct _GypsyClientPrivate {
 	/* For serial devices */
 	speed_t baudrate;
 
+	/* From the device's section of the config file */
+	GypsyProtocol protocol;
+	guint update_rate;
+	char *log_prefix;
+	gboolean power_down;
+	gboolean standby; /* The last session left the receiver in standby */
+	GypsyCommands commands;
+	char *assistance_path;
+	char *corrections_path;
+
+	/* The assistance being sent and the InjectAssistance to answer */
+	GypsyAssistance *assistance;
+	GDBusMethodInvocation *assistance_invocation;
+
+	/* Forwarding RTCM to the receiver, or NULL */
+	GypsyCorrections *corrections;
+
+	/* For replay:// devices */
+	GypsyCaptureReader *replay_reader;
+	GypsyCaptureReplay *replay;
+	double replay_speed;
+	gboolean replay_loop;
+
+	/* For sim:// devices */
+	GypsySimulator *simulator;
+
+	/* For tcp:// and udp:// devices */
+	guint32 reconnect_id;
+	guint reconnect_delay;
+
+	/* Subscribers and the sentences we asked the receiver for */
+	GHashTable *subscribers; /* sender -> GypsyClientSubscriber */
+	int limited_count; /* Subscribers with a minimum interval */
+	gboolean prune_sentences;
+	NMEASentences output_profile;
+
+	/* Readers the sentences can't be pruned for, as
+	   they don't say what they need */
+	guint consumers; /* gpsd watchers */
+	guint raw_readers;
+
 	/* Fix details */
 	int timestamp;
 	FixType fix_type;
+	FixQuality fix_quality;
+	double dgps_age; /* Seconds, -1 if not known */
+	int dgps_station; /* -1 if not known */
 
 	/* Position details */
+	gboolean stale; /* Read back from the state file, not
+			   from the receiver since it started */
 	PositionFields position_fields;
 	double latitude;
 	double longitude;
 	double altitude;
 
-	/* For calculating climb */
-	int last_alt_timestamp;
+	/* The fraction of a second to add to timestamp, for receivers
+	   that give one */
+	double timestamp_fraction;
+
+	/* For calculating climb, unless the receiver sends its own */
+	gboolean native_climb;
+	ClimbSample climb_samples[CLIMB_SAMPLES];
+	int climb_sample_count;
+	gint64 climb_sample_time; /* Monotonic time of the last sample */
+	guint32 climb_stale_id; /* Unsets the climb once it's too old */
+
+	/* How far and how long after the last PositionChanged the position
+	   has to have moved before another is emitted. 0 for any change */
+	double min_distance; /* metres */
+	double min_altitude; /* metres, defaults to min_distance */
+	guint min_time; /* ms */
+
+	/* The position in the last PositionChanged */
+	PositionFields emitted_fields;
+	double emitted_latitude;
+	double emitted_longitude;
+	double emitted_altitude;
+	gint64 emitted_time;
+	guint32 position_id; /* A position held back by MinTime */
+
+	/* When the last two of the receiver's epochs arrived, monotonic
+	   microseconds, and the position before the current one. For
+	   GetPositionAt, fix_time is 0 until there's a live position */
+	gint64 fix_time;
+	int fix_timestamp;
+	gint64 previous_time;
+	PositionFields previous_fields;
+	double previous_latitude;
+	double previous_longitude;
+	double previous_altitude;
+
+	/* How often PositionPredicted is emitted, in ms, or 0 for never */
+	guint prediction_interval;
+	guint32 prediction_id;
+
+	/* The filter behind the Smoothed interface, or NULL if smoothing is
+	   off, and what of the current epoch has been given to it */
+	GypsyKalman *kalman;
+	SmoothedInputs smoothed_inputs;
+	guint32 smoothed_id;
 
 	/* Accuracy details */
 	AccuracyFields accuracy_fields;
@@ -126,6 +314,8 @@ typedef struct _GypsyClientPrivate {
 	double direction;
 	double climb;
 
+	guint32 course_id; /* CourseChanged waiting for the rest of the epoch */
+
 	/* Satellite details */
 	int sat_count; /* The known confirmed satellites */
 	GypsyClientSatellite satellites[MAX_SAT_SVID];
@@ -154,909 +344,3199 @@ static guint32 signals[LAST_SIGNAL] = {0, };
 G_DEFINE_TYPE (GypsyClient, gypsy_client, G_TYPE_OBJECT);
 
 #define GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), GYPSY_TYPE_CLIENT, GypsyClientPrivate))
-#define GYPSY_CLIENT_SATELLITES_CHANGED_TYPE (dbus_g_type_get_struct ("GValueArray", G_TYPE_UINT, G_TYPE_BOOLEAN, G_TYPE_UINT, G_TYPE_UINT, G_TYPE_UINT, G_TYPE_INVALID))
-
-static gboolean gypsy_client_set_start_options (GypsyClient *client,
-						GHashTable  *options,
-						GError     **error);
-static gboolean gypsy_client_start (GypsyClient *client,
-				    GError     **error);
-static gboolean gypsy_client_stop (GypsyClient *client,
-				   GError     **error);
-static gboolean gypsy_client_get_fix_status (GypsyClient *client,
-					     int         *fix_status,
-					     GError     **error);
-static gboolean gypsy_client_get_connection_status (GypsyClient *client,
-						    gboolean    *connected,
-						    GError     **error);
-static gboolean gypsy_client_get_accuracy (GypsyClient *client,
-					   int         *fields_OUT,
-					   double      *pdop_OUT,
-					   double      *hdop_OUT,
-					   double      *vdop_OUT,
-					   GError     **error);
-static gboolean gypsy_client_get_position (GypsyClient *client,
-					   int         *fields_OUT,
-					   int         *timestamp_OUT,
-					   double      *latitude_OUT,
-					   double      *longitude_OUT,
-					   double      *altitude_OUT,
-					   GError     **error);
-static gboolean gypsy_client_get_course (GypsyClient *client,
-					 int         *fields_OUT,
-					 int         *timestamp_OUT,
-					 double      *speed_OUT,
-					 double      *direction_OUT,
-					 double      *climb_OUT,
-					 GError     **error);
-static gboolean gypsy_client_get_satellites (GypsyClient *client,
-					     GPtrArray  **satellites_OUT,
-					     GError     **error);
-static gboolean gypsy_client_get_time (GypsyClient *client,
-				       int         *timestamp_OUT,
-				       GError     **error);
-
-#include "gypsy-client-glue.h"
 
-static void
-shutdown_connection (GypsyClient *client)
-{
-	GypsyClientPrivate *priv;
+#include "gypsy-client-introspection.h"
+
+static GDBusNodeInfo *introspection_data = NULL;
+
+static const struct {
+	const char *interface;
+	GypsyClientInterest interest;
+} interest_map[] = {
+	{ GYPSY_ACCURACY_INTERFACE, GYPSY_CLIENT_INTEREST_ACCURACY },
+	{ GYPSY_COURSE_INTERFACE, GYPSY_CLIENT_INTEREST_COURSE },
+	{ GYPSY_DEVICE_INTERFACE, GYPSY_CLIENT_INTEREST_DEVICE },
+	{ GYPSY_POSITION_INTERFACE, GYPSY_CLIENT_INTEREST_POSITION },
+	{ GYPSY_SATELLITE_INTERFACE, GYPSY_CLIENT_INTEREST_SATELLITE },
+	{ GYPSY_SMOOTHED_INTERFACE, GYPSY_CLIENT_INTEREST_SMOOTHED },
+	{ GYPSY_TIME_INTERFACE, GYPSY_CLIENT_INTEREST_TIME },
+};
 
-	priv = GET_PRIVATE (client);
+/* Each is broadcast under name, and sent to the subscribers with a
+   minimum interval under limited_name */
+static const struct {
+	const char *interface;
+	const char *name;
+	const char *limited_name;
+	GypsyClientInterest interest;
+} limited_signals[LIMITED_LAST] = {
+	{ GYPSY_POSITION_INTERFACE, "PositionChanged",
+	  "PositionChangedLimited", GYPSY_CLIENT_INTEREST_POSITION },
+	{ GYPSY_COURSE_INTERFACE, "CourseChanged",
+	  "CourseChangedLimited", GYPSY_CLIENT_INTEREST_COURSE },
+	{ GYPSY_ACCURACY_INTERFACE, "AccuracyChanged",
+	  "AccuracyChangedLimited", GYPSY_CLIENT_INTEREST_ACCURACY },
+	{ GYPSY_SATELLITE_INTERFACE, "SatellitesChanged",
+	  "SatellitesChangedLimited", GYPSY_CLIENT_INTEREST_SATELLITE },
+};
 
-	if (priv->error_id > 0) {
-		g_source_remove (priv->error_id);
-		priv->error_id = 0;
-	}
+static gboolean
+lookup_interest (const char          *interface,
+		 GypsyClientInterest *interest)
+{
+	int i;
 
-	if (priv->connect_id > 0) {
-		g_source_remove (priv->connect_id);
-		priv->connect_id = 0;
+	for (i = 0; i < G_N_ELEMENTS (interest_map); i++) {
+		if (g_str_equal (interest_map[i].interface, interface)) {
+			*interest = interest_map[i].interest;
+			return TRUE;
+		}
 	}
 
-	if (priv->input_id > 0) {
-		g_source_remove (priv->input_id);
-		priv->input_id = 0;
+	return FALSE;
+}
+
+static NMEASentences
+sentences_for_interests (GypsyClientInterest interests)
+{
+	NMEASentences sentences;
+
+	/* RMC and GGA carry the time, position, course and fix type,
+	   so they are always needed */
+	sentences = NMEA_SENTENCE_RMC | NMEA_SENTENCE_GGA;
+
+	/* GSA has the DOPs and the satellites used in the fix. Smoothing
+	   weighs the altitude by the VDOP, which only GSA has */
+	if (interests & (GYPSY_CLIENT_INTEREST_ACCURACY |
+			 GYPSY_CLIENT_INTEREST_SATELLITE |
+			 GYPSY_CLIENT_INTEREST_SMOOTHED)) {
+		sentences |= NMEA_SENTENCE_GSA;
 	}
 
-	if (priv->channel) {
-		g_io_channel_shutdown (priv->channel, TRUE, NULL);
-		g_io_channel_unref (priv->channel);
-		priv->channel = NULL;
+	if (interests & GYPSY_CLIENT_INTEREST_SATELLITE) {
+		sentences |= NMEA_SENTENCE_GSV;
 	}
 
-	if (priv->debug_log) {
-		g_io_channel_shutdown (priv->channel, TRUE, NULL);
-		g_io_channel_unref (priv->debug_log);
-		priv->debug_log = NULL;
+	return sentences;
+}
+
+static void
+command_done (GypsyCommandQueue *queue,
+	      GypsyCommandResult result,
+	      gpointer           userdata)
+{
+	if (result != GYPSY_COMMAND_OK) {
+		GYPSY_NOTE (CLIENT, "Error sending %s: %s",
+			    (const char *) userdata,
+			    gypsy_command_result_to_string (result));
 	}
+}
 
-	if (priv->fd > 0) {
-		close (priv->fd);
-		priv->fd = -1;
+/* Unless the device database or config file says which chipset is on
+   the other end, send both the MTK and the u-blox form of a command.
+   Each receiver ignores the other's, so then neither is waited for */
+static void
+send_commands (GypsyCommandQueue *queue,
+	       GypsyCommands      commands,
+	       const char        *pmtk,
+	       GByteArray        *ubx,
+	       const char        *what)
+{
+	gboolean known = (commands != GYPSY_COMMANDS_UNKNOWN);
+	gsize offset, length;
+
+	if (!known || (commands & GYPSY_COMMANDS_MTK)) {
+		gypsy_command_queue_push (queue, (const guint8 *) pmtk,
+					  strlen (pmtk),
+					  known ? GYPSY_COMMAND_ACK_PMTK :
+					  GYPSY_COMMAND_ACK_NONE,
+					  command_done, (gpointer) what);
 	}
 
-	if (priv->parser) {
-		g_object_unref (priv->parser);
-		priv->parser = NULL;
+	if (known && !(commands & GYPSY_COMMANDS_UBX)) {
+		return;
 	}
 
-#ifdef ENABLE_N810
-	/* Turn off the N810's GPS device */
-	if (g_ascii_strcasecmp (priv->device_path, N810_INTERNAL_GPS_PATH) == 0) {
-		GYPSY_NOTE (CLIENT, "N810 chip off");
-		gpsctrl_set_chip_off ();
+	/* One packet at a time so each can be acknowledged */
+	for (offset = 0; offset + 8 <= ubx->len; offset += length) {
+		const guint8 *packet = ubx->data + offset;
+
+		length = MIN ((packet[4] | packet[5] << 8) + 8,
+			      ubx->len - offset);
+		gypsy_command_queue_push (queue, packet, length,
+					  known ?
+					  gypsy_command_ack_for (packet,
+								 length) :
+					  GYPSY_COMMAND_ACK_NONE,
+					  command_done, (gpointer) what);
 	}
-#endif /* ENABLE_N810 */
 }
 
-static gboolean
-gps_channel_error (GIOChannel  *channel,
-		   GIOCondition condition,
-		   gpointer     userdata)
+static void
+send_output_profile (GypsyCommandQueue *queue,
+		     GypsyCommands      commands,
+		     NMEASentences      sentences)
 {
-	GypsyClient *client;
-	GypsyClientPrivate *priv;
+	GByteArray *ubx;
+	char *pmtk;
 
-	client = (GypsyClient *) userdata;
-	priv = GET_PRIVATE (userdata);
+	if (sentences == NMEA_SENTENCE_DEFAULT) {
+		pmtk = nmea_profile_build_pmtk314_default ();
+	} else {
+		pmtk = nmea_profile_build_pmtk314 (sentences);
+	}
+	ubx = nmea_profile_build_ubx_cfg_msg (sentences);
 
-	GYPSY_NOTE (CLIENT, "Error on connection to %s", priv->device_path);
-	shutdown_connection ((GypsyClient *) userdata);
+	send_commands (queue, commands, pmtk, ubx, "output profile");
 
-	g_signal_emit (G_OBJECT (client), signals[CONNECTION_CHANGED],
-		       0, FALSE);
+	g_free (pmtk);
+	g_byte_array_free (ubx, TRUE);
+}
 
-	return FALSE;
+static void
+send_update_rate (GypsyCommandQueue *queue,
+		  GypsyCommands      commands,
+		  guint              rate)
+{
+	GByteArray *ubx;
+	char *pmtk;
+
+	pmtk = nmea_profile_build_pmtk220 (1000 / rate);
+	ubx = nmea_profile_build_ubx_cfg_rate (1000 / rate);
+
+	send_commands (queue, commands, pmtk, ubx, "update rate");
+
+	g_free (pmtk);
+	g_byte_array_free (ubx, TRUE);
 }
 
-static gboolean
-gps_channel_input (GIOChannel  *channel,
-		   GIOCondition condition,
-		   gpointer     userdata)
+/* Tells the receiver the time and the last known position, so it can
+   work out which satellites should be up and get a fix sooner */
+static void
+send_aiding (GypsyCommandQueue *queue,
+	     GypsyCommands      commands,
+	     double             latitude,
+	     double             longitude,
+	     double             altitude)
 {
-	GypsyClientPrivate *priv;
-	GIOStatus status;
-	char *buf;
-	gsize chars_left_in_buffer, chars_read;
-	GError *error = NULL;
+	GDateTime *now;
+	GByteArray *ubx, *ubx_time;
+	char *pmtk;
 
-	priv = GET_PRIVATE (userdata);
+	now = g_date_time_new_now_utc ();
 
-	chars_left_in_buffer = gypsy_parser_get_buffer (priv->parser, &buf);
-	status = g_io_channel_read_chars (priv->channel,
-					  (char *) buf,
-					  chars_left_in_buffer,
-					  &chars_read,
-					  &error);
-	if (priv->debug_log) {
-		g_io_channel_write_chars (priv->debug_log, buf,
-					  chars_read, NULL, NULL);
-	}
+	pmtk = nmea_profile_build_pmtk741 (latitude, longitude, altitude, now);
+	ubx = nmea_profile_build_ubx_mga_ini_pos (latitude, longitude,
+						  altitude, AIDING_ACCURACY);
 
-	if (status == G_IO_STATUS_NORMAL) {
-		gypsy_parser_received_data (priv->parser, chars_read, NULL);
-	} else {
-		GYPSY_NOTE (CLIENT, "Read error on channel %p %d: %s (%s)", priv->channel, status, error->message, g_strerror (errno));
-		g_error_free (error);
-	}
+	/* The time goes first for u-blox, PMTK741 has both */
+	ubx_time = nmea_profile_build_ubx_mga_ini_time (now);
+	g_byte_array_prepend (ubx, ubx_time->data, ubx_time->len);
+	g_byte_array_free (ubx_time, TRUE);
 
-	return TRUE;
+	send_commands (queue, commands, pmtk, ubx, "aiding");
+
+	g_free (pmtk);
+	g_byte_array_free (ubx, TRUE);
+	g_date_time_unref (now);
 }
 
-/* Returns TRUE/FALSE to indicate success/error */
-static gboolean
-garmin_usb_device (GIOChannel *channel,
-		   char      *devpath,
-		   gboolean  *device_is_garmin)
+/* Both receivers wake up on the next thing written to them, which
+   send_wake_up writes when the device is started again */
+static void
+send_standby (GypsyCommandQueue *queue,
+	      GypsyCommands      commands)
 {
-	GIOStatus status;
-	u_int32_t privcmd[GARMIN_PRIV_PKT_MAX_SIZE];
-	gsize chars_written;
-	gsize chars_read;
+	GByteArray *ubx;
+	char *pmtk;
 
-	/*
-	 *  Since the Garmin driver sets up the device at /dev/ttyUSB<n> it seems
-	 *  to be a pretty good bet that this check will be valid.
-	 *
-	 *  FIXME: Use gudev to get the VID of the device, and check against Garmin?
-	 */
+	pmtk = nmea_profile_build_pmtk161_standby ();
+	ubx = nmea_profile_build_ubx_rxm_pmreq ();
 
-	*device_is_garmin = FALSE;
-	if (! strcmp (devpath, "/dev/ttyUSB0")) {
+	send_commands (queue, commands, pmtk, ubx, "standby");
 
-		/* query the device driver to see if it is Garmin */
+	g_free (pmtk);
+	g_byte_array_free (ubx, TRUE);
+}
 
-		privcmd[0] = GARMIN_LAYERID_PRIVATE;		// LayerId
-		privcmd[1] = GARMIN_PRIV_PKTID_INFO_REQ;	// PacketId
-		privcmd[2] = 0;					// DataLength
+/* u-blox receivers can miss the first bytes while they wake up, so
+   some filler that neither receiver takes for a command goes first,
+   then the default output profile in case it was pruned before */
+static void
+send_wake_up (GypsyCommandQueue *queue,
+	      GypsyCommands      commands)
+{
+	static const guint8 filler[] = {
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+	};
+
+	gypsy_command_queue_push (queue, filler, sizeof (filler),
+				  GYPSY_COMMAND_ACK_NONE, command_done,
+				  "wake up");
+	send_output_profile (queue, commands, NMEA_SENTENCE_DEFAULT);
+}
 
-		status = g_io_channel_write_chars (channel,
-						   (gchar*)privcmd,
-						   12,
-						   &chars_written,
-						   NULL);
+static void
+update_output_profile (GypsyClient *client)
+{
+	GypsyClientPrivate *priv;
+	NMEASentences wanted;
 
-		if (status != G_IO_STATUS_NORMAL) {
-			g_warning ("GARMIN: Error writing \"Private Info Req\" packet:\n%s",
-				   g_strerror (errno));
-			return FALSE;
-		}
+	priv = GET_PRIVATE (client);
 
-		g_io_channel_flush (channel, NULL);
+	/* Only NMEA serial receivers can be configured,
+	   and only once we know that's what we're talking to */
+	if (priv->queue == NULL || priv->parser == NULL ||
+	    priv->type != GYPSY_DEVICE_TYPE_SERIAL) {
+		return;
+	}
 
-		/* check the response */
+	if (priv->prune_sentences && priv->consumers == 0 &&
+	    priv->raw_readers == 0 &&
+	    g_hash_table_size (priv->subscribers) > 0) {
+		GypsyClientInterest interests = GYPSY_CLIENT_INTEREST_NONE;
+		GHashTableIter iter;
+		gpointer value;
 
-		status = g_io_channel_read_chars (channel,
-						  (gchar*)privcmd,
-						  GARMIN_PRIV_PKT_INFO_RESP_SIZE,
-						  &chars_read,
-						  NULL);
+		g_hash_table_iter_init (&iter, priv->subscribers);
+		while (g_hash_table_iter_next (&iter, NULL, &value)) {
+			GypsyClientSubscriber *subscriber = value;
 
-		if (status != G_IO_STATUS_NORMAL) {
-			g_message ("GARMIN: Error reading \"Private Info Resp\" packet: %s", g_strerror (errno));
-			return TRUE;
+			interests |= subscriber->interests;
 		}
 
-		if ((privcmd[0] == GARMIN_LAYERID_PRIVATE) &&
-		    (privcmd[1] == GARMIN_PRIV_PKTID_INFO_RESP)) {
-			/* we're talking to the Garmin driver */
-			GYPSY_NOTE (CLIENT, "GARMIN: device type confirmed");
-			*device_is_garmin = TRUE;
-			return TRUE;
-		} else {
-			GYPSY_NOTE (CLIENT, "GARMIN: \"Private Info Resp\" packet data not recognized");
-			return TRUE;
-		}
+		wanted = sentences_for_interests (interests);
+	} else {
+		wanted = NMEA_SENTENCE_DEFAULT;
 	}
 
-	return TRUE;
+	if (wanted == priv->output_profile) {
+		return;
+	}
+
+	GYPSY_NOTE (CLIENT, "Changing output profile of %s from 0x%x to 0x%x",
+		    priv->device_path, priv->output_profile, wanted);
+	send_output_profile (priv->queue, priv->commands, wanted);
+	priv->output_profile = wanted;
 }
 
-static gboolean
-garmin_init (GIOChannel *channel)
+static void
+raw_readers_changed (GypsyRawStream *stream,
+		     guint           readers,
+		     gpointer        userdata)
 {
-	GIOStatus status;
-	u_int32_t privcmd[GARMIN_PRIV_PKT_MAX_SIZE];
-	gsize chars_written;
-	GError *error = NULL;
-	G_Packet_t *pvtpack;
+	GypsyClientPrivate *priv;
 
-	GYPSY_NOTE (CLIENT, "GARMIN: initialize device");
+	priv = GET_PRIVATE (userdata);
 
-	/* set the device driver mode to "native" */
-	/* (without this, the device will not talk to us) */
+	priv->raw_readers = readers;
+	update_output_profile (GYPSY_CLIENT (userdata));
+}
 
-	privcmd[0] = GARMIN_LAYERID_PRIVATE;		/* LayerId */
-	privcmd[1] = GARMIN_PRIV_PKTID_SET_MODE;	/* PacketId */
-	privcmd[2] = 4;					/* DataLength */
-	privcmd[3] = GARMIN_MODE_NATIVE;		/* data */
+/* Copies everything we know into the shared memory segment */
+static void
+publish_fix (GypsyClient *client)
+{
+	GypsyClientPrivate *priv;
 
-	status = g_io_channel_write_chars (channel,
-					   (char*)privcmd,
-					   16,
-					   &chars_written,
-					   NULL);
+	priv = GET_PRIVATE (client);
 
-	if (status != G_IO_STATUS_NORMAL) {
-		GYPSY_NOTE (CLIENT, "GARMIN: Error writing \"Private Set Mode\" packet:\n%s", g_strerror (errno));
-		g_set_error (&error, GYPSY_ERROR, errno, g_strerror (errno));
-		return FALSE;
+	if (priv->shm == NULL) {
+		return;
 	}
 
-	g_io_channel_flush (channel, NULL);
+	gypsy_client_get_fix (client, gypsy_shm_publisher_begin (priv->shm));
+	gypsy_shm_publisher_commit (priv->shm);
+}
 
-	/* start PVT transfers */
+/* Takes the floating parameters, and drops them
+   if we aren't on a bus */
+static void
+emit_dbus_signal (GypsyClient *client,
+		  const char  *interface,
+		  const char  *name,
+		  GVariant    *parameters)
+{
+	GypsyClientPrivate *priv;
 
-	pvtpack = (G_Packet_t*)malloc(sizeof(G_Packet_t)+1);
+	priv = GET_PRIVATE (client);
 
-	pvtpack->mPacketType = LAYERID_APPL;
-	pvtpack->mReserved1  = 0;
-	pvtpack->mReserved2  = 0;
-	pvtpack->mPacketId   = Pid_Command_Data;
-	pvtpack->mReserved3  = 0;
-	pvtpack->mDataSize   = 2;
-	pvtpack->mData[0]    = Cmnd_Start_Pvt_Data;
-	pvtpack->mData[1]    = 0;
+	if (priv->connection == NULL) {
+		g_variant_unref (g_variant_ref_sink (parameters));
+		return;
+	}
 
-	status = g_io_channel_write_chars (channel,
-					   (gchar*)pvtpack,
-					   GARMIN_HEADER_SIZE + pvtpack->mDataSize,
-					   &chars_written,
-					   NULL);
+	g_dbus_connection_emit_signal (priv->connection, NULL,
+				       priv->object_path, interface, name,
+				       parameters, NULL);
+}
 
-	if (status != G_IO_STATUS_NORMAL) {
-		GYPSY_NOTE (CLIENT, "GARMIN: Error writing \"Start PVT Transfer\" packet:\n%s", g_strerror (errno));
-		g_set_error (&error, GYPSY_ERROR, errno, g_strerror (errno));
-		return FALSE;
+static void
+emit_connection_changed (GypsyClient *client,
+			 gboolean     connected)
+{
+	g_signal_emit (G_OBJECT (client), signals[CONNECTION_CHANGED],
+		       0, connected);
+	emit_dbus_signal (client, GYPSY_DEVICE_INTERFACE,
+			  "ConnectionStatusChanged",
+			  g_variant_new ("(b)", connected));
+}
+
+static GVariant *
+build_satellites (GypsyClientPrivate *priv)
+{
+	GVariantBuilder builder;
+	int i;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ubuuu)"));
+	for (i = 0; i < priv->sat_count; i++) {
+		GypsyClientSatellite *sat = &priv->satellites[i];
+
+		g_variant_builder_add (&builder, "(ubuuu)",
+				       sat->satellite_id, sat->in_use,
+				       sat->elevation, sat->azimuth,
+				       sat->snr);
 	}
 
-	g_io_channel_flush (channel, NULL);
+	return g_variant_builder_end (&builder);
+}
 
-	free((void*)pvtpack);
+/* The arguments of one of the limited signals, which are
+   also the reply to the matching Get method */
+static GVariant *
+build_limited_signal (GypsyClientPrivate *priv,
+		      LimitedSignal       which)
+{
+	GVariant *satellites;
 
-	return TRUE;
+	switch (which) {
+	case LIMITED_POSITION:
+		return g_variant_new ("(iiddd)", priv->position_fields,
+				      priv->timestamp, priv->latitude,
+				      priv->longitude, priv->altitude);
+
+	case LIMITED_COURSE:
+		return g_variant_new ("(iiddd)", priv->course_fields,
+				      priv->timestamp, priv->speed,
+				      priv->direction, priv->climb);
+
+	case LIMITED_ACCURACY:
+		return g_variant_new ("(iddd)", priv->accuracy_fields,
+				      priv->pdop, priv->hdop, priv->vdop);
+
+	case LIMITED_SATELLITES:
+		satellites = build_satellites (priv);
+		return g_variant_new_tuple (&satellites, 1);
+
+	default:
+		break;
+	}
+
+	g_assert_not_reached ();
+	return NULL;
 }
 
-static gboolean
-gps_channel_connect (GIOChannel  *channel,
-		     GIOCondition condition,
-		     gpointer     userdata)
+static void
+send_to_subscriber (GypsyClient           *client,
+		    GypsyClientSubscriber *subscriber,
+		    LimitedSignal          which,
+		    GVariant              *parameters,
+		    gint64                 now)
 {
 	GypsyClientPrivate *priv;
-	gboolean ret, device_is_garmin;
 
-	priv = GET_PRIVATE (userdata);
+	priv = GET_PRIVATE (client);
 
-	GYPSY_NOTE (CLIENT, "GPS channel can connect");
+	g_dbus_connection_emit_signal (priv->connection, subscriber->sender,
+				       priv->object_path,
+				       limited_signals[which].interface,
+				       limited_signals[which].limited_name,
+				       parameters, NULL);
+	subscriber->last_sent[which] = now;
+	subscriber->pending &= ~(1 << which);
+}
 
-	ret = FALSE;
-	device_is_garmin = FALSE;
-	if (priv->type == GYPSY_DEVICE_TYPE_SERIAL) {
-		ret = garmin_usb_device (channel, priv->device_path,
-					 &device_is_garmin);
-		if (ret == FALSE) {
-			/* we got an error trying to figure it out */
-			GYPSY_NOTE (CLIENT,
-				    "Error determining device type for %s",
-				    priv->device_path);
-			/* g_set_error () has already been called */
-			goto end;
-		}
-	}
+static void schedule_flush (GypsyClientSubscriber *subscriber,
+			    gint64                 now);
 
-	if (device_is_garmin) {
-		priv->type = GYPSY_DEVICE_TYPE_GARMIN;
-		priv->parser = gypsy_garmin_parser_new (GYPSY_CLIENT (userdata));
-		garmin_init (channel);
-	} else {
-		priv->parser = gypsy_nmea_parser_new (GYPSY_CLIENT (userdata));
+/* Sends the latest values for the signals held back while
+   the subscriber's interval was running */
+static gboolean
+flush_subscriber (gpointer userdata)
+{
+	GypsyClientSubscriber *subscriber = userdata;
+	GypsyClientPrivate *priv;
+	gint64 now;
+	int i;
+
+	priv = GET_PRIVATE (subscriber->client);
+	subscriber->flush_id = 0;
+
+	if (priv->connection == NULL) {
+		subscriber->pending = 0;
+		return FALSE;
 	}
 
-	priv->input_id = g_io_add_watch_full (priv->channel,
-					      G_PRIORITY_HIGH_IDLE,
-					      G_IO_IN | G_IO_PRI,
-					      gps_channel_input,
-					      userdata, NULL);
+	now = g_get_monotonic_time () / 1000;
+	for (i = 0; i < LIMITED_LAST; i++) {
+		if ((subscriber->pending & (1 << i)) &&
+		    now - subscriber->last_sent[i] >= subscriber->min_interval) {
+			send_to_subscriber (subscriber->client, subscriber, i,
+					    build_limited_signal (priv, i),
+					    now);
+		}
+	}
 
-end:
-	g_signal_emit (G_OBJECT (userdata), signals[CONNECTION_CHANGED],
-		       0, TRUE);
+	if (subscriber->pending) {
+		schedule_flush (subscriber, now);
+	}
 
-	priv->connect_id = 0;
 	return FALSE;
 }
 
-static gboolean
-gypsy_client_set_start_options (GypsyClient *client,
-				GHashTable  *options,
-				GError     **error)
+static void
+schedule_flush (GypsyClientSubscriber *subscriber,
+		gint64                 now)
 {
-	GypsyClientPrivate *priv;
-	GList *keys, *l;
-
-	priv = GET_PRIVATE (client);
-
-	keys = g_hash_table_get_keys (options);
-	for (l = keys; l != NULL; l = l->next) {
-		if (g_str_equal (l->data, "BaudRate")) {
-			GValue *value = g_hash_table_lookup (options, "BaudRate");
-			guint rate;
+	gint64 due = G_MAXINT64;
+	int i;
 
-			if (priv->channel != NULL) {
-				g_set_error (error, GYPSY_ERROR, 0, "Device already started");
-				g_list_free (keys);
-				return FALSE;
-			}
+	if (subscriber->flush_id > 0) {
+		return;
+	}
 
-			rate = g_value_get_uint (value);
-			switch (rate) {
-			case 4800:
-				priv->baudrate = B4800;
-				break;
-			case 9600:
-				priv->baudrate = B9600;
-				break;
-			case 19200:
-				priv->baudrate = B19200;
-				break;
-			case 38400:
-				priv->baudrate = B38400;
-				break;
-			case 57600:
-				priv->baudrate = B57600;
-				break;
-			case 115200:
-				priv->baudrate = B115200;
-				break;
-			default:
-				GYPSY_NOTE (CLIENT,
-					    "Unsupported baud rate '%d'",
-					    rate);
-				g_set_error (error, GYPSY_ERROR, 0, "Unsupported baud rate '%d'", rate);
-				g_list_free (keys);
-				return FALSE;
-			}
-		} else {
-			GYPSY_NOTE (CLIENT,
-				    "Unsupported option key '%s'", l->data);
+	for (i = 0; i < LIMITED_LAST; i++) {
+		if (subscriber->pending & (1 << i)) {
+			due = MIN (due, subscriber->last_sent[i] +
+				   subscriber->min_interval);
 		}
 	}
-	g_list_free (keys);
 
-	return TRUE;
+	subscriber->flush_id = g_timeout_add (MAX (due - now, 0),
+					      flush_subscriber, subscriber);
 }
 
-static gboolean
-gypsy_client_start (GypsyClient *client,
-		    GError     **error)
+/* Broadcasts one of the limited signals, and sends it directly to
+   each subscriber with a minimum interval as often as it asked for */
+static void
+emit_limited_signal (GypsyClient  *client,
+		     LimitedSignal which)
 {
 	GypsyClientPrivate *priv;
-	GIOStatus status;
+	GHashTableIter iter;
+	GVariant *parameters;
+	gpointer value;
+	gint64 now;
 
 	priv = GET_PRIVATE (client);
 
-	if (priv->fd != -1) {
-		GYPSY_NOTE (CLIENT, "Connection to %s already started",
-			       priv->device_path);
-		return TRUE;
-	}
-	else {
-		GYPSY_NOTE (CLIENT, "Starting connection to %s",
-			       priv->device_path);
-	}
+	emit_dbus_signal (client, limited_signals[which].interface,
+			  limited_signals[which].name,
+			  build_limited_signal (priv, which));
 
-	/* Enable the N810's internal GPS */
-#ifdef ENABLE_N810
-		if (g_ascii_strcasecmp (priv->device_path, N810_INTERNAL_GPS_PATH) == 0) {
-			GYPSY_NOTE (CLIENT, "N810 chip on");
-			gpsctrl_set_chip_on ();
-		}
-#endif /* ENABLE_N810 */
+	if (priv->limited_count == 0 || priv->connection == NULL) {
+		return;
+	}
 
-	/* Open a connection to our device */
+	parameters = NULL;
+	now = g_get_monotonic_time () / 1000;
 
-	/* we assume that a device path starting with slash is a tty device or
-	 * a FIFO */
-	if (priv->device_path[0] == '/') {
-		priv->fd = open (priv->device_path, O_RDONLY | O_NOCTTY | O_NONBLOCK);
-		if (priv->fd != -1 && isatty (priv->fd)) {
-			/* Reopen read-write for TTY devices,
-			 * we'll be detecting whether it's garmin later */
-			priv->type = GYPSY_DEVICE_TYPE_SERIAL;
-			close (priv->fd);
-			priv->fd = open (priv->device_path, O_RDWR | O_NOCTTY | O_NONBLOCK);
-		} else {
-			priv->type = GYPSY_DEVICE_TYPE_FIFO;
-		}
+	g_hash_table_iter_init (&iter, priv->subscribers);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		GypsyClientSubscriber *subscriber = value;
 
-		if (priv->fd == -1) {
-			g_warning ("Error opening device %s: %s", priv->device_path, g_strerror (errno));
-			g_set_error (error, GYPSY_ERROR, errno, g_strerror (errno));
-			return FALSE;
+		if (subscriber->min_interval == 0 ||
+		    (subscriber->interests &
+		     limited_signals[which].interest) == 0) {
+			continue;
 		}
 
-		if (priv->type == GYPSY_DEVICE_TYPE_SERIAL) {
-			struct termios term;
-
-			if (tcgetattr (priv->fd, &term) < 0) {
-				g_warning ("Error getting term: %s", g_strerror (errno));
-				g_set_error (error, GYPSY_ERROR, errno, g_strerror (errno));
-				return FALSE;
-			}
-
-			cfmakeraw(&term);
-			if (priv->baudrate != B0)
-				cfsetispeed(&term, priv->baudrate);
-
-			if (tcsetattr (priv->fd, TCSAFLUSH, &term) < 0) {
-				g_warning ("Error setting term: %s", g_strerror (errno));
-				g_set_error (error, GYPSY_ERROR, errno, g_strerror (errno));
-				return FALSE;
+		if (now - subscriber->last_sent[which] >= subscriber->min_interval) {
+			if (parameters == NULL) {
+				parameters = g_variant_ref_sink
+					(build_limited_signal (priv, which));
 			}
-		}
-	} else {
-		priv->type = GYPSY_DEVICE_TYPE_BLUETOOTH;
-#ifdef HAVE_BLUEZ
-		priv->fd = socket (AF_BLUETOOTH, SOCK_STREAM, BTPROTO_RFCOMM);
-#else
-		g_warning ("Trying to connect to a Bluetooth GPS but Gypsy does not have Bluetooth support");
-		return FALSE;
-#endif
-	}
 
-	if (nmea_log) {
-		if (g_str_equal (nmea_log, "stdout") ||
-		    g_str_equal (nmea_log, "-")) {
-			priv->debug_log = g_io_channel_unix_new (STDOUT_FILENO);
+			send_to_subscriber (client, subscriber, which,
+					    parameters, now);
 		} else {
-			char *device, *filename;
-			device = g_path_get_basename (priv->device_path);
-			filename = g_strconcat (nmea_log, ".", device, NULL);
-			priv->debug_log = g_io_channel_new_file (filename, "w", NULL);
-			g_free (device);
-			g_free (filename);
+			subscriber->pending |= 1 << which;
+			schedule_flush (subscriber, now);
 		}
-		g_io_channel_set_encoding (priv->debug_log, NULL, NULL);
-		g_io_channel_set_buffered (priv->debug_log, FALSE);
 	}
 
-	/* Set up the IO Channel */
-
-	priv->channel = g_io_channel_unix_new (priv->fd);
-	GYPSY_NOTE (CLIENT, "Created new channel: %p", priv->channel);
-
-	status = g_io_channel_set_flags (priv->channel,
-					 G_IO_FLAG_NONBLOCK | G_IO_FLAG_IS_READABLE | G_IO_FLAG_IS_WRITEABLE,
-					 NULL);
-
-	if (status != G_IO_STATUS_NORMAL) {
-		g_warning ("Error setting flags: %s", g_strerror (errno));
-		g_set_error (error, GYPSY_ERROR, errno, g_strerror (errno));
-		return FALSE;
+	if (parameters) {
+		g_variant_unref (parameters);
 	}
+}
 
-	/* set encoding to NULL so we can do reads and writes */
-	status = g_io_channel_set_encoding (priv->channel, NULL, NULL);
+static void
+subscriber_free (gpointer data)
+{
+	GypsyClientSubscriber *subscriber = data;
 
-	if (status != G_IO_STATUS_NORMAL) {
-		g_warning ("Error setting encoding: %s", g_strerror (errno));
-		g_set_error (error, GYPSY_ERROR, errno, g_strerror (errno));
-		return FALSE;
+	if (subscriber->flush_id > 0) {
+		g_source_remove (subscriber->flush_id);
 	}
 
-	priv->error_id = g_io_add_watch_full (priv->channel,
-					      G_PRIORITY_HIGH_IDLE,
-					      G_IO_ERR | G_IO_HUP,
-					      gps_channel_error, client, NULL);
-
-	priv->connect_id = g_io_add_watch_full (priv->channel,
-						G_PRIORITY_HIGH_IDLE,
-						G_IO_OUT,
-						gps_channel_connect, client, NULL);
-
-#ifdef HAVE_BLUEZ
-	/* Now connect to the bluetooth socket */
-	if (priv->device_path[0] != '/') {
-		struct sockaddr_rc addr = { 0 };
-
-		addr.rc_family = AF_BLUETOOTH;
-		addr.rc_channel = (uint8_t) 1;
-		str2ba(priv->device_path, &addr.rc_bdaddr);
-
-		if (connect (priv->fd, (struct sockaddr *) &addr, sizeof (addr)) == -1) {
-			/* Error */
-			if (errno == EINPROGRESS || errno == EAGAIN) {
-				return TRUE;
-			}
+	g_free (subscriber->sender);
+	g_slice_free (GypsyClientSubscriber, subscriber);
+}
 
-			g_warning ("Error connecting: %s", g_strerror (errno));
-			g_set_error (error, GYPSY_ERROR, errno, g_strerror (errno));
+/* Opens the log the device's NMEA is written to, if there is one */
+static void
+open_nmea_log (GypsyClient *client)
+{
+	GypsyClientPrivate *priv;
+	GError *log_error = NULL;
+	const char *prefix;
+	char *filename;
 
-			g_source_remove (priv->error_id);
-			priv->error_id = 0;
-			g_source_remove (priv->connect_id);
-			priv->connect_id = 0;
+	priv = GET_PRIVATE (client);
 
-			g_io_channel_unref (priv->channel);
-			priv->channel = NULL;
+	prefix = priv->log_prefix ? priv->log_prefix : nmea_log;
+	if (prefix == NULL) {
+		return;
+	}
 
-			close (priv->fd);
-			priv->fd = -1;
+	if (g_str_equal (prefix, "stdout") ||
+	    g_str_equal (prefix, "-")) {
+		filename = g_strdup (prefix);
+	} else {
+		char *device;
+
+		device = g_path_get_basename (priv->device_path);
+		filename = g_strconcat (prefix, ".", device,
+					nmea_log_settings.capture ?
+					GYPSY_CAPTURE_SUFFIX : NULL,
+					NULL);
+		g_free (device);
+	}
 
-			return FALSE;
-		}
+	priv->debug_log = gypsy_nmea_log_new (filename,
+					      &nmea_log_settings,
+					      &log_error);
+	if (priv->debug_log == NULL) {
+		g_warning ("Error opening NMEA log: %s",
+			   log_error->message);
+		g_error_free (log_error);
+	} else if (nmea_log_settings.capture) {
+		gypsy_nmea_log_set_header
+			(priv->debug_log,
+			 gypsy_capture_build_header (priv->device_path));
+		priv->capture_record = g_byte_array_new ();
 	}
-#endif
-	return TRUE;
+	g_free (filename);
 }
 
-static gboolean
-gypsy_client_stop (GypsyClient *client,
-		   GError     **error)
+static void
+close_nmea_log (GypsyClient *client)
 {
 	GypsyClientPrivate *priv;
 
 	priv = GET_PRIVATE (client);
 
-	GYPSY_NOTE (CLIENT, "Stopping connection to %s", priv->device_path);
-	shutdown_connection (client);
+	if (priv->debug_log) {
+		gypsy_nmea_log_free (priv->debug_log);
+		priv->debug_log = NULL;
+	}
 
-	g_signal_emit (G_OBJECT (client), signals[CONNECTION_CHANGED],
-		       0, FALSE);
-	return TRUE;
+	if (priv->capture_record) {
+		g_byte_array_free (priv->capture_record, TRUE);
+		priv->capture_record = NULL;
+	}
 }
 
-static gboolean
-gypsy_client_get_connection_status (GypsyClient *client,
-				    gboolean    *connected,
-				    GError     **error)
+static void
+assistance_done (GypsyAssistance *assistance,
+		 guint            sent,
+		 guint            failed,
+		 gpointer         userdata)
 {
 	GypsyClientPrivate *priv;
 
-	priv = GET_PRIVATE (client);
+	priv = GET_PRIVATE (userdata);
 
-	*connected = (priv->fd > 0);
+	GYPSY_NOTE (CLIENT, "Assistance for %s: %u sent, %u failed",
+		    priv->device_path, sent, failed);
 
-	return TRUE;
+	g_dbus_method_invocation_return_value (priv->assistance_invocation,
+					       g_variant_new ("(uu)",
+							      sent, failed));
+	priv->assistance_invocation = NULL;
+
+	gypsy_assistance_free (priv->assistance);
+	priv->assistance = NULL;
 }
 
-static gboolean
-gypsy_client_get_fix_status (GypsyClient *client,
-			     int         *fix_status,
-			     GError     **error)
+/* Stops an injection when the connection goes away */
+static void
+cancel_assistance (GypsyClient *client)
 {
 	GypsyClientPrivate *priv;
 
 	priv = GET_PRIVATE (client);
 
-	*fix_status = priv->fix_type;
+	if (priv->assistance == NULL) {
+		return;
+	}
+
+	g_dbus_method_invocation_return_error (priv->assistance_invocation,
+					       GYPSY_ERROR, 0,
+					       "Device was stopped");
+	priv->assistance_invocation = NULL;
 
-	return TRUE;
+	gypsy_assistance_free (priv->assistance);
+	priv->assistance = NULL;
 }
 
-static gboolean 
-gypsy_client_get_accuracy (GypsyClient *client,
-			   int         *fields_OUT,
-			   double      *pdop_OUT,
-			   double      *hdop_OUT,
-			   double      *vdop_OUT,
-			   GError     **error)
+/* Forwarding only makes sense to an NMEA receiver we can write to */
+static void
+start_corrections (GypsyClient *client)
 {
 	GypsyClientPrivate *priv;
+	GError *error = NULL;
 
 	priv = GET_PRIVATE (client);
 
-	*fields_OUT = priv->accuracy_fields;
-	*pdop_OUT = priv->pdop;
-	*hdop_OUT = priv->hdop;
-	*vdop_OUT = priv->vdop;
+	if (priv->corrections_path == NULL || priv->corrections ||
+	    priv->queue == NULL || priv->type == GYPSY_DEVICE_TYPE_FIFO ||
+	    priv->type == GYPSY_DEVICE_TYPE_UDP ||
+	    priv->parser == NULL || !GYPSY_IS_NMEA_PARSER (priv->parser)) {
+		return;
+	}
 
-	return TRUE;
+	priv->corrections = gypsy_corrections_new (priv->corrections_path,
+						   priv->queue, &error);
+	if (priv->corrections == NULL) {
+		g_warning ("Error forwarding corrections to %s: %s",
+			   priv->device_path, error->message);
+		g_error_free (error);
+	}
 }
 
-static gboolean 
-gypsy_client_get_position (GypsyClient *client,
-			   int         *fields_OUT,
-			   int         *timestamp_OUT,
-			   double      *latitude_OUT,
-			   double      *longitude_OUT,
-			   double      *altitude_OUT,
-			   GError     **error)
+static void
+stop_corrections (GypsyClient *client)
 {
 	GypsyClientPrivate *priv;
 
 	priv = GET_PRIVATE (client);
 
-	*fields_OUT = priv->position_fields;
-	*timestamp_OUT = priv->timestamp;
-	*latitude_OUT = priv->latitude;
-	*longitude_OUT = priv->longitude;
-	*altitude_OUT = priv->altitude;
-
-	return TRUE;
+	if (priv->corrections) {
+		gypsy_corrections_free (priv->corrections);
+		priv->corrections = NULL;
+	}
 }
 
-static gboolean 
-gypsy_client_get_course (GypsyClient *client,
-			 int         *fields_OUT,
-			 int         *timestamp_OUT,
-			 double      *speed_OUT,
-			 double      *direction_OUT,
-			 double      *climb_OUT,
-			 GError     **error)
+static GVariant *
+build_correction_status (GypsyClient *client)
 {
 	GypsyClientPrivate *priv;
+	GVariantBuilder builder;
 
 	priv = GET_PRIVATE (client);
 
-	*fields_OUT = priv->position_fields;
-	*timestamp_OUT = priv->timestamp;
-	*speed_OUT = priv->speed;
-	*direction_OUT = priv->direction;
-	*climb_OUT = priv->climb;
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+	g_variant_builder_add (&builder, "{sv}", "FixQuality",
+			       g_variant_new_int32 (priv->fix_quality));
+	g_variant_builder_add (&builder, "{sv}", "ReceiverAge",
+			       g_variant_new_double (priv->dgps_age));
+	g_variant_builder_add (&builder, "{sv}", "Station",
+			       g_variant_new_int32 (priv->dgps_station));
 
-	return TRUE;
+	if (priv->corrections) {
+		gypsy_corrections_add_status (priv->corrections, &builder);
+	}
+
+	return g_variant_new ("(a{sv})", &builder);
 }
 
+/* Starts sending the device's assistance data, returning FALSE
+   if it can't, or TRUE if invocation will be answered when done */
 static gboolean
-gypsy_client_get_satellites (GypsyClient *client,
-			     GPtrArray  **satellites_OUT,
-			     GError     **error)
+inject_assistance (GypsyClient           *client,
+		   GDBusMethodInvocation *invocation,
+		   GError               **error)
 {
 	GypsyClientPrivate *priv;
-	GPtrArray *sat_array;
-	int i;
 
 	priv = GET_PRIVATE (client);
 
-	sat_array = g_ptr_array_new ();
-
-	for (i = 0; i < priv->sat_count; i++) {
-		GValue sat_struct = {0, };
-		GypsyClientSatellite *sat;
-
-		sat = &priv->satellites[i];
+	if (priv->assistance) {
+		g_set_error (error, GYPSY_ERROR, 0,
+			     "Assistance is already being sent");
+		return FALSE;
+	}
 
-		g_value_init (&sat_struct,
-			      GYPSY_CLIENT_SATELLITES_CHANGED_TYPE);
-		g_value_take_boxed (&sat_struct,
-				    dbus_g_type_specialized_construct
-				    (GYPSY_CLIENT_SATELLITES_CHANGED_TYPE));
+	if (priv->assistance_path == NULL) {
+		g_set_error (error, GYPSY_ERROR, 0,
+			     "No assistance data configured for %s",
+			     priv->device_path);
+		return FALSE;
+	}
 
-		dbus_g_type_struct_set (&sat_struct,
-					0, sat->satellite_id,
-					1, sat->in_use,
-					2, sat->elevation,
-					3, sat->azimuth,
-					4, sat->snr,
-					G_MAXUINT);
-		g_ptr_array_add (sat_array, 
-				 g_value_get_boxed (&sat_struct));
+	if (priv->queue == NULL || priv->type != GYPSY_DEVICE_TYPE_SERIAL ||
+	    priv->parser == NULL || !GYPSY_IS_NMEA_PARSER (priv->parser)) {
+		g_set_error (error, GYPSY_ERROR, 0,
+			     "Assistance needs a connected NMEA serial device");
+		return FALSE;
 	}
 
-	*satellites_OUT = sat_array;
+	priv->assistance = gypsy_assistance_new_from_path
+		(priv->assistance_path, priv->commands, error);
+	if (priv->assistance == NULL) {
+		return FALSE;
+	}
 
+	priv->assistance_invocation = invocation;
+	gypsy_assistance_start (priv->assistance, priv->queue,
+				assistance_done, client);
 	return TRUE;
 }
 
-static gboolean
-gypsy_client_get_time (GypsyClient *client,
-		       int         *timestamp_OUT,
-		       GError     **error)
+static void
+shutdown_connection (GypsyClient *client)
 {
 	GypsyClientPrivate *priv;
 
 	priv = GET_PRIVATE (client);
 
-	*timestamp_OUT = priv->timestamp;
+	if (priv->reconnect_id > 0) {
+		g_source_remove (priv->reconnect_id);
+		priv->reconnect_id = 0;
+	}
 
-	return TRUE;
-}
+	cancel_assistance (client);
 
-static void
-finalize (GObject *object) 
-{
-	GypsyClientPrivate *priv;
+	/* Nothing to carry on from until the receiver is back */
+	priv->fix_time = 0;
+	priv->previous_time = 0;
 
-	priv = GET_PRIVATE (object);
+	if (priv->kalman) {
+		gypsy_kalman_reset (priv->kalman);
+	}
 
-	shutdown_connection ((GypsyClient *) object);
+	priv->native_climb = FALSE;
+	priv->climb_sample_count = 0;
+	if (priv->climb_stale_id > 0) {
+		g_source_remove (priv->climb_stale_id);
+		priv->climb_stale_id = 0;
+	}
+	if (priv->course_id > 0) {
+		g_source_remove (priv->course_id);
+		priv->course_id = 0;
+	}
+	if (priv->smoothed_id > 0) {
+		g_source_remove (priv->smoothed_id);
+		priv->smoothed_id = 0;
+	}
 
-	g_free (priv->device_path);
+	/* Nothing to predict from until the receiver is back */
+	if (priv->prediction_id > 0) {
+		g_source_remove (priv->prediction_id);
+		priv->prediction_id = 0;
+	}
 
-	((GObjectClass *) gypsy_client_parent_class)->finalize (object);
-}
+	/* Leave the receiver as we found it for whoever opens it next */
+	if (priv->queue && priv->output_profile != NMEA_SENTENCE_DEFAULT) {
+		send_output_profile (priv->queue, priv->commands,
+				     NMEA_SENTENCE_DEFAULT);
+		priv->output_profile = NMEA_SENTENCE_DEFAULT;
+	}
+
+	stop_corrections (client);
+
+	/* There's no waiting for answers now */
+	if (priv->queue) {
+		gypsy_command_queue_flush (priv->queue);
+		gypsy_command_queue_free (priv->queue);
+		priv->queue = NULL;
+	}
+
+	if (priv->error_id > 0) {
+		g_source_remove (priv->error_id);
+		priv->error_id = 0;
+	}
+
+	if (priv->connect_id > 0) {
+		g_source_remove (priv->connect_id);
+		priv->connect_id = 0;
+	}
+
+	if (priv->input_id > 0) {
+		g_source_remove (priv->input_id);
+		priv->input_id = 0;
+	}
+
+	if (priv->channel) {
+		g_io_channel_shutdown (priv->channel, TRUE, NULL);
+		g_io_channel_unref (priv->channel);
+		priv->channel = NULL;
+	}
+
+	close_nmea_log (client);
+
+	if (priv->raw_stream) {
+		gypsy_raw_stream_free (priv->raw_stream);
+		priv->raw_stream = NULL;
+		priv->raw_readers = 0;
+	}
+
+	if (priv->fd > 0) {
+		close (priv->fd);
+		priv->fd = -1;
+	}
+
+	if (priv->replay) {
+		gypsy_capture_replay_free (priv->replay);
+		priv->replay = NULL;
+	}
+
+	if (priv->replay_reader) {
+		gypsy_capture_reader_free (priv->replay_reader);
+		priv->replay_reader = NULL;
+	}
+
+	if (priv->simulator) {
+		gypsy_simulator_free (priv->simulator);
+		priv->simulator = NULL;
+	}
+
+	if (priv->parser) {
+		g_object_unref (priv->parser);
+		priv->parser = NULL;
+	}
+
+#ifdef ENABLE_N810
+	/* Turn off the N810's GPS device */
+	if (g_ascii_strcasecmp (priv->device_path, N810_INTERNAL_GPS_PATH) == 0) {
+		GYPSY_NOTE (CLIENT, "N810 chip off");
+		gpsctrl_set_chip_off ();
+	}
+#endif /* ENABLE_N810 */
+}
+
+static void schedule_reconnect (GypsyClient *client);
+static void start_prediction (GypsyClient *client);
+
+static gboolean
+reconnect_device (gpointer userdata)
+{
+	GypsyClientPrivate *priv;
+	GError *error = NULL;
+
+	priv = GET_PRIVATE (userdata);
+	priv->reconnect_id = 0;
+
+	GYPSY_NOTE (CLIENT, "Reconnecting to %s", priv->device_path);
+	if (!gypsy_client_start (GYPSY_CLIENT (userdata), &error)) {
+		GYPSY_NOTE (CLIENT, "Reconnecting failed: %s",
+			    error->message);
+		g_error_free (error);
+		schedule_reconnect (GYPSY_CLIENT (userdata));
+	}
+
+	return FALSE;
+}
+
+static void
+schedule_reconnect (GypsyClient *client)
+{
+	GypsyClientPrivate *priv;
+
+	priv = GET_PRIVATE (client);
+
+	if (priv->reconnect_id > 0) {
+		return;
+	}
+
+	priv->reconnect_delay = CLAMP (priv->reconnect_delay * 2,
+				       RECONNECT_MIN, RECONNECT_MAX);
+	priv->reconnect_id = g_timeout_add (priv->reconnect_delay,
+					    reconnect_device, client);
+}
+
+/* Network devices come back by themselves, anything else
+   waits to be started again */
+static void
+connection_lost (GypsyClient *client)
+{
+	GypsyClientPrivate *priv;
+	gboolean network;
+
+	priv = GET_PRIVATE (client);
+
+	network = (priv->type == GYPSY_DEVICE_TYPE_TCP ||
+		   priv->type == GYPSY_DEVICE_TYPE_UDP);
+
+	shutdown_connection (client);
+
+	emit_connection_changed (client, FALSE);
+
+	if (network) {
+		schedule_reconnect (client);
+	}
+}
+
+static gboolean
+gps_channel_error (GIOChannel  *channel,
+		   GIOCondition condition,
+		   gpointer     userdata)
+{
+	GypsyClientPrivate *priv;
+
+	priv = GET_PRIVATE (userdata);
+
+	GYPSY_NOTE (CLIENT, "Error on connection to %s", priv->device_path);
+	connection_lost ((GypsyClient *) userdata);
+
+	return FALSE;
+}
+
+/* Hands chars_read bytes, already read into the parser's buffer at buf,
+   to everything that wants them */
+static void
+handle_input (GypsyClient *client,
+	      char        *buf,
+	      gsize        chars_read)
+{
+	GypsyClientPrivate *priv;
+
+	priv = GET_PRIVATE (client);
+
+	/* Copy the data before the parser gets to modify it */
+	if (priv->capture_record) {
+		/* One write per record so a full log
+		   drops whole records */
+		g_byte_array_set_size (priv->capture_record, 0);
+		gypsy_capture_append_chunk (priv->capture_record, 0,
+					    g_get_monotonic_time (),
+					    buf, chars_read);
+		gypsy_nmea_log_write (priv->debug_log,
+				      (char *) priv->capture_record->data,
+				      priv->capture_record->len);
+	} else if (priv->debug_log) {
+		gypsy_nmea_log_write (priv->debug_log, buf, chars_read);
+	}
+
+	if (priv->raw_stream) {
+		gypsy_raw_stream_write (priv->raw_stream,
+					buf, chars_read);
+	}
+
+	/* Look for answers to commands before the parser
+	   gets to the buffer */
+	if (priv->queue) {
+		gypsy_command_queue_received_data (priv->queue,
+						   buf, chars_read);
+	}
+
+	gypsy_parser_received_data (priv->parser, chars_read, NULL);
+
+	/* Talking again, so start the backoff from scratch */
+	priv->reconnect_delay = 0;
+}
+
+/* Datagrams are read whole with recv(), where a read into the parser's
+   free space would drop the end of any bigger than that, and an empty
+   one would look like end of file */
+static void
+read_datagram (GypsyClient *client)
+{
+	static char datagram[MAX_DATAGRAM_SIZE];
+	GypsyClientPrivate *priv;
+	const char *data;
+	ssize_t length;
+
+	priv = GET_PRIVATE (client);
+
+	length = recv (priv->fd, datagram, sizeof (datagram), MSG_TRUNC);
+	if (length == -1) {
+		if (errno != EAGAIN && errno != EINTR) {
+			GYPSY_NOTE (CLIENT, "Error receiving on %s: %s",
+				    priv->device_path, g_strerror (errno));
+		}
+		return;
+	}
+
+	if ((gsize) length > sizeof (datagram)) {
+		g_warning ("Dropping a %d byte datagram on %s",
+			   (int) length, priv->device_path);
+		return;
+	}
+
+	data = datagram;
+	while (length > 0) {
+		char *buf;
+		gsize space, n;
+
+		space = gypsy_parser_get_buffer (priv->parser, &buf);
+		if (space == 0) {
+			GYPSY_NOTE (CLIENT, "Parser buffer full, dropping %d bytes",
+				    (int) length);
+			return;
+		}
+
+		n = MIN (space, length);
+		memcpy (buf, data, n);
+		handle_input (client, buf, n);
+
+		data += n;
+		length -= n;
+	}
+}
+
+static gboolean
+gps_channel_input (GIOChannel  *channel,
+		   GIOCondition condition,
+		   gpointer     userdata)
+{
+	GypsyClientPrivate *priv;
+	GIOStatus status;
+	char *buf;
+	gsize chars_left_in_buffer, chars_read;
+	GError *error = NULL;
+
+	priv = GET_PRIVATE (userdata);
+
+	if (priv->type == GYPSY_DEVICE_TYPE_UDP) {
+		read_datagram ((GypsyClient *) userdata);
+		return TRUE;
+	}
+
+	chars_left_in_buffer = gypsy_parser_get_buffer (priv->parser, &buf);
+	status = g_io_channel_read_chars (priv->channel,
+					  (char *) buf,
+					  chars_left_in_buffer,
+					  &chars_read,
+					  &error);
+
+	if (status == G_IO_STATUS_NORMAL) {
+		handle_input ((GypsyClient *) userdata, buf, chars_read);
+	} else if (status == G_IO_STATUS_EOF) {
+		/* The other end closed the socket or FIFO */
+		GYPSY_NOTE (CLIENT, "End of file on %s", priv->device_path);
+		connection_lost ((GypsyClient *) userdata);
+		return FALSE;
+	} else if (status == G_IO_STATUS_ERROR) {
+		GYPSY_NOTE (CLIENT, "Read error on channel %p %d: %s (%s)", priv->channel, status, error->message, g_strerror (errno));
+		g_error_free (error);
+	}
+
+	return TRUE;
+}
+
+/* Returns TRUE/FALSE to indicate success/error */
+static gboolean
+garmin_usb_device (GIOChannel *channel,
+		   char      *devpath,
+		   gboolean  *device_is_garmin)
+{
+	GIOStatus status;
+	u_int32_t privcmd[GARMIN_PRIV_PKT_MAX_SIZE];
+	gsize chars_written;
+	gsize chars_read;
+
+	/*
+	 *  Since the Garmin driver sets up the device at /dev/ttyUSB<n> it seems
+	 *  to be a pretty good bet that this check will be valid.
+	 *
+	 *  FIXME: Use gudev to get the VID of the device, and check against Garmin?
+	 */
+
+	*device_is_garmin = FALSE;
+	if (! strcmp (devpath, "/dev/ttyUSB0")) {
+
+		/* query the device driver to see if it is Garmin */
+
+		privcmd[0] = GARMIN_LAYERID_PRIVATE;		// LayerId
+		privcmd[1] = GARMIN_PRIV_PKTID_INFO_REQ;	// PacketId
+		privcmd[2] = 0;					// DataLength
+
+		status = g_io_channel_write_chars (channel,
+						   (gchar*)privcmd,
+						   12,
+						   &chars_written,
+						   NULL);
+
+		if (status != G_IO_STATUS_NORMAL) {
+			g_warning ("GARMIN: Error writing \"Private Info Req\" packet:\n%s",
+				   g_strerror (errno));
+			return FALSE;
+		}
+
+		g_io_channel_flush (channel, NULL);
+
+		/* check the response */
+
+		status = g_io_channel_read_chars (channel,
+						  (gchar*)privcmd,
+						  GARMIN_PRIV_PKT_INFO_RESP_SIZE,
+						  &chars_read,
+						  NULL);
+
+		if (status != G_IO_STATUS_NORMAL) {
+			g_message ("GARMIN: Error reading \"Private Info Resp\" packet: %s", g_strerror (errno));
+			return TRUE;
+		}
+
+		if ((privcmd[0] == GARMIN_LAYERID_PRIVATE) &&
+		    (privcmd[1] == GARMIN_PRIV_PKTID_INFO_RESP)) {
+			/* we're talking to the Garmin driver */
+			GYPSY_NOTE (CLIENT, "GARMIN: device type confirmed");
+			*device_is_garmin = TRUE;
+			return TRUE;
+		} else {
+			GYPSY_NOTE (CLIENT, "GARMIN: \"Private Info Resp\" packet data not recognized");
+			return TRUE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* Neither packet is acknowledged over USB */
+static void
+garmin_init (GypsyCommandQueue *queue)
+{
+	u_int32_t privcmd[GARMIN_PRIV_PKT_MAX_SIZE];
+	G_Packet_t *pvtpack;
+
+	GYPSY_NOTE (CLIENT, "GARMIN: initialize device");
+
+	/* set the device driver mode to "native" */
+	/* (without this, the device will not talk to us) */
+
+	privcmd[0] = GARMIN_LAYERID_PRIVATE;		/* LayerId */
+	privcmd[1] = GARMIN_PRIV_PKTID_SET_MODE;	/* PacketId */
+	privcmd[2] = 4;					/* DataLength */
+	privcmd[3] = GARMIN_MODE_NATIVE;		/* data */
+
+	gypsy_command_queue_push (queue, (guint8 *) privcmd, 16,
+				  GYPSY_COMMAND_ACK_NONE, command_done,
+				  "\"Private Set Mode\" packet");
+
+	/* start PVT transfers */
+
+	pvtpack = (G_Packet_t*)malloc(sizeof(G_Packet_t)+1);
+
+	pvtpack->mPacketType = LAYERID_APPL;
+	pvtpack->mReserved1  = 0;
+	pvtpack->mReserved2  = 0;
+	pvtpack->mPacketId   = Pid_Command_Data;
+	pvtpack->mReserved3  = 0;
+	pvtpack->mDataSize   = 2;
+	pvtpack->mData[0]    = Cmnd_Start_Pvt_Data;
+	pvtpack->mData[1]    = 0;
+
+	gypsy_command_queue_push (queue, (guint8 *) pvtpack,
+				  GARMIN_HEADER_SIZE + pvtpack->mDataSize,
+				  GYPSY_COMMAND_ACK_NONE, command_done,
+				  "\"Start PVT Transfer\" packet");
+
+	free((void*)pvtpack);
+}
+
+static gboolean
+gps_channel_connect (GIOChannel  *channel,
+		     GIOCondition condition,
+		     gpointer     userdata)
+{
+	GypsyClientPrivate *priv;
+	gboolean ret, device_is_garmin;
+
+	priv = GET_PRIVATE (userdata);
+
+	GYPSY_NOTE (CLIENT, "GPS channel can connect");
+
+	if (priv->type == GYPSY_DEVICE_TYPE_TCP) {
+		GError *error = NULL;
+
+		if (!gypsy_network_check_connected (priv->fd, &error)) {
+			GYPSY_NOTE (CLIENT, "Error connecting to %s: %s",
+				    priv->device_path, error->message);
+			g_error_free (error);
+
+			priv->connect_id = 0;
+			connection_lost (GYPSY_CLIENT (userdata));
+			return FALSE;
+		}
+	}
+
+	/* Detecting a Garmin needs its answer straight away, so it
+	   writes directly. Everything after goes through the queue */
+	priv->queue = gypsy_command_queue_new (channel);
+
+	ret = FALSE;
+	device_is_garmin = (priv->protocol == GYPSY_PROTOCOL_GARMIN);
+	if (priv->type == GYPSY_DEVICE_TYPE_SERIAL &&
+	    priv->protocol == GYPSY_PROTOCOL_AUTO) {
+		ret = garmin_usb_device (channel, priv->device_path,
+					 &device_is_garmin);
+		if (ret == FALSE) {
+			/* we got an error trying to figure it out */
+			GYPSY_NOTE (CLIENT,
+				    "Error determining device type for %s",
+				    priv->device_path);
+			/* g_set_error () has already been called */
+			goto end;
+		}
+	}
+
+	/* A simulator on a pty can't answer the driver query */
+	if (priv->simulator &&
+	    gypsy_simulator_is_garmin (priv->simulator)) {
+		device_is_garmin = TRUE;
+	}
+
+	if (device_is_garmin) {
+		priv->type = GYPSY_DEVICE_TYPE_GARMIN;
+		priv->parser = gypsy_garmin_parser_new (GYPSY_CLIENT (userdata));
+		garmin_init (priv->queue);
+	} else {
+		priv->parser = gypsy_nmea_parser_new (GYPSY_CLIENT (userdata));
+
+		if (priv->standby && priv->type == GYPSY_DEVICE_TYPE_SERIAL) {
+			send_wake_up (priv->queue, priv->commands);
+			priv->standby = FALSE;
+		}
+		update_output_profile (GYPSY_CLIENT (userdata));
+
+		if (priv->update_rate > 0 &&
+		    priv->type == GYPSY_DEVICE_TYPE_SERIAL) {
+			send_update_rate (priv->queue, priv->commands,
+					  priv->update_rate);
+		}
+
+		if (priv->type == GYPSY_DEVICE_TYPE_SERIAL &&
+		    (priv->position_fields & POSITION_LATITUDE) &&
+		    (priv->position_fields & POSITION_LONGITUDE)) {
+			send_aiding (priv->queue, priv->commands,
+				     priv->latitude, priv->longitude,
+				     priv->altitude);
+		}
+
+		start_corrections (GYPSY_CLIENT (userdata));
+	}
+
+	priv->input_id = g_io_add_watch_full (priv->channel,
+					      G_PRIORITY_HIGH_IDLE,
+					      G_IO_IN | G_IO_PRI,
+					      gps_channel_input,
+					      userdata, NULL);
+
+end:
+	start_prediction (GYPSY_CLIENT (userdata));
+	emit_connection_changed (GYPSY_CLIENT (userdata), TRUE);
+
+	priv->connect_id = 0;
+	return FALSE;
+}
+
+static gboolean
+baud_rate_to_speed (guint    rate,
+		    speed_t *speed)
+{
+	switch (rate) {
+	case 4800:
+		*speed = B4800;
+		break;
+	case 9600:
+		*speed = B9600;
+		break;
+	case 19200:
+		*speed = B19200;
+		break;
+	case 38400:
+		*speed = B38400;
+		break;
+	case 57600:
+		*speed = B57600;
+		break;
+	case 115200:
+		*speed = B115200;
+		break;
+	default:
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Metres per second in a knot */
+#define KNOTS_TO_MPS (1852.0 / 3600.0)
+#define rad2deg(x) ((x) * 180.0 / G_PI)
+
+/* How far past the last epoch a position is carried on. If the receiver
+   has gone quiet for longer than this, guessing further won't help */
+#define MAX_PREDICTION 5.0 /* seconds */
+#define MIN_PREDICTION_INTERVAL 10 /* ms */
+
+/* The velocity in metres per second north, east and up. The receiver's
+   course is used when there is one, or else the last two epochs */
+static void
+get_velocity (GypsyClientPrivate *priv,
+	      double             *north,
+	      double             *east,
+	      double             *up)
+{
+	double dt = 0.0;
+
+	*north = *east = *up = 0.0;
+
+	if (priv->previous_time > 0) {
+		dt = (priv->fix_time - priv->previous_time) / (double) G_USEC_PER_SEC;
+	}
+
+	if ((priv->course_fields & (COURSE_SPEED | COURSE_DIRECTION)) ==
+	    (COURSE_SPEED | COURSE_DIRECTION)) {
+		double speed = priv->speed * KNOTS_TO_MPS;
+
+		*north = speed * cos (deg2rad (priv->direction));
+		*east = speed * sin (deg2rad (priv->direction));
+	} else if (dt > 0.0 && dt <= MAX_PREDICTION) {
+		double dlon;
+
+		dlon = priv->longitude - priv->previous_longitude;
+		if (dlon > 180.0) {
+			dlon -= 360.0;
+		} else if (dlon < -180.0) {
+			dlon += 360.0;
+		}
+
+		*north = deg2rad (priv->latitude - priv->previous_latitude) *
+			EARTH_MEAN_RADIUS / dt;
+		*east = deg2rad (dlon) * EARTH_MEAN_RADIUS *
+			cos (deg2rad (priv->latitude)) / dt;
+	}
+
+	if (priv->course_fields & COURSE_CLIMB) {
+		*up = priv->climb;
+	} else if (dt > 0.0 && dt <= MAX_PREDICTION &&
+		   (priv->previous_fields & POSITION_ALTITUDE)) {
+		*up = (priv->altitude - priv->previous_altitude) / dt;
+	}
+}
+
+static double
+normalise_longitude (double longitude)
+{
+	if (longitude > 180.0) {
+		longitude -= 360.0;
+	} else if (longitude < -180.0) {
+		longitude += 360.0;
+	}
+
+	return longitude;
+}
+
+/* The position at the monotonic time @when, in microseconds. Between the
+   last two epochs it is interpolated, otherwise the last position is
+   carried on at constant velocity for up to MAX_PREDICTION seconds.
+   Returns the fields that are set, with POSITION_PREDICTED if the
+   position isn't the receiver's own */
+static PositionFields
+predict_position (GypsyClientPrivate *priv,
+		  gint64              when,
+		  int                *timestamp,
+		  double             *latitude,
+		  double             *longitude,
+		  double             *altitude)
+{
+	double dt;
+
+	*timestamp = priv->timestamp;
+	*latitude = priv->latitude;
+	*longitude = priv->longitude;
+	*altitude = priv->altitude;
+
+	if (priv->fix_time == 0 || when == priv->fix_time ||
+	    (priv->position_fields & (POSITION_LATITUDE | POSITION_LONGITUDE)) !=
+	    (POSITION_LATITUDE | POSITION_LONGITUDE)) {
+		return priv->position_fields;
+	}
+
+	dt = (when - priv->fix_time) / (double) G_USEC_PER_SEC;
+	if (*timestamp > 0) {
+		*timestamp += (int) dt;
+	}
+
+	if (when < priv->fix_time && priv->previous_time > 0 &&
+	    when >= priv->previous_time) {
+		double f, dlon;
+
+		f = (double) (when - priv->previous_time) /
+			(priv->fix_time - priv->previous_time);
+
+		dlon = normalise_longitude (priv->longitude -
+					    priv->previous_longitude);
+		*latitude = priv->previous_latitude +
+			f * (priv->latitude - priv->previous_latitude);
+		*longitude = normalise_longitude (priv->previous_longitude +
+						  f * dlon);
+		if (priv->previous_fields & POSITION_ALTITUDE) {
+			*altitude = priv->previous_altitude +
+				f * (priv->altitude - priv->previous_altitude);
+		}
+	} else {
+		double north, east, up, c;
+
+		dt = CLAMP (dt, -MAX_PREDICTION, MAX_PREDICTION);
+		get_velocity (priv, &north, &east, &up);
+
+		*latitude += rad2deg (north * dt / EARTH_MEAN_RADIUS);
+		*latitude = CLAMP (*latitude, -90.0, 90.0);
+
+		/* Going east means nothing at the poles */
+		c = cos (deg2rad (priv->latitude));
+		if (c > 1e-6) {
+			*longitude = normalise_longitude
+				(*longitude +
+				 rad2deg (east * dt / (EARTH_MEAN_RADIUS * c)));
+		}
+
+		*altitude += up * dt;
+	}
+
+	return priv->position_fields | POSITION_PREDICTED;
+}
+
+/* A new epoch starts when the timestamp or position changes, so the
+   GGA and RMC for the same fix don't count as two */
+static void
+note_position_epoch (GypsyClientPrivate *priv,
+		     float               latitude,
+		     float               longitude)
+{
+	if (priv->fix_time > 0 && priv->fix_timestamp == priv->timestamp &&
+	    priv->latitude == latitude && priv->longitude == longitude) {
+		return;
+	}
+
+	if (priv->fix_time > 0) {
+		priv->previous_time = priv->fix_time;
+		priv->previous_fields = priv->position_fields;
+		priv->previous_latitude = priv->latitude;
+		priv->previous_longitude = priv->longitude;
+		priv->previous_altitude = priv->altitude;
+	}
+
+	priv->fix_time = g_get_monotonic_time ();
+	priv->fix_timestamp = priv->timestamp;
+	priv->smoothed_inputs = 0;
+}
+
+static gboolean
+emit_predicted_position (gpointer userdata)
+{
+	GypsyClient *client = userdata;
+	GypsyClientPrivate *priv;
+	PositionFields fields;
+	int timestamp;
+	double latitude, longitude, altitude;
+	gint64 now;
+
+	priv = GET_PRIVATE (client);
+
+	if (priv->fix_time == 0) {
+		return TRUE;
+	}
+
+	now = g_get_monotonic_time ();
+	fields = predict_position (priv, now, &timestamp,
+				   &latitude, &longitude, &altitude);
+	emit_dbus_signal (client, GYPSY_POSITION_INTERFACE,
+			  "PositionPredicted",
+			  g_variant_new ("(xiiddd)", now, fields, timestamp,
+					 latitude, longitude, altitude));
+
+	return TRUE;
+}
+
+/* PositionPredicted only runs while the device is being read */
+static void
+start_prediction (GypsyClient *client)
+{
+	GypsyClientPrivate *priv;
+
+	priv = GET_PRIVATE (client);
+
+	if (priv->prediction_interval > 0 && priv->prediction_id == 0) {
+		priv->prediction_id = g_timeout_add (priv->prediction_interval,
+						     emit_predicted_position,
+						     client);
+	}
+}
+
+static void
+set_prediction_interval (GypsyClient *client,
+			 guint        interval)
+{
+	GypsyClientPrivate *priv;
+
+	priv = GET_PRIVATE (client);
+
+	if (interval > 0) {
+		interval = MAX (interval, MIN_PREDICTION_INTERVAL);
+	}
+
+	if (interval == priv->prediction_interval) {
+		return;
+	}
+	priv->prediction_interval = interval;
+
+	if (priv->prediction_id > 0) {
+		g_source_remove (priv->prediction_id);
+		priv->prediction_id = 0;
+	}
+
+	if (priv->fd > 0 || priv->replay != NULL ||
+	    priv->simulator != NULL) {
+		start_prediction (client);
+	}
+}
+
+static GVariant *
+build_smoothed_position (GypsyClientPrivate *priv)
+{
+	PositionFields fields = POSITION_NONE;
+	double latitude = 0.0, longitude = 0.0, altitude = 0.0;
+
+	if (priv->kalman &&
+	    gypsy_kalman_get_position (priv->kalman, &latitude, &longitude,
+				       NULL, NULL, NULL)) {
+		fields |= POSITION_LATITUDE | POSITION_LONGITUDE;
+	}
+
+	if (priv->kalman &&
+	    gypsy_kalman_get_altitude (priv->kalman, &altitude, NULL, NULL)) {
+		fields |= POSITION_ALTITUDE;
+	}
+
+	return g_variant_new ("(iiddd)", fields, priv->timestamp,
+			      latitude, longitude, altitude);
+}
+
+/* The same units as the Course interface, knots and degrees */
+static GVariant *
+build_smoothed_course (GypsyClientPrivate *priv)
+{
+	CourseFields fields = COURSE_NONE;
+	double speed = 0.0, direction = 0.0, climb = 0.0;
+	double north, east;
+
+	if (priv->kalman &&
+	    gypsy_kalman_get_position (priv->kalman, NULL, NULL,
+				       &north, &east, NULL)) {
+		speed = hypot (north, east) / KNOTS_TO_MPS;
+		direction = rad2deg (atan2 (east, north));
+		if (direction < 0.0) {
+			direction += 360.0;
+		}
+		fields |= COURSE_SPEED | COURSE_DIRECTION;
+	}
+
+	if (priv->kalman &&
+	    gypsy_kalman_get_altitude (priv->kalman, NULL, &climb, NULL)) {
+		fields |= COURSE_CLIMB;
+	}
+
+	return g_variant_new ("(iiddd)", fields, priv->timestamp,
+			      speed, direction, climb);
+}
+
+/* Standard deviations in metres, -1 for what isn't known */
+static GVariant *
+build_smoothed_uncertainty (GypsyClientPrivate *priv)
+{
+	double horizontal = -1.0, vertical = -1.0;
+
+	if (priv->kalman) {
+		gypsy_kalman_get_position (priv->kalman, NULL, NULL,
+					   NULL, NULL, &horizontal);
+		gypsy_kalman_get_altitude (priv->kalman, NULL, NULL,
+					   &vertical);
+	}
+
+	return g_variant_new ("(dd)", horizontal, vertical);
+}
+
+/* Sent once what has been read has all been parsed, so an epoch's
+   sentences give one signal rather than one each */
+static gboolean
+emit_smoothed (gpointer userdata)
+{
+	GypsyClient *client = userdata;
+	GypsyClientPrivate *priv;
+
+	priv = GET_PRIVATE (client);
+
+	priv->smoothed_id = 0;
+
+	emit_dbus_signal (client, GYPSY_SMOOTHED_INTERFACE,
+			  "PositionChanged", build_smoothed_position (priv));
+	emit_dbus_signal (client, GYPSY_SMOOTHED_INTERFACE,
+			  "CourseChanged", build_smoothed_course (priv));
+
+	return FALSE;
+}
+
+static void
+set_smoothing (GypsyClient *client,
+	       gboolean     smoothing)
+{
+	GypsyClientPrivate *priv;
+
+	priv = GET_PRIVATE (client);
+
+	if (smoothing && priv->kalman == NULL) {
+		priv->kalman = gypsy_kalman_new ();
+		priv->smoothed_inputs = 0;
+	} else if (!smoothing && priv->kalman != NULL) {
+		if (priv->smoothed_id > 0) {
+			g_source_remove (priv->smoothed_id);
+			priv->smoothed_id = 0;
+		}
+
+		gypsy_kalman_free (priv->kalman);
+		priv->kalman = NULL;
+	}
+}
+
+/* Thresholds can be sent as whichever number type the caller has */
+static gboolean
+get_number_option (GVariant *value,
+		   double   *number)
+{
+	if (g_variant_is_of_type (value, G_VARIANT_TYPE_DOUBLE)) {
+		*number = g_variant_get_double (value);
+	} else if (g_variant_is_of_type (value, G_VARIANT_TYPE_INT32)) {
+		*number = g_variant_get_int32 (value);
+	} else if (g_variant_is_of_type (value, G_VARIANT_TYPE_UINT32)) {
+		*number = g_variant_get_uint32 (value);
+	} else {
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* options is an a{sv} */
+static gboolean
+gypsy_client_set_start_options (GypsyClient *client,
+				GVariant    *options,
+				GError     **error)
+{
+	GypsyClientPrivate *priv;
+	GVariantIter iter;
+	const char *key;
+	GVariant *value;
+	double number;
+
+	priv = GET_PRIVATE (client);
+
+	g_variant_iter_init (&iter, options);
+	while (g_variant_iter_next (&iter, "{&sv}", &key, &value)) {
+		if (g_str_equal (key, "BaudRate")) {
+			guint rate;
+
+			if (priv->channel != NULL) {
+				g_set_error (error, GYPSY_ERROR, 0, "Device already started");
+				g_variant_unref (value);
+				return FALSE;
+			}
+
+			/* dbus-glib callers sent a uint, accept an int too */
+			if (g_variant_is_of_type (value, G_VARIANT_TYPE_INT32)) {
+				rate = g_variant_get_int32 (value);
+			} else if (g_variant_is_of_type (value, G_VARIANT_TYPE_UINT32)) {
+				rate = g_variant_get_uint32 (value);
+			} else {
+				rate = 0;
+			}
+			if (!baud_rate_to_speed (rate, &priv->baudrate)) {
+				GYPSY_NOTE (CLIENT,
+					    "Unsupported baud rate '%d'",
+					    rate);
+				g_set_error (error, GYPSY_ERROR, 0, "Unsupported baud rate '%d'", rate);
+				g_variant_unref (value);
+				return FALSE;
+			}
+		} else if (g_str_equal (key, "PruneSentences") &&
+			   g_variant_is_of_type (value, G_VARIANT_TYPE_BOOLEAN)) {
+			priv->prune_sentences = g_variant_get_boolean (value);
+			update_output_profile (client);
+		} else if (g_str_equal (key, "MinDistance") &&
+			   get_number_option (value, &number)) {
+			priv->min_distance = MAX (number, 0.0);
+		} else if (g_str_equal (key, "MinAltitudeChange") &&
+			   get_number_option (value, &number)) {
+			priv->min_altitude = MAX (number, 0.0);
+		} else if (g_str_equal (key, "MinTime") &&
+			   get_number_option (value, &number)) {
+			priv->min_time = (guint) MAX (number, 0.0);
+		} else if (g_str_equal (key, "PredictionInterval") &&
+			   get_number_option (value, &number)) {
+			set_prediction_interval (client,
+						 (guint) MAX (number, 0.0));
+		} else if (g_str_equal (key, "Smoothing") &&
+			   g_variant_is_of_type (value, G_VARIANT_TYPE_BOOLEAN)) {
+			set_smoothing (client, g_variant_get_boolean (value));
+		} else {
+			GYPSY_NOTE (CLIENT,
+				    "Unsupported option key '%s'", key);
+		}
+		g_variant_unref (value);
+	}
+
+	return TRUE;
+}
+
+static void
+replay_done (GypsyCaptureReplay *replay,
+	     gpointer            userdata)
+{
+	GypsyClient *client = userdata;
+	GypsyClientPrivate *priv;
+
+	priv = GET_PRIVATE (client);
+
+	if (priv->replay_loop) {
+		GypsyCaptureChunk chunk;
+		gboolean empty;
+
+		/* Looping a log with nothing in it would never stop */
+		gypsy_capture_reader_rewind (priv->replay_reader);
+		empty = !gypsy_capture_reader_next (priv->replay_reader, 0,
+						    &chunk);
+		gypsy_capture_reader_rewind (priv->replay_reader);
+
+		if (!empty) {
+			gypsy_capture_replay_free (priv->replay);
+			priv->replay = gypsy_capture_replay_new
+				(priv->replay_reader, 0, priv->parser,
+				 priv->replay_speed, replay_done, client);
+			return;
+		}
+	}
+
+	/* The end of the log is the device going away */
+	GYPSY_NOTE (CLIENT, "Finished replaying %s", priv->device_path);
+	shutdown_connection (client);
+
+	emit_connection_changed (client, FALSE);
+}
+
+/* replay://FILE?speed=N&loop=1&format=garmin&baud=N feeds a recorded log
+   through the parser as though it came from a device. Captures, known by
+   their magic whatever they're called, keep their recorded timing, and
+   raw logs are paced at the baud rate. Other
+   keys are ignored, so one log can back many devices (e.g. &id=2). */
+static gboolean
+start_replay (GypsyClient *client,
+	      GError     **error)
+{
+	GypsyClientPrivate *priv;
+	GError *replay_error = NULL;
+	char **parts;
+	const char *filename;
+	gboolean garmin = FALSE;
+	guint baud = REPLAY_DEFAULT_BAUD;
+
+	priv = GET_PRIVATE (client);
+
+	priv->replay_speed = 1.0;
+	priv->replay_loop = FALSE;
+
+	parts = g_strsplit (priv->device_path + strlen (REPLAY_SCHEME), "?", 2);
+	filename = parts[0];
+
+	if (parts[1] != NULL) {
+		char **params;
+		int i;
+
+		params = g_strsplit (parts[1], "&", -1);
+		for (i = 0; params[i] != NULL; i++) {
+			char **param = g_strsplit (params[i], "=", 2);
+
+			if (param[1] == NULL) {
+				GYPSY_NOTE (CLIENT, "Ignoring replay option '%s'",
+					    param[0]);
+			} else if (g_str_equal (param[0], "speed")) {
+				priv->replay_speed = g_ascii_strtod (param[1],
+								     NULL);
+			} else if (g_str_equal (param[0], "loop")) {
+				priv->replay_loop = (atoi (param[1]) != 0);
+			} else if (g_str_equal (param[0], "format")) {
+				garmin = g_str_equal (param[1], "garmin");
+			} else if (g_str_equal (param[0], "baud")) {
+				baud = atoi (param[1]);
+			}
+			g_strfreev (param);
+		}
+		g_strfreev (params);
+	}
+
+	if (priv->replay_speed < 0.0 || baud == 0) {
+		g_set_error (error, GYPSY_ERROR, 0,
+			     "Bad replay options: %s", priv->device_path);
+		g_strfreev (parts);
+		return FALSE;
+	}
+
+	if (gypsy_capture_is_capture_file (filename)) {
+		priv->replay_reader = gypsy_capture_reader_new (filename,
+								&replay_error);
+	} else {
+		/* 8N1 framing is 10 bits a byte */
+		priv->replay_reader = gypsy_capture_reader_new_raw
+			(filename, baud / 10, &replay_error);
+	}
+	g_strfreev (parts);
+
+	if (priv->replay_reader == NULL) {
+		g_warning ("Error opening replay %s: %s", priv->device_path,
+			   replay_error->message);
+		g_set_error (error, GYPSY_ERROR, 0, "%s",
+			     replay_error->message);
+		g_error_free (replay_error);
+		return FALSE;
+	}
+
+	priv->type = GYPSY_DEVICE_TYPE_REPLAY;
+	if (garmin) {
+		priv->parser = gypsy_garmin_parser_new (client);
+	} else {
+		priv->parser = gypsy_nmea_parser_new (client);
+	}
+
+	priv->replay = gypsy_capture_replay_new (priv->replay_reader, 0,
+						 priv->parser,
+						 priv->replay_speed,
+						 replay_done, client);
+
+	start_prediction (client);
+	emit_connection_changed (client, TRUE);
+	return TRUE;
+}
+
+static void
+simulator_output (GypsySimulator *simulator,
+		  const char     *data,
+		  gsize           length,
+		  gpointer        userdata)
+{
+	GypsyClientPrivate *priv;
+
+	priv = GET_PRIVATE (userdata);
+	gypsy_capture_feed_parser (priv->parser, data, length);
+}
+
+/* sim://NAME?OPTIONS runs the built in simulator (see gypsy-simulator.c
+   for the options). With pty=1 it is given back in tty_path to be opened
+   like any other serial device, otherwise it feeds the parser directly. */
+static gboolean
+start_simulator (GypsyClient *client,
+		 const char **tty_path,
+		 GError     **error)
+{
+	GypsyClientPrivate *priv;
+	GError *sim_error = NULL;
+	const char *options;
+
+	priv = GET_PRIVATE (client);
+
+	options = strchr (priv->device_path, '?');
+	priv->simulator = gypsy_simulator_new (options ? options + 1 : NULL,
+					       simulator_output, client,
+					       &sim_error);
+	if (priv->simulator == NULL) {
+		g_warning ("Error starting simulator %s: %s",
+			   priv->device_path, sim_error->message);
+		g_set_error (error, GYPSY_ERROR, 0, "%s", sim_error->message);
+		g_error_free (sim_error);
+		return FALSE;
+	}
+
+	*tty_path = gypsy_simulator_get_pty (priv->simulator);
+	if (*tty_path != NULL) {
+		return TRUE;
+	}
+
+	priv->type = GYPSY_DEVICE_TYPE_SIMULATOR;
+	if (gypsy_simulator_is_garmin (priv->simulator)) {
+		priv->parser = gypsy_garmin_parser_new (client);
+	} else {
+		priv->parser = gypsy_nmea_parser_new (client);
+	}
+
+	start_prediction (client);
+	emit_connection_changed (client, TRUE);
+	return TRUE;
+}
+
+/* Replays and the simulator have nothing worth keeping */
+static gboolean
+keeps_warm_start (GypsyClientPrivate *priv)
+{
+	return !g_str_has_prefix (priv->device_path, REPLAY_SCHEME) &&
+		!g_str_has_prefix (priv->device_path, SIMULATOR_SCHEME);
+}
+
+/* Until the receiver has a fix of its own, the last one from the state
+   file is served with its old timestamp and no fix status, so clients
+   can tell it's stale */
+static void
+load_warm_start (GypsyClient *client)
+{
+	GypsyClientPrivate *priv = GET_PRIVATE (client);
+	GypsyWarmStart state;
+	GError *error = NULL;
+	char *device;
+
+	if (priv->position_fields != POSITION_NONE ||
+	    !keeps_warm_start (priv)) {
+		return;
+	}
+
+	device = gypsy_client_device_name (priv->device_path);
+	if (!gypsy_warm_start_load (device, &state, &error)) {
+		GYPSY_NOTE (CLIENT, "No warm start for %s: %s",
+			    priv->device_path, error->message);
+		g_error_free (error);
+		g_free (device);
+		return;
+	}
+	g_free (device);
+
+	GYPSY_NOTE (CLIENT, "Warm start for %s from %d", priv->device_path,
+		    state.timestamp);
+
+	priv->stale = TRUE;
+	priv->timestamp = state.timestamp;
+	priv->position_fields = state.position_fields;
+	priv->latitude = state.latitude;
+	priv->longitude = state.longitude;
+	priv->altitude = state.altitude;
+
+	priv->sat_count = state.sat_count;
+	memcpy (priv->satellites, state.satellites,
+		state.sat_count * sizeof (GypsyClientSatellite));
+
+	if (priv->shm) {
+		publish_fix (client);
+	}
+}
+
+static void
+save_warm_start (GypsyClient *client)
+{
+	GypsyClientPrivate *priv = GET_PRIVATE (client);
+	GypsyWarmStart state;
+	GError *error = NULL;
+	char *device;
+	int i;
+
+	/* Nothing new since it was loaded */
+	if (priv->stale || !keeps_warm_start (priv) ||
+	    !(priv->position_fields & POSITION_LATITUDE) ||
+	    !(priv->position_fields & POSITION_LONGITUDE)) {
+		return;
+	}
+
+	memset (&state, 0, sizeof (GypsyWarmStart));
+	state.timestamp = priv->timestamp;
+	state.position_fields = priv->position_fields;
+	state.latitude = priv->latitude;
+	state.longitude = priv->longitude;
+	state.altitude = priv->altitude;
+
+	for (i = 0; i < priv->sat_count; i++) {
+		state.satellites[i] = priv->satellites[i];
+		state.satellites[i].in_use = FALSE;
+		state.satellites[i].snr = 0;
+	}
+	state.sat_count = priv->sat_count;
+
+	device = gypsy_client_device_name (priv->device_path);
+	if (!gypsy_warm_start_save (device, &state, &error)) {
+		g_warning ("Error saving the last fix of %s: %s",
+			   priv->device_path, error->message);
+		g_error_free (error);
+	}
+	g_free (device);
+}
+
+gboolean
+gypsy_client_start (GypsyClient *client,
+		    GError     **error)
+{
+	GypsyClientPrivate *priv;
+	GIOStatus status;
+	const char *path;
+
+	priv = GET_PRIVATE (client);
+
+	if (priv->fd != -1 || priv->replay != NULL ||
+	    priv->simulator != NULL) {
+		GYPSY_NOTE (CLIENT, "Connection to %s already started",
+			       priv->device_path);
+		return TRUE;
+	}
+	else {
+		GYPSY_NOTE (CLIENT, "Starting connection to %s",
+			       priv->device_path);
+	}
+
+	load_warm_start (client);
+
+	/* The segment stays for as long as the object, so
+	   readers can hold on to it across restarts */
+	if (priv->shm == NULL) {
+		GError *shm_error = NULL;
+		char *device;
+
+		device = gypsy_client_device_name (priv->device_path);
+		priv->shm = gypsy_shm_publisher_new (device, &shm_error);
+		if (priv->shm == NULL) {
+			g_warning ("Error publishing fix: %s",
+				   shm_error->message);
+			g_error_free (shm_error);
+		} else {
+			publish_fix (client);
+		}
+		g_free (device);
+	}
+
+	/* Enable the N810's internal GPS */
+#ifdef ENABLE_N810
+		if (g_ascii_strcasecmp (priv->device_path, N810_INTERNAL_GPS_PATH) == 0) {
+			GYPSY_NOTE (CLIENT, "N810 chip on");
+			gpsctrl_set_chip_on ();
+		}
+#endif /* ENABLE_N810 */
+
+	/* Open a connection to our device */
+
+	if (g_str_has_prefix (priv->device_path, REPLAY_SCHEME)) {
+		return start_replay (client, error);
+	}
+
+	path = priv->device_path;
+	if (g_str_has_prefix (priv->device_path, SIMULATOR_SCHEME)) {
+		if (!start_simulator (client, &path, error)) {
+			return FALSE;
+		}
+
+		if (path == NULL) {
+			return TRUE;
+		}
+	}
+
+	/* we assume that a device path starting with slash is a tty device or
+	 * a FIFO */
+	if (path[0] == '/') {
+		priv->fd = open (path, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+		if (priv->fd != -1 && isatty (priv->fd)) {
+			/* Reopen read-write for TTY devices,
+			 * we'll be detecting whether it's garmin later */
+			priv->type = GYPSY_DEVICE_TYPE_SERIAL;
+			close (priv->fd);
+			priv->fd = open (path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+		} else {
+			priv->type = GYPSY_DEVICE_TYPE_FIFO;
+		}
+
+		if (priv->fd == -1) {
+			g_warning ("Error opening device %s: %s", path, g_strerror (errno));
+			g_set_error (error, GYPSY_ERROR, errno, g_strerror (errno));
+
+			if (priv->simulator) {
+				gypsy_simulator_free (priv->simulator);
+				priv->simulator = NULL;
+			}
+			return FALSE;
+		}
+
+		if (priv->type == GYPSY_DEVICE_TYPE_SERIAL) {
+			struct termios term;
+
+			if (tcgetattr (priv->fd, &term) < 0) {
+				g_warning ("Error getting term: %s", g_strerror (errno));
+				g_set_error (error, GYPSY_ERROR, errno, g_strerror (errno));
+				return FALSE;
+			}
+
+			cfmakeraw(&term);
+			if (priv->baudrate != B0)
+				cfsetispeed(&term, priv->baudrate);
+
+			if (tcsetattr (priv->fd, TCSAFLUSH, &term) < 0) {
+				g_warning ("Error setting term: %s", g_strerror (errno));
+				g_set_error (error, GYPSY_ERROR, errno, g_strerror (errno));
+				return FALSE;
+			}
+		}
+	} else if (gypsy_network_is_network_device (path)) {
+		gboolean datagram;
+
+		GError *open_error = NULL;
+
+		priv->fd = gypsy_network_open (path, &datagram, &open_error);
+		if (priv->fd == -1) {
+			/* The converter may just not be up yet, so keep
+			   trying, unless the address can never work */
+			if (!g_error_matches (open_error, GYPSY_ERROR, EINVAL)) {
+				GYPSY_NOTE (CLIENT, "Opening %s failed: %s",
+					    path, open_error->message);
+				schedule_reconnect (client);
+			}
+			g_propagate_error (error, open_error);
+			return FALSE;
+		}
+
+		priv->type = datagram ? GYPSY_DEVICE_TYPE_UDP :
+			GYPSY_DEVICE_TYPE_TCP;
+	} else {
+		priv->type = GYPSY_DEVICE_TYPE_BLUETOOTH;
+#ifdef HAVE_BLUEZ
+		priv->fd = socket (AF_BLUETOOTH, SOCK_STREAM, BTPROTO_RFCOMM);
+#else
+		g_warning ("Trying to connect to a Bluetooth GPS but Gypsy does not have Bluetooth support");
+		return FALSE;
+#endif
+	}
+
+	open_nmea_log (client);
+
+	if (raw_stream_dir) {
+		GError *stream_error = NULL;
+		char *device, *filename;
+
+		device = gypsy_client_device_name (priv->device_path);
+		filename = g_strdup_printf ("%s/%s.raw", raw_stream_dir,
+					    device);
+		g_free (device);
+
+		priv->raw_stream = gypsy_raw_stream_new (filename,
+							 raw_readers_changed,
+							 client,
+							 &stream_error);
+		if (priv->raw_stream == NULL) {
+			g_warning ("Error opening raw stream: %s",
+				   stream_error->message);
+			g_error_free (stream_error);
+		} else {
+			GYPSY_NOTE (CLIENT, "Raw data for %s on %s",
+				    priv->device_path, filename);
+		}
+		g_free (filename);
+	}
+
+	/* Set up the IO Channel */
+
+	priv->channel = g_io_channel_unix_new (priv->fd);
+	GYPSY_NOTE (CLIENT, "Created new channel: %p", priv->channel);
+
+	status = g_io_channel_set_flags (priv->channel,
+					 G_IO_FLAG_NONBLOCK | G_IO_FLAG_IS_READABLE | G_IO_FLAG_IS_WRITEABLE,
+					 NULL);
+
+	if (status != G_IO_STATUS_NORMAL) {
+		g_warning ("Error setting flags: %s", g_strerror (errno));
+		g_set_error (error, GYPSY_ERROR, errno, g_strerror (errno));
+		return FALSE;
+	}
+
+	/* set encoding to NULL so we can do reads and writes */
+	status = g_io_channel_set_encoding (priv->channel, NULL, NULL);
+
+	if (status != G_IO_STATUS_NORMAL) {
+		g_warning ("Error setting encoding: %s", g_strerror (errno));
+		g_set_error (error, GYPSY_ERROR, errno, g_strerror (errno));
+		return FALSE;
+	}
+
+	priv->error_id = g_io_add_watch_full (priv->channel,
+					      G_PRIORITY_HIGH_IDLE,
+					      G_IO_ERR | G_IO_HUP,
+					      gps_channel_error, client, NULL);
+
+	priv->connect_id = g_io_add_watch_full (priv->channel,
+						G_PRIORITY_HIGH_IDLE,
+						G_IO_OUT,
+						gps_channel_connect, client, NULL);
+
+#ifdef HAVE_BLUEZ
+	/* Now connect to the bluetooth socket */
+	if (priv->type == GYPSY_DEVICE_TYPE_BLUETOOTH) {
+		struct sockaddr_rc addr = { 0 };
+
+		addr.rc_family = AF_BLUETOOTH;
+		addr.rc_channel = (uint8_t) 1;
+		str2ba(priv->device_path, &addr.rc_bdaddr);
+
+		if (connect (priv->fd, (struct sockaddr *) &addr, sizeof (addr)) == -1) {
+			/* Error */
+			if (errno == EINPROGRESS || errno == EAGAIN) {
+				return TRUE;
+			}
+
+			g_warning ("Error connecting: %s", g_strerror (errno));
+			g_set_error (error, GYPSY_ERROR, errno, g_strerror (errno));
+
+			g_source_remove (priv->error_id);
+			priv->error_id = 0;
+			g_source_remove (priv->connect_id);
+			priv->connect_id = 0;
+
+			g_io_channel_unref (priv->channel);
+			priv->channel = NULL;
+
+			close (priv->fd);
+			priv->fd = -1;
+
+			return FALSE;
+		}
+	}
+#endif
+	return TRUE;
+}
+
+static gboolean
+gypsy_client_stop (GypsyClient *client,
+		   GError     **error)
+{
+	GypsyClientPrivate *priv;
+
+	priv = GET_PRIVATE (client);
+
+	GYPSY_NOTE (CLIENT, "Stopping connection to %s", priv->device_path);
+	save_warm_start (client);
+	shutdown_connection (client);
+
+	emit_connection_changed (client, FALSE);
+	return TRUE;
+}
+
+static gboolean
+gypsy_client_get_connection_status (GypsyClient *client)
+{
+	GypsyClientPrivate *priv;
+
+	priv = GET_PRIVATE (client);
+
+	return (priv->fd > 0 || priv->replay != NULL ||
+		priv->simulator != NULL);
+}
+
+static gboolean
+gypsy_client_subscribe (GypsyClient *client,
+			const char **interfaces,
+			const char  *sender,
+			GError     **error)
+{
+	GypsyClientPrivate *priv;
+	GypsyClientSubscriber *subscriber;
+	GypsyClientInterest interests = GYPSY_CLIENT_INTEREST_NONE;
+	int i;
+
+	priv = GET_PRIVATE (client);
+
+	for (i = 0; interfaces && interfaces[i]; i++) {
+		GypsyClientInterest interest;
+
+		if (lookup_interest (interfaces[i], &interest) == FALSE) {
+			g_set_error (error, GYPSY_ERROR, 0,
+				     "Unknown interface '%s'",
+				     interfaces[i]);
+			return FALSE;
+		}
+
+		interests |= interest;
+	}
+
+	GYPSY_NOTE (CLIENT, "%s subscribed to 0x%x on %s", sender,
+		    interests, priv->device_path);
+
+	subscriber = g_hash_table_lookup (priv->subscribers, sender);
+	if (subscriber == NULL) {
+		subscriber = g_slice_new0 (GypsyClientSubscriber);
+		subscriber->client = client;
+		subscriber->sender = g_strdup (sender);
+		g_hash_table_insert (priv->subscribers, subscriber->sender,
+				     subscriber);
+	}
+
+	subscriber->interests = interests;
+	update_output_profile (client);
+
+	return TRUE;
+}
+
+static gboolean
+gypsy_client_set_minimum_interval (GypsyClient *client,
+				   guint        interval,
+				   const char  *sender,
+				   GError     **error)
+{
+	GypsyClientPrivate *priv;
+	GypsyClientSubscriber *subscriber;
+
+	priv = GET_PRIVATE (client);
+
+	subscriber = g_hash_table_lookup (priv->subscribers, sender);
+	if (subscriber == NULL) {
+		g_set_error (error, GYPSY_ERROR, 0,
+			     "%s has not subscribed to %s", sender,
+			     priv->device_path);
+		return FALSE;
+	}
+
+	GYPSY_NOTE (CLIENT, "%s wants updates from %s at most every %u ms",
+		    sender, priv->device_path, interval);
+
+	if (subscriber->min_interval == 0 && interval > 0) {
+		priv->limited_count++;
+	} else if (subscriber->min_interval > 0 && interval == 0) {
+		priv->limited_count--;
+	}
+	subscriber->min_interval = interval;
+
+	/* Whatever was held back goes out at the new rate */
+	if (subscriber->pending) {
+		if (subscriber->flush_id > 0) {
+			g_source_remove (subscriber->flush_id);
+			subscriber->flush_id = 0;
+		}
+		schedule_flush (subscriber, g_get_monotonic_time () / 1000);
+	}
+
+	return TRUE;
+}
+
+static void
+send_command_done (GypsyCommandQueue *queue,
+		   GypsyCommandResult result,
+		   gpointer           userdata)
+{
+	GDBusMethodInvocation *invocation = userdata;
+
+	if (result == GYPSY_COMMAND_OK) {
+		g_dbus_method_invocation_return_value (invocation, NULL);
+	} else {
+		g_dbus_method_invocation_return_error
+			(invocation, GYPSY_ERROR, 0, "Command %s",
+			 gypsy_command_result_to_string (result));
+	}
+}
+
+static gboolean
+parse_command_ack (const char      *name,
+		   const guint8    *data,
+		   gsize            length,
+		   GypsyCommandAck *ack)
+{
+	if (name[0] == '\0' || g_str_equal (name, "auto")) {
+		*ack = gypsy_command_ack_for (data, length);
+	} else if (g_str_equal (name, "none")) {
+		*ack = GYPSY_COMMAND_ACK_NONE;
+	} else if (g_str_equal (name, "pmtk")) {
+		*ack = GYPSY_COMMAND_ACK_PMTK;
+	} else if (g_str_equal (name, "ubx")) {
+		*ack = GYPSY_COMMAND_ACK_UBX;
+	} else if (g_str_equal (name, "mga")) {
+		*ack = GYPSY_COMMAND_ACK_UBX_MGA;
+	} else if (g_str_equal (name, "garmin")) {
+		*ack = GYPSY_COMMAND_ACK_GARMIN;
+	} else {
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Queues a command from SendCommand, returning FALSE if it
+   can't, or TRUE if invocation will be answered when done */
+static gboolean
+send_command (GypsyClient           *client,
+	      GVariant              *parameters,
+	      GDBusMethodInvocation *invocation,
+	      GError               **error)
+{
+	GypsyClientPrivate *priv;
+	GypsyCommandAck ack;
+	GVariant *command;
+	const guint8 *data;
+	const char *ack_name;
+	gsize length;
+	gboolean ret = FALSE;
+
+	priv = GET_PRIVATE (client);
+
+	g_variant_get (parameters, "(@ay&s)", &command, &ack_name);
+	data = g_variant_get_fixed_array (command, &length, 1);
+
+	if (priv->queue == NULL || priv->type == GYPSY_DEVICE_TYPE_FIFO ||
+	    priv->type == GYPSY_DEVICE_TYPE_UDP) {
+		g_set_error (error, GYPSY_ERROR, 0,
+			     "%s can't be sent commands", priv->device_path);
+	} else if (length == 0) {
+		g_set_error (error, GYPSY_ERROR, 0, "Empty command");
+	} else if (!parse_command_ack (ack_name, data, length, &ack)) {
+		g_set_error (error, GYPSY_ERROR, 0,
+			     "Unknown acknowledgement '%s'", ack_name);
+	} else {
+		gypsy_command_queue_push (priv->queue, data, length, ack,
+					  send_command_done, invocation);
+		ret = TRUE;
+	}
+
+	g_variant_unref (command);
+	return ret;
+}
+
+/* Replies to every method on every interface, they are all cheap
+   enough to answer straight away apart from InjectAssistance and
+   SendCommand, which are answered once the receiver has */
+static void
+method_call (GDBusConnection       *connection,
+	     const char            *sender,
+	     const char            *object_path,
+	     const char            *interface_name,
+	     const char            *method_name,
+	     GVariant              *parameters,
+	     GDBusMethodInvocation *invocation,
+	     gpointer               userdata)
+{
+	GypsyClient *client = userdata;
+	GypsyClientPrivate *priv;
+	GVariant *reply = NULL;
+	GError *error = NULL;
+
+	priv = GET_PRIVATE (client);
+
+	if (g_str_equal (method_name, "GetPosition") &&
+	    g_str_equal (interface_name, GYPSY_SMOOTHED_INTERFACE)) {
+		reply = build_smoothed_position (priv);
+	} else if (g_str_equal (method_name, "GetPosition")) {
+		reply = build_limited_signal (priv, LIMITED_POSITION);
+	} else if (g_str_equal (method_name, "GetPositionAt")) {
+		PositionFields fields;
+		int timestamp;
+		double latitude, longitude, altitude;
+		gint64 when;
+
+		g_variant_get (parameters, "(x)", &when);
+		if (when == 0) {
+			when = g_get_monotonic_time ();
+		}
+
+		fields = predict_position (priv, when, &timestamp, &latitude,
+					   &longitude, &altitude);
+		reply = g_variant_new ("(iiddd)", fields, timestamp,
+				       latitude, longitude, altitude);
+	} else if (g_str_equal (method_name, "GetCourse") &&
+		   g_str_equal (interface_name, GYPSY_SMOOTHED_INTERFACE)) {
+		reply = build_smoothed_course (priv);
+	} else if (g_str_equal (method_name, "GetUncertainty")) {
+		reply = build_smoothed_uncertainty (priv);
+	} else if (g_str_equal (method_name, "GetCourse")) {
+		reply = build_limited_signal (priv, LIMITED_COURSE);
+	} else if (g_str_equal (method_name, "GetAccuracy")) {
+		reply = build_limited_signal (priv, LIMITED_ACCURACY);
+	} else if (g_str_equal (method_name, "GetSatellites")) {
+		reply = build_limited_signal (priv, LIMITED_SATELLITES);
+	} else if (g_str_equal (method_name, "GetTime")) {
+		reply = g_variant_new ("(i)", priv->timestamp);
+	} else if (g_str_equal (method_name, "GetFixStatus")) {
+		reply = g_variant_new ("(i)", priv->fix_type);
+	} else if (g_str_equal (method_name, "GetFixQuality")) {
+		reply = g_variant_new ("(i)", priv->fix_quality);
+	} else if (g_str_equal (method_name, "GetCorrectionStatus")) {
+		reply = build_correction_status (client);
+	} else if (g_str_equal (method_name, "GetConnectionStatus")) {
+		reply = g_variant_new ("(b)",
+				       gypsy_client_get_connection_status (client));
+	} else if (g_str_equal (method_name, "SetStartOptions")) {
+		GVariant *options;
+
+		options = g_variant_get_child_value (parameters, 0);
+		gypsy_client_set_start_options (client, options, &error);
+		g_variant_unref (options);
+	} else if (g_str_equal (method_name, "Start")) {
+		gypsy_client_start (client, &error);
+	} else if (g_str_equal (method_name, "Stop")) {
+		gypsy_client_stop (client, &error);
+	} else if (g_str_equal (method_name, "Subscribe")) {
+		const char **interfaces;
+
+		g_variant_get (parameters, "(^a&s)", &interfaces);
+		gypsy_client_subscribe (client, interfaces, sender, &error);
+		g_free (interfaces);
+	} else if (g_str_equal (method_name, "Unsubscribe")) {
+		gypsy_client_remove_subscriber (client, sender);
+	} else if (g_str_equal (method_name, "SetMinimumInterval")) {
+		guint interval;
+
+		g_variant_get (parameters, "(u)", &interval);
+		gypsy_client_set_minimum_interval (client, interval, sender,
+						   &error);
+	} else if (g_str_equal (method_name, "InjectAssistance")) {
+		if (inject_assistance (client, invocation, &error)) {
+			return;
+		}
+	} else if (g_str_equal (method_name, "SendCommand")) {
+		if (send_command (client, parameters, invocation, &error)) {
+			return;
+		}
+	}
+
+	if (error != NULL) {
+		g_dbus_method_invocation_return_gerror (invocation, error);
+		g_error_free (error);
+	} else {
+		g_dbus_method_invocation_return_value (invocation, reply);
+	}
+}
+
+static const GDBusInterfaceVTable interface_vtable = {
+	method_call,
+	NULL,
+	NULL
+};
+
+static void
+unregister_objects (GypsyClient *client)
+{
+	GypsyClientPrivate *priv;
+	int i;
+
+	priv = GET_PRIVATE (client);
+
+	if (priv->connection == NULL) {
+		return;
+	}
+
+	for (i = 0; i < priv->registration_ids->len; i++) {
+		g_dbus_connection_unregister_object
+			(priv->connection,
+			 g_array_index (priv->registration_ids, guint, i));
+	}
+	g_array_set_size (priv->registration_ids, 0);
+
+	g_object_unref (priv->connection);
+	priv->connection = NULL;
+}
+
+static void
+finalize (GObject *object) 
+{
+	GypsyClientPrivate *priv;
+
+	priv = GET_PRIVATE (object);
+
+	save_warm_start ((GypsyClient *) object);
+	shutdown_connection ((GypsyClient *) object);
+
+	if (priv->position_id > 0) {
+		g_source_remove (priv->position_id);
+	}
+
+	gypsy_kalman_free (priv->kalman);
+
+	if (priv->shm) {
+		gypsy_shm_publisher_free (priv->shm);
+	}
+
+	g_hash_table_destroy (priv->subscribers);
+	g_array_free (priv->registration_ids, TRUE);
+	g_free (priv->object_path);
+	g_free (priv->log_prefix);
+	g_free (priv->assistance_path);
+	g_free (priv->corrections_path);
+	g_free (priv->device_path);
+
+	((GObjectClass *) gypsy_client_parent_class)->finalize (object);
+}
+
+static void
+dispose (GObject *object)
+{
+	unregister_objects ((GypsyClient *) object);
 
-static void
-dispose (GObject *object)
-{
 	((GObjectClass *) gypsy_client_parent_class)->dispose (object);
 }
 
 static void
-set_property (GObject      *object,
-	      guint         prop_id,
-	      const GValue *value,
-	      GParamSpec   *pspec)
+set_property (GObject      *object,
+	      guint         prop_id,
+	      const GValue *value,
+	      GParamSpec   *pspec)
+{
+	GypsyClientPrivate *priv;
+
+	priv = GET_PRIVATE (object);
+
+	switch (prop_id) {
+	case PROP_DEVICE:
+		priv->device_path = g_value_dup_string (value);
+
+		break;
+
+	default:
+		break;
+	}
+}
+
+static void
+get_property (GObject    *object,
+	      guint       prop_id,
+	      GValue     *value,
+	      GParamSpec *pspec)
+{
+	GypsyClientPrivate *priv;
+
+	priv = GET_PRIVATE (object);
+
+	switch (prop_id) {
+	case PROP_DEVICE:
+		g_value_set_string (value, priv->device_path);
+		break;
+
+	default:
+		break;
+	}
+}
+
+static void
+gypsy_client_class_init (GypsyClientClass *klass)
+{
+	GObjectClass *o_class;
+
+	o_class = (GObjectClass *) klass;
+
+	o_class->finalize = finalize;
+	o_class->dispose = dispose;
+	o_class->set_property = set_property;
+	o_class->get_property = get_property;
+
+	g_type_class_add_private (klass, sizeof (GypsyClientPrivate));
+
+	g_object_class_install_property (o_class,
+					 PROP_DEVICE,
+					 g_param_spec_string ("device_path",
+							      "Device path", 
+							      "The path of the GPS device",
+							      "", 
+							      G_PARAM_READWRITE |
+							      G_PARAM_CONSTRUCT_ONLY));
+
+	signals[ACCURACY_CHANGED] = g_signal_new ("accuracy-changed",
+						  G_TYPE_FROM_CLASS (klass),
+						  G_SIGNAL_RUN_FIRST |
+						  G_SIGNAL_NO_RECURSE,
+						  G_STRUCT_OFFSET (GypsyClientClass, 
+								   accuracy_changed),
+						  NULL, NULL,
+						  gypsy_marshal_VOID__INT_DOUBLE_DOUBLE_DOUBLE,
+						  G_TYPE_NONE,
+						  4, G_TYPE_INT,
+						  G_TYPE_DOUBLE, G_TYPE_DOUBLE, G_TYPE_DOUBLE);
+	signals[POSITION_CHANGED] = g_signal_new ("position-changed",
+						  G_TYPE_FROM_CLASS (klass),
+						  G_SIGNAL_RUN_FIRST |
+						  G_SIGNAL_NO_RECURSE,
+						  G_STRUCT_OFFSET (GypsyClientClass, 
+								   position_changed),
+						  NULL, NULL,
+						  gypsy_marshal_VOID__INT_INT_DOUBLE_DOUBLE_DOUBLE,
+						  G_TYPE_NONE,
+						  5, G_TYPE_INT,
+						  G_TYPE_INT, G_TYPE_DOUBLE,
+						  G_TYPE_DOUBLE, G_TYPE_DOUBLE);
+	signals[COURSE_CHANGED] = g_signal_new ("course-changed",
+						G_TYPE_FROM_CLASS (klass),
+						G_SIGNAL_RUN_FIRST |
+						G_SIGNAL_NO_RECURSE,
+						G_STRUCT_OFFSET (GypsyClientClass, 
+								 course_changed),
+						NULL, NULL,
+						gypsy_marshal_VOID__INT_INT_DOUBLE_DOUBLE_DOUBLE,
+						G_TYPE_NONE,
+						5, G_TYPE_INT,
+						G_TYPE_INT, G_TYPE_DOUBLE,
+						G_TYPE_DOUBLE, G_TYPE_DOUBLE);
+	/* The satellites are an a(ubuuu), as sent on the bus */
+	signals[SATELLITES_CHANGED] = g_signal_new ("satellites-changed",
+						    G_TYPE_FROM_CLASS (klass),
+						    G_SIGNAL_RUN_LAST, 0,
+						    NULL, NULL,
+						    g_cclosure_marshal_VOID__VARIANT,
+						    G_TYPE_NONE, 1,
+						    G_TYPE_VARIANT);
+
+	signals[CONNECTION_CHANGED] = g_signal_new ("connection-status-changed",
+						    G_TYPE_FROM_CLASS (klass),
+						    G_SIGNAL_RUN_FIRST |
+						    G_SIGNAL_NO_RECURSE,
+						    G_STRUCT_OFFSET (GypsyClientClass, connection_changed),
+						    NULL, NULL,
+						    g_cclosure_marshal_VOID__BOOLEAN,
+						    G_TYPE_NONE,
+						    1, G_TYPE_BOOLEAN);
+	signals[FIX_STATUS] = g_signal_new ("fix-status-changed",
+					    G_TYPE_FROM_CLASS (klass),
+					    G_SIGNAL_RUN_FIRST |
+					    G_SIGNAL_NO_RECURSE,
+					    G_STRUCT_OFFSET (GypsyClientClass,
+							     fix_status_changed),
+					    NULL, NULL,
+					    g_cclosure_marshal_VOID__INT,
+					    G_TYPE_NONE, 
+					    1, G_TYPE_INT);
+	signals[TIME_CHANGED] = g_signal_new ("time-changed",
+					      G_TYPE_FROM_CLASS (klass),
+					      G_SIGNAL_RUN_FIRST |
+					      G_SIGNAL_NO_RECURSE,
+					      G_STRUCT_OFFSET (GypsyClientClass,
+							       time_changed),
+					      NULL, NULL,
+					      g_cclosure_marshal_VOID__INT,
+					      G_TYPE_NONE,
+					      1, G_TYPE_INT);
+
+	introspection_data = g_dbus_node_info_new_for_xml (introspection_xml,
+							   NULL);
+	g_assert (introspection_data != NULL);
+}
+
+static void
+gypsy_client_init (GypsyClient *client)
 {
 	GypsyClientPrivate *priv;
 
-	priv = GET_PRIVATE (object);
+	priv = GET_PRIVATE (client);
+	priv->fd = -1;
+	priv->type = GYPSY_DEVICE_TYPE_UNKNOWN;
+	priv->baudrate = B0;
+	priv->timestamp = 0;
+	priv->parser = NULL;
+	priv->dgps_age = -1.0;
+	priv->dgps_station = -1;
+
+	priv->subscribers = g_hash_table_new_full (g_str_hash, g_str_equal,
+						   NULL, subscriber_free);
+	priv->registration_ids = g_array_new (FALSE, FALSE, sizeof (guint));
+	priv->prune_sentences = FALSE;
+	priv->output_profile = NMEA_SENTENCE_DEFAULT;
+}
 
-	switch (prop_id) {
-	case PROP_DEVICE:
-		priv->device_path = g_value_dup_string (value);
+/* Great circle distance in metres */
+static double
+distance_between (double latitude1,
+		  double longitude1,
+		  double latitude2,
+		  double longitude2)
+{
+	double dlat, dlon, a;
 
-		break;
+	dlat = deg2rad (latitude2 - latitude1);
+	dlon = deg2rad (longitude2 - longitude1);
+
+	a = sin (dlat / 2) * sin (dlat / 2) +
+		cos (deg2rad (latitude1)) * cos (deg2rad (latitude2)) *
+		sin (dlon / 2) * sin (dlon / 2);
+
+	return 2 * EARTH_MEAN_RADIUS * atan2 (sqrt (a), sqrt (1 - a));
+}
+
+/* Whether the position has moved far enough, and long enough after the
+   last PositionChanged, to emit another. A stationary receiver's jitter
+   would otherwise be sent with every fix */
+static gboolean
+position_passes_thresholds (GypsyClientPrivate *priv,
+			    gint64              now)
+{
+	double min_altitude;
+
+	/* Always tell people about gaining or losing a field */
+	if (priv->position_fields != priv->emitted_fields) {
+		return TRUE;
+	}
+
+	if (priv->min_time > 0 && now - priv->emitted_time < priv->min_time) {
+		return FALSE;
+	}
+
+	if ((priv->position_fields & (POSITION_LATITUDE | POSITION_LONGITUDE)) ==
+	    (POSITION_LATITUDE | POSITION_LONGITUDE)) {
+		double moved;
+
+		moved = distance_between (priv->emitted_latitude,
+					  priv->emitted_longitude,
+					  priv->latitude, priv->longitude);
+		if (priv->min_distance > 0.0 ? moved >= priv->min_distance :
+		    moved > 0.0) {
+			return TRUE;
+		}
+	}
 
+	if (priv->position_fields & POSITION_ALTITUDE) {
+		double climbed;
+
+		min_altitude = priv->min_altitude > 0.0 ?
+			priv->min_altitude : priv->min_distance;
+		climbed = fabs (priv->altitude - priv->emitted_altitude);
+		if (min_altitude > 0.0 ? climbed >= min_altitude :
+		    climbed > 0.0) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static void
+emit_position_changed (GypsyClient *client,
+		       gint64       now)
+{
+	GypsyClientPrivate *priv;
+
+	priv = GET_PRIVATE (client);
+
+	if (priv->position_id > 0) {
+		g_source_remove (priv->position_id);
+		priv->position_id = 0;
+	}
+
+	priv->emitted_fields = priv->position_fields;
+	priv->emitted_latitude = priv->latitude;
+	priv->emitted_longitude = priv->longitude;
+	priv->emitted_altitude = priv->altitude;
+	priv->emitted_time = now;
+
+	g_signal_emit (client, signals[POSITION_CHANGED], 0,
+		       priv->position_fields, priv->timestamp, 
+		       priv->latitude, priv->longitude, priv->altitude);
+	emit_limited_signal (client, LIMITED_POSITION);
+}
+
+/* MinTime is up since the last PositionChanged, so the position held
+   back then is sent if it has moved far enough, even if the receiver
+   hasn't moved since */
+static gboolean
+emit_held_position (gpointer userdata)
+{
+	GypsyClient *client = userdata;
+	GypsyClientPrivate *priv;
+	gint64 now;
+
+	priv = GET_PRIVATE (client);
+	priv->position_id = 0;
+
+	now = g_get_monotonic_time () / 1000;
+	if (position_passes_thresholds (priv, now)) {
+		emit_position_changed (client, now);
+	}
+
+	return FALSE;
+}
+
+/* The receiver's range error in metres, which the DOPs scale
+   to give how far out a fix is likely to be */
+static double
+range_error (FixQuality quality)
+{
+	switch (quality) {
+	case FIX_QUALITY_RTK_FIXED:
+		return 0.02;
+	case FIX_QUALITY_RTK_FLOAT:
+		return 0.5;
+	case FIX_QUALITY_DGPS:
+	case FIX_QUALITY_PPS:
+		return 1.0;
 	default:
-		break;
+		return 4.0;
 	}
 }
 
+/* For when the receiver doesn't send the DOPs, and the least believed,
+   as a receiver that has just lost a fix can report silly small ones */
+#define DEFAULT_DOP 2.0
+#define MIN_DOP 0.5
+
+/* Metres per second */
+#define VELOCITY_ERROR 0.5
+
 static void
-get_property (GObject    *object,
-	      guint       prop_id,
-	      GValue     *value,
-	      GParamSpec *pspec)
+schedule_smoothed (GypsyClient *client)
 {
 	GypsyClientPrivate *priv;
 
-	priv = GET_PRIVATE (object);
+	priv = GET_PRIVATE (client);
 
-	switch (prop_id) {
-	case PROP_DEVICE:
-		g_value_set_string (value, priv->device_path);
-		break;
+	if (priv->smoothed_id == 0) {
+		priv->smoothed_id = g_idle_add (emit_smoothed, client);
+	}
+}
+
+/* Gives the filter the first of each measurement in an epoch. The DOPs
+   are the latest there are, which can be the last epoch's when GSA comes
+   after GGA */
+static void
+smooth_position (GypsyClient   *client,
+		 PositionFields fields_set,
+		 double         latitude,
+		 double         longitude,
+		 double         altitude)
+{
+	GypsyClientPrivate *priv;
+	double error, dop;
+
+	priv = GET_PRIVATE (client);
+
+	if (priv->kalman == NULL || priv->fix_time == 0) {
+		return;
+	}
+
+	error = range_error (priv->fix_quality);
+
+	if ((fields_set & (POSITION_LATITUDE | POSITION_LONGITUDE)) ==
+	    (POSITION_LATITUDE | POSITION_LONGITUDE) &&
+	    !(priv->smoothed_inputs & SMOOTHED_POSITION)) {
+		dop = (priv->accuracy_fields & ACCURACY_HORIZONTAL) ?
+			priv->hdop : DEFAULT_DOP;
+		gypsy_kalman_add_position (priv->kalman, priv->fix_time,
+					   latitude, longitude,
+					   MAX (dop, MIN_DOP) * error);
+		priv->smoothed_inputs |= SMOOTHED_POSITION;
+		schedule_smoothed (client);
+	}
+
+	if ((fields_set & POSITION_ALTITUDE) &&
+	    !(priv->smoothed_inputs & SMOOTHED_ALTITUDE)) {
+		dop = (priv->accuracy_fields & ACCURACY_VERTICAL) ?
+			priv->vdop : DEFAULT_DOP * 1.5;
+		gypsy_kalman_add_altitude (priv->kalman, priv->fix_time,
+					   altitude,
+					   MAX (dop, MIN_DOP) * error);
+		priv->smoothed_inputs |= SMOOTHED_ALTITUDE;
+		schedule_smoothed (client);
+	}
+}
+
+static void
+smooth_course (GypsyClient *client,
+	       CourseFields fields_set,
+	       double       speed,
+	       double       direction)
+{
+	GypsyClientPrivate *priv;
+
+	priv = GET_PRIVATE (client);
+
+	if (priv->kalman == NULL || priv->fix_time == 0 ||
+	    (fields_set & (COURSE_SPEED | COURSE_DIRECTION)) !=
+	    (COURSE_SPEED | COURSE_DIRECTION) ||
+	    (priv->smoothed_inputs & SMOOTHED_VELOCITY)) {
+		return;
+	}
+
+	speed *= KNOTS_TO_MPS;
+	gypsy_kalman_add_velocity (priv->kalman, priv->fix_time,
+				   speed * cos (deg2rad (direction)),
+				   speed * sin (deg2rad (direction)),
+				   VELOCITY_ERROR);
+	priv->smoothed_inputs |= SMOOTHED_VELOCITY;
+	schedule_smoothed (client);
+}
+
+static gboolean
+emit_course_changed (gpointer userdata)
+{
+	GypsyClient *client = userdata;
+	GypsyClientPrivate *priv;
+
+	priv = GET_PRIVATE (client);
+
+	priv->course_id = 0;
+
+	g_signal_emit (client, signals[COURSE_CHANGED], 0,
+		       priv->course_fields, priv->timestamp,
+		       priv->speed, priv->direction, priv->climb);
+	emit_limited_signal (client, LIMITED_COURSE);
+
+	return FALSE;
+}
+
+/* The speed and direction come in one sentence and the altitude the climb
+   is worked out from in another, so CourseChanged waits for everything
+   that has been read to be parsed to be sent once an epoch */
+static void
+schedule_course_changed (GypsyClient *client)
+{
+	GypsyClientPrivate *priv;
+
+	priv = GET_PRIVATE (client);
+
+	if (priv->course_id == 0) {
+		priv->course_id = g_idle_add (emit_course_changed, client);
+	}
+}
+
+/* The time of the current epoch in seconds, to a fraction of a second
+   if the receiver says. Without a timestamp it's when the epoch arrived */
+static double
+get_epoch_time (GypsyClientPrivate *priv)
+{
+	if (priv->timestamp > 0) {
+		return priv->timestamp + priv->timestamp_fraction;
+	}
+
+	return priv->fix_time / (double) G_USEC_PER_SEC;
+}
+
+/* Forgets the altitudes, and unsets the climb worked out from them */
+static void
+clear_climb (GypsyClient *client)
+{
+	GypsyClientPrivate *priv;
+
+	priv = GET_PRIVATE (client);
+
+	priv->climb_sample_count = 0;
+
+	if (priv->course_fields & COURSE_CLIMB) {
+		priv->climb = 0.0;
+		priv->course_fields &= ~COURSE_CLIMB;
+		publish_fix (client);
+		schedule_course_changed (client);
+	}
+}
+
+/* Runs every CLIMB_MAX_GAP seconds while there are altitudes, rather
+   than being moved along by each one, and unsets the climb if none
+   have come since */
+static gboolean
+check_climb_stale (gpointer userdata)
+{
+	GypsyClient *client = userdata;
+	GypsyClientPrivate *priv;
+	gint64 age;
+
+	priv = GET_PRIVATE (client);
+
+	age = g_get_monotonic_time () - priv->climb_sample_time;
+	if (age < CLIMB_MAX_GAP * G_USEC_PER_SEC) {
+		priv->climb_stale_id = g_timeout_add
+			((CLIMB_MAX_GAP * G_USEC_PER_SEC - age) / 1000 + 1,
+			 check_climb_stale, client);
+		return FALSE;
+	}
+
+	GYPSY_NOTE (CLIENT, "No altitude for %.0f seconds, unsetting the climb",
+		    CLIMB_MAX_GAP);
+	priv->climb_stale_id = 0;
+	clear_climb (client);
+
+	return FALSE;
+}
+
+/* Adds the epoch's altitude to the window, and sets the climb to the
+   least squares slope through it */
+static void
+estimate_climb (GypsyClient *client,
+		double       altitude)
+{
+	GypsyClientPrivate *priv;
+	ClimbSample *samples;
+	double now, t0, mean_t = 0.0, mean_a = 0.0, stt = 0.0, sta = 0.0;
+	double climb;
+	int i, first;
+
+	priv = GET_PRIVATE (client);
+	samples = priv->climb_samples;
+
+	now = get_epoch_time (priv);
+	if (now <= 0.0) {
+		return;
+	}
+
+	if (priv->climb_sample_count > 0) {
+		double last = samples[priv->climb_sample_count - 1].time;
+
+		/* GGA and a proprietary sentence can both
+		   give the altitude for the same epoch */
+		if (now == last) {
+			return;
+		}
 
-	default:
-		break;
+		/* Time has gone backwards, or there's been a gap */
+		if (now < last || now - last > CLIMB_MAX_GAP) {
+			clear_climb (client);
+		}
 	}
-}
 
-static void
-gypsy_client_class_init (GypsyClientClass *klass)
-{
-	GObjectClass *o_class;
+	/* The receiver may stop sending altitudes altogether */
+	priv->climb_sample_time = g_get_monotonic_time ();
+	if (priv->climb_stale_id == 0) {
+		priv->climb_stale_id = g_timeout_add (CLIMB_MAX_GAP * 1000,
+						      check_climb_stale,
+						      client);
+	}
 
-	o_class = (GObjectClass *) klass;
+	/* Drop what's fallen out of the window, keeping room for this one
+	   and always the one before it */
+	for (first = 0; first < priv->climb_sample_count; first++) {
+		if ((now - samples[first].time <= CLIMB_WINDOW ||
+		     first == priv->climb_sample_count - 1) &&
+		    priv->climb_sample_count - first < CLIMB_SAMPLES) {
+			break;
+		}
+	}
+	if (first > 0) {
+		priv->climb_sample_count -= first;
+		memmove (samples, samples + first,
+			 priv->climb_sample_count * sizeof (ClimbSample));
+	}
 
-	o_class->finalize = finalize;
-	o_class->dispose = dispose;
-	o_class->set_property = set_property;
-	o_class->get_property = get_property;
+	samples[priv->climb_sample_count].time = now;
+	samples[priv->climb_sample_count].altitude = altitude;
+	priv->climb_sample_count++;
 
-	g_type_class_add_private (klass, sizeof (GypsyClientPrivate));
+	if (priv->climb_sample_count < 2) {
+		return;
+	}
 
-	g_object_class_install_property (o_class,
-					 PROP_DEVICE,
-					 g_param_spec_string ("device_path",
-							      "Device path", 
-							      "The path of the GPS device",
-							      "", 
-							      G_PARAM_WRITABLE |
-							      G_PARAM_CONSTRUCT_ONLY));
+	/* Times are taken from the first, so seconds
+	   since 1970 don't swamp the fractions */
+	t0 = samples[0].time;
+	for (i = 0; i < priv->climb_sample_count; i++) {
+		mean_t += samples[i].time - t0;
+		mean_a += samples[i].altitude;
+	}
+	mean_t /= priv->climb_sample_count;
+	mean_a /= priv->climb_sample_count;
 
-	signals[ACCURACY_CHANGED] = g_signal_new ("accuracy-changed",
-						  G_TYPE_FROM_CLASS (klass),
-						  G_SIGNAL_RUN_FIRST |
-						  G_SIGNAL_NO_RECURSE,
-						  G_STRUCT_OFFSET (GypsyClientClass, 
-								   accuracy_changed),
-						  NULL, NULL,
-						  gypsy_marshal_VOID__INT_DOUBLE_DOUBLE_DOUBLE,
-						  G_TYPE_NONE,
-						  4, G_TYPE_INT,
-						  G_TYPE_DOUBLE, G_TYPE_DOUBLE, G_TYPE_DOUBLE);
-	signals[POSITION_CHANGED] = g_signal_new ("position-changed",
-						  G_TYPE_FROM_CLASS (klass),
-						  G_SIGNAL_RUN_FIRST |
-						  G_SIGNAL_NO_RECURSE,
-						  G_STRUCT_OFFSET (GypsyClientClass, 
-								   position_changed),
-						  NULL, NULL,
-						  gypsy_marshal_VOID__INT_INT_DOUBLE_DOUBLE_DOUBLE,
-						  G_TYPE_NONE,
-						  5, G_TYPE_INT,
-						  G_TYPE_INT, G_TYPE_DOUBLE,
-						  G_TYPE_DOUBLE, G_TYPE_DOUBLE);
-	signals[COURSE_CHANGED] = g_signal_new ("course-changed",
-						G_TYPE_FROM_CLASS (klass),
-						G_SIGNAL_RUN_FIRST |
-						G_SIGNAL_NO_RECURSE,
-						G_STRUCT_OFFSET (GypsyClientClass, 
-								 course_changed),
-						NULL, NULL,
-						gypsy_marshal_VOID__INT_INT_DOUBLE_DOUBLE_DOUBLE,
-						G_TYPE_NONE,
-						5, G_TYPE_INT,
-						G_TYPE_INT, G_TYPE_DOUBLE,
-						G_TYPE_DOUBLE, G_TYPE_DOUBLE);
-	signals[SATELLITES_CHANGED] = g_signal_new ("satellites-changed",
-						    G_TYPE_FROM_CLASS (klass),
-						    G_SIGNAL_RUN_LAST, 0,
-						    NULL, NULL,
-						    g_cclosure_marshal_VOID__BOXED,
-						    G_TYPE_NONE, 1, 
-						    (dbus_g_type_get_collection
-						     ("GPtrArray", 
-						      (dbus_g_type_get_struct
-						       ("GValueArray", 
-							G_TYPE_UINT, 
-							G_TYPE_BOOLEAN,
-							G_TYPE_UINT,
-							G_TYPE_UINT,
-							G_TYPE_UINT,
-							G_TYPE_INVALID)))));
-						    
-	signals[CONNECTION_CHANGED] = g_signal_new ("connection-status-changed",
-						    G_TYPE_FROM_CLASS (klass),
-						    G_SIGNAL_RUN_FIRST |
-						    G_SIGNAL_NO_RECURSE,
-						    G_STRUCT_OFFSET (GypsyClientClass, connection_changed),
-						    NULL, NULL,
-						    g_cclosure_marshal_VOID__BOOLEAN,
-						    G_TYPE_NONE,
-						    1, G_TYPE_BOOLEAN);
-	signals[FIX_STATUS] = g_signal_new ("fix-status-changed",
-					    G_TYPE_FROM_CLASS (klass),
-					    G_SIGNAL_RUN_FIRST |
-					    G_SIGNAL_NO_RECURSE,
-					    G_STRUCT_OFFSET (GypsyClientClass,
-							     fix_status_changed),
-					    NULL, NULL,
-					    g_cclosure_marshal_VOID__INT,
-					    G_TYPE_NONE, 
-					    1, G_TYPE_INT);
-	signals[TIME_CHANGED] = g_signal_new ("time-changed",
-					      G_TYPE_FROM_CLASS (klass),
-					      G_SIGNAL_RUN_FIRST |
-					      G_SIGNAL_NO_RECURSE,
-					      G_STRUCT_OFFSET (GypsyClientClass,
-							       time_changed),
-					      NULL, NULL,
-					      g_cclosure_marshal_VOID__INT,
-					      G_TYPE_NONE,
-					      1, G_TYPE_INT);
+	for (i = 0; i < priv->climb_sample_count; i++) {
+		double dt = samples[i].time - t0 - mean_t;
 
-	dbus_g_object_type_install_info (G_TYPE_FROM_CLASS (klass),
-					 &dbus_glib_gypsy_client_object_info);
-}
+		stt += dt * dt;
+		sta += dt * (samples[i].altitude - mean_a);
+	}
 
-static void
-gypsy_client_init (GypsyClient *client)
-{
-	GypsyClientPrivate *priv;
+	if (stt <= 0.0) {
+		return;
+	}
 
-	priv = GET_PRIVATE (client);
-	priv->fd = -1;
-	priv->type = GYPSY_DEVICE_TYPE_UNKNOWN;
-	priv->baudrate = B0;
-	priv->timestamp = 0;
-	priv->last_alt_timestamp = 0;
-	priv->parser = NULL;
+	climb = sta / stt;
+	if (!(priv->course_fields & COURSE_CLIMB) || priv->climb != climb) {
+		priv->climb = climb;
+		priv->course_fields |= COURSE_CLIMB;
+		publish_fix (client);
+		schedule_course_changed (client);
+	}
 }
 
 void
@@ -1071,6 +3551,15 @@ gypsy_client_set_position (GypsyClient   *client,
 
 	priv = GET_PRIVATE (client);
 
+	if (fields_set & (POSITION_LATITUDE | POSITION_LONGITUDE)) {
+		priv->stale = FALSE;
+	}
+
+	if ((fields_set & (POSITION_LATITUDE | POSITION_LONGITUDE)) ==
+	    (POSITION_LATITUDE | POSITION_LONGITUDE)) {
+		note_position_epoch (priv, latitude, longitude);
+	}
+
 	if (fields_set & POSITION_LATITUDE) {
 		if (priv->position_fields & POSITION_LATITUDE) {
 			if (priv->latitude != latitude) {
@@ -1091,46 +3580,45 @@ gypsy_client_set_position (GypsyClient   *client,
 				changed = TRUE;
 			}
 		} else {
-				priv->longitude = longitude;
-				priv->position_fields |= POSITION_LONGITUDE;
-				changed = TRUE;
+			priv->longitude = longitude;
+			priv->position_fields |= POSITION_LONGITUDE;
+			changed = TRUE;
 		}
 	}
 
 	if (fields_set & POSITION_ALTITUDE) {
 		if (priv->position_fields & POSITION_ALTITUDE) {
 			if (priv->altitude != altitude) {
-				/* If we've got a timestamp for the last alt
-				   then we are able to calculate the climb. */
-				if (priv->last_alt_timestamp > 0) {
-					int dt;
-					double da, climb;
-
-					dt = priv->timestamp - priv->last_alt_timestamp;
-					da = altitude - priv->altitude;
-					climb = da / (double) dt;
-					gypsy_client_set_course (client,
-								 COURSE_CLIMB,
-								 0.0, 0.0, 
-								 climb);
-				}
-
 				priv->altitude = altitude;
-				priv->last_alt_timestamp = priv->timestamp;
 				changed = TRUE;
 			} 
 		} else {
 			priv->altitude = altitude;
-			priv->last_alt_timestamp = priv->timestamp;
 			priv->position_fields |= POSITION_ALTITUDE;
 			changed = TRUE;
 		}
+
+		if (!priv->native_climb) {
+			estimate_climb (client, altitude);
+		}
 	}
 
+	smooth_position (client, fields_set, latitude, longitude, altitude);
+
 	if (changed) {
-		g_signal_emit (client, signals[POSITION_CHANGED], 0,
-			       priv->position_fields, priv->timestamp, 
-			       priv->latitude, priv->longitude, priv->altitude);
+		gint64 now;
+
+		publish_fix (client);
+
+		now = g_get_monotonic_time () / 1000;
+		if (position_passes_thresholds (priv, now)) {
+			emit_position_changed (client, now);
+		} else if (priv->min_time > 0 && priv->position_id == 0 &&
+			   now - priv->emitted_time < priv->min_time) {
+			priv->position_id = g_timeout_add
+				(priv->emitted_time + priv->min_time - now,
+				 emit_held_position, client);
+		}
 	}
 }
 
@@ -1146,6 +3634,12 @@ gypsy_client_set_course (GypsyClient *client,
 
 	priv = GET_PRIVATE (client);
 
+	/* Once the receiver gives its vertical velocity,
+	   that's used instead of working it out */
+	if (fields_set & COURSE_CLIMB) {
+		priv->native_climb = TRUE;
+	}
+
 	if (fields_set & COURSE_SPEED) {
 		if (priv->course_fields & COURSE_SPEED) {
 			if (priv->speed != speed) {
@@ -1185,25 +3679,40 @@ gypsy_client_set_course (GypsyClient *client,
 		}
 	}
 
+	smooth_course (client, fields_set, speed, direction);
+
 	if (changed) {
-		/* Emit course changed, we don't deal with climb yet */
-		g_signal_emit (client, signals[COURSE_CHANGED], 0,
-			       priv->course_fields, priv->timestamp, 
-			       priv->speed, priv->direction, priv->climb);
+		publish_fix (client);
+		schedule_course_changed (client);
 	}
 }
 
 void
 gypsy_client_set_timestamp (GypsyClient *client,
 			    int          utc_time)
+{
+	gypsy_client_set_precise_timestamp (client, utc_time, 0.0);
+}
+
+/* For receivers that give the time to a fraction of a second. fraction is
+   added to utc_time, and can be negative if utc_time has been rounded */
+void
+gypsy_client_set_precise_timestamp (GypsyClient *client,
+				    int          utc_time,
+				    double       fraction)
 {
 	GypsyClientPrivate *priv;
 
 	priv = GET_PRIVATE (client);
 
+	priv->timestamp_fraction = fraction;
+
 	if (priv->timestamp != utc_time) {
 		priv->timestamp = utc_time;
+		publish_fix (client);
 		g_signal_emit (client, signals[TIME_CHANGED], 0, utc_time);
+		emit_dbus_signal (client, GYPSY_TIME_INTERFACE, "TimeChanged",
+				  g_variant_new ("(i)", utc_time));
 	}
 }
 
@@ -1229,7 +3738,34 @@ gypsy_client_set_fix_type (GypsyClient *client,
 
 	if (weak_type != type) {
 		priv->fix_type = type;
+		publish_fix (client);
 		g_signal_emit (G_OBJECT (client), signals[FIX_STATUS], 0, type);
+		emit_dbus_signal (client, GYPSY_DEVICE_INTERFACE,
+				  "FixStatusChanged",
+				  g_variant_new ("(i)", type));
+	}
+}
+
+/* From GGA, which also says how old the corrections
+   the receiver is using are and where they are from */
+void
+gypsy_client_set_fix_quality (GypsyClient *client,
+			      FixQuality   quality,
+			      double       dgps_age,
+			      int          dgps_station)
+{
+	GypsyClientPrivate *priv;
+
+	priv = GET_PRIVATE (client);
+
+	priv->dgps_age = dgps_age;
+	priv->dgps_station = dgps_station;
+
+	if (priv->fix_quality != quality) {
+		priv->fix_quality = quality;
+		emit_dbus_signal (client, GYPSY_DEVICE_INTERFACE,
+				  "FixQualityChanged",
+				  g_variant_new ("(i)", quality));
 	}
 }
 
@@ -1285,9 +3821,11 @@ gypsy_client_set_accuracy (GypsyClient *client,
 	}
 
 	if (changed) {
+		publish_fix (client);
 		g_signal_emit (client, signals[ACCURACY_CHANGED], 0,
 			       priv->accuracy_fields,
 			       priv->pdop, priv->hdop, priv->vdop);
+		emit_limited_signal (client, LIMITED_ACCURACY);
 	}
 }
 
@@ -1307,6 +3845,12 @@ gypsy_client_add_satellite (GypsyClient *client,
 
 	priv = GET_PRIVATE (client);
 
+	/* Several constellations together can see more than there's room
+	   for. The first ones given are kept */
+	if (priv->new_sat_count == MAX_SAT_SVID) {
+		return;
+	}
+
 	satellite = &(priv->new_satellites[priv->new_sat_count]);
 	satellite->satellite_id = satellite_id;
 	satellite->in_use = in_use;
@@ -1367,43 +3911,304 @@ gypsy_client_set_satellites (GypsyClient *client)
 	}
 
 	if (changed) {
-		GPtrArray *sat_array;
-		int i;
+		GVariant *satellites;
+
+		publish_fix (client);
+
+		satellites = g_variant_ref_sink (build_satellites (priv));
+		g_signal_emit (client, signals[SATELLITES_CHANGED], 0,
+			       satellites);
+		g_variant_unref (satellites);
+
+		emit_limited_signal (client, LIMITED_SATELLITES);
+	}
+
+	priv->new_sat_count = 0;
+}
+
+/* For readers outside D-Bus, such as gpsd watchers, which get
+   every sentence for as long as they are there */
+void
+gypsy_client_add_consumer (GypsyClient *client)
+{
+	GypsyClientPrivate *priv;
+
+	priv = GET_PRIVATE (client);
+
+	priv->consumers++;
+	update_output_profile (client);
+}
+
+void
+gypsy_client_remove_consumer (GypsyClient *client)
+{
+	GypsyClientPrivate *priv;
+
+	priv = GET_PRIVATE (client);
+
+	g_return_if_fail (priv->consumers > 0);
+
+	priv->consumers--;
+	update_output_profile (client);
+}
+
+/* Called when a subscriber goes away without unsubscribing */
+void
+gypsy_client_remove_subscriber (GypsyClient *client,
+				const char  *sender)
+{
+	GypsyClientPrivate *priv;
+	GypsyClientSubscriber *subscriber;
+
+	priv = GET_PRIVATE (client);
+
+	subscriber = g_hash_table_lookup (priv->subscribers, sender);
+	if (subscriber && subscriber->min_interval > 0) {
+		priv->limited_count--;
+	}
+
+	if (g_hash_table_remove (priv->subscribers, sender)) {
+		GYPSY_NOTE (CLIENT, "%s unsubscribed from %s", sender,
+			    priv->device_path);
+		update_output_profile (client);
+	}
+}
+
+/* Fills fix with everything we know about the device */
+void
+gypsy_client_get_fix (GypsyClient *client,
+		      GypsyShmFix *fix)
+{
+	GypsyClientPrivate *priv;
+	int i;
+
+	priv = GET_PRIVATE (client);
+
+	/* The enums are the same as libgypsy's */
+	fix->timestamp = priv->timestamp;
+	fix->fix_status = (GypsyDeviceFixStatus) priv->fix_type;
+	fix->position_fields = (GypsyPositionFields) priv->position_fields;
+	fix->course_fields = (GypsyCourseFields) priv->course_fields;
+	fix->accuracy_fields = (GypsyAccuracyFields) priv->accuracy_fields;
+
+	fix->latitude = priv->latitude;
+	fix->longitude = priv->longitude;
+	fix->altitude = priv->altitude;
+	fix->speed = priv->speed;
+	fix->direction = priv->direction;
+	fix->climb = priv->climb;
+	fix->pdop = priv->pdop;
+	fix->hdop = priv->hdop;
+	fix->vdop = priv->vdop;
+
+	fix->satellite_count = MIN (priv->sat_count, GYPSY_SHM_MAX_SATELLITES);
+	for (i = 0; i < fix->satellite_count; i++) {
+		GypsyClientSatellite *sat = &priv->satellites[i];
+
+		fix->satellites[i].satellite_id = sat->satellite_id;
+		fix->satellites[i].in_use = sat->in_use;
+		fix->satellites[i].elevation = sat->elevation;
+		fix->satellites[i].azimuth = sat->azimuth;
+		fix->satellites[i].snr = sat->snr;
+	}
+}
+
+/* The name a device is known by outside the daemon: the last element of
+   its object path, its shared memory segment and its raw stream. Only
+   [A-Za-z0-9_] are allowed in object paths, so every other byte, and _
+   itself, is written as _ and two hex digits, the way systemd escapes
+   unit names. Unlike folding them all to _ this is reversible, so two
+   devices never share a name. Devices directly in /dev are known by
+   their node name; anything else, URL style devices included, keeps the
+   whole string so its options tell it apart. */
+char *
+gypsy_client_device_name (const char *device_path)
+{
+	const char *name, *p;
+	GString *escaped;
+
+	name = device_path;
+	if (g_str_has_prefix (device_path, "/dev/") &&
+	    strchr (device_path + 5, '/') == NULL &&
+	    device_path[5] != '\0') {
+		name = device_path + 5;
+	}
 
-		sat_array = g_ptr_array_new ();
-		for (i = 0; i < priv->sat_count; i++) {
-			GValue sat_struct = {0, };
-			GypsyClientSatellite *sat;
-
-			sat = &priv->satellites[i];
-
-			g_value_init (&sat_struct,
-				      GYPSY_CLIENT_SATELLITES_CHANGED_TYPE);
-			g_value_take_boxed (&sat_struct,
-					    dbus_g_type_specialized_construct
-					    (GYPSY_CLIENT_SATELLITES_CHANGED_TYPE));
-
-			dbus_g_type_struct_set (&sat_struct,
-						0, sat->satellite_id,
-						1, sat->in_use,
-						2, sat->elevation,
-						3, sat->azimuth,
-						4, sat->snr,
-						G_MAXUINT);
-			g_ptr_array_add (sat_array, 
-					 g_value_get_boxed (&sat_struct));
+	escaped = g_string_sized_new (strlen (name));
+	for (p = name; *p; p++) {
+		if (g_ascii_isalnum (*p)) {
+			g_string_append_c (escaped, *p);
+		} else {
+			g_string_append_printf (escaped, "_%02x",
+						(guchar) *p);
 		}
+	}
+
+	return g_string_free (escaped, FALSE);
+}
+
+/* Puts the client on every Gypsy interface at object_path */
+gboolean
+gypsy_client_register (GypsyClient     *client,
+		       GDBusConnection *connection,
+		       const char      *object_path,
+		       GError         **error)
+{
+	GypsyClientPrivate *priv;
+	int i;
 
-		g_signal_emit (client, signals[SATELLITES_CHANGED], 0, 
-			       sat_array);
+	priv = GET_PRIVATE (client);
+
+	g_return_val_if_fail (priv->connection == NULL, FALSE);
+
+	priv->connection = g_object_ref (connection);
+	g_free (priv->object_path);
+	priv->object_path = g_strdup (object_path);
+
+	for (i = 0; introspection_data->interfaces[i] != NULL; i++) {
+		guint id;
 
-		for (i = 0; i < sat_array->len; i++) {
-			g_boxed_free (GYPSY_CLIENT_SATELLITES_CHANGED_TYPE,
-				      g_ptr_array_index (sat_array, i));
+		id = g_dbus_connection_register_object
+			(connection, object_path,
+			 introspection_data->interfaces[i],
+			 &interface_vtable, client, NULL, error);
+		if (id == 0) {
+			unregister_objects (client);
+			return FALSE;
 		}
-		g_ptr_array_free (sat_array, TRUE);
+
+		g_array_append_val (priv->registration_ids, id);
 	}
 
-	priv->new_sat_count = 0;
+	return TRUE;
+}
+
+/* Applies the device's section of the config file, over its entry in the
+   device database, or the defaults if config is NULL. Called when the
+   client is created and whenever the config file changes, so settings
+   are applied to a running device where they can be */
+void
+gypsy_client_set_config (GypsyClient             *client,
+			 const GypsyDeviceConfig *config)
+{
+	GypsyClientPrivate *priv;
+	GypsyDeviceConfig defaults;
+	speed_t speed = B0;
+
+	priv = GET_PRIVATE (client);
+
+	if (config == NULL) {
+		memset (&defaults, 0, sizeof (GypsyDeviceConfig));
+		config = &defaults;
+	}
+
+	if (config->baud_rate > 0 &&
+	    !baud_rate_to_speed (config->baud_rate, &speed)) {
+		g_warning ("Unsupported baud rate %u for %s",
+			   config->baud_rate, priv->device_path);
+	}
+
+	if (speed != B0 && speed != priv->baudrate) {
+		priv->baudrate = speed;
+
+		if (priv->fd > 0 && priv->type == GYPSY_DEVICE_TYPE_SERIAL) {
+			struct termios term;
+
+			if (tcgetattr (priv->fd, &term) < 0 ||
+			    cfsetispeed (&term, speed) < 0 ||
+			    tcsetattr (priv->fd, TCSADRAIN, &term) < 0) {
+				g_warning ("Error setting baud rate of %s: %s",
+					   priv->device_path,
+					   g_strerror (errno));
+			}
+		}
+	}
+
+	/* The protocol is worked out when connecting,
+	   so a change takes effect on the next connection */
+	priv->protocol = config->protocol;
+
+	if (config->update_rate != priv->update_rate) {
+		priv->update_rate = config->update_rate;
+
+		if (priv->update_rate > 0 && priv->queue &&
+		    priv->type == GYPSY_DEVICE_TYPE_SERIAL &&
+		    priv->parser && GYPSY_IS_NMEA_PARSER (priv->parser)) {
+			send_update_rate (priv->queue, priv->commands,
+					  priv->update_rate);
+		}
+	}
+
+	priv->power_down = config->power_down;
+	priv->commands = config->commands;
+
+	/* Read when InjectAssistance is called, so the data can be
+	   refreshed without the config changing */
+	g_free (priv->assistance_path);
+	priv->assistance_path = g_strdup (config->assistance);
+
+	if (g_strcmp0 (config->corrections, priv->corrections_path) != 0) {
+		g_free (priv->corrections_path);
+		priv->corrections_path = g_strdup (config->corrections);
+
+		stop_corrections (client);
+		start_corrections (client);
+	}
+
+	if (g_strcmp0 (config->log, priv->log_prefix) != 0) {
+		g_free (priv->log_prefix);
+		priv->log_prefix = g_strdup (config->log);
+
+		/* Start writing to the new log straight away */
+		if (priv->debug_log) {
+			close_nmea_log (client);
+			open_nmea_log (client);
+		} else if (priv->channel && priv->log_prefix) {
+			open_nmea_log (client);
+		}
+	}
+
+	GYPSY_NOTE (CLIENT, "Config for %s: baud %u, protocol %d, rate %u, "
+		    "log %s, power down %d, commands 0x%x", priv->device_path,
+		    config->baud_rate, config->protocol, config->update_rate,
+		    config->log ? config->log : "default", config->power_down,
+		    config->commands);
 }
 
+/* Called by the server once nobody has used the device for a while.
+   Reading stops, and the receiver is put in standby if the config asks
+   for it, but the last fix and the shared memory segment are kept so a
+   later Start picks up where it left off */
+void
+gypsy_client_idle (GypsyClient *client)
+{
+	GypsyClientPrivate *priv;
+
+	priv = GET_PRIVATE (client);
+
+	if (priv->fd == -1 && priv->replay == NULL &&
+	    priv->simulator == NULL) {
+		return;
+	}
+
+	GYPSY_NOTE (CLIENT, "%s is idle", priv->device_path);
+
+	save_warm_start (client);
+
+	if (priv->power_down && priv->queue &&
+	    priv->type == GYPSY_DEVICE_TYPE_SERIAL &&
+	    priv->parser && GYPSY_IS_NMEA_PARSER (priv->parser)) {
+		/* Anything written after standby wakes the
+		   receiver up, so restore the profile first */
+		if (priv->output_profile != NMEA_SENTENCE_DEFAULT) {
+			send_output_profile (priv->queue, priv->commands,
+					     NMEA_SENTENCE_DEFAULT);
+			priv->output_profile = NMEA_SENTENCE_DEFAULT;
+		}
+		send_standby (priv->queue, priv->commands);
+		priv->standby = TRUE;
+	}
+
+	shutdown_connection (client);
+	emit_connection_changed (client, FALSE);
+}
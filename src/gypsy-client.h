@@ -28,6 +28,9 @@
 #define __GYPSY_CLIENT_H__
 
 #include <glib-object.h>
+#include <gio/gio.h>
+#include <gypsy/gypsy-shm.h>
+#include "gypsy-policy.h"
 #include "nmea.h"
 
 G_BEGIN_DECLS
@@ -60,6 +63,18 @@ typedef struct _GypsyClientSatellite {
 	int snr;
 } GypsyClientSatellite;
 
+/* The interfaces a subscriber has declared it listens to */
+typedef enum {
+	GYPSY_CLIENT_INTEREST_NONE	= 0,
+	GYPSY_CLIENT_INTEREST_ACCURACY	= 1 << 0,
+	GYPSY_CLIENT_INTEREST_COURSE	= 1 << 1,
+	GYPSY_CLIENT_INTEREST_DEVICE	= 1 << 2,
+	GYPSY_CLIENT_INTEREST_POSITION	= 1 << 3,
+	GYPSY_CLIENT_INTEREST_SATELLITE	= 1 << 4,
+	GYPSY_CLIENT_INTEREST_TIME	= 1 << 5,
+	GYPSY_CLIENT_INTEREST_SMOOTHED	= 1 << 6
+} GypsyClientInterest;
+
 typedef struct _GypsyClient {
 	GObject parent_object;
 } GypsyClient;
@@ -94,6 +109,11 @@ typedef struct _GypsyClientClass {
 
 GType gypsy_client_get_type (void);
 
+gboolean gypsy_client_register (GypsyClient     *client,
+				GDBusConnection *connection,
+				const char      *object_path,
+				GError         **error);
+
 void gypsy_client_set_position (GypsyClient   *client,
 				PositionFields fields_set,
 				float          latitude,
@@ -106,9 +126,16 @@ void gypsy_client_set_course (GypsyClient *client,
 			      float        climb);
 void gypsy_client_set_timestamp (GypsyClient *client,
 				 int          utc_time);
+void gypsy_client_set_precise_timestamp (GypsyClient *client,
+					 int          utc_time,
+					 double       fraction);
 void gypsy_client_set_fix_type (GypsyClient *client,
 				FixType      type,
 				gboolean     weak);
+void gypsy_client_set_fix_quality (GypsyClient *client,
+				   FixQuality   quality,
+				   double       dgps_age,
+				   int          dgps_station);
 
 void gypsy_client_add_satellite (GypsyClient *client,
 				 int          number,
@@ -125,6 +152,20 @@ void gypsy_client_set_accuracy (GypsyClient *client,
 				double hdop,
 				double vdop);
 
+gboolean gypsy_client_start (GypsyClient *client,
+			     GError     **error);
+void gypsy_client_add_consumer (GypsyClient *client);
+void gypsy_client_remove_consumer (GypsyClient *client);
+void gypsy_client_remove_subscriber (GypsyClient *client,
+				     const char  *sender);
+void gypsy_client_set_config (GypsyClient             *client,
+			      const GypsyDeviceConfig *config);
+void gypsy_client_idle (GypsyClient *client);
+
+void gypsy_client_get_fix (GypsyClient *client,
+			   GypsyShmFix *fix);
+char *gypsy_client_device_name (const char *device_path);
+
 G_END_DECLS
 
 #endif
@@ -0,0 +1,587 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * GypsyCommandQueue - Writes commands to a receiver without blocking the
+ *                     main loop, and matches up the receiver's answers.
+ *
+ * Commands are written in the order they were pushed, from a G_IO_OUT
+ * watch. Commands that aren't answered are written together with the
+ * next, up to the first that is answered, which is then waited for before
+ * anything else is written. A command that isn't answered in time is
+ * written again, a command the receiver refuses is not.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "gypsy-command-queue.h"
+#include "gypsy-debug.h"
+
+#include "garmin.h"
+
+/* How long to wait for an answer, and how many more
+   times to write a command before giving up on it */
+#define COMMAND_TIMEOUT 1000
+#define COMMAND_RETRIES 2
+
+/* Enough to hold an answer split across two reads */
+#define SCAN_SIZE 64
+
+#define UBX_SYNC_1 0xb5
+#define UBX_SYNC_2 0x62
+#define UBX_CLASS_ACK 0x05
+#define UBX_ACK_NAK 0x00
+#define UBX_ACK_ACK 0x01
+#define UBX_CLASS_CFG 0x06
+#define UBX_CLASS_MGA 0x13
+#define UBX_MGA_ACK 0x60
+
+typedef struct _Command {
+	GByteArray *data;
+	GypsyCommandAck ack;
+	guint id; /* What the answer names: the PMTK command number,
+		     UBX class << 8 | id, MGA id or Garmin packet id */
+	guint retries;
+
+	GypsyCommandDone done;
+	gpointer userdata;
+} Command;
+
+struct _GypsyCommandQueue {
+	GIOChannel *channel;
+	guint32 write_id, timeout_id;
+
+	GQueue *pending; /* Command, not yet written */
+	GQueue *writing; /* Command, being written as batch */
+	GByteArray *batch;
+	gsize batch_written;
+	Command *waiting; /* Written and waiting for its answer */
+
+	/* The end of what the receiver last sent */
+	char scan[SCAN_SIZE * 2];
+	gsize scan_length;
+};
+
+/* A command's number from $PMTKnnn,... */
+static guint
+get_pmtk_number (const guint8 *data,
+		 gsize         length)
+{
+	char number[4];
+
+	if (length < 8 || strncmp ((const char *) data, "$PMTK", 5) != 0) {
+		return 0;
+	}
+
+	memcpy (number, data + 5, 3);
+	number[3] = 0;
+	return atoi (number);
+}
+
+/* The answer a command gets by default. Only u-blox configuration
+   is acknowledged unless the receiver is told otherwise */
+GypsyCommandAck
+gypsy_command_ack_for (const guint8 *data,
+		       gsize         length)
+{
+	if (get_pmtk_number (data, length) > 0) {
+		return GYPSY_COMMAND_ACK_PMTK;
+	}
+
+	if (length >= 8 && data[0] == UBX_SYNC_1 && data[1] == UBX_SYNC_2 &&
+	    data[2] == UBX_CLASS_CFG) {
+		return GYPSY_COMMAND_ACK_UBX;
+	}
+
+	return GYPSY_COMMAND_ACK_NONE;
+}
+
+const char *
+gypsy_command_result_to_string (GypsyCommandResult result)
+{
+	switch (result) {
+	case GYPSY_COMMAND_OK:
+		return "ok";
+	case GYPSY_COMMAND_REFUSED:
+		return "refused";
+	case GYPSY_COMMAND_TIMED_OUT:
+		return "timed out";
+	case GYPSY_COMMAND_WRITE_ERROR:
+		return "write error";
+	case GYPSY_COMMAND_CANCELLED:
+		return "cancelled";
+	default:
+		return "unknown";
+	}
+}
+
+static void
+command_free (Command *command)
+{
+	g_byte_array_free (command->data, TRUE);
+	g_slice_free (Command, command);
+}
+
+/* Calls the command's callback and frees it */
+static void
+command_done (GypsyCommandQueue *queue,
+	      Command           *command,
+	      GypsyCommandResult result)
+{
+	if (result != GYPSY_COMMAND_OK) {
+		GYPSY_NOTE (CLIENT, "Command %u: %s", command->id,
+			    gypsy_command_result_to_string (result));
+	}
+
+	if (command->done) {
+		command->done (queue, result, command->userdata);
+	}
+	command_free (command);
+}
+
+static gboolean channel_writable (GIOChannel  *channel,
+				  GIOCondition condition,
+				  gpointer     userdata);
+
+static void
+schedule_write (GypsyCommandQueue *queue)
+{
+	if (queue->write_id > 0 || queue->waiting != NULL ||
+	    g_queue_is_empty (queue->pending)) {
+		return;
+	}
+
+	queue->write_id = g_io_add_watch (queue->channel, G_IO_OUT,
+					  channel_writable, queue);
+}
+
+static gboolean
+command_timeout (gpointer userdata)
+{
+	GypsyCommandQueue *queue = userdata;
+	Command *command = queue->waiting;
+
+	queue->timeout_id = 0;
+	queue->waiting = NULL;
+
+	if (command->retries < COMMAND_RETRIES) {
+		GYPSY_NOTE (CLIENT, "No answer to command %u, writing it again",
+			    command->id);
+		command->retries++;
+		g_queue_push_head (queue->pending, command);
+	} else {
+		command_done (queue, command, GYPSY_COMMAND_TIMED_OUT);
+	}
+
+	schedule_write (queue);
+	return FALSE;
+}
+
+/* Takes commands off the queue until one that needs answering */
+static void
+fill_batch (GypsyCommandQueue *queue)
+{
+	g_byte_array_set_size (queue->batch, 0);
+	queue->batch_written = 0;
+
+	while (!g_queue_is_empty (queue->pending)) {
+		Command *command = g_queue_pop_head (queue->pending);
+
+		g_byte_array_append (queue->batch, command->data->data,
+				     command->data->len);
+		g_queue_push_tail (queue->writing, command);
+
+		if (command->ack != GYPSY_COMMAND_ACK_NONE) {
+			break;
+		}
+	}
+}
+
+/* Everything in the batch is out, so the commands
+   are done apart from the last if it needs answering */
+static void
+finish_batch (GypsyCommandQueue *queue,
+	      GIOStatus          status)
+{
+	Command *command;
+
+	while ((command = g_queue_pop_head (queue->writing))) {
+		if (status != G_IO_STATUS_NORMAL) {
+			command_done (queue, command,
+				      GYPSY_COMMAND_WRITE_ERROR);
+		} else if (command->ack == GYPSY_COMMAND_ACK_NONE) {
+			command_done (queue, command, GYPSY_COMMAND_OK);
+		} else {
+			/* Don't match a late answer to an earlier write */
+			queue->scan_length = 0;
+			queue->waiting = command;
+			queue->timeout_id = g_timeout_add (COMMAND_TIMEOUT,
+							   command_timeout,
+							   queue);
+		}
+	}
+}
+
+static gboolean
+channel_writable (GIOChannel  *channel,
+		  GIOCondition condition,
+		  gpointer     userdata)
+{
+	GypsyCommandQueue *queue = userdata;
+	GIOStatus status = G_IO_STATUS_NORMAL;
+
+	if (g_queue_is_empty (queue->writing)) {
+		fill_batch (queue);
+	}
+
+	while (queue->batch_written < queue->batch->len) {
+		gsize written = 0;
+
+		status = g_io_channel_write_chars
+			(channel, (char *) queue->batch->data + queue->batch_written,
+			 queue->batch->len - queue->batch_written,
+			 &written, NULL);
+		queue->batch_written += written;
+
+		if (status != G_IO_STATUS_NORMAL) {
+			break;
+		}
+	}
+
+	if (status == G_IO_STATUS_NORMAL) {
+		status = g_io_channel_flush (channel, NULL);
+	}
+
+	/* Carry on when the receiver has caught up */
+	if (status == G_IO_STATUS_AGAIN) {
+		return TRUE;
+	}
+
+	queue->write_id = 0;
+	finish_batch (queue, status);
+	schedule_write (queue);
+
+	return FALSE;
+}
+
+GypsyCommandQueue *
+gypsy_command_queue_new (GIOChannel *channel)
+{
+	GypsyCommandQueue *queue;
+
+	queue = g_slice_new0 (GypsyCommandQueue);
+	queue->channel = g_io_channel_ref (channel);
+	queue->pending = g_queue_new ();
+	queue->writing = g_queue_new ();
+	queue->batch = g_byte_array_new ();
+
+	return queue;
+}
+
+/* Queues a command to be written. done, if not NULL, is called
+   once it has been answered or given up on, and mustn't free queue */
+void
+gypsy_command_queue_push (GypsyCommandQueue *queue,
+			  const guint8      *data,
+			  gsize              length,
+			  GypsyCommandAck    ack,
+			  GypsyCommandDone   done,
+			  gpointer           userdata)
+{
+	Command *command;
+
+	command = g_slice_new0 (Command);
+	command->data = g_byte_array_sized_new (length);
+	g_byte_array_append (command->data, data, length);
+	command->ack = ack;
+	command->done = done;
+	command->userdata = userdata;
+
+	switch (ack) {
+	case GYPSY_COMMAND_ACK_PMTK:
+		command->id = get_pmtk_number (data, length);
+		break;
+	case GYPSY_COMMAND_ACK_UBX:
+		command->id = length > 3 ? data[2] << 8 | data[3] : 0;
+		break;
+	case GYPSY_COMMAND_ACK_UBX_MGA:
+		command->id = length > 3 ? data[3] : 0;
+		break;
+	case GYPSY_COMMAND_ACK_GARMIN:
+		command->id = length > 4 ? data[4] : 0;
+		break;
+	default:
+		break;
+	}
+
+	g_queue_push_tail (queue->pending, command);
+	schedule_write (queue);
+}
+
+/* Drops the commands pushed with done and userdata without calling
+   done, for when whoever pushed them is going away */
+void
+gypsy_command_queue_cancel (GypsyCommandQueue *queue,
+			    GypsyCommandDone   done,
+			    gpointer           userdata)
+{
+	GList *l, *next;
+
+	for (l = queue->pending->head; l; l = next) {
+		Command *command = l->data;
+
+		next = l->next;
+		if (command->done == done && command->userdata == userdata) {
+			g_queue_delete_link (queue->pending, l);
+			command_free (command);
+		}
+	}
+
+	/* These are partly written, so they have to be finished */
+	for (l = queue->writing->head; l; l = l->next) {
+		Command *command = l->data;
+
+		if (command->done == done && command->userdata == userdata) {
+			command->done = NULL;
+		}
+	}
+
+	if (queue->waiting && queue->waiting->done == done &&
+	    queue->waiting->userdata == userdata) {
+		g_source_remove (queue->timeout_id);
+		queue->timeout_id = 0;
+		command_free (queue->waiting);
+		queue->waiting = NULL;
+
+		schedule_write (queue);
+	}
+}
+
+/* Returns 1 for an acknowledgement, -1 for a refusal
+   or 0 if there is nothing about the command */
+static int
+find_answer (GypsyCommandQueue *queue,
+	     Command           *command)
+{
+	const guint8 *scan = (const guint8 *) queue->scan;
+	gsize i, length = queue->scan_length;
+
+	for (i = 0; i < length; i++) {
+		const guint8 *p = scan + i;
+		gsize left = length - i;
+
+		switch (command->ack) {
+		case GYPSY_COMMAND_ACK_PMTK:
+			/* $PMTK001,nnn,F where F is 3 for success */
+			if (left > 9 &&
+			    strncmp ((const char *) p, "$PMTK001,", 9) == 0) {
+				guint number = 0;
+				gsize j;
+
+				for (j = 9; j < left && g_ascii_isdigit (p[j]); j++) {
+					number = number * 10 + p[j] - '0';
+				}
+				if (j + 1 >= left) {
+					/* The rest is still to come */
+					return 0;
+				}
+				if (p[j] == ',' && number == command->id) {
+					return p[j + 1] == '3' ? 1 : -1;
+				}
+			}
+			break;
+
+		case GYPSY_COMMAND_ACK_UBX:
+			/* B5 62 05 01|00 02 00 class id */
+			if (left >= 8 && p[0] == UBX_SYNC_1 &&
+			    p[1] == UBX_SYNC_2 && p[2] == UBX_CLASS_ACK &&
+			    (p[6] << 8 | p[7]) == command->id) {
+				return p[3] == UBX_ACK_ACK ? 1 : -1;
+			}
+			break;
+
+		case GYPSY_COMMAND_ACK_UBX_MGA:
+			/* B5 62 13 60 08 00 type version infoCode msgId */
+			if (left >= 10 && p[0] == UBX_SYNC_1 &&
+			    p[1] == UBX_SYNC_2 && p[2] == UBX_CLASS_MGA &&
+			    p[3] == UBX_MGA_ACK && p[9] == command->id) {
+				return p[6] == 1 ? 1 : -1;
+			}
+			break;
+
+		case GYPSY_COMMAND_ACK_GARMIN:
+			/* An application packet naming the command's id */
+			if (left >= GARMIN_HEADER_SIZE + 1 &&
+			    p[0] == LAYERID_APPL && p[5] == 0 &&
+			    (p[4] == Pid_Ack_Byte || p[4] == Pid_Nak_Byte) &&
+			    p[GARMIN_HEADER_SIZE] == command->id) {
+				return p[4] == Pid_Ack_Byte ? 1 : -1;
+			}
+			break;
+
+		default:
+			return 0;
+		}
+	}
+
+	return 0;
+}
+
+/* Fed everything the receiver sends */
+void
+gypsy_command_queue_received_data (GypsyCommandQueue *queue,
+				   const char        *data,
+				   gsize              length)
+{
+	while (length > 0 && queue->waiting) {
+		Command *command;
+		gsize chunk;
+		int answer;
+
+		chunk = MIN (length, SCAN_SIZE);
+		if (queue->scan_length + chunk > sizeof (queue->scan)) {
+			/* Keep the end in case an answer straddles reads */
+			memmove (queue->scan,
+				 queue->scan + queue->scan_length - SCAN_SIZE,
+				 SCAN_SIZE);
+			queue->scan_length = SCAN_SIZE;
+		}
+		memcpy (queue->scan + queue->scan_length, data, chunk);
+		queue->scan_length += chunk;
+		data += chunk;
+		length -= chunk;
+
+		answer = find_answer (queue, queue->waiting);
+		if (answer == 0) {
+			continue;
+		}
+
+		command = queue->waiting;
+		queue->waiting = NULL;
+		queue->scan_length = 0;
+		g_source_remove (queue->timeout_id);
+		queue->timeout_id = 0;
+
+		command_done (queue, command, answer > 0 ?
+			      GYPSY_COMMAND_OK : GYPSY_COMMAND_REFUSED);
+		schedule_write (queue);
+	}
+}
+
+/* Writes everything still queued straight away, without waiting for
+   answers, for when the device is about to be closed */
+void
+gypsy_command_queue_flush (GypsyCommandQueue *queue)
+{
+	Command *command;
+
+	if (queue->write_id > 0) {
+		g_source_remove (queue->write_id);
+		queue->write_id = 0;
+	}
+
+	if (queue->waiting) {
+		g_source_remove (queue->timeout_id);
+		queue->timeout_id = 0;
+		command = queue->waiting;
+		queue->waiting = NULL;
+		command_done (queue, command, GYPSY_COMMAND_CANCELLED);
+	}
+
+	/* Finish what was being written first */
+	while ((command = g_queue_pop_tail (queue->writing))) {
+		g_queue_push_head (queue->pending, command);
+	}
+	if (queue->batch_written > 0) {
+		gsize skip = queue->batch_written;
+		GList *l;
+
+		for (l = queue->pending->head; l && skip > 0; l = l->next) {
+			gsize length;
+
+			command = l->data;
+			length = MIN (skip, command->data->len);
+			g_byte_array_remove_range (command->data, 0, length);
+			skip -= length;
+		}
+		queue->batch_written = 0;
+	}
+
+	while ((command = g_queue_pop_head (queue->pending))) {
+		GIOStatus status;
+		gsize written;
+
+		status = g_io_channel_write_chars (queue->channel,
+						   (char *) command->data->data,
+						   command->data->len,
+						   &written, NULL);
+		if (status != G_IO_STATUS_NORMAL) {
+			command_done (queue, command,
+				      GYPSY_COMMAND_WRITE_ERROR);
+		} else {
+			command_done (queue, command,
+				      command->ack == GYPSY_COMMAND_ACK_NONE ?
+				      GYPSY_COMMAND_OK :
+				      GYPSY_COMMAND_CANCELLED);
+		}
+	}
+	g_io_channel_flush (queue->channel, NULL);
+}
+
+/* Commands not yet done are cancelled */
+void
+gypsy_command_queue_free (GypsyCommandQueue *queue)
+{
+	Command *command;
+
+	if (queue->write_id > 0) {
+		g_source_remove (queue->write_id);
+	}
+	if (queue->timeout_id > 0) {
+		g_source_remove (queue->timeout_id);
+	}
+
+	if (queue->waiting) {
+		command_done (queue, queue->waiting,
+			      GYPSY_COMMAND_CANCELLED);
+	}
+	while ((command = g_queue_pop_head (queue->writing))) {
+		command_done (queue, command, GYPSY_COMMAND_CANCELLED);
+	}
+	while ((command = g_queue_pop_head (queue->pending))) {
+		command_done (queue, command, GYPSY_COMMAND_CANCELLED);
+	}
+
+	g_queue_free (queue->pending);
+	g_queue_free (queue->writing);
+	g_byte_array_free (queue->batch, TRUE);
+	g_io_channel_unref (queue->channel);
+	g_slice_free (GypsyCommandQueue, queue);
+}
@@ -0,0 +1,78 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef __GYPSY_COMMAND_QUEUE_H__
+#define __GYPSY_COMMAND_QUEUE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GypsyCommandQueue GypsyCommandQueue;
+
+/* How the receiver answers a command */
+typedef enum {
+	GYPSY_COMMAND_ACK_NONE, /* Done once it has been written */
+	GYPSY_COMMAND_ACK_PMTK, /* $PMTK001,<command>,<flag> */
+	GYPSY_COMMAND_ACK_UBX, /* UBX-ACK-ACK or UBX-ACK-NAK */
+	GYPSY_COMMAND_ACK_UBX_MGA, /* UBX-MGA-ACK-DATA0 */
+	GYPSY_COMMAND_ACK_GARMIN /* Pid_Ack_Byte or Pid_Nak_Byte */
+} GypsyCommandAck;
+
+typedef enum {
+	GYPSY_COMMAND_OK, /* Acknowledged, or written if no answer is expected */
+	GYPSY_COMMAND_REFUSED,
+	GYPSY_COMMAND_TIMED_OUT,
+	GYPSY_COMMAND_WRITE_ERROR,
+	GYPSY_COMMAND_CANCELLED
+} GypsyCommandResult;
+
+typedef void (* GypsyCommandDone) (GypsyCommandQueue *queue,
+				   GypsyCommandResult result,
+				   gpointer           userdata);
+
+GypsyCommandQueue *gypsy_command_queue_new (GIOChannel *channel);
+void gypsy_command_queue_push (GypsyCommandQueue *queue,
+			       const guint8      *data,
+			       gsize              length,
+			       GypsyCommandAck    ack,
+			       GypsyCommandDone   done,
+			       gpointer           userdata);
+void gypsy_command_queue_cancel (GypsyCommandQueue *queue,
+				 GypsyCommandDone   done,
+				 gpointer           userdata);
+void gypsy_command_queue_received_data (GypsyCommandQueue *queue,
+					const char        *data,
+					gsize              length);
+void gypsy_command_queue_flush (GypsyCommandQueue *queue);
+void gypsy_command_queue_free (GypsyCommandQueue *queue);
+
+GypsyCommandAck gypsy_command_ack_for (const guint8 *data,
+				       gsize         length);
+const char *gypsy_command_result_to_string (GypsyCommandResult result);
+
+G_END_DECLS
+
+#endif
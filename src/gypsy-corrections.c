@@ -0,0 +1,449 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * GypsyCorrections - Forwards an RTCM3 correction stream from a local
+ *                    source to the receiver, for DGPS and RTK.
+ *
+ * The source is a Unix socket to connect to, a FIFO or a file. The stream
+ * is split into messages, and only those with a good CRC are passed on,
+ * whole, through the device's command queue. Reading stops while the
+ * receiver is behind, so the source is held up rather than the queue
+ * growing without end.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+#include <glib.h>
+
+#include "gypsy-corrections.h"
+#include "gypsy-debug.h"
+
+#define RTCM_PREAMBLE 0xd3
+#define RTCM_HEADER_SIZE 3
+#define RTCM_CRC_SIZE 3
+#define RTCM_MAX_PAYLOAD 1023
+
+/* Stop reading with this many bytes waiting to be
+   written to the receiver, and start again below the other */
+#define HIGH_WATER 4096
+#define LOW_WATER 1024
+
+/* Seconds to measure the rate over, and between
+   attempts to reconnect to a socket */
+#define RATE_WINDOW 10
+#define RECONNECT_DELAY 5
+
+struct _GypsyCorrections {
+	char *path;
+	gboolean is_socket;
+	int fd;
+	GIOChannel *channel;
+	guint32 input_id, reconnect_id;
+
+	GypsyCommandQueue *queue;
+	GQueue *queued; /* Length of each message not yet written */
+	gsize queued_bytes;
+
+	GByteArray *buffer;
+
+	/* Statistics */
+	guint messages, errors;
+	guint64 bytes;
+	GHashTable *types; /* message type -> count */
+	gint64 last_message; /* Monotonic time, 0 for none yet */
+	gint64 window_start;
+	guint64 window_bytes;
+	double rate; /* Bytes per second over the last window */
+};
+
+static gboolean open_source (GypsyCorrections *corrections,
+			     GError          **error);
+
+/* CRC-24Q, as used by RTCM3 */
+static guint32
+crc24q (const guint8 *data,
+	gsize         length)
+{
+	guint32 crc = 0;
+	gsize i;
+	int bit;
+
+	for (i = 0; i < length; i++) {
+		crc ^= data[i] << 16;
+		for (bit = 0; bit < 8; bit++) {
+			crc <<= 1;
+			if (crc & 0x1000000) {
+				crc ^= 0x1864cfb;
+			}
+		}
+	}
+
+	return crc & 0xffffff;
+}
+
+static void
+close_source (GypsyCorrections *corrections)
+{
+	if (corrections->input_id > 0) {
+		g_source_remove (corrections->input_id);
+		corrections->input_id = 0;
+	}
+
+	if (corrections->channel) {
+		g_io_channel_unref (corrections->channel);
+		corrections->channel = NULL;
+	}
+
+	if (corrections->fd != -1) {
+		close (corrections->fd);
+		corrections->fd = -1;
+	}
+
+	g_byte_array_set_size (corrections->buffer, 0);
+}
+
+static gboolean
+reconnect (gpointer userdata)
+{
+	GypsyCorrections *corrections = userdata;
+	GError *error = NULL;
+
+	if (!open_source (corrections, &error)) {
+		GYPSY_NOTE (CLIENT, "%s", error->message);
+		g_error_free (error);
+		return TRUE;
+	}
+
+	corrections->reconnect_id = 0;
+	return FALSE;
+}
+
+static void
+message_written (GypsyCommandQueue *queue,
+		 GypsyCommandResult result,
+		 gpointer           userdata);
+
+static void
+forward_message (GypsyCorrections *corrections,
+		 const guint8     *message,
+		 gsize             length)
+{
+	guint type;
+	gint64 now;
+
+	type = message[3] << 4 | message[4] >> 4;
+	g_hash_table_insert (corrections->types, GUINT_TO_POINTER (type),
+			     GUINT_TO_POINTER (GPOINTER_TO_UINT
+					       (g_hash_table_lookup
+						(corrections->types,
+						 GUINT_TO_POINTER (type))) + 1));
+
+	corrections->messages++;
+	corrections->bytes += length;
+
+	now = g_get_monotonic_time ();
+	corrections->last_message = now;
+	if (corrections->window_start == 0) {
+		corrections->window_start = now;
+	}
+	corrections->window_bytes += length;
+	if (now - corrections->window_start >= RATE_WINDOW * G_USEC_PER_SEC) {
+		corrections->rate = corrections->window_bytes /
+			((now - corrections->window_start) /
+			 (double) G_USEC_PER_SEC);
+		corrections->window_start = now;
+		corrections->window_bytes = 0;
+	}
+
+	g_queue_push_tail (corrections->queued, GSIZE_TO_POINTER (length));
+	corrections->queued_bytes += length;
+	gypsy_command_queue_push (corrections->queue, message, length,
+				  GYPSY_COMMAND_ACK_NONE, message_written,
+				  corrections);
+}
+
+/* Passes on every whole message in the buffer, and
+   skips anything that isn't one */
+static void
+split_messages (GypsyCorrections *corrections)
+{
+	guint8 *data = corrections->buffer->data;
+	gsize length = corrections->buffer->len, used = 0;
+
+	while (used < length) {
+		guint8 *p = data + used;
+		gsize left = length - used, payload, size;
+
+		if (p[0] != RTCM_PREAMBLE) {
+			used++;
+			continue;
+		}
+
+		if (left < RTCM_HEADER_SIZE) {
+			break;
+		}
+
+		payload = (p[1] & 0x03) << 8 | p[2];
+		size = RTCM_HEADER_SIZE + payload + RTCM_CRC_SIZE;
+		if (left < size) {
+			break;
+		}
+
+		if (payload >= 2 &&
+		    crc24q (p, size - RTCM_CRC_SIZE) ==
+		    (guint32) (p[size - 3] << 16 | p[size - 2] << 8 |
+			       p[size - 1])) {
+			forward_message (corrections, p, size);
+			used += size;
+		} else {
+			/* Not a message after all, look
+			   for the next preamble */
+			corrections->errors++;
+			used++;
+		}
+	}
+
+	g_byte_array_remove_range (corrections->buffer, 0, used);
+}
+
+static gboolean
+source_input (GIOChannel  *channel,
+	      GIOCondition condition,
+	      gpointer     userdata)
+{
+	GypsyCorrections *corrections = userdata;
+	guint8 buffer[RTCM_HEADER_SIZE + RTCM_MAX_PAYLOAD + RTCM_CRC_SIZE];
+	gssize bytes;
+
+	bytes = read (corrections->fd, buffer, sizeof (buffer));
+	if (bytes > 0) {
+		g_byte_array_append (corrections->buffer, buffer, bytes);
+		split_messages (corrections);
+
+		/* Wait for the receiver to catch up */
+		if (corrections->queued_bytes > HIGH_WATER) {
+			corrections->input_id = 0;
+			return FALSE;
+		}
+		return TRUE;
+	}
+
+	if (bytes < 0 && (errno == EAGAIN || errno == EINTR)) {
+		return TRUE;
+	}
+
+	GYPSY_NOTE (CLIENT, "Correction source %s closed", corrections->path);
+	corrections->input_id = 0;
+	close_source (corrections);
+
+	/* Whatever was serving the socket may come back */
+	if (corrections->is_socket) {
+		corrections->reconnect_id = g_timeout_add_seconds
+			(RECONNECT_DELAY, reconnect, corrections);
+	}
+
+	return FALSE;
+}
+
+static void
+watch_source (GypsyCorrections *corrections)
+{
+	corrections->input_id = g_io_add_watch (corrections->channel,
+						G_IO_IN | G_IO_HUP |
+						G_IO_ERR,
+						source_input, corrections);
+}
+
+static void
+message_written (GypsyCommandQueue *queue,
+		 GypsyCommandResult result,
+		 gpointer           userdata)
+{
+	GypsyCorrections *corrections = userdata;
+
+	corrections->queued_bytes -=
+		GPOINTER_TO_SIZE (g_queue_pop_head (corrections->queued));
+
+	if (corrections->input_id == 0 && corrections->channel &&
+	    corrections->queued_bytes < LOW_WATER) {
+		watch_source (corrections);
+	}
+}
+
+static gboolean
+open_source (GypsyCorrections *corrections,
+	     GError          **error)
+{
+	struct stat st;
+	int fd;
+
+	if (stat (corrections->path, &st) == -1) {
+		g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+			     "Error opening %s: %s", corrections->path,
+			     g_strerror (errno));
+		return FALSE;
+	}
+
+	corrections->is_socket = S_ISSOCK (st.st_mode);
+	if (corrections->is_socket) {
+		struct sockaddr_un addr;
+
+		memset (&addr, 0, sizeof (addr));
+		addr.sun_family = AF_UNIX;
+		g_strlcpy (addr.sun_path, corrections->path,
+			   sizeof (addr.sun_path));
+
+		fd = socket (AF_UNIX, SOCK_STREAM, 0);
+		if (fd != -1 &&
+		    connect (fd, (struct sockaddr *) &addr, sizeof (addr)) == -1) {
+			close (fd);
+			fd = -1;
+		}
+		if (fd != -1) {
+			fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+		}
+	} else if (S_ISFIFO (st.st_mode)) {
+		/* Holding the write end too means writers can
+		   come and go without us seeing end of file */
+		fd = open (corrections->path, O_RDWR | O_NONBLOCK);
+	} else {
+		fd = open (corrections->path, O_RDONLY | O_NONBLOCK);
+	}
+
+	if (fd == -1) {
+		g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+			     "Error opening %s: %s", corrections->path,
+			     g_strerror (errno));
+		return FALSE;
+	}
+
+	GYPSY_NOTE (CLIENT, "Reading corrections from %s", corrections->path);
+
+	corrections->fd = fd;
+	corrections->channel = g_io_channel_unix_new (fd);
+	if (corrections->queued_bytes < LOW_WATER) {
+		watch_source (corrections);
+	}
+
+	return TRUE;
+}
+
+GypsyCorrections *
+gypsy_corrections_new (const char        *path,
+		       GypsyCommandQueue *queue,
+		       GError           **error)
+{
+	GypsyCorrections *corrections;
+
+	corrections = g_slice_new0 (GypsyCorrections);
+	corrections->path = g_strdup (path);
+	corrections->fd = -1;
+	corrections->queue = queue;
+	corrections->queued = g_queue_new ();
+	corrections->buffer = g_byte_array_new ();
+	corrections->types = g_hash_table_new (NULL, NULL);
+
+	if (!open_source (corrections, error)) {
+		gypsy_corrections_free (corrections);
+		return NULL;
+	}
+
+	return corrections;
+}
+
+/* Adds the statistics to a GetCorrectionStatus reply */
+void
+gypsy_corrections_add_status (GypsyCorrections *corrections,
+			      GVariantBuilder  *builder)
+{
+	GVariantBuilder types;
+	GHashTableIter iter;
+	gpointer key, value;
+	double age = -1.0;
+
+	if (corrections->last_message > 0) {
+		age = (g_get_monotonic_time () - corrections->last_message) /
+			(double) G_USEC_PER_SEC;
+	}
+
+	g_variant_builder_init (&types, G_VARIANT_TYPE ("a{uu}"));
+	g_hash_table_iter_init (&iter, corrections->types);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		g_variant_builder_add (&types, "{uu}", GPOINTER_TO_UINT (key),
+				       GPOINTER_TO_UINT (value));
+	}
+
+	g_variant_builder_add (builder, "{sv}", "Source",
+			       g_variant_new_string (corrections->path));
+	g_variant_builder_add (builder, "{sv}", "Connected",
+			       g_variant_new_boolean (corrections->fd != -1));
+	g_variant_builder_add (builder, "{sv}", "Messages",
+			       g_variant_new_uint32 (corrections->messages));
+	g_variant_builder_add (builder, "{sv}", "Bytes",
+			       g_variant_new_uint64 (corrections->bytes));
+	g_variant_builder_add (builder, "{sv}", "Errors",
+			       g_variant_new_uint32 (corrections->errors));
+	g_variant_builder_add (builder, "{sv}", "Rate",
+			       g_variant_new_double (corrections->rate));
+	g_variant_builder_add (builder, "{sv}", "Age",
+			       g_variant_new_double (age));
+	g_variant_builder_add (builder, "{sv}", "MessageTypes",
+			       g_variant_builder_end (&types));
+}
+
+void
+gypsy_corrections_free (GypsyCorrections *corrections)
+{
+	GYPSY_NOTE (CLIENT, "Forwarded %u correction messages, %u errors",
+		    corrections->messages, corrections->errors);
+
+	/* Stale corrections are worse than none */
+	if (!g_queue_is_empty (corrections->queued)) {
+		gypsy_command_queue_cancel (corrections->queue,
+					    message_written, corrections);
+	}
+
+	if (corrections->reconnect_id > 0) {
+		g_source_remove (corrections->reconnect_id);
+	}
+	close_source (corrections);
+
+	g_queue_free (corrections->queued);
+	g_byte_array_free (corrections->buffer, TRUE);
+	g_hash_table_destroy (corrections->types);
+	g_free (corrections->path);
+	g_slice_free (GypsyCorrections, corrections);
+}
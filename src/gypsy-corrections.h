@@ -0,0 +1,46 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef __GYPSY_CORRECTIONS_H__
+#define __GYPSY_CORRECTIONS_H__
+
+#include <glib.h>
+
+#include "gypsy-command-queue.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GypsyCorrections GypsyCorrections;
+
+GypsyCorrections *gypsy_corrections_new (const char        *path,
+					 GypsyCommandQueue *queue,
+					 GError           **error);
+void gypsy_corrections_add_status (GypsyCorrections *corrections,
+				   GVariantBuilder  *builder);
+void gypsy_corrections_free (GypsyCorrections *corrections);
+
+G_END_DECLS
+
+#endif
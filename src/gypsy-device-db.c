@@ -0,0 +1,134 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * GypsyDeviceDb - The receivers Gypsy knows about, by USB vendor and
+ * product ID, so a discovered device can be started with the right
+ * protocol and speed without probing it.
+ *
+ * Each group of gypsy-devices.conf is VENDOR:PRODUCT in hex, and takes
+ * the same keys as a [device GLOB] group of gypsy.conf, plus a Name:
+ *   [1546:01a6]
+ *   Name=u-blox 6 GPS Receiver
+ *   Protocol=nmea
+ *   Commands=ubx
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+
+#include <glib.h>
+
+#include "gypsy-device-db.h"
+
+struct _GypsyDeviceDb {
+	GHashTable *entries; /* vendor << 16 | product -> GypsyDeviceDbEntry */
+};
+
+#define DEVICE_KEY(vendor, product) \
+	GUINT_TO_POINTER (((vendor) & 0xffff) << 16 | ((product) & 0xffff))
+
+static void
+entry_free (gpointer data)
+{
+	GypsyDeviceDbEntry *entry = data;
+
+	g_free (entry->name);
+	g_free (entry->config.log);
+	g_free (entry->config.assistance);
+	g_free (entry->config.corrections);
+	g_slice_free (GypsyDeviceDbEntry, entry);
+}
+
+GypsyDeviceDb *
+gypsy_device_db_new_from_file (const char *filename,
+			       GError    **error)
+{
+	GypsyDeviceDb *db;
+	GKeyFile *key_file;
+	char **groups;
+	int i;
+
+	key_file = g_key_file_new ();
+	if (!g_key_file_load_from_file (key_file, filename,
+					G_KEY_FILE_NONE, error)) {
+		g_key_file_free (key_file);
+		return NULL;
+	}
+
+	db = g_slice_new0 (GypsyDeviceDb);
+	db->entries = g_hash_table_new_full (NULL, NULL, NULL, entry_free);
+
+	groups = g_key_file_get_groups (key_file, NULL);
+	for (i = 0; groups[i]; i++) {
+		GypsyDeviceDbEntry *entry;
+		guint vendor, product;
+		char end;
+
+		if (sscanf (groups[i], "%4x:%4x%c",
+			    &vendor, &product, &end) != 2) {
+			g_warning ("Ignoring [%s] in %s, it should be "
+				   "[VENDOR:PRODUCT]", groups[i], filename);
+			continue;
+		}
+
+		entry = g_slice_new0 (GypsyDeviceDbEntry);
+		if (!gypsy_device_config_parse (key_file, groups[i],
+						&entry->config, error)) {
+			g_slice_free (GypsyDeviceDbEntry, entry);
+			g_strfreev (groups);
+			g_key_file_free (key_file);
+			gypsy_device_db_free (db);
+			return NULL;
+		}
+
+		entry->name = g_key_file_get_string (key_file, groups[i],
+						     "Name", NULL);
+		g_hash_table_replace (db->entries,
+				      DEVICE_KEY (vendor, product), entry);
+	}
+	g_strfreev (groups);
+
+	g_key_file_free (key_file);
+	return db;
+}
+
+/* Returns NULL if the receiver isn't in the database */
+const GypsyDeviceDbEntry *
+gypsy_device_db_lookup (GypsyDeviceDb *db,
+			guint          vendor_id,
+			guint          product_id)
+{
+	return g_hash_table_lookup (db->entries,
+				    DEVICE_KEY (vendor_id, product_id));
+}
+
+void
+gypsy_device_db_free (GypsyDeviceDb *db)
+{
+	g_hash_table_destroy (db->entries);
+	g_slice_free (GypsyDeviceDb, db);
+}
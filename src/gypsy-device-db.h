@@ -0,0 +1,52 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef __GYPSY_DEVICE_DB_H__
+#define __GYPSY_DEVICE_DB_H__
+
+#include <glib.h>
+
+#include "gypsy-policy.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GypsyDeviceDb GypsyDeviceDb;
+
+/* A receiver in the device database */
+typedef struct _GypsyDeviceDbEntry {
+	char *name;
+	GypsyDeviceConfig config; /* What to start the device with */
+} GypsyDeviceDbEntry;
+
+GypsyDeviceDb *gypsy_device_db_new_from_file (const char *filename,
+					      GError    **error);
+const GypsyDeviceDbEntry *gypsy_device_db_lookup (GypsyDeviceDb *db,
+						  guint          vendor_id,
+						  guint          product_id);
+void gypsy_device_db_free (GypsyDeviceDb *db);
+
+G_END_DECLS
+
+#endif
@@ -30,20 +30,20 @@
  */
 #include "config.h"
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
 #include <glib.h>
-
-#include <dbus/dbus-glib.h>
-#include <dbus/dbus-glib-bindings.h>
-#include <dbus/dbus-glib-lowlevel.h>
+#include <gio/gio.h>
 
 #include <gudev/gudev.h>
 
 #include "gypsy-debug.h"
+#include "gypsy-device-db.h"
 #include "gypsy-discovery.h"
 #include "gypsy-marshal-internal.h"
+#include "gypsy-probe.h"
 
 enum {
         PROP_0,
@@ -58,6 +58,9 @@ enum {
 typedef struct _DeviceInfo {
 	char *device_path;
 	char *type;
+
+	/* What a scan found the device talking, or NULL */
+	GypsyDeviceDbEntry *probed;
 } DeviceInfo;
 
 struct _GypsyDiscoveryPrivate {
@@ -66,53 +69,60 @@ struct _GypsyDiscoveryPrivate {
 	/* Contains DeviceInfo */
 	GPtrArray *known_devices;
 
-#ifdef HAVE_BLUEZ
-	DBusGConnection *connection;
-	DBusGProxy *adapter_proxy;
-	DBusGProxy *manager_proxy;
-#endif
+	/* The receivers to look for, NULL if it couldn't be read */
+	GypsyDeviceDb *device_db;
+
+	/* The ttys are only looked at once the main loop is running, a
+	   few at a time, or all at once if ListDevices needs them first */
+	gboolean enumerated;
+	GList *pending; /* GUdevDevices still to look at */
+	guint32 enumerate_id;
+	gint64 start_time; /* For timing the enumeration */
+	gboolean replied;
+
+	/* device path -> GypsyProbe, while scanning */
+	GHashTable *probes;
+	GypsyDiscoveryIgnoreFunc ignore_func;
+	gpointer ignore_data;
+
+	GDBusConnection *connection;
+	guint registration_id;
 };
 
+#define GYPSY_DISCOVERY_INTERFACE "org.freedesktop.Gypsy.Discovery"
+
+/* ttys to look at in each idle callback */
+#define ENUMERATE_CHUNK 16
+
 #define BLUEZ_SERVICE "org.bluez"
 #define BLUEZ_MANAGER_PATH "/"
 #define BLUEZ_MANAGER_IFACE "org.bluez.Manager"
 #define BLUEZ_ADAPTER_IFACE "org.bluez.Adapter"
 #define BLUEZ_DEVICE_IFACE "org.bluez.Device"
 
-#ifndef DBUS_TYPE_G_OBJECT_PATH_ARRAY
-#define DBUS_TYPE_G_OBJECT_PATH_ARRAY \
-        (dbus_g_type_get_collection("GPtrArray", DBUS_TYPE_G_OBJECT_PATH))
-#endif
-
-#ifndef DBUS_TYPE_G_DICTIONARY
-#define DBUS_TYPE_G_DICTIONARY \
-        (dbus_g_type_get_map("GHashTable", G_TYPE_STRING, G_TYPE_VALUE))
-#endif
-
 #define GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), GYPSY_TYPE_DISCOVERY, GypsyDiscoveryPrivate))
 G_DEFINE_TYPE (GypsyDiscovery, gypsy_discovery, G_TYPE_OBJECT);
 static guint32 signals[LAST_SIGNAL] = {0,};
 
-static gboolean gypsy_discovery_list_devices (GypsyDiscovery  *discovery,
-                                              char          ***devices,
-					      char          ***types,
-                                              GError         **error);
-static gboolean gypsy_discovery_start_scanning (GypsyDiscovery *discovery,
-                                                GError        **error);
-static gboolean gypsy_discovery_stop_scanning (GypsyDiscovery *discovery,
-                                               GError        **error);
+#include "gypsy-discovery-introspection.h"
 
-#include "gypsy-discovery-glue.h"
+static GDBusNodeInfo *introspection_data = NULL;
 
 const char *internal_type = "internal";
 const char *bluetooth_type = "bluetooth";
 const char *usb_type = "usb";
+const char *serial_type = "serial";
 
 static void
 device_info_free (gpointer data)
 {
 	DeviceInfo *di = (DeviceInfo *) data;
 
+	if (di->probed) {
+		g_free (di->probed->name);
+		g_slice_free (GypsyDeviceDbEntry, di->probed);
+	}
+
 	g_free (di->device_path);
 	g_slice_free (DeviceInfo, di);
 }
@@ -124,6 +134,7 @@ device_info_new (const char *device_path,
 	DeviceInfo *di = g_slice_new (DeviceInfo);
 	di->device_path = g_strdup (device_path);
 	di->type = (char *) type;
+	di->probed = NULL;
 
 	return di;
 }
@@ -139,6 +150,11 @@ gypsy_discovery_finalize (GObject *object)
 		priv->known_devices = NULL;
 	}
 
+	if (priv->device_db) {
+		gypsy_device_db_free (priv->device_db);
+		priv->device_db = NULL;
+	}
+
         G_OBJECT_CLASS (gypsy_discovery_parent_class)->finalize (object);
 }
 
@@ -148,22 +164,36 @@ gypsy_discovery_dispose (GObject *object)
         GypsyDiscovery *self = (GypsyDiscovery *) object;
         GypsyDiscoveryPrivate *priv = self->priv;
 
+	if (priv->enumerate_id > 0) {
+		g_source_remove (priv->enumerate_id);
+		priv->enumerate_id = 0;
+	}
+
+	if (priv->probes) {
+		g_hash_table_destroy (priv->probes);
+		priv->probes = NULL;
+	}
+
+	if (priv->pending) {
+		g_list_free_full (priv->pending, g_object_unref);
+		priv->pending = NULL;
+	}
+
         if (priv->client) {
                 g_object_unref (priv->client);
                 priv->client = NULL;
         }
 
-#ifdef HAVE_BLUEZ
-	if (priv->manager_proxy) {
-		g_object_unref (priv->manager_proxy);
-		priv->manager_proxy = NULL;
+	if (priv->registration_id > 0) {
+		g_dbus_connection_unregister_object (priv->connection,
+						     priv->registration_id);
+		priv->registration_id = 0;
 	}
 
-	if (priv->adapter_proxy) {
-		g_object_unref (priv->adapter_proxy);
-		priv->adapter_proxy = NULL;
+	if (priv->connection) {
+		g_object_unref (priv->connection);
+		priv->connection = NULL;
 	}
-#endif
 
         G_OBJECT_CLASS (gypsy_discovery_parent_class)->dispose (object);
 }
@@ -195,77 +225,57 @@ gypsy_discovery_class_init (GypsyDiscoveryClass *klass)
 						G_TYPE_NONE, 2,
 						G_TYPE_STRING,
 						G_TYPE_STRING);
-        dbus_g_object_type_install_info (G_TYPE_FROM_CLASS (klass),
-                                         &dbus_glib_gypsy_discovery_object_info);
+
+	introspection_data = g_dbus_node_info_new_for_xml (introspection_xml,
+							   NULL);
+	g_assert (introspection_data != NULL);
 }
 
 #ifdef HAVE_BLUEZ
 static gboolean
-class_is_positioning_device (GValue *value)
+class_is_positioning_device (guint32 class_id)
 {
-	int class_id = g_value_get_uint (value);
-
 	return ((class_id >> 16) & 0x1);
 }
 
+/* devices is an array of object paths */
 static gboolean
 get_positioning_devices (GypsyDiscovery *discovery,
-			 GPtrArray *devices,
-			 GError   **error)
+			 GVariant       *devices,
+			 GError        **error)
 {
 	GypsyDiscoveryPrivate *priv = discovery->priv;
-	int i;
-
-	if (devices == NULL) {
-		/* It didn't fail, there just weren't any devices */
-		return TRUE;
-	}
-
-	for (i = 0; i < devices->len; i++) {
-		DBusGProxy *proxy;
-		GHashTable *properties;
-		GValue *path, *class;
-		gboolean ret;
-
-		proxy = dbus_g_proxy_new_for_name (priv->connection,
-						   BLUEZ_SERVICE,
-						   devices->pdata[i],
-						   BLUEZ_DEVICE_IFACE);
-		ret = dbus_g_proxy_call (proxy, "GetProperties", error,
-					 G_TYPE_INVALID,
-					 DBUS_TYPE_G_DICTIONARY, &properties,
-					 G_TYPE_INVALID);
-		if (ret == FALSE) {
-			g_object_unref (proxy);
+	GVariantIter iter;
+	const char *device;
+
+	g_variant_iter_init (&iter, devices);
+	while (g_variant_iter_next (&iter, "&o", &device)) {
+		GVariant *reply, *properties;
+		const char *address;
+		guint32 class_id;
+
+		reply = g_dbus_connection_call_sync (priv->connection,
+						     BLUEZ_SERVICE, device,
+						     BLUEZ_DEVICE_IFACE,
+						     "GetProperties", NULL,
+						     G_VARIANT_TYPE ("(a{sv})"),
+						     G_DBUS_CALL_FLAGS_NONE,
+						     -1, NULL, error);
+		if (reply == NULL) {
 			return FALSE;
 		}
 
-		class = g_hash_table_lookup (properties, "Class");
-		if (class == NULL) {
-			g_object_unref (proxy);
-			g_hash_table_destroy (properties);
-			continue;
-		}
-
-		if (class_is_positioning_device (class) == FALSE) {
-			g_object_unref (proxy);
-			g_hash_table_destroy (properties);
-			continue;
-		}
-
-		path = g_hash_table_lookup (properties, "Address");
-		if (path == NULL) {
-			g_object_unref (proxy);
-			g_hash_table_destroy (properties);
-			continue;
+		properties = g_variant_get_child_value (reply, 0);
+		if (g_variant_lookup (properties, "Class", "u", &class_id) &&
+		    class_is_positioning_device (class_id) &&
+		    g_variant_lookup (properties, "Address", "&s", &address)) {
+			g_ptr_array_add (priv->known_devices,
+					 device_info_new (address,
+							  bluetooth_type));
 		}
 
-		g_ptr_array_add (priv->known_devices,
-				 device_info_new (g_value_get_string (path),
-						  bluetooth_type));
-
-		g_object_unref (proxy);
-		g_hash_table_destroy (properties);
+		g_variant_unref (properties);
+		g_variant_unref (reply);
 	}
 
 	return TRUE;
@@ -278,252 +288,227 @@ setup_bluetooth_discovery (GypsyDiscovery *discovery)
 #ifdef HAVE_BLUEZ
         GypsyDiscoveryPrivate *priv = discovery->priv;
 	GError *error = NULL;
-	char *default_adapter;
-	GPtrArray *devices;
-	gboolean ret;
+	GVariant *reply, *devices;
+	const char *default_adapter;
 
 	GYPSY_NOTE (DISCOVERY, "Bluetooth discovery enabled");
 
-	priv->connection = dbus_g_bus_get (DBUS_BUS_SYSTEM, &error);
-	if (!priv->connection) {
-		g_warning ("Error getting D-Bus connection: %s\n"
-			   "Continuing without Bluetooth discovery",
-			   error->message);
-		g_error_free (error);
-		return;
-	}
-
-	priv->manager_proxy = dbus_g_proxy_new_for_name (priv->connection,
-							 BLUEZ_SERVICE,
-							 BLUEZ_MANAGER_PATH,
-							 BLUEZ_MANAGER_IFACE);
-
-	ret = dbus_g_proxy_call (priv->manager_proxy, "DefaultAdapter",
-				 &error, G_TYPE_INVALID,
-				 DBUS_TYPE_G_OBJECT_PATH, &default_adapter,
-				 G_TYPE_INVALID);
-	if (ret == FALSE) {
+	reply = g_dbus_connection_call_sync (priv->connection,
+					     BLUEZ_SERVICE, BLUEZ_MANAGER_PATH,
+					     BLUEZ_MANAGER_IFACE,
+					     "DefaultAdapter", NULL,
+					     G_VARIANT_TYPE ("(o)"),
+					     G_DBUS_CALL_FLAGS_NONE,
+					     -1, NULL, &error);
+	if (reply == NULL) {
 		g_warning ("Error getting default adapter path: %s\n"
 			   "Continuing without Bluetooth discovery",
 			   error->message);
 		g_error_free (error);
-
-		/* Shut down BT discovery */
-		g_object_unref (priv->manager_proxy);
-		priv->manager_proxy = NULL;
-
-		priv->connection = NULL;
 		return;
 	}
 
-	priv->adapter_proxy = dbus_g_proxy_new_for_name (priv->connection,
-							 BLUEZ_SERVICE,
-							 default_adapter,
-							 BLUEZ_ADAPTER_IFACE);
-	ret = dbus_g_proxy_call (priv->adapter_proxy, "ListDevices", &error,
-				 G_TYPE_INVALID,
-				 DBUS_TYPE_G_OBJECT_PATH_ARRAY, &devices,
-				 G_TYPE_INVALID);
-	if (ret == FALSE) {
+	g_variant_get (reply, "(&o)", &default_adapter);
+	devices = g_dbus_connection_call_sync (priv->connection,
+					       BLUEZ_SERVICE, default_adapter,
+					       BLUEZ_ADAPTER_IFACE,
+					       "ListDevices", NULL,
+					       G_VARIANT_TYPE ("(ao)"),
+					       G_DBUS_CALL_FLAGS_NONE,
+					       -1, NULL, &error);
+	if (devices == NULL) {
 		g_warning ("Error getting devices on %s: %s\n", default_adapter,
 			   error->message);
 		g_error_free (error);
+		g_variant_unref (reply);
 		return;
 	}
+	g_variant_unref (reply);
 
-	if (!get_positioning_devices (discovery, devices, &error)) {
+	reply = g_variant_get_child_value (devices, 0);
+	if (!get_positioning_devices (discovery, reply, &error)) {
 		g_warning ("Error getting positioning devices: %s",
 			   error->message);
 		g_error_free (error);
-		return;
 	}
+
+	g_variant_unref (reply);
+	g_variant_unref (devices);
 #endif
 }
 
-/* A list of all the product IDs we know about */
-struct ProductMap {
-	char *product_id;
-	char *product_name;
-};
+static DeviceInfo *
+find_device (GPtrArray  *array,
+	     const char *device_path)
+{
+	int i;
 
-static struct ProductMap known_ids[] = {
-	{ "e8d/3329/100", "MTK GPS Receiver" },
-	{ "0e8d/3329/0100", "MTK GPS Receiver" },
-	{ "1546/1a4/100", "u-blox AG ANTARIS r4 GPS Receiver" },
-	{ "1546/01a4/0100", "u-blox AG ANTARIS r4 GPS Receiver" },
-	{ NULL, NULL }
-};
+	for (i = 0; i < array->len; i++) {
+		DeviceInfo *di = array->pdata[i];
 
-static const char *
-maybe_add_device (GypsyDiscovery *discovery,
-		  GUdevDevice    *device)
+		if (g_str_equal (device_path, di->device_path)) {
+			return di;
+		}
+	}
+
+	return NULL;
+}
+
+static gboolean
+get_ids_from_tty (GUdevDevice *tty,
+		  guint       *vendor_id,
+		  guint       *product_id)
 {
-	GypsyDiscoveryPrivate *priv = discovery->priv;
-	GUdevDevice *parent;
-	const char *property_id, *property_type, *name;
-	int i;
+	const char *vendor, *model;
 
-	name = g_udev_device_get_device_file (device);
-	if (name == NULL) {
-		return NULL;
+	vendor = g_udev_device_get_property (tty, "ID_VENDOR_ID");
+	model = g_udev_device_get_property (tty, "ID_MODEL_ID");
+
+	if (vendor == NULL || model == NULL) {
+		GYPSY_NOTE (DISCOVERY, "Missing property %s %s",
+			    vendor, model);
+		return FALSE;
 	}
 
+	*vendor_id = strtoul (vendor, NULL, 16);
+	*product_id = strtoul (model, NULL, 16);
+	return TRUE;
+}
+
+/* Only for ttys udev hasn't put the USB IDs on, as walking
+   up to the usb_device is slow with a lot of ttys */
+static gboolean
+get_ids_from_parent (GUdevDevice *tty,
+		     guint       *vendor_id,
+		     guint       *product_id)
+{
+	GUdevDevice *parent;
+	gboolean ret = FALSE;
+
 	/* Find the usb device that owns this TTY */
-	parent = g_udev_device_get_parent (device);
+	parent = g_udev_device_get_parent (tty);
 	while (parent) {
+		const char *property_type, *product;
+		GUdevDevice *next;
+
 		property_type = g_udev_device_get_property (parent, "DEVTYPE");
 
 		GYPSY_NOTE (DISCOVERY, "Found UDev type: %s", property_type);
 		if (property_type &&
 		    g_str_equal (property_type, "usb_device")) {
+			/* PRODUCT is vendor/product/revision in hex */
+			product = g_udev_device_get_property (parent,
+							      "PRODUCT");
+			ret = (product && sscanf (product, "%x/%x",
+						  vendor_id, product_id) == 2);
+			g_object_unref (parent);
 			break;
 		}
 
-		parent = g_udev_device_get_parent (parent);
+		next = g_udev_device_get_parent (parent);
+		g_object_unref (parent);
+		parent = next;
 	}
 
-	if (parent == NULL) {
-		return NULL;
-	}
+	return ret;
+}
+
+static const GypsyDeviceDbEntry *
+find_known_product (GypsyDiscovery *discovery,
+		    GUdevDevice    *device)
+{
+	GypsyDiscoveryPrivate *priv = discovery->priv;
+	guint vendor_id, product_id;
 
-	property_id = g_udev_device_get_property (parent, "PRODUCT");
-	if (property_id == NULL) {
+	if (priv->device_db == NULL) {
 		return NULL;
 	}
 
-	for (i = 0; known_ids[i].product_id; i++) {
-		if (g_str_equal (property_id,
-				 known_ids[i].product_id)) {
-			GYPSY_NOTE (DISCOVERY, "Found %s - %s",
-				    known_ids[i].product_name,
-				    name);
-			g_ptr_array_add (priv->known_devices,
-					 device_info_new (name, usb_type));
-
-			return name;
-		}
+	if (!get_ids_from_tty (device, &vendor_id, &product_id) &&
+	    !get_ids_from_parent (device, &vendor_id, &product_id)) {
+		return NULL;
 	}
 
-	return NULL;
+	GYPSY_NOTE (DISCOVERY, "Found Product ID %04x:%04x",
+		    vendor_id, product_id);
+	return gypsy_device_db_lookup (priv->device_db, vendor_id,
+				       product_id);
 }
 
-static void
-remove_device_from_array (GPtrArray  *array,
-			  const char *device_path)
+static const char *
+maybe_add_device (GypsyDiscovery *discovery,
+		  GUdevDevice    *device)
 {
-	int i;
+	GypsyDiscoveryPrivate *priv = discovery->priv;
+	const GypsyDeviceDbEntry *product;
+	const char *name;
 
-	if (array == NULL || device_path == NULL) {
-		return;
+	name = g_udev_device_get_device_file (device);
+	if (name == NULL) {
+		return NULL;
 	}
 
-	for (i = 0; i < array->len; i++) {
-		DeviceInfo *di = array->pdata[i];
-
-		GYPSY_NOTE (DISCOVERY, "Comparing %s -> %s", device_path,
-			    di->device_path);
-		if (g_str_equal (device_path, di->device_path)) {
-			g_ptr_array_remove_index (array, i);
-			return;
-		}
+	/* An add event can arrive while the ttys are still being
+	   enumerated, so don't list the device twice */
+	if (find_device (priv->known_devices, name)) {
+		return NULL;
 	}
-}
 
-static char *
-build_product_id_from_tty (GUdevDevice *tty)
-{
-	const char *vendor_id, *model_id, *revision_id;
-
-	vendor_id = g_udev_device_get_property (tty, "ID_VENDOR_ID");
-	model_id = g_udev_device_get_property (tty, "ID_MODEL_ID");
-	revision_id = g_udev_device_get_property (tty, "ID_REVISION");
-
-	if (vendor_id == NULL || model_id == NULL || revision_id == NULL) {
-		GYPSY_NOTE (DISCOVERY, "Missing property %s %s %s",
-			    vendor_id, model_id, revision_id);
+	product = find_known_product (discovery, device);
+	if (product == NULL) {
 		return NULL;
 	}
 
-	return g_strdup_printf ("%s/%s/%s", vendor_id, model_id, revision_id);
+	GYPSY_NOTE (DISCOVERY, "Found %s - %s",
+		    product->name ? product->name : "GPS Receiver", name);
+	g_ptr_array_add (priv->known_devices,
+			 device_info_new (name, usb_type));
+
+	return name;
 }
 
+/* Anything we listed is removed, so there is no need to look
+   at the IDs, which udev doesn't always give for a removed tty */
 static const char *
 maybe_remove_device (GypsyDiscovery *discovery,
 		     GUdevDevice    *device)
 {
 	GypsyDiscoveryPrivate *priv = discovery->priv;
-	const char *property_id, *property_type, *name;
-	char *tty_id;
-	GUdevDevice *parent;
-	int i;
+	DeviceInfo *di;
+	const char *name;
 
 	name = g_udev_device_get_device_file (device);
 	if (name == NULL) {
 		return NULL;
 	}
 
-	/* Find the usb device that owns this TTY */
-	parent = g_udev_device_get_parent (device);
-	while (parent) {
-		property_type = g_udev_device_get_property (parent, "DEVTYPE");
-
-		GYPSY_NOTE (DISCOVERY, "Found UDev type: %s", property_type);
-		if (property_type &&
-		    g_str_equal (property_type, "usb_device")) {
-			break;
-		}
-
-		parent = g_udev_device_get_parent (parent);
-	}
-
-	property_id = g_udev_device_get_property (parent, "PRODUCT");
-	if (property_id == NULL) {
-		GYPSY_NOTE (DISCOVERY, "Product ID was NULL");
-		return NULL;
-	}
-
-	GYPSY_NOTE (DISCOVERY, "Found Product ID %s", property_id);
-	for (i = 0; known_ids[i].product_id; i++) {
-		if (g_str_equal (property_id,
-				 known_ids[i].product_id)) {
-			GYPSY_NOTE (DISCOVERY, "Found %s - %s",
-				    known_ids[i].product_name,
-				    name);
-			remove_device_from_array (priv->known_devices,
-						  name);
-
-			return name;
-		}
-	}
-
-	/* When removing a USB device, UDev seems to often (only?) give the
-	   parent of the tty as the USB port or hub rather than the device
-	   that was removed. But there may be the various components of the
-	   product ID on the tty device. Check that against the known
-	   database */
-	tty_id = build_product_id_from_tty (device);
-	if (tty_id == NULL) {
+	di = find_device (priv->known_devices, name);
+	if (di == NULL) {
 		GYPSY_NOTE (DISCOVERY, "%s is an unknown device.", name);
 		return NULL;
 	}
 
-	GYPSY_NOTE (DISCOVERY, "Found usb_device with unknown product ID. Falling back to tty IDs: %s", tty_id);
-	for (i = 0; known_ids[i].product_id; i++) {
-		if (g_str_equal (tty_id,
-				 known_ids[i].product_id)) {
-			GYPSY_NOTE (DISCOVERY, "Found %s - %s",
-				    known_ids[i].product_name, name);
-			remove_device_from_array (priv->known_devices, name);
-			g_free (tty_id);
+	g_ptr_array_remove (priv->known_devices, di);
+	return name;
+}
 
-			return name;
-		}
-	}
+static void
+emit_device_signal (GypsyDiscovery *discovery,
+		    const char     *name,
+		    const char     *path,
+		    const char     *type)
+{
+	GypsyDiscoveryPrivate *priv = discovery->priv;
 
-	GYPSY_NOTE (DISCOVERY, "%s (%s)is an unknown device.", name, tty_id);
-	g_free (tty_id);
+	if (priv->connection == NULL) {
+		return;
+	}
 
-	return NULL;
+	g_dbus_connection_emit_signal (priv->connection, NULL,
+				       GYPSY_DISCOVERY_PATH,
+				       GYPSY_DISCOVERY_INTERFACE, name,
+				       g_variant_new ("(ss)", path, type),
+				       NULL);
 }
 
 static void
@@ -544,6 +529,7 @@ uevent_occurred_cb (GUdevClient    *client,
 
 		GYPSY_NOTE (DISCOVERY, "Was a known GPS device at %s", path);
 		g_signal_emit (discovery, signals[DEVICE_ADDED], 0, path, "usb");
+		emit_device_signal (discovery, "DeviceAdded", path, "usb");
         } else if (strcmp (action, "remove") == 0) {
 		const char *path;
 
@@ -556,24 +542,81 @@ uevent_occurred_cb (GUdevClient    *client,
 
 		GYPSY_NOTE (DISCOVERY, "Was a known GPS device at %s", path);
 		g_signal_emit (discovery, signals[DEVICE_REMOVED], 0, path, "usb");
+		emit_device_signal (discovery, "DeviceRemoved", path, "usb");
         }
 }
 
+/* Only the ttys udev has found USB IDs for are asked for, rather than
+   every virtual console and pty, and nothing is looked up until the
+   daemon has answered whatever it was activated for */
 static void
-add_known_udev_devices (GypsyDiscovery *self)
+begin_enumeration (GypsyDiscovery *self)
 {
 	GypsyDiscoveryPrivate *priv = self->priv;
-	GList *udev_devices = NULL, *l;
+	GUdevEnumerator *enumerator;
 
-	udev_devices = g_udev_client_query_by_subsystem (priv->client, "tty");
-	for (l = udev_devices; l; l = l->next) {
-		GUdevDevice *device = l->data;
+	priv->enumerated = TRUE;
+
+	enumerator = g_udev_enumerator_new (priv->client);
+	g_udev_enumerator_add_match_subsystem (enumerator, "tty");
+	g_udev_enumerator_add_match_property (enumerator, "ID_BUS", "usb");
+	g_udev_enumerator_add_match_is_initialized (enumerator);
+
+	priv->pending = g_udev_enumerator_execute (enumerator);
+	g_object_unref (enumerator);
+
+	GYPSY_NOTE (DISCOVERY, "%u USB ttys to check",
+		    g_list_length (priv->pending));
+
+	if (priv->connection) {
+		setup_bluetooth_discovery (self);
+	}
+}
+
+/* Looks at up to max of the pending ttys, or all of them if max is 0.
+   Returns TRUE if there are more left */
+static gboolean
+enumerate_devices (GypsyDiscovery *self,
+		   guint           max)
+{
+	GypsyDiscoveryPrivate *priv = self->priv;
+	guint count = 0;
+
+	if (!priv->enumerated) {
+		begin_enumeration (self);
+	}
+
+	while (priv->pending && (max == 0 || count < max)) {
+		GUdevDevice *device = priv->pending->data;
 
+		priv->pending = g_list_delete_link (priv->pending,
+						    priv->pending);
 		maybe_add_device (self, device);
 		g_object_unref (device);
+		count++;
 	}
 
-	g_list_free (udev_devices);
+	if (priv->pending) {
+		return TRUE;
+	}
+
+	GYPSY_NOTE (DISCOVERY, "Found %u devices, %.1f ms after starting",
+		    priv->known_devices->len,
+		    (g_get_monotonic_time () - priv->start_time) / 1000.0);
+	return FALSE;
+}
+
+static gboolean
+enumerate_idle (gpointer userdata)
+{
+	GypsyDiscovery *self = userdata;
+
+	if (enumerate_devices (self, ENUMERATE_CHUNK)) {
+		return TRUE;
+	}
+
+	self->priv->enumerate_id = 0;
+	return FALSE;
 }
 
 static void
@@ -581,57 +624,368 @@ gypsy_discovery_init (GypsyDiscovery *self)
 {
         GypsyDiscoveryPrivate *priv = GET_PRIVATE (self);
         const char * const subsystems[] = { "tty", NULL };
+	GError *error = NULL;
 
         self->priv = priv;
 
 	priv->known_devices = g_ptr_array_new_with_free_func (device_info_free);
+	priv->probes = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+					      (GDestroyNotify) gypsy_probe_free);
+	priv->start_time = g_get_monotonic_time ();
+
+	priv->device_db = gypsy_device_db_new_from_file (DEVICE_DB_PATH,
+							 &error);
+	if (priv->device_db == NULL) {
+		g_warning ("Error reading device database %s: %s\n"
+			   "Continuing without USB discovery",
+			   DEVICE_DB_PATH, error->message);
+		g_error_free (error);
+	}
 
         priv->client = g_udev_client_new (subsystems);
         g_signal_connect (priv->client, "uevent",
                           G_CALLBACK (uevent_occurred_cb), self);
 
-	add_known_udev_devices (self);
+	priv->enumerate_id = g_idle_add_full (G_PRIORITY_LOW, enumerate_idle,
+					      self, NULL);
+}
 
-	setup_bluetooth_discovery (self);
+/* Finishes off the enumeration if it hasn't got there yet */
+static void
+finish_enumeration (GypsyDiscovery *discovery)
+{
+	GypsyDiscoveryPrivate *priv = discovery->priv;
+
+	if (priv->enumerate_id > 0) {
+		g_source_remove (priv->enumerate_id);
+		priv->enumerate_id = 0;
+		enumerate_devices (discovery, 0);
+	}
 }
 
-static gboolean
-gypsy_discovery_list_devices (GypsyDiscovery  *discovery,
-                              char          ***devices,
-			      char          ***types,
-                              GError         **error)
+static GVariant *
+gypsy_discovery_list_devices (GypsyDiscovery *discovery)
 {
 	GypsyDiscoveryPrivate *priv = discovery->priv;
+	GVariantBuilder devices, types;
 	int i;
 
-	*devices = g_new (char *, priv->known_devices->len + 1);
-	*types = g_new (char *, priv->known_devices->len + 1);
+	finish_enumeration (discovery);
+
+	g_variant_builder_init (&devices, G_VARIANT_TYPE ("as"));
+	g_variant_builder_init (&types, G_VARIANT_TYPE ("as"));
 	for (i = 0; i < priv->known_devices->len; i++) {
 		DeviceInfo *di = priv->known_devices->pdata[i];
 
-		(*devices)[i] = g_strdup (di->device_path);
-		(*types)[i] = g_strdup (di->type);
+		g_variant_builder_add (&devices, "s", di->device_path);
+		g_variant_builder_add (&types, "s", di->type);
 	}
 
-	/* NULL terminate the arrays */
-	(*devices)[i] = NULL;
-	(*types)[i] = NULL;
+	if (!priv->replied) {
+		priv->replied = TRUE;
+		GYPSY_NOTE (DISCOVERY, "First ListDevices reply %.1f ms "
+			    "after starting",
+			    (g_get_monotonic_time () - priv->start_time) / 1000.0);
+	}
 
-        return TRUE;
+	return g_variant_new ("(asas)", &devices, &types);
 }
 
-static gboolean
-gypsy_discovery_start_scanning (GypsyDiscovery *discovery,
-                                GError        **error)
+static const char *
+protocol_to_string (GypsyProtocol protocol)
 {
-	g_warning ("Scanning not implemented");
-        return TRUE;
+	switch (protocol) {
+	case GYPSY_PROTOCOL_NMEA:
+		return "nmea";
+	case GYPSY_PROTOCOL_GARMIN:
+		return "garmin";
+	default:
+		return "auto";
+	}
 }
 
+static GVariant *
+gypsy_discovery_get_device_info (GypsyDiscovery *discovery,
+				 const char     *device_path)
+{
+	GypsyDiscoveryPrivate *priv = discovery->priv;
+	const GypsyDeviceDbEntry *entry;
+	GVariantBuilder info;
+	DeviceInfo *di;
+
+	finish_enumeration (discovery);
+
+	di = find_device (priv->known_devices, device_path);
+	if (di == NULL) {
+		return NULL;
+	}
+
+	g_variant_builder_init (&info, G_VARIANT_TYPE ("a{sv}"));
+	g_variant_builder_add (&info, "{sv}", "Type",
+			       g_variant_new_string (di->type));
+
+	entry = gypsy_discovery_lookup (discovery, device_path);
+	if (entry) {
+		if (entry->name) {
+			g_variant_builder_add (&info, "{sv}", "Name",
+					       g_variant_new_string (entry->name));
+		}
+		g_variant_builder_add (&info, "{sv}", "Protocol",
+				       g_variant_new_string
+				       (protocol_to_string (entry->config.protocol)));
+		if (entry->config.baud_rate > 0) {
+			g_variant_builder_add (&info, "{sv}", "BaudRate",
+					       g_variant_new_uint32
+					       (entry->config.baud_rate));
+		}
+	}
+
+	return g_variant_new ("(a{sv})", &info);
+}
+
+static void
+probe_finished (GypsyProbe      *probe,
+		GypsyProbeResult result,
+		guint            baud_rate,
+		gpointer         userdata)
+{
+	GypsyDiscovery *discovery = userdata;
+	GypsyDiscoveryPrivate *priv = discovery->priv;
+	GypsyDeviceDbEntry *entry;
+	DeviceInfo *di;
+	char *path;
+
+	path = g_strdup (gypsy_probe_get_device_path (probe));
+	g_hash_table_remove (priv->probes, path);
+
+	if (result == GYPSY_PROBE_RESULT_NONE ||
+	    find_device (priv->known_devices, path)) {
+		g_free (path);
+		return;
+	}
+
+	entry = g_slice_new0 (GypsyDeviceDbEntry);
+	entry->name = g_strdup_printf ("%s receiver",
+				       gypsy_probe_result_to_string (result));
+	entry->config.baud_rate = baud_rate;
+
+	switch (result) {
+	case GYPSY_PROBE_RESULT_NMEA:
+		entry->config.protocol = GYPSY_PROTOCOL_NMEA;
+		break;
+	case GYPSY_PROBE_RESULT_UBX:
+		/* Its NMEA output is turned off, but it takes UBX-CFG-MSG */
+		entry->config.protocol = GYPSY_PROTOCOL_NMEA;
+		entry->config.commands = GYPSY_COMMANDS_UBX;
+		break;
+	case GYPSY_PROBE_RESULT_GARMIN:
+		entry->config.protocol = GYPSY_PROTOCOL_GARMIN;
+		entry->config.commands = GYPSY_COMMANDS_NONE;
+		break;
+	default:
+		/* Nothing here can read SiRF binary, but it is still a GPS */
+		entry->config.commands = GYPSY_COMMANDS_NONE;
+		break;
+	}
+
+	di = device_info_new (path, serial_type);
+	di->probed = entry;
+	g_ptr_array_add (priv->known_devices, di);
+
+	g_signal_emit (discovery, signals[DEVICE_ADDED], 0, path, serial_type);
+	emit_device_signal (discovery, "DeviceAdded", path, serial_type);
+	g_free (path);
+}
+
+/* Virtual consoles and ptys have no parent device, so they don't need
+   to be listened to, and neither do the ports the daemon has open or
+   the config file doesn't allow */
 static gboolean
-gypsy_discovery_stop_scanning (GypsyDiscovery *discovery,
-                               GError        **error)
+is_scan_candidate (GypsyDiscovery *discovery,
+		   GUdevDevice    *device)
 {
-	g_warning ("Scanning not implemented");
-        return TRUE;
+	GypsyDiscoveryPrivate *priv = discovery->priv;
+	GUdevDevice *parent;
+	const char *name;
+
+	name = g_udev_device_get_device_file (device);
+	if (name == NULL || find_device (priv->known_devices, name) ||
+	    g_hash_table_lookup (priv->probes, name)) {
+		return FALSE;
+	}
+
+	if (priv->ignore_func && priv->ignore_func (name, priv->ignore_data)) {
+		return FALSE;
+	}
+
+	parent = g_udev_device_get_parent (device);
+	if (parent == NULL) {
+		return FALSE;
+	}
+	g_object_unref (parent);
+
+	return TRUE;
+}
+
+/* Every candidate is probed at once, so a scan takes as long
+   as probing one device rather than all of them in turn */
+static void
+gypsy_discovery_start_scanning (GypsyDiscovery *discovery)
+{
+	GypsyDiscoveryPrivate *priv = discovery->priv;
+	GList *udev_devices, *l;
+
+	finish_enumeration (discovery);
+
+	udev_devices = g_udev_client_query_by_subsystem (priv->client, "tty");
+	for (l = udev_devices; l; l = l->next) {
+		GUdevDevice *device = l->data;
+		GypsyProbe *probe;
+		GError *error = NULL;
+
+		if (is_scan_candidate (discovery, device)) {
+			probe = gypsy_probe_new
+				(g_udev_device_get_device_file (device),
+				 probe_finished, discovery, &error);
+			if (probe) {
+				g_hash_table_insert
+					(priv->probes,
+					 (char *) gypsy_probe_get_device_path (probe),
+					 probe);
+			} else {
+				GYPSY_NOTE (DISCOVERY, "%s", error->message);
+				g_error_free (error);
+			}
+		}
+
+		g_object_unref (device);
+	}
+	g_list_free (udev_devices);
+
+	GYPSY_NOTE (DISCOVERY, "Probing %u devices",
+		    g_hash_table_size (priv->probes));
+}
+
+static void
+gypsy_discovery_stop_scanning (GypsyDiscovery *discovery)
+{
+	GypsyDiscoveryPrivate *priv = discovery->priv;
+
+	g_hash_table_remove_all (priv->probes);
+}
+
+static void
+method_call (GDBusConnection       *connection,
+	     const char            *sender,
+	     const char            *object_path,
+	     const char            *interface_name,
+	     const char            *method_name,
+	     GVariant              *parameters,
+	     GDBusMethodInvocation *invocation,
+	     gpointer               userdata)
+{
+	GypsyDiscovery *discovery = userdata;
+	GVariant *reply = NULL;
+
+	if (g_str_equal (method_name, "ListDevices")) {
+		reply = gypsy_discovery_list_devices (discovery);
+	} else if (g_str_equal (method_name, "GetDeviceInfo")) {
+		const char *device_path;
+
+		g_variant_get (parameters, "(&s)", &device_path);
+		reply = gypsy_discovery_get_device_info (discovery,
+							 device_path);
+		if (reply == NULL) {
+			g_dbus_method_invocation_return_error
+				(invocation, G_DBUS_ERROR,
+				 G_DBUS_ERROR_INVALID_ARGS,
+				 "Unknown device %s", device_path);
+			return;
+		}
+	} else if (g_str_equal (method_name, "StartScanning")) {
+		gypsy_discovery_start_scanning (discovery);
+	} else if (g_str_equal (method_name, "StopScanning")) {
+		gypsy_discovery_stop_scanning (discovery);
+	}
+
+	g_dbus_method_invocation_return_value (invocation, reply);
+}
+
+static const GDBusInterfaceVTable interface_vtable = {
+	method_call,
+	NULL,
+	NULL
+};
+
+gboolean
+gypsy_discovery_register (GypsyDiscovery  *discovery,
+			  GDBusConnection *connection,
+			  GError         **error)
+{
+	GypsyDiscoveryPrivate *priv = discovery->priv;
+
+	g_return_val_if_fail (priv->registration_id == 0, FALSE);
+
+	priv->registration_id = g_dbus_connection_register_object
+		(connection, GYPSY_DISCOVERY_PATH,
+		 introspection_data->interfaces[0], &interface_vtable,
+		 discovery, NULL, error);
+	if (priv->registration_id == 0) {
+		return FALSE;
+	}
+
+	priv->connection = g_object_ref (connection);
+
+	/* BlueZ is asked on the same bus, along with udev, unless
+	   the ttys have already been looked at */
+	if (priv->enumerated) {
+		setup_bluetooth_discovery (discovery);
+	}
+
+	return TRUE;
+}
+
+/* Returns the device database entry for the device file device_path,
+   or NULL if it isn't a receiver we know. This asks udev about just that
+   device, so it doesn't wait for the enumeration */
+const GypsyDeviceDbEntry *
+gypsy_discovery_lookup (GypsyDiscovery *discovery,
+			const char     *device_path)
+{
+	GypsyDiscoveryPrivate *priv = discovery->priv;
+	const GypsyDeviceDbEntry *entry;
+	GUdevDevice *device;
+	DeviceInfo *di;
+
+	di = find_device (priv->known_devices, device_path);
+	if (di && di->probed) {
+		return di->probed;
+	}
+
+	if (priv->device_db == NULL ||
+	    !g_str_has_prefix (device_path, "/dev/")) {
+		return NULL;
+	}
+
+	device = g_udev_client_query_by_device_file (priv->client,
+						     device_path);
+	if (device == NULL) {
+		return NULL;
+	}
+
+	entry = find_known_product (discovery, device);
+	g_object_unref (device);
+
+	return entry;
+}
+
+void
+gypsy_discovery_set_ignore_func (GypsyDiscovery          *discovery,
+				 GypsyDiscoveryIgnoreFunc func,
+				 gpointer                 userdata)
+{
+	GypsyDiscoveryPrivate *priv = discovery->priv;
+
+	priv->ignore_func = func;
+	priv->ignore_data = userdata;
 }
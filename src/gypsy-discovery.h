@@ -2,10 +2,14 @@
 #define __GYPSY_DISCOVERY_H__
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
+#include "gypsy-device-db.h"
 
 G_BEGIN_DECLS
 
+#define GYPSY_DISCOVERY_PATH "/org/freedesktop/Gypsy/Discovery"
+
 #define GYPSY_TYPE_DISCOVERY                                            \
    (gypsy_discovery_get_type())
 #define GYPSY_DISCOVERY(obj)                                            \
@@ -44,6 +48,19 @@ struct _GypsyDiscoveryClass
 };
 
 GType gypsy_discovery_get_type (void) G_GNUC_CONST;
+gboolean gypsy_discovery_register (GypsyDiscovery  *discovery,
+                                   GDBusConnection *connection,
+                                   GError         **error);
+const GypsyDeviceDbEntry *gypsy_discovery_lookup (GypsyDiscovery *discovery,
+                                                  const char     *device_path);
+
+/* Whether scanning has to leave device_path alone, because the daemon
+   has it open or isn't allowed to open it */
+typedef gboolean (* GypsyDiscoveryIgnoreFunc) (const char *device_path,
+                                               gpointer    userdata);
+void gypsy_discovery_set_ignore_func (GypsyDiscovery          *discovery,
+                                      GypsyDiscoveryIgnoreFunc func,
+                                      gpointer                 userdata);
 
 G_END_DECLS
 
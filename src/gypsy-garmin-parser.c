@@ -253,7 +253,11 @@ gypsy_garmin_parser_received_data (GypsyParser *parser,
 
             pvt = (D800_Pvt_Data_Type *) pGpkt->mData;
 
-            gypsy_client_set_timestamp (client, calculate_utc (garmin, pvt));
+            /* The time of week is rounded to get the timestamp,
+               so the fraction left over can be either side of it */
+            gypsy_client_set_precise_timestamp (client,
+                                                calculate_utc (garmin, pvt),
+                                                pvt->tow - rint (pvt->tow));
 
             switch (pvt->fix) {
             case 0:
@@ -285,8 +289,9 @@ gypsy_garmin_parser_received_data (GypsyParser *parser,
             calculate_speed_course (garmin, pvt, &speed, &course);
             gypsy_client_set_course (client,
                                      COURSE_SPEED |
-                                     COURSE_DIRECTION,
-                                     speed, course, 0.0);
+                                     COURSE_DIRECTION |
+                                     COURSE_CLIMB,
+                                     speed, course, pvt->up);
         } else if (pGpkt->mPacketId == Pid_SatData_Record) {
             int i;
             cpo_sat_data *sat;
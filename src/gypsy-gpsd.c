@@ -0,0 +1,1149 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * GypsyGpsd - Serves the gpsd JSON protocol so that gpspipe, cgps,
+ *             chrony and other libgps programs can use Gypsy's devices.
+ *
+ * Only the JSON side of the protocol is spoken: VERSION, DEVICES, WATCH
+ * and POLL requests, and TPV, SKY, DEVICE and DEVICES reports. The
+ * reports of a device are built once per read from it and the same
+ * bytes are queued to every watcher, so a new epoch costs the same
+ * however many programs are watching. Watchers that stop reading are
+ * dropped once they have too many reports waiting. Watching a device
+ * keeps it running the way a D-Bus Create and Start do.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <glib.h>
+
+#include "gypsy-client.h"
+#include "gypsy-debug.h"
+#include "gypsy-gpsd.h"
+
+#define GPSD_PROTO_MAJOR 3
+#define GPSD_PROTO_MINOR 11
+
+#define LISTEN_BACKLOG 16
+#define MAX_QUEUED_REPORTS 64
+#define MAX_REQUEST_LENGTH 1024
+
+#define KNOTS_TO_MPS 0.514444
+
+/* What the devices gpsd watchers keep going are held as. Bus names
+   always have a '.' or start with ':', so it can't clash with one */
+#define GPSD_HOLDER "gpsd"
+
+/* A serialized report, shared by every watcher it is queued to */
+typedef struct _Report {
+	int ref_count;
+	gsize length;
+	char data[1];
+} Report;
+
+typedef struct _Device {
+	GypsyGpsd *gpsd;
+	GypsyClient *client;
+	char *path;
+	int activated; /* When it connected, or 0 */
+	gboolean watched; /* Whether any watcher wants its reports */
+
+	gboolean tpv_dirty, sky_dirty;
+	Report *tpv, *sky;
+	guint32 flush_id;
+} Device;
+
+typedef struct _Watcher {
+	GypsyGpsd *gpsd;
+	int fd;
+	GIOChannel *channel;
+	guint32 input_id, write_id;
+
+	GString *request; /* What's been read of the next request */
+
+	gboolean watching;
+	char *device; /* Only watch this device, or NULL for all */
+
+	GQueue *queue; /* Reports waiting to be sent */
+	gsize offset; /* How much of the first one has been sent */
+} Watcher;
+
+struct _GypsyGpsd {
+	GypsyServer *server;
+	gulong client_added_id;
+
+	int fd;
+	GIOChannel *channel;
+	guint32 accept_id;
+
+	GList *devices;
+	GList *watchers;
+	int watching; /* Watchers with watching set */
+};
+
+static Report *
+report_new (GString *json)
+{
+	Report *report;
+
+	report = g_malloc (G_STRUCT_OFFSET (Report, data) + json->len);
+	report->ref_count = 1;
+	report->length = json->len;
+	memcpy (report->data, json->str, json->len);
+
+	return report;
+}
+
+static Report *
+report_ref (Report *report)
+{
+	report->ref_count++;
+	return report;
+}
+
+static void
+report_unref (Report *report)
+{
+	if (--report->ref_count == 0) {
+		g_free (report);
+	}
+}
+
+/* JSON building. Every member is followed by a comma, which
+   close_object replaces with the closing brace. */
+
+static void
+append_escaped (GString    *json,
+		const char *value)
+{
+	const char *p;
+
+	g_string_append_c (json, '"');
+	for (p = value; *p; p++) {
+		switch (*p) {
+		case '"':
+		case '\\':
+			g_string_append_c (json, '\\');
+			g_string_append_c (json, *p);
+			break;
+
+		default:
+			if ((guchar) *p < 0x20) {
+				g_string_append_printf (json, "\\u%04x",
+							(guchar) *p);
+			} else {
+				g_string_append_c (json, *p);
+			}
+			break;
+		}
+	}
+	g_string_append_c (json, '"');
+}
+
+static void
+append_string (GString    *json,
+	       const char *key,
+	       const char *value)
+{
+	g_string_append_printf (json, "\"%s\":", key);
+	append_escaped (json, value);
+	g_string_append_c (json, ',');
+}
+
+static void
+append_int (GString    *json,
+	    const char *key,
+	    int         value)
+{
+	g_string_append_printf (json, "\"%s\":%d,", key, value);
+}
+
+static void
+append_bool (GString    *json,
+	     const char *key,
+	     gboolean    value)
+{
+	g_string_append_printf (json, "\"%s\":%s,", key,
+				value ? "true" : "false");
+}
+
+/* Numbers are always written with a '.', whatever the locale */
+static void
+append_double (GString    *json,
+	       const char *key,
+	       const char *format,
+	       double      value)
+{
+	char buffer[G_ASCII_DTOSTR_BUF_SIZE];
+
+	g_ascii_formatd (buffer, sizeof (buffer), format, value);
+	g_string_append_printf (json, "\"%s\":%s,", key, buffer);
+}
+
+static void
+append_time (GString    *json,
+	     const char *key,
+	     int         timestamp)
+{
+	GTimeVal tv = { timestamp, 0 };
+	char *iso;
+
+	iso = g_time_val_to_iso8601 (&tv);
+	append_string (json, key, iso);
+	g_free (iso);
+}
+
+static void
+close_object (GString *json)
+{
+	if (json->str[json->len - 1] == ',') {
+		g_string_truncate (json, json->len - 1);
+	}
+	g_string_append_c (json, '}');
+}
+
+static void
+append_device (GString *json,
+	       Device  *device)
+{
+	g_string_append (json, "{\"class\":\"DEVICE\",");
+	append_string (json, "path", device->path);
+	if (device->activated) {
+		append_time (json, "activated", device->activated);
+	} else {
+		append_int (json, "activated", 0);
+	}
+	close_object (json);
+}
+
+static void
+append_devices (GString   *json,
+		GypsyGpsd *gpsd)
+{
+	GList *l;
+
+	g_string_append (json, "{\"class\":\"DEVICES\",\"devices\":[");
+	for (l = gpsd->devices; l; l = l->next) {
+		Device *device = l->data;
+
+		if (device->activated == 0) {
+			continue;
+		}
+
+		append_device (json, device);
+		g_string_append_c (json, ',');
+	}
+	if (json->str[json->len - 1] == ',') {
+		g_string_truncate (json, json->len - 1);
+	}
+	g_string_append (json, "]}");
+}
+
+static Report *
+build_tpv (Device *device)
+{
+	GypsyShmFix fix;
+	GString *json;
+	Report *report;
+
+	gypsy_client_get_fix (device->client, &fix);
+
+	json = g_string_new ("{\"class\":\"TPV\",");
+	append_string (json, "device", device->path);
+
+	/* gpsd's modes are the same as the fix status */
+	append_int (json, "mode", fix.fix_status);
+	if (fix.timestamp > 0) {
+		append_time (json, "time", fix.timestamp);
+	}
+
+	if (fix.fix_status >= GYPSY_DEVICE_FIX_STATUS_2D) {
+		if (fix.position_fields & GYPSY_POSITION_FIELDS_LATITUDE) {
+			append_double (json, "lat", "%.9f", fix.latitude);
+		}
+		if (fix.position_fields & GYPSY_POSITION_FIELDS_LONGITUDE) {
+			append_double (json, "lon", "%.9f", fix.longitude);
+		}
+	}
+	if (fix.fix_status == GYPSY_DEVICE_FIX_STATUS_3D &&
+	    fix.position_fields & GYPSY_POSITION_FIELDS_ALTITUDE) {
+		append_double (json, "alt", "%.3f", fix.altitude);
+	}
+
+	if (fix.course_fields & GYPSY_COURSE_FIELDS_DIRECTION) {
+		append_double (json, "track", "%.4f", fix.direction);
+	}
+	if (fix.course_fields & GYPSY_COURSE_FIELDS_SPEED) {
+		append_double (json, "speed", "%.3f",
+			       fix.speed * KNOTS_TO_MPS);
+	}
+	if (fix.course_fields & GYPSY_COURSE_FIELDS_CLIMB) {
+		append_double (json, "climb", "%.3f", fix.climb);
+	}
+
+	close_object (json);
+	g_string_append_c (json, '\n');
+
+	report = report_new (json);
+	g_string_free (json, TRUE);
+
+	return report;
+}
+
+static Report *
+build_sky (Device *device)
+{
+	GypsyShmFix fix;
+	GString *json;
+	Report *report;
+	int i;
+
+	gypsy_client_get_fix (device->client, &fix);
+
+	json = g_string_new ("{\"class\":\"SKY\",");
+	append_string (json, "device", device->path);
+	if (fix.timestamp > 0) {
+		append_time (json, "time", fix.timestamp);
+	}
+
+	if (fix.accuracy_fields & GYPSY_ACCURACY_FIELDS_HORIZONTAL) {
+		append_double (json, "hdop", "%.2f", fix.hdop);
+	}
+	if (fix.accuracy_fields & GYPSY_ACCURACY_FIELDS_VERTICAL) {
+		append_double (json, "vdop", "%.2f", fix.vdop);
+	}
+	if (fix.accuracy_fields & GYPSY_ACCURACY_FIELDS_POSITION) {
+		append_double (json, "pdop", "%.2f", fix.pdop);
+	}
+
+	g_string_append (json, "\"satellites\":[");
+	for (i = 0; i < fix.satellite_count; i++) {
+		GypsyShmSatellite *sat = &fix.satellites[i];
+
+		g_string_append_printf (json, "%s{\"PRN\":%d,\"el\":%d,"
+					"\"az\":%d,\"ss\":%d,\"used\":%s}",
+					i > 0 ? "," : "",
+					sat->satellite_id, sat->elevation,
+					sat->azimuth, sat->snr,
+					sat->in_use ? "true" : "false");
+	}
+	g_string_append (json, "]}\n");
+
+	report = report_new (json);
+	g_string_free (json, TRUE);
+
+	return report;
+}
+
+static void update_watched (GypsyGpsd *gpsd,
+			    gboolean   start);
+
+static void
+remove_watcher (Watcher *watcher)
+{
+	GypsyGpsd *gpsd = watcher->gpsd;
+	Report *report;
+
+	if (watcher->input_id > 0) {
+		g_source_remove (watcher->input_id);
+	}
+
+	if (watcher->write_id > 0) {
+		g_source_remove (watcher->write_id);
+	}
+
+	if (watcher->watching) {
+		gpsd->watching--;
+	}
+
+	while ((report = g_queue_pop_head (watcher->queue))) {
+		report_unref (report);
+	}
+	g_queue_free (watcher->queue);
+
+	g_io_channel_unref (watcher->channel);
+	close (watcher->fd);
+
+	g_string_free (watcher->request, TRUE);
+	g_free (watcher->device);
+
+	gpsd->watchers = g_list_remove (gpsd->watchers, watcher);
+	g_slice_free (Watcher, watcher);
+
+	update_watched (gpsd, FALSE);
+}
+
+static gboolean watcher_writable (GIOChannel  *channel,
+				  GIOCondition condition,
+				  gpointer     userdata);
+
+/* Sends as much of the queue as the socket will take. Returns
+   FALSE if the watcher had to be removed. */
+static gboolean
+flush_watcher (Watcher *watcher)
+{
+	Report *report;
+
+	while ((report = g_queue_peek_head (watcher->queue))) {
+		ssize_t sent;
+
+		sent = send (watcher->fd, report->data + watcher->offset,
+			     report->length - watcher->offset,
+			     MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (sent < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			if (errno == EAGAIN) {
+				if (watcher->write_id == 0) {
+					watcher->write_id = g_io_add_watch
+						(watcher->channel, G_IO_OUT,
+						 watcher_writable, watcher);
+				}
+				return TRUE;
+			}
+
+			remove_watcher (watcher);
+			return FALSE;
+		}
+
+		watcher->offset += sent;
+		if (watcher->offset == report->length) {
+			g_queue_pop_head (watcher->queue);
+			report_unref (report);
+			watcher->offset = 0;
+		}
+	}
+
+	return TRUE;
+}
+
+static gboolean
+watcher_writable (GIOChannel  *channel,
+		  GIOCondition condition,
+		  gpointer     userdata)
+{
+	Watcher *watcher = userdata;
+
+	watcher->write_id = 0;
+	flush_watcher (watcher);
+
+	return FALSE;
+}
+
+/* Returns FALSE if the watcher had to be removed */
+static gboolean
+queue_report (Watcher *watcher,
+	      Report  *report)
+{
+	if (g_queue_get_length (watcher->queue) >= MAX_QUEUED_REPORTS) {
+		GYPSY_NOTE (SERVER, "Dropping slow gpsd watcher");
+		remove_watcher (watcher);
+		return FALSE;
+	}
+
+	g_queue_push_tail (watcher->queue, report_ref (report));
+
+	/* Watchers waiting for their socket get it when it's ready */
+	if (watcher->write_id == 0) {
+		return flush_watcher (watcher);
+	}
+
+	return TRUE;
+}
+
+static gboolean
+queue_json (Watcher *watcher,
+	    GString *json)
+{
+	Report *report;
+	gboolean ret;
+
+	g_string_append_c (json, '\n');
+	report = report_new (json);
+	ret = queue_report (watcher, report);
+	report_unref (report);
+
+	return ret;
+}
+
+/* Sends report to everyone watching device */
+static void
+broadcast (GypsyGpsd  *gpsd,
+	   const char *path,
+	   Report     *report)
+{
+	GList *l, *next;
+
+	for (l = gpsd->watchers; l; l = next) {
+		Watcher *watcher = l->data;
+
+		/* queue_report may remove l */
+		next = l->next;
+
+		if (watcher->watching &&
+		    (watcher->device == NULL ||
+		     g_str_equal (watcher->device, path))) {
+			queue_report (watcher, report);
+		}
+	}
+}
+
+static void
+update_reports (Device *device)
+{
+	if (device->tpv_dirty) {
+		if (device->tpv) {
+			report_unref (device->tpv);
+		}
+		device->tpv = build_tpv (device);
+		device->tpv_dirty = FALSE;
+	}
+
+	if (device->sky_dirty) {
+		if (device->sky) {
+			report_unref (device->sky);
+		}
+		device->sky = build_sky (device);
+		device->sky_dirty = FALSE;
+	}
+}
+
+/* Runs once everything read from the device has been parsed, so
+   that each read results in at most one TPV and one SKY */
+static gboolean
+flush_device (gpointer userdata)
+{
+	Device *device = userdata;
+	gboolean tpv_dirty, sky_dirty;
+
+	device->flush_id = 0;
+
+	tpv_dirty = device->tpv_dirty;
+	sky_dirty = device->sky_dirty;
+	update_reports (device);
+
+	if (tpv_dirty) {
+		broadcast (device->gpsd, device->path, device->tpv);
+	}
+
+	if (sky_dirty) {
+		broadcast (device->gpsd, device->path, device->sky);
+	}
+
+	return FALSE;
+}
+
+static void
+schedule_flush (Device *device)
+{
+	/* With nobody watching the reports are built when polled */
+	if (device->gpsd->watching > 0 && device->flush_id == 0) {
+		device->flush_id = g_idle_add (flush_device, device);
+	}
+}
+
+static void
+tpv_changed (Device *device)
+{
+	device->tpv_dirty = TRUE;
+	schedule_flush (device);
+}
+
+static void
+sky_changed (Device *device)
+{
+	device->sky_dirty = TRUE;
+	schedule_flush (device);
+}
+
+static void
+connection_changed (GypsyClient *client,
+		    gboolean     connected,
+		    Device      *device)
+{
+	GString *json;
+	Report *report;
+
+	device->activated = connected ? (int) time (NULL) : 0;
+
+	json = g_string_new (NULL);
+	append_device (json, device);
+	g_string_append_c (json, '\n');
+
+	report = report_new (json);
+	broadcast (device->gpsd, device->path, report);
+	report_unref (report);
+
+	g_string_free (json, TRUE);
+}
+
+static gboolean
+is_watched (GypsyGpsd *gpsd,
+	    Device    *device)
+{
+	GList *l;
+
+	for (l = gpsd->watchers; l; l = l->next) {
+		Watcher *watcher = l->data;
+
+		if (watcher->watching &&
+		    (watcher->device == NULL ||
+		     g_str_equal (watcher->device, device->path))) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/* A watched device is held like a Create holds it, so it doesn't go
+   idle under its watchers, and with start set is started like a D-Bus
+   Start would. A device that has only just been created is left for its
+   creator to set up and start. Watchers want TPV and SKY whatever the
+   D-Bus subscribers need, so it mustn't prune the sentences behind them
+   either */
+static void
+update_watched (GypsyGpsd *gpsd,
+		gboolean   start)
+{
+	GList *l, *next;
+
+	for (l = gpsd->devices; l; l = next) {
+		Device *device = l->data;
+		gboolean watched;
+
+		/* Releasing the last hold may close the device and
+		   remove l, but nothing else */
+		next = l->next;
+
+		watched = is_watched (gpsd, device);
+		if (watched == device->watched) {
+			continue;
+		}
+
+		device->watched = watched;
+		if (watched) {
+			GError *error = NULL;
+
+			gypsy_server_hold_client (gpsd->server,
+						  G_OBJECT (device->client),
+						  GPSD_HOLDER);
+			gypsy_client_add_consumer (device->client);
+
+			if (start &&
+			    !gypsy_client_start (device->client, &error)) {
+				GYPSY_NOTE (SERVER, "Error starting %s: %s",
+					    device->path, error->message);
+				g_error_free (error);
+			}
+		} else {
+			gypsy_client_remove_consumer (device->client);
+			gypsy_server_release_client (gpsd->server,
+						     G_OBJECT (device->client),
+						     GPSD_HOLDER);
+		}
+	}
+}
+
+static void
+device_gone (gpointer userdata,
+	     GObject *client)
+{
+	Device *device = userdata;
+	GypsyGpsd *gpsd = device->gpsd;
+
+	if (device->flush_id > 0) {
+		g_source_remove (device->flush_id);
+	}
+
+	if (device->tpv) {
+		report_unref (device->tpv);
+	}
+
+	if (device->sky) {
+		report_unref (device->sky);
+	}
+
+	gpsd->devices = g_list_remove (gpsd->devices, device);
+
+	g_free (device->path);
+	g_slice_free (Device, device);
+}
+
+static void
+client_added (GypsyServer *server,
+	      GObject     *client,
+	      GypsyGpsd   *gpsd)
+{
+	Device *device;
+
+	device = g_slice_new0 (Device);
+	device->gpsd = gpsd;
+	device->client = GYPSY_CLIENT (client);
+	device->tpv_dirty = TRUE;
+	device->sky_dirty = TRUE;
+	g_object_get (client, "device_path", &device->path, NULL);
+
+	g_signal_connect_swapped (client, "position-changed",
+				  G_CALLBACK (tpv_changed), device);
+	g_signal_connect_swapped (client, "course-changed",
+				  G_CALLBACK (tpv_changed), device);
+	g_signal_connect_swapped (client, "fix-status-changed",
+				  G_CALLBACK (tpv_changed), device);
+	g_signal_connect_swapped (client, "time-changed",
+				  G_CALLBACK (tpv_changed), device);
+	g_signal_connect_swapped (client, "accuracy-changed",
+				  G_CALLBACK (sky_changed), device);
+	g_signal_connect_swapped (client, "satellites-changed",
+				  G_CALLBACK (sky_changed), device);
+	g_signal_connect (client, "connection-status-changed",
+			  G_CALLBACK (connection_changed), device);
+	g_object_weak_ref (client, device_gone, device);
+
+	gpsd->devices = g_list_prepend (gpsd->devices, device);
+
+	update_watched (gpsd, FALSE);
+}
+
+/* Just enough JSON parsing for the arguments of ?WATCH */
+static const char *
+find_value (const char *json,
+	    const char *key)
+{
+	char *quoted;
+	const char *p;
+
+	quoted = g_strdup_printf ("\"%s\"", key);
+	p = strstr (json, quoted);
+	if (p) {
+		p += strlen (quoted);
+		while (g_ascii_isspace (*p)) {
+			p++;
+		}
+		if (*p == ':') {
+			p++;
+			while (g_ascii_isspace (*p)) {
+				p++;
+			}
+		} else {
+			p = NULL;
+		}
+	}
+	g_free (quoted);
+
+	return p;
+}
+
+static gboolean
+get_bool (const char *json,
+	  const char *key,
+	  gboolean    default_value)
+{
+	const char *value;
+
+	value = find_value (json, key);
+	if (value == NULL) {
+		return default_value;
+	}
+
+	if (g_str_has_prefix (value, "true")) {
+		return TRUE;
+	}
+
+	if (g_str_has_prefix (value, "false")) {
+		return FALSE;
+	}
+
+	return default_value;
+}
+
+static char *
+get_string (const char *json,
+	    const char *key)
+{
+	const char *value, *end;
+
+	value = find_value (json, key);
+	if (value == NULL || *value != '"') {
+		return NULL;
+	}
+
+	value++;
+	end = strchr (value, '"');
+	if (end == NULL) {
+		return NULL;
+	}
+
+	return g_strndup (value, end - value);
+}
+
+static gboolean
+send_version (Watcher *watcher)
+{
+	GString *json;
+	gboolean ret;
+
+	json = g_string_new ("{\"class\":\"VERSION\",");
+	append_string (json, "release", VERSION);
+	append_string (json, "rev", PACKAGE "-" VERSION);
+	append_int (json, "proto_major", GPSD_PROTO_MAJOR);
+	append_int (json, "proto_minor", GPSD_PROTO_MINOR);
+	close_object (json);
+
+	ret = queue_json (watcher, json);
+	g_string_free (json, TRUE);
+
+	return ret;
+}
+
+static gboolean
+send_devices (Watcher *watcher)
+{
+	GString *json;
+	gboolean ret;
+
+	json = g_string_new (NULL);
+	append_devices (json, watcher->gpsd);
+
+	ret = queue_json (watcher, json);
+	g_string_free (json, TRUE);
+
+	return ret;
+}
+
+static gboolean
+handle_watch (Watcher    *watcher,
+	      const char *args)
+{
+	GypsyGpsd *gpsd = watcher->gpsd;
+	GString *json;
+	gboolean enable, ret;
+
+	/* Only JSON is spoken, so asking for
+	   anything else is the same as not watching */
+	enable = get_bool (args, "enable", TRUE) &&
+		get_bool (args, "json", TRUE);
+
+	if (watcher->watching != enable) {
+		gpsd->watching += enable ? 1 : -1;
+		watcher->watching = enable;
+	}
+
+	g_free (watcher->device);
+	watcher->device = get_string (args, "device");
+
+	update_watched (gpsd, TRUE);
+
+	if (!send_devices (watcher)) {
+		return FALSE;
+	}
+
+	json = g_string_new ("{\"class\":\"WATCH\",");
+	append_bool (json, "enable", enable);
+	append_bool (json, "json", enable);
+	append_bool (json, "nmea", FALSE);
+	append_int (json, "raw", 0);
+	append_bool (json, "scaled", FALSE);
+	append_bool (json, "timing", FALSE);
+	append_bool (json, "split24", FALSE);
+	append_bool (json, "pps", FALSE);
+	if (watcher->device) {
+		append_string (json, "device", watcher->device);
+	}
+	close_object (json);
+
+	ret = queue_json (watcher, json);
+	g_string_free (json, TRUE);
+
+	return ret;
+}
+
+static gboolean
+handle_poll (Watcher *watcher)
+{
+	GypsyGpsd *gpsd = watcher->gpsd;
+	GString *json, *sky;
+	GList *l;
+	int active = 0;
+	gboolean ret;
+
+	json = g_string_new ("{\"class\":\"POLL\",");
+	append_time (json, "time", (int) time (NULL));
+
+	sky = g_string_new ("\"sky\":[");
+	g_string_append (json, "\"tpv\":[");
+	for (l = gpsd->devices; l; l = l->next) {
+		Device *device = l->data;
+
+		if (device->activated == 0) {
+			continue;
+		}
+
+		update_reports (device);
+
+		/* Without the newline */
+		g_string_append_len (json, device->tpv->data,
+				     device->tpv->length - 1);
+		g_string_append_c (json, ',');
+		g_string_append_len (sky, device->sky->data,
+				     device->sky->length - 1);
+		g_string_append_c (sky, ',');
+		active++;
+	}
+
+	if (active > 0) {
+		g_string_truncate (json, json->len - 1);
+		g_string_truncate (sky, sky->len - 1);
+	}
+	g_string_append (json, "],");
+	g_string_append (json, sky->str);
+	g_string_append (json, "],");
+	append_int (json, "active", active);
+	close_object (json);
+	g_string_free (sky, TRUE);
+
+	ret = queue_json (watcher, json);
+	g_string_free (json, TRUE);
+
+	return ret;
+}
+
+/* Returns FALSE if the watcher had to be removed */
+static gboolean
+handle_request (Watcher *watcher,
+		char    *request)
+{
+	GString *json;
+	char *args;
+	gboolean ret;
+
+	request = g_strstrip (request);
+	if (*request == '\0') {
+		return TRUE;
+	}
+
+	GYPSY_NOTE (SERVER, "gpsd request: %s", request);
+
+	args = strchr (request, '=');
+	if (args) {
+		*args++ = '\0';
+	} else {
+		args = "";
+	}
+
+	if (g_str_equal (request, "?VERSION")) {
+		return send_version (watcher);
+	} else if (g_str_equal (request, "?DEVICES")) {
+		return send_devices (watcher);
+	} else if (g_str_equal (request, "?WATCH")) {
+		return handle_watch (watcher, args);
+	} else if (g_str_equal (request, "?POLL")) {
+		return handle_poll (watcher);
+	}
+
+	json = g_string_new ("{\"class\":\"ERROR\",");
+	append_string (json, "message", "Unrecognized request");
+	close_object (json);
+
+	ret = queue_json (watcher, json);
+	g_string_free (json, TRUE);
+
+	return ret;
+}
+
+static gboolean
+watcher_input (GIOChannel  *channel,
+	       GIOCondition condition,
+	       gpointer     userdata)
+{
+	Watcher *watcher = userdata;
+	char buffer[512];
+	ssize_t n;
+	char *start, *end;
+
+	n = recv (watcher->fd, buffer, sizeof (buffer), MSG_DONTWAIT);
+	if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+		return TRUE;
+	}
+
+	if (n <= 0) {
+		watcher->input_id = 0;
+		remove_watcher (watcher);
+		return FALSE;
+	}
+
+	g_string_append_len (watcher->request, buffer, n);
+
+	/* Requests end with a ; or a newline */
+	start = watcher->request->str;
+	while ((end = strpbrk (start, ";\n"))) {
+		*end = '\0';
+		if (!handle_request (watcher, start)) {
+			/* The watcher is gone, and the source with it */
+			return FALSE;
+		}
+		start = end + 1;
+	}
+	g_string_erase (watcher->request, 0, start - watcher->request->str);
+
+	if (watcher->request->len > MAX_REQUEST_LENGTH) {
+		watcher->input_id = 0;
+		remove_watcher (watcher);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+gpsd_accept (GIOChannel  *channel,
+	     GIOCondition condition,
+	     gpointer     userdata)
+{
+	GypsyGpsd *gpsd = userdata;
+	Watcher *watcher;
+	int fd;
+
+	fd = accept (gpsd->fd, NULL, NULL);
+	if (fd == -1) {
+		return TRUE;
+	}
+
+	fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+	fcntl (fd, F_SETFD, FD_CLOEXEC);
+
+	watcher = g_slice_new0 (Watcher);
+	watcher->gpsd = gpsd;
+	watcher->fd = fd;
+	watcher->request = g_string_new (NULL);
+	watcher->queue = g_queue_new ();
+	watcher->channel = g_io_channel_unix_new (fd);
+	watcher->input_id = g_io_add_watch (watcher->channel,
+					    G_IO_IN | G_IO_HUP | G_IO_ERR,
+					    watcher_input, watcher);
+
+	gpsd->watchers = g_list_prepend (gpsd->watchers, watcher);
+
+	GYPSY_NOTE (SERVER, "New gpsd client");
+
+	/* gpsd greets every client with its version */
+	send_version (watcher);
+
+	return TRUE;
+}
+
+GypsyGpsd *
+gypsy_gpsd_new (GypsyServer *server,
+		int          port,
+		GError     **error)
+{
+	GypsyGpsd *gpsd;
+	struct sockaddr_in addr;
+	int fd, on = 1;
+
+	fd = socket (AF_INET, SOCK_STREAM, 0);
+	if (fd == -1) {
+		goto error;
+	}
+
+	fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+	fcntl (fd, F_SETFD, FD_CLOEXEC);
+	setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on));
+
+	/* Like gpsd, only listen locally */
+	memset (&addr, 0, sizeof (addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons (port);
+	addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+
+	if (bind (fd, (struct sockaddr *) &addr, sizeof (addr)) == -1 ||
+	    listen (fd, LISTEN_BACKLOG) == -1) {
+		int saved_errno = errno;
+
+		close (fd);
+		errno = saved_errno;
+		goto error;
+	}
+
+	gpsd = g_slice_new0 (GypsyGpsd);
+	gpsd->server = g_object_ref (server);
+	gpsd->fd = fd;
+	gpsd->channel = g_io_channel_unix_new (fd);
+	gpsd->accept_id = g_io_add_watch (gpsd->channel, G_IO_IN,
+					  gpsd_accept, gpsd);
+	gpsd->client_added_id = g_signal_connect (server, "client-added",
+						  G_CALLBACK (client_added),
+						  gpsd);
+
+	GYPSY_NOTE (SERVER, "Serving gpsd protocol on port %d", port);
+	return gpsd;
+
+ error:
+	g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+		     "Error listening on port %d: %s", port,
+		     g_strerror (errno));
+	return NULL;
+}
+
+void
+gypsy_gpsd_free (GypsyGpsd *gpsd)
+{
+	while (gpsd->watchers) {
+		remove_watcher (gpsd->watchers->data);
+	}
+
+	while (gpsd->devices) {
+		Device *device = gpsd->devices->data;
+
+		g_signal_handlers_disconnect_matched (device->client,
+						      G_SIGNAL_MATCH_DATA,
+						      0, 0, NULL, NULL,
+						      device);
+		g_object_weak_unref (G_OBJECT (device->client),
+				     device_gone, device);
+		device_gone (device, NULL);
+	}
+
+	g_signal_handler_disconnect (gpsd->server, gpsd->client_added_id);
+	g_object_unref (gpsd->server);
+
+	g_source_remove (gpsd->accept_id);
+	g_io_channel_unref (gpsd->channel);
+	close (gpsd->fd);
+
+	g_slice_free (GypsyGpsd, gpsd);
+}
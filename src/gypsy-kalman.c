@@ -0,0 +1,400 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * GypsyKalman - A constant velocity Kalman filter over the receiver's
+ *               fixes, for the Smoothed interface.
+ *
+ * North, east and up are filtered separately, each with a position and a
+ * velocity, driven by random acceleration. Horizontal positions are
+ * measured in metres from an origin near the first fix, which is moved
+ * when the position gets far enough from it for the flat earth to show.
+ */
+
+#include "config.h"
+
+#include <math.h>
+
+#include <glib.h>
+
+#include "gypsy-kalman.h"
+
+#define EARTH_MEAN_RADIUS 6371008.8
+#define deg2rad(x) ((x) * G_PI / 180.0)
+#define rad2deg(x) ((x) * 180.0 / G_PI)
+
+/* Variance of the acceleration, (m/s^2)^2. How quickly the filter
+   believes a change in velocity */
+#define HORIZONTAL_ACCELERATION 1.0
+#define VERTICAL_ACCELERATION 0.25
+
+/* The velocity variance to start with, before anything is known */
+#define INITIAL_VELOCITY_VARIANCE 100.0
+
+/* Longer than this between measurements and the filter starts again */
+#define MAX_GAP (10 * G_USEC_PER_SEC)
+
+/* Metres from the origin before it's moved */
+#define MAX_ORIGIN_DISTANCE 10000.0
+
+typedef struct _KalmanAxis {
+	gboolean valid;
+	gint64 time;
+	double acceleration;
+
+	double position, velocity;
+	double p00, p01, p11; /* Covariance, which is symmetric */
+} KalmanAxis;
+
+struct _GypsyKalman {
+	/* Where the horizontal positions are measured from */
+	double origin_latitude;
+	double origin_longitude;
+
+	KalmanAxis north, east, up;
+};
+
+static void
+axis_init (KalmanAxis *axis,
+	   gint64      time,
+	   double      position,
+	   double      variance)
+{
+	axis->valid = TRUE;
+	axis->time = time;
+	axis->position = position;
+	axis->velocity = 0.0;
+	axis->p00 = variance;
+	axis->p01 = 0.0;
+	axis->p11 = INITIAL_VELOCITY_VARIANCE;
+}
+
+/* Moves the axis on to time. Returns FALSE if it's been
+   too long and it needs to start again */
+static gboolean
+axis_predict (KalmanAxis *axis,
+	      gint64      time)
+{
+	double dt, q;
+
+	if (!axis->valid) {
+		return FALSE;
+	}
+
+	if (time - axis->time > MAX_GAP) {
+		axis->valid = FALSE;
+		return FALSE;
+	}
+
+	/* Measurements are applied in the order they arrive, so one that's
+	   earlier than the last is taken as happening at the same time */
+	if (time <= axis->time) {
+		return TRUE;
+	}
+
+	dt = (time - axis->time) / (double) G_USEC_PER_SEC;
+	q = axis->acceleration;
+
+	axis->position += axis->velocity * dt;
+
+	axis->p00 += 2 * dt * axis->p01 + dt * dt * axis->p11 +
+		q * dt * dt * dt / 3;
+	axis->p01 += dt * axis->p11 + q * dt * dt / 2;
+	axis->p11 += q * dt;
+
+	axis->time = time;
+	return TRUE;
+}
+
+static void
+axis_measure_position (KalmanAxis *axis,
+		       double      position,
+		       double      variance)
+{
+	double s, k0, k1, y;
+
+	y = position - axis->position;
+	s = axis->p00 + variance;
+	k0 = axis->p00 / s;
+	k1 = axis->p01 / s;
+
+	axis->position += k0 * y;
+	axis->velocity += k1 * y;
+
+	axis->p11 -= k1 * axis->p01;
+	axis->p01 *= 1 - k0;
+	axis->p00 *= 1 - k0;
+}
+
+static void
+axis_measure_velocity (KalmanAxis *axis,
+		       double      velocity,
+		       double      variance)
+{
+	double s, k0, k1, y;
+
+	y = velocity - axis->velocity;
+	s = axis->p11 + variance;
+	k0 = axis->p01 / s;
+	k1 = axis->p11 / s;
+
+	axis->position += k0 * y;
+	axis->velocity += k1 * y;
+
+	axis->p00 -= k0 * axis->p01;
+	axis->p01 *= 1 - k1;
+	axis->p11 *= 1 - k1;
+}
+
+static double
+normalise_longitude (double longitude)
+{
+	if (longitude > 180.0) {
+		longitude -= 360.0;
+	} else if (longitude < -180.0) {
+		longitude += 360.0;
+	}
+
+	return longitude;
+}
+
+static void
+to_local (GypsyKalman *kalman,
+	  double       latitude,
+	  double       longitude,
+	  double      *north,
+	  double      *east)
+{
+	*north = deg2rad (latitude - kalman->origin_latitude) *
+		EARTH_MEAN_RADIUS;
+	*east = deg2rad (normalise_longitude (longitude -
+					      kalman->origin_longitude)) *
+		EARTH_MEAN_RADIUS * cos (deg2rad (kalman->origin_latitude));
+}
+
+static void
+from_local (GypsyKalman *kalman,
+	    double       north,
+	    double       east,
+	    double      *latitude,
+	    double      *longitude)
+{
+	double c;
+
+	*latitude = kalman->origin_latitude +
+		rad2deg (north / EARTH_MEAN_RADIUS);
+	*latitude = CLAMP (*latitude, -90.0, 90.0);
+
+	c = cos (deg2rad (kalman->origin_latitude));
+	*longitude = kalman->origin_longitude;
+	if (c > 1e-6) {
+		*longitude = normalise_longitude
+			(*longitude + rad2deg (east / (EARTH_MEAN_RADIUS * c)));
+	}
+}
+
+/* Moves the origin under the current position, so the
+   flat earth approximation holds around it */
+static void
+move_origin (GypsyKalman *kalman)
+{
+	double latitude, longitude;
+
+	from_local (kalman, kalman->north.position, kalman->east.position,
+		    &latitude, &longitude);
+
+	kalman->origin_latitude = latitude;
+	kalman->origin_longitude = longitude;
+	kalman->north.position = 0.0;
+	kalman->east.position = 0.0;
+}
+
+GypsyKalman *
+gypsy_kalman_new (void)
+{
+	GypsyKalman *kalman;
+
+	kalman = g_slice_new0 (GypsyKalman);
+	kalman->north.acceleration = HORIZONTAL_ACCELERATION;
+	kalman->east.acceleration = HORIZONTAL_ACCELERATION;
+	kalman->up.acceleration = VERTICAL_ACCELERATION;
+
+	return kalman;
+}
+
+/* Forgets everything, for when the receiver has gone */
+void
+gypsy_kalman_reset (GypsyKalman *kalman)
+{
+	g_return_if_fail (kalman != NULL);
+
+	kalman->north.valid = FALSE;
+	kalman->east.valid = FALSE;
+	kalman->up.valid = FALSE;
+}
+
+void
+gypsy_kalman_add_position (GypsyKalman *kalman,
+			   gint64       time,
+			   double       latitude,
+			   double       longitude,
+			   double       sigma)
+{
+	double north, east, variance;
+
+	g_return_if_fail (kalman != NULL);
+
+	variance = sigma * sigma;
+
+	if (!axis_predict (&kalman->north, time) ||
+	    !axis_predict (&kalman->east, time)) {
+		kalman->origin_latitude = latitude;
+		kalman->origin_longitude = longitude;
+		axis_init (&kalman->north, time, 0.0, variance);
+		axis_init (&kalman->east, time, 0.0, variance);
+		return;
+	}
+
+	to_local (kalman, latitude, longitude, &north, &east);
+	axis_measure_position (&kalman->north, north, variance);
+	axis_measure_position (&kalman->east, east, variance);
+
+	if (hypot (kalman->north.position, kalman->east.position) >
+	    MAX_ORIGIN_DISTANCE) {
+		move_origin (kalman);
+	}
+}
+
+void
+gypsy_kalman_add_altitude (GypsyKalman *kalman,
+			   gint64       time,
+			   double       altitude,
+			   double       sigma)
+{
+	g_return_if_fail (kalman != NULL);
+
+	if (!axis_predict (&kalman->up, time)) {
+		axis_init (&kalman->up, time, altitude, sigma * sigma);
+		return;
+	}
+
+	axis_measure_position (&kalman->up, altitude, sigma * sigma);
+}
+
+/* Only used once there's a position, as
+   a velocity alone says nothing about where */
+void
+gypsy_kalman_add_velocity (GypsyKalman *kalman,
+			   gint64       time,
+			   double       north,
+			   double       east,
+			   double       sigma)
+{
+	g_return_if_fail (kalman != NULL);
+
+	if (!axis_predict (&kalman->north, time) ||
+	    !axis_predict (&kalman->east, time)) {
+		return;
+	}
+
+	axis_measure_velocity (&kalman->north, north, sigma * sigma);
+	axis_measure_velocity (&kalman->east, east, sigma * sigma);
+}
+
+/* The filtered position as of the last measurement, the velocity in
+   metres per second, and the standard deviation of the position in metres.
+   Any of them can be NULL. Returns FALSE if there's no position yet */
+gboolean
+gypsy_kalman_get_position (GypsyKalman *kalman,
+			   double      *latitude,
+			   double      *longitude,
+			   double      *north,
+			   double      *east,
+			   double      *sigma)
+{
+	double la, lo;
+
+	g_return_val_if_fail (kalman != NULL, FALSE);
+
+	if (!kalman->north.valid || !kalman->east.valid) {
+		return FALSE;
+	}
+
+	from_local (kalman, kalman->north.position, kalman->east.position,
+		    &la, &lo);
+
+	if (latitude) {
+		*latitude = la;
+	}
+	if (longitude) {
+		*longitude = lo;
+	}
+	if (north) {
+		*north = kalman->north.velocity;
+	}
+	if (east) {
+		*east = kalman->east.velocity;
+	}
+	if (sigma) {
+		*sigma = sqrt (kalman->north.p00 + kalman->east.p00);
+	}
+
+	return TRUE;
+}
+
+gboolean
+gypsy_kalman_get_altitude (GypsyKalman *kalman,
+			   double      *altitude,
+			   double      *climb,
+			   double      *sigma)
+{
+	g_return_val_if_fail (kalman != NULL, FALSE);
+
+	if (!kalman->up.valid) {
+		return FALSE;
+	}
+
+	if (altitude) {
+		*altitude = kalman->up.position;
+	}
+	if (climb) {
+		*climb = kalman->up.velocity;
+	}
+	if (sigma) {
+		*sigma = sqrt (kalman->up.p00);
+	}
+
+	return TRUE;
+}
+
+void
+gypsy_kalman_free (GypsyKalman *kalman)
+{
+	if (kalman == NULL) {
+		return;
+	}
+
+	g_slice_free (GypsyKalman, kalman);
+}
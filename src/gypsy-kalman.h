@@ -0,0 +1,67 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef __GYPSY_KALMAN_H__
+#define __GYPSY_KALMAN_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GypsyKalman GypsyKalman;
+
+/* Times are monotonic microseconds, sigmas are standard deviations in
+   metres or metres per second */
+GypsyKalman *gypsy_kalman_new (void);
+void gypsy_kalman_reset (GypsyKalman *kalman);
+void gypsy_kalman_add_position (GypsyKalman *kalman,
+				gint64       time,
+				double       latitude,
+				double       longitude,
+				double       sigma);
+void gypsy_kalman_add_altitude (GypsyKalman *kalman,
+				gint64       time,
+				double       altitude,
+				double       sigma);
+void gypsy_kalman_add_velocity (GypsyKalman *kalman,
+				gint64       time,
+				double       north,
+				double       east,
+				double       sigma);
+gboolean gypsy_kalman_get_position (GypsyKalman *kalman,
+				    double      *latitude,
+				    double      *longitude,
+				    double      *north,
+				    double      *east,
+				    double      *sigma);
+gboolean gypsy_kalman_get_altitude (GypsyKalman *kalman,
+				    double      *altitude,
+				    double      *climb,
+				    double      *sigma);
+void gypsy_kalman_free (GypsyKalman *kalman);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,221 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * GypsyNetwork - Sockets for receivers behind serial to Ethernet converters
+ *                and NMEA multiplexers.
+ *
+ *   tcp://HOST:PORT    Connect to HOST
+ *   udp://[HOST]:PORT  Listen for datagrams on PORT, on HOST if given
+ *
+ * IPv6 addresses go in brackets, e.g. tcp://[fe80::1]:10110
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "gypsy-debug.h"
+#include "gypsy-network.h"
+
+#define GYPSY_ERROR g_quark_from_static_string ("gypsy-error")
+
+#define TCP_SCHEME "tcp://"
+#define UDP_SCHEME "udp://"
+
+/* Multiplexers can deliver bursts from many receivers at once */
+#define RECEIVE_BUFFER_SIZE (256 * 1024)
+
+gboolean
+gypsy_network_is_network_device (const char *device_path)
+{
+	return (g_str_has_prefix (device_path, TCP_SCHEME) ||
+		g_str_has_prefix (device_path, UDP_SCHEME));
+}
+
+/* Splits HOST:PORT, [HOST]:PORT or :PORT */
+static gboolean
+split_address (const char *address,
+	       char      **host,
+	       char      **port)
+{
+	const char *colon;
+
+	if (address[0] == '[') {
+		const char *end = strchr (address, ']');
+
+		if (end == NULL || end[1] != ':') {
+			return FALSE;
+		}
+		*host = g_strndup (address + 1, end - address - 1);
+		colon = end + 1;
+	} else {
+		colon = strrchr (address, ':');
+		if (colon == NULL) {
+			return FALSE;
+		}
+		*host = g_strndup (address, colon - address);
+	}
+
+	if (colon[1] == '\0') {
+		g_free (*host);
+		return FALSE;
+	}
+
+	*port = g_strdup (colon + 1);
+	return TRUE;
+}
+
+static int
+open_socket (struct addrinfo *ai,
+	     gboolean         datagram)
+{
+	int fd, size = RECEIVE_BUFFER_SIZE, on = 1;
+
+	fd = socket (ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+	if (fd == -1) {
+		return -1;
+	}
+
+	fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+	fcntl (fd, F_SETFD, FD_CLOEXEC);
+
+	/* Not fatal, the kernel may cap it */
+	if (setsockopt (fd, SOL_SOCKET, SO_RCVBUF,
+			&size, sizeof (size)) == -1) {
+		GYPSY_NOTE (CLIENT, "Error setting receive buffer: %s",
+			    g_strerror (errno));
+	}
+
+	if (datagram) {
+		setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on));
+		if (bind (fd, ai->ai_addr, ai->ai_addrlen) == -1) {
+			goto error;
+		}
+	} else {
+		/* Notice converters that go away without a FIN */
+		setsockopt (fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof (on));
+		if (connect (fd, ai->ai_addr, ai->ai_addrlen) == -1 &&
+		    errno != EINPROGRESS) {
+			goto error;
+		}
+	}
+
+	return fd;
+
+ error:
+	{
+		int saved_errno = errno;
+
+		close (fd);
+		errno = saved_errno;
+	}
+	return -1;
+}
+
+/* Returns a non-blocking socket for device_path, or -1. TCP sockets come
+   back with the connect still in progress: wait for them to become
+   writable then call gypsy_network_check_connected().
+
+   Name lookups block, so addresses are best given as numbers. */
+int
+gypsy_network_open (const char *device_path,
+		    gboolean   *datagram,
+		    GError    **error)
+{
+	struct addrinfo hints, *addrs, *ai;
+	char *host, *port;
+	int fd = -1, ret;
+
+	*datagram = g_str_has_prefix (device_path, UDP_SCHEME);
+
+	if (!split_address (device_path + strlen (TCP_SCHEME), &host, &port) ||
+	    (*datagram == FALSE && *host == '\0')) {
+		g_set_error (error, GYPSY_ERROR, EINVAL,
+			     "Bad network address: %s", device_path);
+		return -1;
+	}
+
+	memset (&hints, 0, sizeof (hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = *datagram ? SOCK_DGRAM : SOCK_STREAM;
+	hints.ai_flags = AI_NUMERICSERV | (*datagram ? AI_PASSIVE : 0);
+
+	ret = getaddrinfo (*host ? host : NULL, port, &hints, &addrs);
+	g_free (host);
+	g_free (port);
+
+	if (ret != 0) {
+		g_set_error (error, GYPSY_ERROR, EHOSTUNREACH,
+			     "Error looking up %s: %s", device_path,
+			     gai_strerror (ret));
+		return -1;
+	}
+
+	/* Take the first address that works */
+	errno = EADDRNOTAVAIL;
+	for (ai = addrs; ai != NULL && fd == -1; ai = ai->ai_next) {
+		fd = open_socket (ai, *datagram);
+	}
+	freeaddrinfo (addrs);
+
+	if (fd == -1) {
+		g_set_error (error, GYPSY_ERROR, errno,
+			     "Error opening %s: %s", device_path,
+			     g_strerror (errno));
+		return -1;
+	}
+
+	GYPSY_NOTE (CLIENT, "Opened %s", device_path);
+	return fd;
+}
+
+/* A socket whose connect failed is writable too, so check that it
+   really did connect */
+gboolean
+gypsy_network_check_connected (int      fd,
+			       GError **error)
+{
+	int err = 0;
+	socklen_t len = sizeof (err);
+
+	if (getsockopt (fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1) {
+		err = errno;
+	}
+
+	if (err != 0) {
+		g_set_error (error, GYPSY_ERROR, err, "%s", g_strerror (err));
+		return FALSE;
+	}
+
+	return TRUE;
+}
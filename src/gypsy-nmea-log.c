@@ -0,0 +1,452 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * GypsyNmeaLog - Buffered, rotating log of the raw data read from a device.
+ *
+ * Data handed to gypsy_nmea_log_write() is only copied into memory. It is
+ * written out in batches from a low priority timeout so that reading and
+ * parsing the device never waits for the disk. If the disk can't keep up
+ * and the buffer fills, new data is dropped and counted.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "gypsy-debug.h"
+#include "gypsy-nmea-log.h"
+
+#define FLUSH_INTERVAL 500 /* Milliseconds between batched writes */
+
+struct _GypsyNmeaLog {
+	char *filename; /* NULL when logging to stdout */
+	int fd;
+	GIOChannel *channel; /* Only used to wait for fd to become writable */
+	GypsyNmeaLogSettings settings;
+
+	GByteArray *header; /* Written at the start of every segment */
+	GByteArray *pending; /* Data waiting to be written */
+	gsize pending_offset; /* How much of pending has been written */
+
+	guint32 flush_id, write_id;
+
+	gsize segment_size; /* Bytes written to the current segment */
+	time_t segment_start;
+
+	GPid compress_pid; /* gzip of the last rotated segment, or 0 */
+	guint32 compress_id;
+
+	guint64 dropped_bytes;
+	guint dropped_chunks;
+};
+
+static gboolean
+open_segment (GypsyNmeaLog *log,
+	      GError      **error)
+{
+	log->fd = open (log->filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (log->fd == -1) {
+		g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+			     "Error opening %s: %s", log->filename,
+			     g_strerror (errno));
+		return FALSE;
+	}
+
+	/* Set after opening so a FIFO still waits for its reader */
+	fcntl (log->fd, F_SETFL, fcntl (log->fd, F_GETFL) | O_NONBLOCK);
+
+	log->segment_size = 0;
+	log->segment_start = time (NULL);
+
+	return TRUE;
+}
+
+static void
+compress_done (GPid     pid,
+	       int      status,
+	       gpointer userdata)
+{
+	GypsyNmeaLog *log = userdata;
+
+	g_spawn_close_pid (pid);
+
+	/* userdata is NULL if the log was freed while gzip was running */
+	if (log) {
+		log->compress_pid = 0;
+		log->compress_id = 0;
+
+		if (!WIFEXITED (status) || WEXITSTATUS (status) != 0) {
+			g_warning ("Error compressing %s.1, leaving it "
+				   "uncompressed", log->filename);
+		}
+	}
+}
+
+static void
+compress_segment (GypsyNmeaLog *log,
+		  const char   *segment)
+{
+	GError *error = NULL;
+	char *argv[] = { "gzip", "-f", (char *) segment, NULL };
+
+	if (!g_spawn_async (NULL, argv, NULL,
+			    G_SPAWN_SEARCH_PATH |
+			    G_SPAWN_DO_NOT_REAP_CHILD |
+			    G_SPAWN_STDOUT_TO_DEV_NULL |
+			    G_SPAWN_STDERR_TO_DEV_NULL,
+			    NULL, NULL, &log->compress_pid, &error)) {
+		g_warning ("Error compressing %s: %s", segment, error->message);
+		g_error_free (error);
+		log->compress_pid = 0;
+		return;
+	}
+
+	log->compress_id = g_child_watch_add (log->compress_pid,
+					      compress_done, log);
+}
+
+static char *
+segment_name (GypsyNmeaLog *log,
+	      int           n)
+{
+	return g_strdup_printf ("%s.%d%s", log->filename, n,
+				log->settings.compress ? ".gz" : "");
+}
+
+static gboolean
+segment_is_full (GypsyNmeaLog *log)
+{
+	if (log->settings.max_size > 0 &&
+	    log->segment_size >= (gsize) log->settings.max_size * 1024) {
+		return TRUE;
+	}
+
+	if (log->settings.max_age > 0 &&
+	    time (NULL) - log->segment_start >= log->settings.max_age) {
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* Moves segment n to n + 1. A segment gzip failed on keeps its plain
+   name, so that is moved as well or the next FILE.1 would overwrite it */
+static void
+move_segment (GypsyNmeaLog *log,
+	      int           n)
+{
+	char *from, *to;
+
+	from = segment_name (log, n);
+	to = segment_name (log, n + 1);
+	g_rename (from, to);
+	g_free (from);
+	g_free (to);
+
+	if (log->settings.compress) {
+		from = g_strdup_printf ("%s.%d", log->filename, n);
+		to = g_strdup_printf ("%s.%d", log->filename, n + 1);
+		g_rename (from, to);
+		g_free (from);
+		g_free (to);
+	}
+}
+
+/* Moves FILE to FILE.1 (shuffling older segments up to FILE.<segments>)
+   and starts a new FILE */
+static void
+rotate_segment (GypsyNmeaLog *log)
+{
+	GError *error = NULL;
+	int i;
+
+	if (log->channel) {
+		g_io_channel_unref (log->channel);
+		log->channel = NULL;
+	}
+	close (log->fd);
+	log->fd = -1;
+
+	if (log->settings.segments > 0) {
+		char *oldest, *rotated;
+
+		oldest = segment_name (log, log->settings.segments);
+		g_unlink (oldest);
+		g_free (oldest);
+
+		if (log->settings.compress) {
+			oldest = g_strdup_printf ("%s.%d", log->filename,
+						  log->settings.segments);
+			g_unlink (oldest);
+			g_free (oldest);
+		}
+
+		for (i = log->settings.segments - 1; i >= 1; i--) {
+			move_segment (log, i);
+		}
+
+		rotated = g_strdup_printf ("%s.1", log->filename);
+		if (g_rename (log->filename, rotated) == 0 &&
+		    log->settings.compress) {
+			compress_segment (log, rotated);
+		}
+		g_free (rotated);
+	}
+
+	GYPSY_NOTE (CLIENT, "Rotated %s after %d bytes", log->filename,
+		    log->segment_size);
+
+	if (!open_segment (log, &error)) {
+		g_warning ("%s", error->message);
+		g_error_free (error);
+		return;
+	}
+
+	if (log->header) {
+		g_byte_array_prepend (log->pending, log->header->data,
+				      log->header->len);
+	}
+}
+
+/* Returns FALSE if the fd would block with data still pending */
+static gboolean
+flush_pending (GypsyNmeaLog *log)
+{
+	/* Don't rotate under a running gzip, it would compress the wrong
+	   file, or in the middle of a partly written chunk. The segment
+	   just grows a little longer instead. */
+	if (log->filename && log->compress_pid == 0 &&
+	    log->pending_offset == 0 && segment_is_full (log)) {
+		rotate_segment (log);
+	}
+
+	while (log->fd != -1 && log->pending_offset < log->pending->len) {
+		ssize_t written;
+
+		written = write (log->fd,
+				 log->pending->data + log->pending_offset,
+				 log->pending->len - log->pending_offset);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			if (errno == EAGAIN) {
+				return FALSE;
+			}
+
+			GYPSY_NOTE (CLIENT, "Error writing NMEA log: %s",
+				    g_strerror (errno));
+			break;
+		}
+
+		log->pending_offset += written;
+		log->segment_size += written;
+	}
+
+	/* Anything left over here could not be written at all */
+	if (log->pending_offset < log->pending->len) {
+		log->dropped_bytes += log->pending->len - log->pending_offset;
+		log->dropped_chunks++;
+	}
+
+	g_byte_array_set_size (log->pending, 0);
+	log->pending_offset = 0;
+
+	return TRUE;
+}
+
+static void watch_writable (GypsyNmeaLog *log);
+
+static gboolean
+log_writable (GIOChannel  *channel,
+	      GIOCondition condition,
+	      gpointer     userdata)
+{
+	GypsyNmeaLog *log = userdata;
+
+	log->write_id = 0;
+
+	/* Rotation may have replaced the fd, so always
+	   start again with a fresh watch */
+	if (!flush_pending (log)) {
+		watch_writable (log);
+	}
+
+	return FALSE;
+}
+
+static void
+watch_writable (GypsyNmeaLog *log)
+{
+	if (log->channel == NULL) {
+		log->channel = g_io_channel_unix_new (log->fd);
+	}
+
+	log->write_id = g_io_add_watch_full (log->channel, G_PRIORITY_LOW,
+					     G_IO_OUT, log_writable,
+					     log, NULL);
+}
+
+static gboolean
+log_flush_timeout (gpointer userdata)
+{
+	GypsyNmeaLog *log = userdata;
+
+	log->flush_id = 0;
+
+	if (!flush_pending (log)) {
+		watch_writable (log);
+	}
+
+	return FALSE;
+}
+
+/* filename can be "stdout" or "-" to log to the standard output,
+   in which case the log is never rotated */
+GypsyNmeaLog *
+gypsy_nmea_log_new (const char                 *filename,
+		    const GypsyNmeaLogSettings *settings,
+		    GError                    **error)
+{
+	GypsyNmeaLog *log;
+
+	log = g_slice_new0 (GypsyNmeaLog);
+	log->settings = *settings;
+	log->pending = g_byte_array_new ();
+
+	if (g_str_equal (filename, "stdout") || g_str_equal (filename, "-")) {
+		log->fd = STDOUT_FILENO;
+	} else {
+		log->filename = g_strdup (filename);
+		if (!open_segment (log, error)) {
+			gypsy_nmea_log_free (log);
+			return NULL;
+		}
+	}
+
+	return log;
+}
+
+void
+gypsy_nmea_log_write (GypsyNmeaLog *log,
+		      const char   *data,
+		      gsize         length)
+{
+	gsize buffered;
+
+	buffered = log->pending->len - log->pending_offset;
+	if (buffered + length > (gsize) log->settings.buffer_size * 1024) {
+		log->dropped_bytes += length;
+		log->dropped_chunks++;
+		return;
+	}
+
+	g_byte_array_append (log->pending, (guint8 *) data, length);
+
+	/* If we're waiting for the fd, that will write it out */
+	if (log->flush_id == 0 && log->write_id == 0) {
+		log->flush_id = g_timeout_add_full (G_PRIORITY_LOW,
+						    FLUSH_INTERVAL,
+						    log_flush_timeout,
+						    log, NULL);
+	}
+}
+
+/* Takes ownership of header, which is written now and again at the
+   start of each new segment so that every segment stands on its own */
+void
+gypsy_nmea_log_set_header (GypsyNmeaLog *log,
+			   GByteArray   *header)
+{
+	if (log->header) {
+		g_byte_array_free (log->header, TRUE);
+	}
+	log->header = header;
+
+	g_byte_array_append (log->pending, header->data, header->len);
+	if (log->flush_id == 0 && log->write_id == 0) {
+		log->flush_id = g_timeout_add_full (G_PRIORITY_LOW,
+						    FLUSH_INTERVAL,
+						    log_flush_timeout,
+						    log, NULL);
+	}
+}
+
+void
+gypsy_nmea_log_free (GypsyNmeaLog *log)
+{
+	if (log->flush_id > 0) {
+		g_source_remove (log->flush_id);
+	}
+
+	if (log->write_id > 0) {
+		g_source_remove (log->write_id);
+	}
+
+	if (log->fd != -1) {
+		/* Whatever is left gets written out now, waiting if needed */
+		if (log->fd != STDOUT_FILENO) {
+			fcntl (log->fd, F_SETFL,
+			       fcntl (log->fd, F_GETFL) & ~O_NONBLOCK);
+		}
+		flush_pending (log);
+	}
+
+	if (log->dropped_bytes > 0) {
+		g_message ("NMEA log %s dropped %" G_GUINT64_FORMAT
+			   " bytes from %u reads",
+			   log->filename ? log->filename : "stdout",
+			   log->dropped_bytes, log->dropped_chunks);
+	}
+
+	if (log->channel) {
+		g_io_channel_unref (log->channel);
+	}
+
+	if (log->fd != -1 && log->fd != STDOUT_FILENO) {
+		close (log->fd);
+	}
+
+	/* Let gzip finish, but make sure it is still reaped */
+	if (log->compress_id > 0) {
+		g_source_remove (log->compress_id);
+		g_child_watch_add (log->compress_pid, compress_done, NULL);
+	}
+
+	if (log->header) {
+		g_byte_array_free (log->header, TRUE);
+	}
+	g_byte_array_free (log->pending, TRUE);
+	g_free (log->filename);
+	g_slice_free (GypsyNmeaLog, log);
+}
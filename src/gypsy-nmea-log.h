@@ -0,0 +1,56 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef __GYPSY_NMEA_LOG_H__
+#define __GYPSY_NMEA_LOG_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GypsyNmeaLogSettings {
+	int max_size; /* Rotate after this many KiB, 0 to never rotate */
+	int max_age; /* Rotate after this many seconds, 0 to never rotate */
+	int segments; /* How many rotated segments to keep */
+	gboolean compress; /* gzip rotated segments */
+	int buffer_size; /* KiB held in memory before data is dropped */
+	gboolean capture; /* Write .gypsycap records instead of raw data */
+} GypsyNmeaLogSettings;
+
+typedef struct _GypsyNmeaLog GypsyNmeaLog;
+
+GypsyNmeaLog *gypsy_nmea_log_new (const char                 *filename,
+				  const GypsyNmeaLogSettings *settings,
+				  GError                    **error);
+void gypsy_nmea_log_write (GypsyNmeaLog *log,
+			   const char   *data,
+			   gsize         length);
+void gypsy_nmea_log_set_header (GypsyNmeaLog *log,
+				GByteArray   *header);
+void gypsy_nmea_log_free (GypsyNmeaLog *log);
+
+G_END_DECLS
+
+#endif
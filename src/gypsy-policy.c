@@ -0,0 +1,362 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+
+/*
+ * GypsyPolicy - The parsed form of gypsy.conf.
+ *
+ * AllowedDeviceGlobs in the [gypsy] group are compiled once, rather than
+ * on every Create. Also in [gypsy]:
+ *   IdleLinger=S  Seconds a device with no users keeps reading (default 10)
+ *   IdleKeep=S    Seconds it is then kept, stopped but with its last fix,
+ *                 before being closed for good (default 300)
+ * Groups named [device GLOB] hold settings for the devices matching GLOB,
+ * the first matching group wins:
+ *   BaudRate=N    Serial port speed
+ *   Protocol=P    auto (default), nmea or garmin
+ *   UpdateRate=N  Fixes per second to ask the receiver for
+ *   Log=PREFIX    Write this device's NMEA to PREFIX.<device>
+ *   PowerDown=B   Put the receiver in standby once it has been idle
+ *                 for IdleLinger
+ *   Commands=L    The vendor commands the receiver takes, a list of mtk
+ *                 and ubx, or none. Both are sent if it isn't given
+ *   Assistance=PATH  EPO or AssistNow Offline file, or a directory of
+ *                 them, for InjectAssistance to send to the receiver
+ *   Corrections=PATH  Unix socket, FIFO or file of RTCM3 corrections to
+ *                 forward to the receiver
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#ifdef HAVE_BLUEZ
+#include <bluetooth/bluetooth.h>
+#endif
+
+#include "gypsy-policy.h"
+
+#define GYPSY_CONF_GROUP "gypsy"
+#define GYPSY_CONF_GLOB_KEY "AllowedDeviceGlobs"
+#define GYPSY_CONF_LINGER_KEY "IdleLinger"
+#define GYPSY_CONF_KEEP_KEY "IdleKeep"
+#define DEFAULT_IDLE_LINGER 10
+#define DEFAULT_IDLE_KEEP 300
+#define MAX_UPDATE_RATE 50 /* The fastest any MTK or u-blox receiver goes */
+#define DEVICE_GROUP_PREFIX "device "
+
+/* The special glob that allows any Bluetooth address */
+#define BLUETOOTH_GLOB "bluetooth"
+
+typedef struct _DeviceSection {
+	GPatternSpec *pattern;
+	GypsyDeviceConfig config;
+} DeviceSection;
+
+struct _GypsyPolicy {
+	GPtrArray *allowed; /* GPatternSpec */
+	gboolean allow_bluetooth;
+
+	GArray *sections; /* DeviceSection, in file order */
+
+	guint idle_linger; /* seconds */
+	guint idle_keep; /* seconds */
+};
+
+static gboolean
+parse_commands (GKeyFile          *key_file,
+		const char        *group,
+		GypsyDeviceConfig *config,
+		GError           **error)
+{
+	char **commands;
+	int i;
+
+	commands = g_key_file_get_string_list (key_file, group, "Commands",
+					       NULL, NULL);
+	if (commands == NULL) {
+		config->commands = GYPSY_COMMANDS_UNKNOWN;
+		return TRUE;
+	}
+
+	for (i = 0; commands[i]; i++) {
+		if (g_str_equal (commands[i], "none")) {
+			config->commands |= GYPSY_COMMANDS_NONE;
+		} else if (g_str_equal (commands[i], "mtk")) {
+			config->commands |= GYPSY_COMMANDS_MTK;
+		} else if (g_str_equal (commands[i], "ubx")) {
+			config->commands |= GYPSY_COMMANDS_UBX;
+		} else {
+			g_set_error (error, G_KEY_FILE_ERROR,
+				     G_KEY_FILE_ERROR_INVALID_VALUE,
+				     "Unknown commands '%s' in [%s]",
+				     commands[i], group);
+			g_strfreev (commands);
+			return FALSE;
+		}
+	}
+	g_strfreev (commands);
+
+	return TRUE;
+}
+
+/* Also used for the entries of the device database */
+gboolean
+gypsy_device_config_parse (GKeyFile          *key_file,
+			   const char        *group,
+			   GypsyDeviceConfig *config,
+			   GError           **error)
+{
+	GError *key_error = NULL;
+	char *protocol;
+	int update_rate;
+
+	memset (config, 0, sizeof (GypsyDeviceConfig));
+
+	if (g_key_file_has_key (key_file, group, "BaudRate", NULL)) {
+		config->baud_rate = g_key_file_get_integer (key_file, group,
+							    "BaudRate",
+							    &key_error);
+		if (key_error) {
+			g_propagate_error (error, key_error);
+			return FALSE;
+		}
+	}
+
+	if (g_key_file_has_key (key_file, group, "UpdateRate", NULL)) {
+		update_rate = g_key_file_get_integer (key_file, group,
+						      "UpdateRate", &key_error);
+		if (key_error) {
+			g_propagate_error (error, key_error);
+			return FALSE;
+		}
+
+		if (update_rate < 1 || update_rate > MAX_UPDATE_RATE) {
+			g_set_error (error, G_KEY_FILE_ERROR,
+				     G_KEY_FILE_ERROR_INVALID_VALUE,
+				     "UpdateRate %d in [%s] is not between 1 and %d",
+				     update_rate, group, MAX_UPDATE_RATE);
+			return FALSE;
+		}
+		config->update_rate = update_rate;
+	}
+
+	protocol = g_key_file_get_string (key_file, group, "Protocol", NULL);
+	if (protocol == NULL || g_str_equal (protocol, "auto")) {
+		config->protocol = GYPSY_PROTOCOL_AUTO;
+	} else if (g_str_equal (protocol, "nmea")) {
+		config->protocol = GYPSY_PROTOCOL_NMEA;
+	} else if (g_str_equal (protocol, "garmin")) {
+		config->protocol = GYPSY_PROTOCOL_GARMIN;
+	} else {
+		g_set_error (error, G_KEY_FILE_ERROR,
+			     G_KEY_FILE_ERROR_INVALID_VALUE,
+			     "Unknown protocol '%s' in [%s]", protocol, group);
+		g_free (protocol);
+		return FALSE;
+	}
+	g_free (protocol);
+
+	if (!parse_commands (key_file, group, config, error)) {
+		return FALSE;
+	}
+
+	config->log = g_key_file_get_string (key_file, group, "Log", NULL);
+	config->power_down = g_key_file_get_boolean (key_file, group,
+						     "PowerDown", NULL);
+	config->assistance = g_key_file_get_string (key_file, group,
+						    "Assistance", NULL);
+	config->corrections = g_key_file_get_string (key_file, group,
+						     "Corrections", NULL);
+
+	return TRUE;
+}
+
+/* Reads a number of seconds from [gypsy], or gives the default
+   if it isn't there or isn't a number */
+static guint
+get_seconds (GKeyFile   *key_file,
+	     const char *key,
+	     guint       fallback)
+{
+	GError *error = NULL;
+	int seconds;
+
+	seconds = g_key_file_get_integer (key_file, GYPSY_CONF_GROUP, key,
+					  &error);
+	if (error) {
+		g_error_free (error);
+		return fallback;
+	}
+
+	return MAX (seconds, 0);
+}
+
+GypsyPolicy *
+gypsy_policy_new_from_file (const char *filename,
+			    GError    **error)
+{
+	GypsyPolicy *policy;
+	GKeyFile *key_file;
+	char **globs, **groups;
+	gsize count;
+	int i;
+
+	key_file = g_key_file_new ();
+	if (!g_key_file_load_from_file (key_file, filename,
+					G_KEY_FILE_NONE, error)) {
+		g_key_file_free (key_file);
+		return NULL;
+	}
+
+	globs = g_key_file_get_string_list (key_file, GYPSY_CONF_GROUP,
+					    GYPSY_CONF_GLOB_KEY, &count,
+					    error);
+	if (globs == NULL) {
+		g_key_file_free (key_file);
+		return NULL;
+	}
+
+	policy = g_slice_new0 (GypsyPolicy);
+	policy->allowed = g_ptr_array_new_with_free_func
+		((GDestroyNotify) g_pattern_spec_free);
+	policy->sections = g_array_new (FALSE, FALSE, sizeof (DeviceSection));
+
+	for (i = 0; i < count; i++) {
+		if (g_str_equal (globs[i], BLUETOOTH_GLOB)) {
+			policy->allow_bluetooth = TRUE;
+		} else {
+			g_ptr_array_add (policy->allowed,
+					 g_pattern_spec_new (globs[i]));
+		}
+	}
+	g_strfreev (globs);
+
+	policy->idle_linger = get_seconds (key_file, GYPSY_CONF_LINGER_KEY,
+					   DEFAULT_IDLE_LINGER);
+	policy->idle_keep = get_seconds (key_file, GYPSY_CONF_KEEP_KEY,
+					 DEFAULT_IDLE_KEEP);
+
+	groups = g_key_file_get_groups (key_file, NULL);
+	for (i = 0; groups[i]; i++) {
+		DeviceSection section;
+
+		if (!g_str_has_prefix (groups[i], DEVICE_GROUP_PREFIX)) {
+			continue;
+		}
+
+		if (!gypsy_device_config_parse (key_file, groups[i],
+						&section.config, error)) {
+			g_strfreev (groups);
+			g_key_file_free (key_file);
+			gypsy_policy_free (policy);
+			return NULL;
+		}
+
+		section.pattern = g_pattern_spec_new
+			(groups[i] + strlen (DEVICE_GROUP_PREFIX));
+		g_array_append_val (policy->sections, section);
+	}
+	g_strfreev (groups);
+
+	g_key_file_free (key_file);
+	return policy;
+}
+
+gboolean
+gypsy_policy_allows (GypsyPolicy *policy,
+		     const char  *device_path)
+{
+	int i;
+
+#ifdef HAVE_BLUEZ
+	if (policy->allow_bluetooth && bachk (device_path) == 0) {
+		return TRUE;
+	}
+#endif
+
+	for (i = 0; i < policy->allowed->len; i++) {
+		if (g_pattern_match_string (policy->allowed->pdata[i],
+					    device_path)) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/* Returns the settings of the first section matching device_path,
+   or NULL if there isn't one */
+const GypsyDeviceConfig *
+gypsy_policy_lookup (GypsyPolicy *policy,
+		     const char  *device_path)
+{
+	int i;
+
+	for (i = 0; i < policy->sections->len; i++) {
+		DeviceSection *section;
+
+		section = &g_array_index (policy->sections, DeviceSection, i);
+		if (g_pattern_match_string (section->pattern, device_path)) {
+			return &section->config;
+		}
+	}
+
+	return NULL;
+}
+
+guint
+gypsy_policy_get_idle_linger (GypsyPolicy *policy)
+{
+	return policy->idle_linger;
+}
+
+guint
+gypsy_policy_get_idle_keep (GypsyPolicy *policy)
+{
+	return policy->idle_keep;
+}
+
+void
+gypsy_policy_free (GypsyPolicy *policy)
+{
+	int i;
+
+	for (i = 0; i < policy->sections->len; i++) {
+		DeviceSection *section;
+
+		section = &g_array_index (policy->sections, DeviceSection, i);
+		g_pattern_spec_free (section->pattern);
+		g_free (section->config.log);
+		g_free (section->config.assistance);
+		g_free (section->config.corrections);
+	}
+	g_array_free (policy->sections, TRUE);
+	g_ptr_array_free (policy->allowed, TRUE);
+
+	g_slice_free (GypsyPolicy, policy);
+}
@@ -0,0 +1,80 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+
+#ifndef __GYPSY_POLICY_H__
+#define __GYPSY_POLICY_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GypsyPolicy GypsyPolicy;
+
+typedef enum {
+	GYPSY_PROTOCOL_AUTO,
+	GYPSY_PROTOCOL_NMEA,
+	GYPSY_PROTOCOL_GARMIN
+} GypsyProtocol;
+
+/* The vendor commands a receiver understands. When it isn't
+   known both the MTK and u-blox forms are sent */
+typedef enum {
+	GYPSY_COMMANDS_UNKNOWN	= 0,
+	GYPSY_COMMANDS_NONE	= 1 << 0,
+	GYPSY_COMMANDS_MTK	= 1 << 1, /* $PMTK sentences */
+	GYPSY_COMMANDS_UBX	= 1 << 2  /* u-blox binary */
+} GypsyCommands;
+
+/* The settings from a [device GLOB] section of the config file */
+typedef struct _GypsyDeviceConfig {
+	guint baud_rate; /* 0 to leave the port as it is */
+	GypsyProtocol protocol;
+	guint update_rate; /* Fixes per second, 0 to leave the receiver alone */
+	char *log; /* NMEA log prefix instead of --nmea-log, or NULL */
+	gboolean power_down; /* Put the receiver in standby when idle */
+	GypsyCommands commands;
+	char *assistance; /* Assistance data file or directory, or NULL */
+	char *corrections; /* RTCM source to forward to the receiver, or NULL */
+} GypsyDeviceConfig;
+
+gboolean gypsy_device_config_parse (GKeyFile          *key_file,
+				    const char        *group,
+				    GypsyDeviceConfig *config,
+				    GError           **error);
+
+GypsyPolicy *gypsy_policy_new_from_file (const char *filename,
+					 GError    **error);
+gboolean gypsy_policy_allows (GypsyPolicy *policy,
+			      const char  *device_path);
+const GypsyDeviceConfig *gypsy_policy_lookup (GypsyPolicy *policy,
+					      const char  *device_path);
+guint gypsy_policy_get_idle_linger (GypsyPolicy *policy);
+guint gypsy_policy_get_idle_keep (GypsyPolicy *policy);
+void gypsy_policy_free (GypsyPolicy *policy);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,478 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * GypsyProbe - Listens to a serial port at each likely speed in turn
+ *              and works out which protocol, if any, a receiver on it
+ *              is talking. Nothing is written to the port, ports
+ *              that another program has locked or made exclusive are
+ *              left alone, and the port's settings are put back after.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "gypsy-debug.h"
+#include "gypsy-probe.h"
+
+/* Most receivers send something every second, so listen for a little
+   longer than that at each speed */
+#define PROBE_WINDOW 1200
+
+/* Enough for a few sentences or packets */
+#define PROBE_BUFFER_SIZE 1024
+
+static const struct {
+	guint rate;
+	speed_t speed;
+} probe_speeds[] = {
+	{ 4800, B4800 },
+	{ 9600, B9600 },
+	{ 38400, B38400 },
+	{ 115200, B115200 },
+	{ 19200, B19200 },
+	{ 57600, B57600 }
+};
+
+struct _GypsyProbe {
+	char *device_path;
+	int fd;
+	struct termios saved_term; /* Put back when the probe is freed */
+	GIOChannel *channel;
+	guint32 input_id, timeout_id;
+
+	guint speed_index;
+
+	guint8 buffer[PROBE_BUFFER_SIZE];
+	gsize length;
+
+	GypsyProbeCallback callback;
+	gpointer userdata;
+};
+
+#define DLE 0x10
+#define ETX 0x03
+
+/* $...*XX with the checksum right */
+static gboolean
+find_nmea (const guint8 *data,
+	   gsize         length)
+{
+	gsize i, j;
+
+	for (i = 0; i < length; i++) {
+		guint8 sum = 0;
+
+		if (data[i] != '$') {
+			continue;
+		}
+
+		for (j = i + 1; j < length && data[j] != '*'; j++) {
+			if (data[j] < 0x20 || data[j] > 0x7e) {
+				break;
+			}
+			sum ^= data[j];
+		}
+
+		/* At least a talker and sentence ID */
+		if (j - i > 5 && j + 2 < length && data[j] == '*' &&
+		    g_ascii_isxdigit (data[j + 1]) &&
+		    g_ascii_isxdigit (data[j + 2]) &&
+		    (g_ascii_xdigit_value (data[j + 1]) << 4 |
+		     g_ascii_xdigit_value (data[j + 2])) == sum) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/* 0xb5 0x62 class id length payload ck_a ck_b */
+static gboolean
+find_ubx (const guint8 *data,
+	  gsize         length)
+{
+	gsize i, j;
+
+	for (i = 0; i + 8 <= length; i++) {
+		guint8 ck_a = 0, ck_b = 0;
+		gsize payload;
+
+		if (data[i] != 0xb5 || data[i + 1] != 0x62) {
+			continue;
+		}
+
+		payload = data[i + 4] | data[i + 5] << 8;
+		if (i + 8 + payload > length) {
+			continue;
+		}
+
+		for (j = i + 2; j < i + 6 + payload; j++) {
+			ck_a += data[j];
+			ck_b += ck_a;
+		}
+
+		if (data[j] == ck_a && data[j + 1] == ck_b) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/* 0xa0 0xa2 length payload checksum 0xb0 0xb3 */
+static gboolean
+find_sirf (const guint8 *data,
+	   gsize         length)
+{
+	gsize i, j;
+
+	for (i = 0; i + 8 <= length; i++) {
+		guint sum = 0;
+		gsize payload;
+
+		if (data[i] != 0xa0 || data[i + 1] != 0xa2) {
+			continue;
+		}
+
+		payload = (data[i + 2] & 0x7f) << 8 | data[i + 3];
+		if (i + 8 + payload > length) {
+			continue;
+		}
+
+		for (j = i + 4; j < i + 4 + payload; j++) {
+			sum += data[j];
+		}
+
+		if ((sum & 0x7fff) == (guint) (data[j] << 8 | data[j + 1]) &&
+		    data[j + 2] == 0xb0 && data[j + 3] == 0xb3) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/* DLE id size data checksum DLE ETX, with any DLE in
+   size, data or checksum sent twice */
+static gboolean
+find_garmin (const guint8 *data,
+	     gsize         length)
+{
+	gsize i;
+
+	for (i = 0; i + 6 <= length; i++) {
+		guint8 packet[258];
+		guint8 sum = 0;
+		gsize j, count = 0, needed = 0;
+
+		if (data[i] != DLE || data[i + 1] == DLE ||
+		    data[i + 1] == ETX) {
+			continue;
+		}
+
+		packet[count++] = data[i + 1];
+		for (j = i + 2; j < length && count < sizeof (packet); j++) {
+			if (data[j] == DLE) {
+				if (j + 1 >= length || data[j + 1] != DLE) {
+					break;
+				}
+				j++;
+			}
+			packet[count++] = data[j];
+
+			/* id, size, size bytes of data and the checksum */
+			if (count == 2) {
+				needed = packet[1] + 3;
+			}
+			if (needed > 0 && count == needed) {
+				j++;
+				break;
+			}
+		}
+
+		if (needed == 0 || count != needed || j + 1 >= length ||
+		    data[j] != DLE || data[j + 1] != ETX) {
+			continue;
+		}
+
+		for (j = 0; j < count; j++) {
+			sum += packet[j];
+		}
+		if (sum == 0) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static GypsyProbeResult
+classify (const guint8 *data,
+	  gsize         length)
+{
+	if (find_nmea (data, length)) {
+		return GYPSY_PROBE_RESULT_NMEA;
+	} else if (find_ubx (data, length)) {
+		return GYPSY_PROBE_RESULT_UBX;
+	} else if (find_sirf (data, length)) {
+		return GYPSY_PROBE_RESULT_SIRF;
+	} else if (find_garmin (data, length)) {
+		return GYPSY_PROBE_RESULT_GARMIN;
+	}
+
+	return GYPSY_PROBE_RESULT_NONE;
+}
+
+static gboolean
+set_speed (GypsyProbe *probe)
+{
+	struct termios term;
+	speed_t speed = probe_speeds[probe->speed_index].speed;
+
+	if (tcgetattr (probe->fd, &term) < 0) {
+		return FALSE;
+	}
+
+	cfmakeraw (&term);
+	term.c_cflag |= CLOCAL | CREAD;
+	cfsetispeed (&term, speed);
+	cfsetospeed (&term, speed);
+
+	if (tcsetattr (probe->fd, TCSAFLUSH, &term) < 0) {
+		return FALSE;
+	}
+
+	probe->length = 0;
+	return TRUE;
+}
+
+/* The callback may free the probe, so nothing can touch it afterwards */
+static void
+probe_done (GypsyProbe      *probe,
+	    GypsyProbeResult result)
+{
+	guint baud_rate = 0;
+
+	if (probe->input_id > 0) {
+		g_source_remove (probe->input_id);
+		probe->input_id = 0;
+	}
+	if (probe->timeout_id > 0) {
+		g_source_remove (probe->timeout_id);
+		probe->timeout_id = 0;
+	}
+
+	if (result != GYPSY_PROBE_RESULT_NONE) {
+		baud_rate = probe_speeds[probe->speed_index].rate;
+	}
+
+	GYPSY_NOTE (DISCOVERY, "Probed %s: %s at %u", probe->device_path,
+		    gypsy_probe_result_to_string (result), baud_rate);
+	probe->callback (probe, result, baud_rate, probe->userdata);
+}
+
+static gboolean
+probe_input (GIOChannel  *channel,
+	     GIOCondition condition,
+	     gpointer     userdata)
+{
+	GypsyProbe *probe = userdata;
+	GypsyProbeResult result;
+	gssize bytes;
+
+	if (condition & (G_IO_HUP | G_IO_ERR)) {
+		probe->input_id = 0;
+		probe_done (probe, GYPSY_PROBE_RESULT_NONE);
+		return FALSE;
+	}
+
+	/* Keep the newer half if it's full, a packet may straddle it */
+	if (probe->length == PROBE_BUFFER_SIZE) {
+		memmove (probe->buffer, probe->buffer + PROBE_BUFFER_SIZE / 2,
+			 PROBE_BUFFER_SIZE / 2);
+		probe->length = PROBE_BUFFER_SIZE / 2;
+	}
+
+	bytes = read (probe->fd, probe->buffer + probe->length,
+		      PROBE_BUFFER_SIZE - probe->length);
+	if (bytes < 0 && (errno == EAGAIN || errno == EINTR)) {
+		return TRUE;
+	} else if (bytes <= 0) {
+		probe->input_id = 0;
+		probe_done (probe, GYPSY_PROBE_RESULT_NONE);
+		return FALSE;
+	}
+	probe->length += bytes;
+
+	result = classify (probe->buffer, probe->length);
+	if (result == GYPSY_PROBE_RESULT_NONE) {
+		return TRUE;
+	}
+
+	probe->input_id = 0;
+	probe_done (probe, result);
+	return FALSE;
+}
+
+static gboolean
+next_speed (gpointer userdata)
+{
+	GypsyProbe *probe = userdata;
+
+	probe->speed_index++;
+	if (probe->speed_index == G_N_ELEMENTS (probe_speeds) ||
+	    !set_speed (probe)) {
+		probe->timeout_id = 0;
+		probe_done (probe, GYPSY_PROBE_RESULT_NONE);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+GypsyProbe *
+gypsy_probe_new (const char        *device_path,
+		 GypsyProbeCallback callback,
+		 gpointer           userdata,
+		 GError           **error)
+{
+	GypsyProbe *probe;
+	struct termios term;
+	int fd, exclusive = 0;
+
+	fd = open (device_path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (fd == -1) {
+		g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+			     "Error opening %s: %s", device_path,
+			     g_strerror (errno));
+		return NULL;
+	}
+
+	if (!isatty (fd)) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+			     "%s is not a tty", device_path);
+		close (fd);
+		return NULL;
+	}
+
+	/* Root can open a port another program has made exclusive,
+	   so that has to be asked. The lock goes when fd is closed */
+#ifdef TIOCGEXCL
+	if (ioctl (fd, TIOCGEXCL, &exclusive) < 0) {
+		exclusive = 0;
+	}
+#endif
+	if (exclusive || flock (fd, LOCK_EX | LOCK_NB) < 0) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_EXIST,
+			     "%s is in use", device_path);
+		close (fd);
+		return NULL;
+	}
+
+	if (tcgetattr (fd, &term) < 0) {
+		g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+			     "Error reading the settings of %s: %s",
+			     device_path, g_strerror (errno));
+		close (fd);
+		return NULL;
+	}
+
+	probe = g_slice_new0 (GypsyProbe);
+	probe->device_path = g_strdup (device_path);
+	probe->fd = fd;
+	probe->saved_term = term;
+	probe->callback = callback;
+	probe->userdata = userdata;
+
+	if (!set_speed (probe)) {
+		g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+			     "Error setting up %s: %s", device_path,
+			     g_strerror (errno));
+		gypsy_probe_free (probe);
+		return NULL;
+	}
+
+	probe->channel = g_io_channel_unix_new (fd);
+	probe->input_id = g_io_add_watch (probe->channel,
+					  G_IO_IN | G_IO_PRI |
+					  G_IO_HUP | G_IO_ERR,
+					  probe_input, probe);
+	probe->timeout_id = g_timeout_add (PROBE_WINDOW, next_speed, probe);
+
+	return probe;
+}
+
+const char *
+gypsy_probe_get_device_path (GypsyProbe *probe)
+{
+	return probe->device_path;
+}
+
+const char *
+gypsy_probe_result_to_string (GypsyProbeResult result)
+{
+	switch (result) {
+	case GYPSY_PROBE_RESULT_NMEA:
+		return "nmea";
+	case GYPSY_PROBE_RESULT_UBX:
+		return "ubx";
+	case GYPSY_PROBE_RESULT_SIRF:
+		return "sirf";
+	case GYPSY_PROBE_RESULT_GARMIN:
+		return "garmin";
+	default:
+		return "none";
+	}
+}
+
+void
+gypsy_probe_free (GypsyProbe *probe)
+{
+	if (probe->input_id > 0) {
+		g_source_remove (probe->input_id);
+	}
+	if (probe->timeout_id > 0) {
+		g_source_remove (probe->timeout_id);
+	}
+	if (probe->channel) {
+		g_io_channel_unref (probe->channel);
+	}
+
+	tcsetattr (probe->fd, TCSANOW, &probe->saved_term);
+	close (probe->fd);
+
+	g_free (probe->device_path);
+	g_slice_free (GypsyProbe, probe);
+}
@@ -0,0 +1,60 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef __GYPSY_PROBE_H__
+#define __GYPSY_PROBE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GypsyProbe GypsyProbe;
+
+typedef enum {
+	GYPSY_PROBE_RESULT_NONE,
+	GYPSY_PROBE_RESULT_NMEA,
+	GYPSY_PROBE_RESULT_UBX,
+	GYPSY_PROBE_RESULT_SIRF,
+	GYPSY_PROBE_RESULT_GARMIN
+} GypsyProbeResult;
+
+/* Called once, when the probe recognises what the device is talking or
+   has run out of speeds to try. baud_rate is 0 for GYPSY_PROBE_RESULT_NONE */
+typedef void (* GypsyProbeCallback) (GypsyProbe      *probe,
+				     GypsyProbeResult result,
+				     guint            baud_rate,
+				     gpointer         userdata);
+
+GypsyProbe *gypsy_probe_new (const char        *device_path,
+			     GypsyProbeCallback callback,
+			     gpointer           userdata,
+			     GError           **error);
+const char *gypsy_probe_get_device_path (GypsyProbe *probe);
+const char *gypsy_probe_result_to_string (GypsyProbeResult result);
+void gypsy_probe_free (GypsyProbe *probe);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,385 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * GypsyRawStream - Hands the raw data read from a device to any number of
+ *                  readers on a Unix socket.
+ *
+ * Data is copied once into a ring shared by every reader, each of which
+ * only keeps its own position in it. A reader that falls a whole ring
+ * behind is disconnected, so however slow it is the device never waits.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "gypsy-debug.h"
+#include "gypsy-raw-stream.h"
+
+#define RING_SIZE (64 * 1024)
+#define LISTEN_BACKLOG 8
+
+typedef struct _Subscriber {
+	GypsyRawStream *stream;
+	int fd;
+	GIOChannel *channel;
+	guint32 hangup_id, write_id;
+	guint64 offset; /* The next byte in the ring to send */
+} Subscriber;
+
+struct _GypsyRawStream {
+	char *path;
+	int fd;
+	GIOChannel *channel;
+	guint32 accept_id;
+
+	char *ring;
+	guint64 head; /* Bytes put in the ring so far */
+
+	GList *subscribers;
+	guint subscriber_count;
+
+	GypsyRawStreamReadersFunc readers_changed;
+	gpointer userdata;
+};
+
+/* The socket paths streams in this process have, so one
+   device can never remove another's socket */
+static GHashTable *owned_paths = NULL;
+
+/* Whether something is listening on the socket at addr already.
+   A file left by a previous run refuses connections */
+static gboolean
+socket_in_use (const struct sockaddr_un *addr)
+{
+	gboolean in_use;
+	int fd;
+
+	fd = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1) {
+		return FALSE;
+	}
+
+	in_use = connect (fd, (const struct sockaddr *) addr,
+			  sizeof (*addr)) == 0;
+	close (fd);
+
+	return in_use;
+}
+
+static void
+remove_subscriber (Subscriber *sub)
+{
+	GypsyRawStream *stream = sub->stream;
+
+	if (sub->hangup_id > 0) {
+		g_source_remove (sub->hangup_id);
+	}
+
+	if (sub->write_id > 0) {
+		g_source_remove (sub->write_id);
+	}
+
+	g_io_channel_unref (sub->channel);
+	close (sub->fd);
+
+	stream->subscribers = g_list_remove (stream->subscribers, sub);
+	g_slice_free (Subscriber, sub);
+
+	stream->subscriber_count--;
+	if (stream->readers_changed) {
+		stream->readers_changed (stream, stream->subscriber_count,
+					 stream->userdata);
+	}
+}
+
+static gboolean subscriber_writable (GIOChannel  *channel,
+				     GIOCondition condition,
+				     gpointer     userdata);
+
+/* Sends as much as the socket will take. Returns FALSE
+   if the subscriber had to be removed. */
+static gboolean
+flush_subscriber (Subscriber *sub)
+{
+	GypsyRawStream *stream = sub->stream;
+
+	/* What it hadn't read yet has been written over */
+	if (stream->head - sub->offset > RING_SIZE) {
+		GYPSY_NOTE (CLIENT, "Dropping slow raw stream reader on %s",
+			    stream->path);
+		remove_subscriber (sub);
+		return FALSE;
+	}
+
+	while (sub->offset < stream->head) {
+		gsize pos, length;
+		ssize_t sent;
+
+		pos = sub->offset % RING_SIZE;
+		length = MIN (stream->head - sub->offset, RING_SIZE - pos);
+
+		sent = send (sub->fd, stream->ring + pos, length,
+			     MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (sent < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			if (errno == EAGAIN) {
+				if (sub->write_id == 0) {
+					sub->write_id = g_io_add_watch
+						(sub->channel, G_IO_OUT,
+						 subscriber_writable, sub);
+				}
+				return TRUE;
+			}
+
+			remove_subscriber (sub);
+			return FALSE;
+		}
+
+		sub->offset += sent;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+subscriber_writable (GIOChannel  *channel,
+		     GIOCondition condition,
+		     gpointer     userdata)
+{
+	Subscriber *sub = userdata;
+
+	sub->write_id = 0;
+	flush_subscriber (sub);
+
+	return FALSE;
+}
+
+/* Readers have nothing to say, so input is only
+   watched to notice them going away */
+static gboolean
+subscriber_hangup (GIOChannel  *channel,
+		   GIOCondition condition,
+		   gpointer     userdata)
+{
+	Subscriber *sub = userdata;
+	char buffer[256];
+	ssize_t n;
+
+	n = recv (sub->fd, buffer, sizeof (buffer), MSG_DONTWAIT);
+	if (n > 0 || (n < 0 && (errno == EAGAIN || errno == EINTR))) {
+		return TRUE;
+	}
+
+	sub->hangup_id = 0;
+	remove_subscriber (sub);
+
+	return FALSE;
+}
+
+static gboolean
+stream_accept (GIOChannel  *channel,
+	       GIOCondition condition,
+	       gpointer     userdata)
+{
+	GypsyRawStream *stream = userdata;
+	Subscriber *sub;
+	int fd;
+
+	fd = accept (stream->fd, NULL, NULL);
+	if (fd == -1) {
+		return TRUE;
+	}
+
+	fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+	fcntl (fd, F_SETFD, FD_CLOEXEC);
+
+	sub = g_slice_new0 (Subscriber);
+	sub->stream = stream;
+	sub->fd = fd;
+	sub->offset = stream->head; /* Only new data */
+	sub->channel = g_io_channel_unix_new (fd);
+	sub->hangup_id = g_io_add_watch (sub->channel,
+					 G_IO_IN | G_IO_HUP | G_IO_ERR,
+					 subscriber_hangup, sub);
+
+	stream->subscribers = g_list_prepend (stream->subscribers, sub);
+	stream->subscriber_count++;
+
+	GYPSY_NOTE (CLIENT, "New raw stream reader on %s", stream->path);
+	if (stream->readers_changed) {
+		stream->readers_changed (stream, stream->subscriber_count,
+					 stream->userdata);
+	}
+	return TRUE;
+}
+
+/* readers_changed lets the owner know when to send everything
+   the device has, as the readers' needs can't be known */
+GypsyRawStream *
+gypsy_raw_stream_new (const char               *socket_path,
+		      GypsyRawStreamReadersFunc readers_changed,
+		      gpointer                  userdata,
+		      GError                  **error)
+{
+	GypsyRawStream *stream;
+	struct sockaddr_un addr;
+
+	if (strlen (socket_path) >= sizeof (addr.sun_path)) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NAMETOOLONG,
+			     "Socket path too long: %s", socket_path);
+		return NULL;
+	}
+
+	memset (&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+	strcpy (addr.sun_path, socket_path);
+
+	if ((owned_paths &&
+	     g_hash_table_lookup (owned_paths, socket_path) != NULL) ||
+	    socket_in_use (&addr)) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_EXIST,
+			     "%s is already in use", socket_path);
+		return NULL;
+	}
+
+	stream = g_slice_new0 (GypsyRawStream);
+	stream->path = g_strdup (socket_path);
+	stream->readers_changed = readers_changed;
+	stream->userdata = userdata;
+
+	stream->fd = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (stream->fd == -1) {
+		goto error;
+	}
+	fcntl (stream->fd, F_SETFL, fcntl (stream->fd, F_GETFL) | O_NONBLOCK);
+	fcntl (stream->fd, F_SETFD, FD_CLOEXEC);
+
+	/* Left over from a previous run, as nothing is listening on it */
+	g_unlink (socket_path);
+
+	if (bind (stream->fd, (struct sockaddr *) &addr, sizeof (addr)) == -1 ||
+	    listen (stream->fd, LISTEN_BACKLOG) == -1) {
+		goto error;
+	}
+
+	/* Anyone can read positions over D-Bus, so anyone can read this */
+	chmod (socket_path, 0666);
+
+	stream->ring = g_malloc (RING_SIZE);
+	stream->channel = g_io_channel_unix_new (stream->fd);
+	stream->accept_id = g_io_add_watch (stream->channel, G_IO_IN,
+					    stream_accept, stream);
+
+	if (owned_paths == NULL) {
+		owned_paths = g_hash_table_new (g_str_hash, g_str_equal);
+	}
+	g_hash_table_insert (owned_paths, stream->path, stream);
+
+	return stream;
+
+ error:
+	g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+		     "Error creating %s: %s", socket_path, g_strerror (errno));
+	if (stream->fd != -1) {
+		close (stream->fd);
+	}
+	g_free (stream->path);
+	g_slice_free (GypsyRawStream, stream);
+
+	return NULL;
+}
+
+void
+gypsy_raw_stream_write (GypsyRawStream *stream,
+			const char     *data,
+			gsize           length)
+{
+	GList *l, *next;
+	gsize pos, first;
+
+	/* Nobody to send it to, and new readers only get new data */
+	if (stream->subscribers == NULL) {
+		return;
+	}
+
+	/* Only the end of an oversized read can fit */
+	if (length > RING_SIZE) {
+		stream->head += length - RING_SIZE;
+		data += length - RING_SIZE;
+		length = RING_SIZE;
+	}
+
+	pos = stream->head % RING_SIZE;
+	first = MIN (length, RING_SIZE - pos);
+	memcpy (stream->ring + pos, data, first);
+	memcpy (stream->ring, data + first, length - first);
+	stream->head += length;
+
+	for (l = stream->subscribers; l; l = next) {
+		Subscriber *sub = l->data;
+
+		/* flush_subscriber may remove l */
+		next = l->next;
+
+		/* Readers waiting for their socket get it when it's ready */
+		if (sub->write_id == 0) {
+			flush_subscriber (sub);
+		}
+	}
+}
+
+void
+gypsy_raw_stream_free (GypsyRawStream *stream)
+{
+	/* The owner is going away too */
+	stream->readers_changed = NULL;
+
+	while (stream->subscribers) {
+		remove_subscriber (stream->subscribers->data);
+	}
+
+	g_source_remove (stream->accept_id);
+	g_io_channel_unref (stream->channel);
+	close (stream->fd);
+	g_unlink (stream->path);
+	g_hash_table_remove (owned_paths, stream->path);
+
+	g_free (stream->ring);
+	g_free (stream->path);
+	g_slice_free (GypsyRawStream, stream);
+}
@@ -0,0 +1,267 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * gypsy-replay - Replays a .gypsycap capture through the parsers without
+ *                a device or a bus. Prints how long it took and what was
+ *                emitted, or with --dump every signal, so the output of
+ *                two builds can be diffed.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#include <glib.h>
+
+#include "gypsy-capture.h"
+#include "gypsy-client.h"
+#include "gypsy-debug.h"
+#include "gypsy-garmin-parser.h"
+#include "gypsy-nmea-log.h"
+#include "gypsy-nmea-parser.h"
+
+/* Globals gypsy-client.c expects from main.c */
+char *nmea_log = NULL;
+GypsyNmeaLogSettings nmea_log_settings = { 0, 0, 0, FALSE, 256, FALSE };
+char *raw_stream_dir = NULL;
+guint gypsy_debug_flags = 0;
+
+static GMainLoop *mainloop;
+static gboolean dump = FALSE;
+
+static struct {
+	guint position, course, accuracy, satellites, fix, time;
+} emitted;
+
+void
+_gypsy_message (const char *format, ...)
+{
+	va_list ap;
+
+	va_start (ap, format);
+	g_logv (G_LOG_DOMAIN, G_LOG_LEVEL_MESSAGE, format, ap);
+	va_end (ap);
+}
+
+static void
+position_changed (GypsyClient *client,
+		  int          fields,
+		  int          timestamp,
+		  double       latitude,
+		  double       longitude,
+		  double       altitude,
+		  gpointer     userdata)
+{
+	emitted.position++;
+	if (dump) {
+		g_print ("position %d %d %f %f %f\n", fields, timestamp,
+			 latitude, longitude, altitude);
+	}
+}
+
+static void
+course_changed (GypsyClient *client,
+		int          fields,
+		int          timestamp,
+		double       speed,
+		double       direction,
+		double       climb,
+		gpointer     userdata)
+{
+	emitted.course++;
+	if (dump) {
+		g_print ("course %d %d %f %f %f\n", fields, timestamp,
+			 speed, direction, climb);
+	}
+}
+
+static void
+accuracy_changed (GypsyClient *client,
+		  int          fields,
+		  double       pdop,
+		  double       hdop,
+		  double       vdop,
+		  gpointer     userdata)
+{
+	emitted.accuracy++;
+	if (dump) {
+		g_print ("accuracy %d %f %f %f\n", fields, pdop, hdop, vdop);
+	}
+}
+
+static void
+satellites_changed (GypsyClient *client,
+		    GVariant    *satellites,
+		    gpointer     userdata)
+{
+	emitted.satellites++;
+	if (dump) {
+		g_print ("satellites %d\n",
+			 (int) g_variant_n_children (satellites));
+	}
+}
+
+static void
+fix_status_changed (GypsyClient *client,
+		    int          fix,
+		    gpointer     userdata)
+{
+	emitted.fix++;
+	if (dump) {
+		g_print ("fix %d\n", fix);
+	}
+}
+
+static void
+time_changed (GypsyClient *client,
+	      int          timestamp,
+	      gpointer     userdata)
+{
+	emitted.time++;
+	if (dump) {
+		g_print ("time %d\n", timestamp);
+	}
+}
+
+static void
+replay_done (GypsyCaptureReplay *replay,
+	     gpointer            userdata)
+{
+	g_main_loop_quit (mainloop);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	GypsyCaptureReader *reader;
+	GypsyCaptureReplay *replay;
+	GypsyCaptureChunk chunk;
+	GypsyClient *client;
+	GypsyParser *parser;
+	double speed = 0.0;
+	int device = 0;
+	gboolean garmin = FALSE;
+	guint chunks = 0;
+	guint64 bytes = 0;
+	gint64 start, elapsed;
+
+	GOptionEntry entries[] = {
+		{ "speed", 0, 0, G_OPTION_ARG_DOUBLE, &speed, "Replay at SPEED times real time, 0 for as fast as possible (default)", "SPEED" },
+		{ "device", 0, 0, G_OPTION_ARG_INT, &device, "Replay the device with index N (default 0)", "N" },
+		{ "garmin", 0, 0, G_OPTION_ARG_NONE, &garmin, "The capture is from a Garmin device", NULL },
+		{ "dump", 0, 0, G_OPTION_ARG_NONE, &dump, "Print every signal emitted", NULL },
+		{ NULL }
+	};
+
+	g_type_init ();
+
+	context = g_option_context_new ("CAPTURE - replay a Gypsy capture");
+	g_option_context_add_main_entries (context, entries, NULL);
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+	g_option_context_free (context);
+
+	if (argc != 2) {
+		g_printerr ("Usage: %s [OPTION...] CAPTURE\n", argv[0]);
+		return 1;
+	}
+
+	reader = gypsy_capture_reader_new (argv[1], &error);
+	if (reader == NULL) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+
+	/* Count what's there first so the numbers don't include the scan */
+	while (gypsy_capture_reader_next (reader, device, &chunk)) {
+		chunks++;
+		bytes += chunk.length;
+	}
+	gypsy_capture_reader_rewind (reader);
+
+	client = g_object_new (GYPSY_TYPE_CLIENT,
+			       "device_path", argv[1],
+			       NULL);
+	g_signal_connect (client, "position-changed",
+			  G_CALLBACK (position_changed), NULL);
+	g_signal_connect (client, "course-changed",
+			  G_CALLBACK (course_changed), NULL);
+	g_signal_connect (client, "accuracy-changed",
+			  G_CALLBACK (accuracy_changed), NULL);
+	g_signal_connect (client, "satellites-changed",
+			  G_CALLBACK (satellites_changed), NULL);
+	g_signal_connect (client, "fix-status-changed",
+			  G_CALLBACK (fix_status_changed), NULL);
+	g_signal_connect (client, "time-changed",
+			  G_CALLBACK (time_changed), NULL);
+
+	if (garmin) {
+		parser = gypsy_garmin_parser_new (client);
+	} else {
+		parser = gypsy_nmea_parser_new (client);
+	}
+
+	mainloop = g_main_loop_new (NULL, FALSE);
+
+	start = g_get_monotonic_time ();
+	replay = gypsy_capture_replay_new (reader, device, parser, speed,
+					   replay_done, NULL);
+	g_main_loop_run (mainloop);
+	elapsed = g_get_monotonic_time () - start;
+
+	gypsy_capture_replay_free (replay);
+
+	if (!dump) {
+		g_print ("Device: %s\n",
+			 gypsy_capture_reader_get_device (reader, device) ?
+			 gypsy_capture_reader_get_device (reader, device) :
+			 "unknown");
+		g_print ("Replayed %u chunks, %" G_GUINT64_FORMAT " bytes in %.3f s",
+			 chunks, bytes, elapsed / 1000000.0);
+		if (elapsed > 0) {
+			g_print (" (%.1f MiB/s)",
+				 (bytes / 1048576.0) / (elapsed / 1000000.0));
+		}
+		g_print ("\n");
+		g_print ("position %u, course %u, accuracy %u, satellites %u, "
+			 "fix %u, time %u\n",
+			 emitted.position, emitted.course, emitted.accuracy,
+			 emitted.satellites, emitted.fix, emitted.time);
+	}
+
+	g_object_unref (parser);
+	g_object_unref (client);
+	gypsy_capture_reader_free (reader);
+	g_main_loop_unref (mainloop);
+
+	return 0;
+}
@@ -29,36 +29,55 @@
  * GypsyServer - The main control object that creates GPS connection objects.
  */
 #include "config.h"
-#include <glib.h>
 
-#include <dbus/dbus-glib.h>
-#include <dbus/dbus-glib-bindings.h>
-#include <dbus/dbus-glib-lowlevel.h>
+#include <string.h>
 
-#ifdef HAVE_BLUEZ
-#include <bluetooth/bluetooth.h>
-#endif
+#include <glib.h>
+#include <gio/gio.h>
 
 #include "gypsy-server.h"
 #include "gypsy-debug.h"
 #include "gypsy-client.h"
+#include "gypsy-policy.h"
 
 enum {
 	TERMINATE,
+	CLIENT_ADDED,
 	LAST_SIGNAL,
 };
 
+/* A device that at least one sender has called Create for, or that
+   nobody has but is being kept around in case somebody does soon */
+typedef struct _GypsyServerDevice {
+	GypsyServer *server;
+	GypsyClient *client;
+	char *path;
+	guint users; /* Creates not yet matched by a Shutdown, all senders */
+
+	guint32 linger_id; /* Stops the device once it has had no
+			      users for IdleLinger */
+	guint32 expire_id; /* Closes it once it has been stopped
+			      for IdleKeep */
+} GypsyServerDevice;
+
 typedef struct _GypsyServerPrivate {
-	DBusGConnection *connection;
+	GDBusConnection *connection;
+	guint registration_id;
+
+	GHashTable *devices; /* object path -> GypsyServerDevice */
+
+	/* sender -> GHashTable of GypsyServerDevice -> hold count,
+	   so a sender going away only touches the devices it holds */
 	GHashTable *connections;
 
 	gboolean auto_terminate;
-	int client_count; /* When client_count returns to 0, 
-			     we quit the daemon after TERMINATE_TIMEOUT */
-	guint32 terminate_id;
+	guint32 terminate_id; /* Quits once there have been no
+				 devices for TERMINATE_TIMEOUT */
 
-	gchar **allowed_device_globs;
-	gsize allowed_device_glob_count;
+	GypsyPolicy *policy; /* NULL if the config file couldn't be read */
+	GypsyDiscovery *discovery; /* For the device database */
+	GFileMonitor *config_monitor;
+	guint32 reload_id;
 } GypsyServerPrivate;
 
 static guint32 signals[LAST_SIGNAL] = {0, };
@@ -70,26 +89,44 @@ G_DEFINE_TYPE (GypsyServer, gypsy_server, G_TYPE_OBJECT);
 #define GYPSY_GPS_PATH "/org/freedesktop/Gypsy/"
 #define TERMINATE_TIMEOUT 10000 /* 10 second timeout */
 
-#define GYPSY_CONF_GROUP "gypsy"
-#define GYPSY_CONF_GLOB_KEY "AllowedDeviceGlobs"
+/* Editors write the config file in several steps,
+   so wait for them to finish before reloading */
+#define RELOAD_DELAY 250
+
+#include "gypsy-server-introspection.h"
 
-static void gypsy_server_create (GypsyServer            *gps,
-				 const char             *IN_device_path,
-				 DBusGMethodInvocation *context);
-static void gypsy_server_shutdown (GypsyServer           *gps,
-				   const char            *IN_device_path,
-				   DBusGMethodInvocation *context);
-#include "gypsy-server-glue.h"
+static GDBusNodeInfo *introspection_data = NULL;
+
+static const GDBusErrorEntry gypsy_server_error_entries[] = {
+	{ GYPSY_SERVER_ERROR_NO_CLIENT, "org.freedesktop.Gypsy.Error.NoClient" },
+	{ GYPSY_SERVER_ERROR_BAD_PATH, "org.freedesktop.Gypsy.Error.BadPath" },
+};
 
 GQuark
 gypsy_server_error_quark (void)
 {
-	static GQuark quark = 0;
-	if (quark == 0) {
-		quark = g_quark_from_static_string ("gypsy-server-error-quark");
-	}
+	static volatile gsize quark = 0;
+
+	g_dbus_error_register_error_domain ("gypsy-server-error-quark",
+					    &quark,
+					    gypsy_server_error_entries,
+					    G_N_ELEMENTS (gypsy_server_error_entries));
+	return (GQuark) quark;
+}
+
+/* The device name is the last element of the client's object path */
+static char *
+device_object_path (const char *device_path)
+{
+	char *device_name, *path;
 
-	return quark;
+	device_name = gypsy_client_device_name (device_path);
+	GYPSY_NOTE (SERVER, "Device name: %s", device_name);
+
+	path = g_strconcat (GYPSY_GPS_PATH, device_name, NULL);
+	g_free (device_name);
+
+	return path;
 }
 
 /* We don't want to terminate at the moment, as there is no way to be
@@ -105,18 +142,205 @@ gypsy_terminate (gpointer data)
 	return FALSE;
 }
 
+static void
+server_device_free (gpointer data)
+{
+	GypsyServerDevice *device = data;
+
+	if (device->linger_id > 0) {
+		g_source_remove (device->linger_id);
+	}
+	if (device->expire_id > 0) {
+		g_source_remove (device->expire_id);
+	}
+
+	g_object_unref (device->client);
+	g_free (device->path);
+	g_slice_free (GypsyServerDevice, device);
+}
+
+static void
+hold_device (GypsyServer       *gps,
+	     const char        *sender,
+	     GypsyServerDevice *device)
+{
+	GypsyServerPrivate *priv = GET_PRIVATE (gps);
+	GHashTable *held;
+	guint count;
+
+	held = g_hash_table_lookup (priv->connections, sender);
+	if (held == NULL) {
+		held = g_hash_table_new (NULL, NULL);
+		g_hash_table_insert (priv->connections, g_strdup (sender),
+				     held);
+	}
+
+	count = GPOINTER_TO_UINT (g_hash_table_lookup (held, device));
+	g_hash_table_insert (held, device, GUINT_TO_POINTER (count + 1));
+
+	device->users++;
+
+	/* Somebody wants it again, so keep it */
+	if (device->linger_id > 0) {
+		g_source_remove (device->linger_id);
+		device->linger_id = 0;
+	}
+	if (device->expire_id > 0) {
+		g_source_remove (device->expire_id);
+		device->expire_id = 0;
+	}
+}
+
+static gboolean
+device_expired (gpointer data)
+{
+	GypsyServerDevice *device = data;
+	GypsyServer *gps = device->server;
+	GypsyServerPrivate *priv = GET_PRIVATE (gps);
+
+	GYPSY_NOTE (SERVER, "Closing %s", device->path);
+
+	device->expire_id = 0;
+	g_hash_table_remove (priv->devices, device->path);
+
+	if (g_hash_table_size (priv->devices) == 0 &&
+	    priv->auto_terminate && priv->terminate_id == 0) {
+		priv->terminate_id = g_timeout_add (TERMINATE_TIMEOUT,
+						    gypsy_terminate, gps);
+	}
+
+	return FALSE;
+}
+
+/* The device has had no users for IdleLinger, so stop reading it but
+   keep its last fix for IdleKeep in case it is wanted again */
+static gboolean
+device_idle (gpointer data)
+{
+	GypsyServerDevice *device = data;
+	GypsyServerPrivate *priv = GET_PRIVATE (device->server);
+	guint keep;
+
+	device->linger_id = 0;
+	gypsy_client_idle (device->client);
+
+	keep = priv->policy ? gypsy_policy_get_idle_keep (priv->policy) : 0;
+	if (keep == 0) {
+		return device_expired (device);
+	}
+
+	device->expire_id = g_timeout_add_seconds (keep, device_expired,
+						   device);
+	return FALSE;
+}
+
+/* Drops count of the sender's holds on device. Once the sender holds
+   it no more its subscription goes, and once nobody does the device
+   is stopped after IdleLinger and closed after IdleKeep */
+static void
+release_device (GypsyServer       *gps,
+		const char        *sender,
+		GHashTable        *held,
+		GypsyServerDevice *device,
+		guint              count)
+{
+	GypsyServerPrivate *priv = GET_PRIVATE (gps);
+	guint holds, linger;
+
+	holds = GPOINTER_TO_UINT (g_hash_table_lookup (held, device));
+	count = MIN (count, holds);
+
+	if (count == holds) {
+		g_hash_table_remove (held, device);
+		gypsy_client_remove_subscriber (device->client, sender);
+	} else {
+		g_hash_table_insert (held, device,
+				     GUINT_TO_POINTER (holds - count));
+	}
+
+	device->users -= count;
+	if (device->users > 0) {
+		return;
+	}
+
+	GYPSY_NOTE (SERVER, "Last user of %s has gone", device->path);
+
+	linger = priv->policy ? gypsy_policy_get_idle_linger (priv->policy) : 0;
+	if (linger == 0) {
+		device_idle (device);
+		return;
+	}
+
+	device->linger_id = g_timeout_add_seconds (linger, device_idle,
+						   device);
+}
+
+/* The device database says how a known receiver should be started, and
+   anything set in its section of the config file overrides that */
+static void
+apply_device_config (GypsyServer *gps,
+		     GypsyClient *client,
+		     const char  *device_path)
+{
+	GypsyServerPrivate *priv = GET_PRIVATE (gps);
+	const GypsyDeviceDbEntry *entry = NULL;
+	const GypsyDeviceConfig *section = NULL;
+	GypsyDeviceConfig config;
+
+	memset (&config, 0, sizeof (GypsyDeviceConfig));
+
+	if (priv->discovery) {
+		entry = gypsy_discovery_lookup (priv->discovery, device_path);
+	}
+	if (entry) {
+		GYPSY_NOTE (SERVER, "%s is a known %s", device_path,
+			    entry->name ? entry->name : "receiver");
+		config = entry->config;
+	}
+
+	if (priv->policy) {
+		section = gypsy_policy_lookup (priv->policy, device_path);
+	}
+	if (section) {
+		if (section->baud_rate > 0) {
+			config.baud_rate = section->baud_rate;
+		}
+		if (section->protocol != GYPSY_PROTOCOL_AUTO) {
+			config.protocol = section->protocol;
+		}
+		if (section->update_rate > 0) {
+			config.update_rate = section->update_rate;
+		}
+		if (section->log) {
+			config.log = section->log;
+		}
+		if (section->power_down) {
+			config.power_down = TRUE;
+		}
+		if (section->commands != GYPSY_COMMANDS_UNKNOWN) {
+			config.commands = section->commands;
+		}
+		if (section->assistance) {
+			config.assistance = section->assistance;
+		}
+		if (section->corrections) {
+			config.corrections = section->corrections;
+		}
+	}
+
+	gypsy_client_set_config (client, &config);
+}
+
 /* IN_args contains that path to the GPS device we wish to open */
 static void
 gypsy_server_create (GypsyServer           *gps,
 		     const char            *IN_device_path,
-		     DBusGMethodInvocation *context)
+		     GDBusMethodInvocation *invocation)
 {
 	GypsyServerPrivate *priv;
+	GypsyServerDevice *device;
 	GypsyClient *client;
-	char *path, *device_name, *sender;
-	GList *list;
-	int i;
-	gboolean allowed;
+	char *path;
 
 	priv = GET_PRIVATE (gps);
 
@@ -131,130 +355,153 @@ gypsy_server_create (GypsyServer           *gps,
 
 	/* compare priv->device_path to allowed globs
 	 * if not allowed, error out */
-	allowed = FALSE;
-	for (i = 0; i < priv->allowed_device_glob_count; i++) {
-		if (g_str_equal (priv->allowed_device_globs[i], "bluetooth")) {
-#ifdef HAVE_BLUEZ
-			if (bachk (IN_device_path) == 0) {
-				allowed = TRUE;
-				break;
-			}
-#else
-			continue;
-#endif /* HAVE_BLUEZ */
-		}
-		if (g_pattern_match_simple (priv->allowed_device_globs[i],
-					    IN_device_path)) {
-			allowed = TRUE;
-			break;
-		}
-	}
-	if (allowed == FALSE) {
+	if (priv->policy == NULL ||
+	    !gypsy_policy_allows (priv->policy, IN_device_path)) {
 		g_warning ("The device path %s is not allowed by config file",
 			   IN_device_path);
-		GError *error = NULL;
-		error = g_error_new (GYPSY_SERVER_ERROR,
-				     GYPSY_SERVER_ERROR_BAD_PATH,
-				     "Bad path: %s",
-				     IN_device_path);
-		dbus_g_method_return_error (context, error);
-		g_error_free (error);
+		g_dbus_method_invocation_return_error (invocation,
+						       GYPSY_SERVER_ERROR,
+						       GYPSY_SERVER_ERROR_BAD_PATH,
+						       "Bad path: %s",
+						       IN_device_path);
 		return;
 	}
 
-	device_name = g_path_get_basename (IN_device_path);
-	GYPSY_NOTE (SERVER, "Device name: %s", device_name);
-	path = g_strdup_printf ("%s%s", GYPSY_GPS_PATH, 
-				g_strdelimit (device_name, ":", '_'));
-	g_free (device_name);
+	path = device_object_path (IN_device_path);
+
+	device = g_hash_table_lookup (priv->devices, path);
+	if (device == NULL) {
+		GError *error = NULL;
 
-	client = (GypsyClient *) dbus_g_connection_lookup_g_object (priv->connection, path);
-	if (client == NULL) {
 		/* If there isn't already an object registered on that path
 		   create and register it */
 		client = g_object_new (GYPSY_TYPE_CLIENT, 
 				       "device_path", IN_device_path,
 				       NULL);
-	
-		dbus_g_connection_register_g_object (priv->connection, path,
-						     G_OBJECT (client));
-	} else {
-		/* Ref the client so that when one client calls shutdown
-		   we won't destroy another clients object */
-		g_object_ref (client);
+		apply_device_config (gps, client, IN_device_path);
+
+		if (!gypsy_client_register (client, priv->connection, path,
+					    &error)) {
+			g_warning ("Error registering %s: %s", path,
+				   error->message);
+			g_dbus_method_invocation_return_gerror (invocation,
+								error);
+			g_error_free (error);
+			g_object_unref (client);
+			g_free (path);
+			return;
+		}
+
+		device = g_slice_new0 (GypsyServerDevice);
+		device->server = gps;
+		device->client = client;
+		device->path = g_strdup (path);
+		g_hash_table_insert (priv->devices, device->path, device);
+		g_signal_emit (gps, signals[CLIENT_ADDED], 0, client);
 	}
 
 	GYPSY_NOTE (SERVER, "Registered client on %s", path);
 
-	/* Update the hash of open connnctions */
-	sender = dbus_g_method_get_sender (context);
-	list = g_hash_table_lookup (priv->connections, sender);
-	list = g_list_prepend (list, client);
-	g_hash_table_insert (priv->connections, sender, list);
-
-	priv->client_count++;
+	hold_device (gps, g_dbus_method_invocation_get_sender (invocation),
+		     device);
 
-	dbus_g_method_return (context, path);
+	g_dbus_method_invocation_return_value (invocation,
+					       g_variant_new ("(o)", path));
 	g_free (path);
 }
 
+/* path is the object path Create returned. Shutdown takes it as it is,
+   and ShutdownDevice works it out from the device passed to Create, as
+   URL style devices aren't object paths */
 static void
 gypsy_server_shutdown (GypsyServer           *gps,
-		       const char            *IN_device_path,
-		       DBusGMethodInvocation *context)
+		       const char            *path,
+		       GDBusMethodInvocation *invocation)
 {
 	GypsyServerPrivate *priv;
-	GypsyClient *client;
-	GList *list, *owner;
-	char *path, *device_name, *sender;
+	GypsyServerDevice *device;
+	GHashTable *held;
+	const char *sender;
 
 	priv = GET_PRIVATE (gps);
 
-	GYPSY_NOTE (SERVER, "Shutting down %s", IN_device_path);
-	device_name = g_path_get_basename (IN_device_path);
-	path = g_strdup_printf ("%s%s", GYPSY_GPS_PATH, device_name);
+	GYPSY_NOTE (SERVER, "Shutting down %s", path);
 
-	client = (GypsyClient *) dbus_g_connection_lookup_g_object (priv->connection, path);
-	g_free (path);
+	device = g_hash_table_lookup (priv->devices, path);
 
-	if (client == NULL) {
-		dbus_g_method_return_error (context,
-					    g_error_new (GYPSY_SERVER_ERROR,
-							 GYPSY_SERVER_ERROR_NO_CLIENT,
-							 "No such client: %s",
-							 device_name));
-	} else {
-		if (--priv->client_count == 0) {
-			if (priv->auto_terminate && priv->terminate_id == 0) {
-				priv->terminate_id = g_timeout_add (TERMINATE_TIMEOUT,
-								    gypsy_terminate,
-								    gps);
-			}
-		}
+	sender = g_dbus_method_invocation_get_sender (invocation);
+	held = g_hash_table_lookup (priv->connections, sender);
 
-		/* Update the hash of open connnctions */
-		sender = dbus_g_method_get_sender (context);
-		list = g_hash_table_lookup (priv->connections, sender);
-		owner = g_list_find (list, client);
-		if (owner) {
-			g_object_unref (owner->data);
-		}
-		list = g_list_remove (list, client);
-		g_hash_table_insert (priv->connections, sender, list);
+	/* Only the devices the caller created can be shut down by it */
+	if (device == NULL || held == NULL ||
+	    g_hash_table_lookup (held, device) == NULL) {
+		g_dbus_method_invocation_return_error (invocation,
+						       GYPSY_SERVER_ERROR,
+						       GYPSY_SERVER_ERROR_NO_CLIENT,
+						       "No such client: %s",
+						       path);
+		return;
+	}
+
+	release_device (gps, sender, held, device, 1);
+	if (g_hash_table_size (held) == 0) {
+		g_hash_table_remove (priv->connections, sender);
+	}
 
-		dbus_g_method_return (context);
+	g_dbus_method_invocation_return_value (invocation, NULL);
+}
 
+static void
+method_call (GDBusConnection       *connection,
+	     const char            *sender,
+	     const char            *object_path,
+	     const char            *interface_name,
+	     const char            *method_name,
+	     GVariant              *parameters,
+	     GDBusMethodInvocation *invocation,
+	     gpointer               userdata)
+{
+	GypsyServer *gps = userdata;
+	const char *device;
+
+	/* GDBus has already checked the arguments against the
+	   introspection data: Shutdown has an o, the others an s */
+	if (g_str_equal (method_name, "Shutdown")) {
+		g_variant_get (parameters, "(&o)", &device);
+		gypsy_server_shutdown (gps, device, invocation);
+		return;
 	}
 
-	g_free (device_name);
+	g_variant_get (parameters, "(&s)", &device);
+
+	if (g_str_equal (method_name, "Create")) {
+		gypsy_server_create (gps, device, invocation);
+	} else if (g_str_equal (method_name, "ShutdownDevice")) {
+		char *path;
+
+		path = device_object_path (device);
+		gypsy_server_shutdown (gps, path, invocation);
+		g_free (path);
+	}
 }
 
+static const GDBusInterfaceVTable interface_vtable = {
+	method_call,
+	NULL,
+	NULL
+};
+
 static void
 finalize (GObject *object) 
 {
  	GypsyServerPrivate *priv = GET_PRIVATE (object);
 
 	g_hash_table_destroy (priv->connections);
+	g_hash_table_destroy (priv->devices);
+
+	if (priv->policy) {
+		gypsy_policy_free (priv->policy);
+	}
 	((GObjectClass *) gypsy_server_parent_class)->finalize (object);
 }
 
@@ -263,11 +510,34 @@ dispose (GObject *object)
 {
 	GypsyServerPrivate *priv = GET_PRIVATE (object);
 
+	if (priv->reload_id > 0) {
+		g_source_remove (priv->reload_id);
+		priv->reload_id = 0;
+	}
+
+	if (priv->config_monitor) {
+		g_file_monitor_cancel (priv->config_monitor);
+		g_object_unref (priv->config_monitor);
+		priv->config_monitor = NULL;
+	}
+
+	if (priv->registration_id > 0) {
+		g_dbus_connection_unregister_object (priv->connection,
+						     priv->registration_id);
+		priv->registration_id = 0;
+	}
+
 	if (priv->connection) {
-		dbus_g_connection_unref (priv->connection);
+		g_object_unref (priv->connection);
 		priv->connection = NULL;
 	}
 
+	if (priv->discovery) {
+		gypsy_discovery_set_ignore_func (priv->discovery, NULL, NULL);
+		g_object_unref (priv->discovery);
+		priv->discovery = NULL;
+	}
+
 	((GObjectClass *) gypsy_server_parent_class)->dispose (object);
 }
 
@@ -280,8 +550,13 @@ gypsy_server_class_init (GypsyServerClass *klass)
 	o_class->dispose = dispose;
 
 	g_type_class_add_private (klass, sizeof (GypsyServerPrivate));
-	dbus_g_object_type_install_info (G_TYPE_FROM_CLASS (klass),
-					 &dbus_glib_gypsy_server_object_info);
+
+	introspection_data = g_dbus_node_info_new_for_xml (introspection_xml,
+							   NULL);
+	g_assert (introspection_data != NULL);
+
+	/* Make sure the error names are known before the first call */
+	gypsy_server_error_quark ();
 
 	signals[TERMINATE] = g_signal_new ("terminate",
 					   G_TYPE_FROM_CLASS (klass),
@@ -292,50 +567,117 @@ gypsy_server_class_init (GypsyServerClass *klass)
 					   NULL, NULL,
 					   g_cclosure_marshal_VOID__VOID,
 					   G_TYPE_NONE, 0);
+	signals[CLIENT_ADDED] = g_signal_new ("client-added",
+					      G_TYPE_FROM_CLASS (klass),
+					      G_SIGNAL_RUN_FIRST |
+					      G_SIGNAL_NO_RECURSE,
+					      G_STRUCT_OFFSET (GypsyServerClass,
+							       client_added),
+					      NULL, NULL,
+					      g_cclosure_marshal_VOID__OBJECT,
+					      G_TYPE_NONE, 1, G_TYPE_OBJECT);
 }
 
+/* Reads the config file, and only replaces the current policy if the new
+   one is complete, so a half written file can't lock everyone out. The
+   device sections are applied to the running clients as well */
 static void
-gypsy_server_init (GypsyServer *gps)
+load_config (GypsyServer *gps)
 {
 	GypsyServerPrivate *priv = GET_PRIVATE (gps);
+	GypsyPolicy *policy;
+	GHashTableIter iter;
+	gpointer value;
 	GError *error = NULL;
-	GKeyFile *key_file = NULL;
 
-	priv->connection = dbus_g_bus_get (DBUS_BUS_SYSTEM, &error);
-	if (priv->connection == NULL) {
-		g_warning ("Error connecting to system bus:\n%s",
+	policy = gypsy_policy_new_from_file (CONFIG_FILE_PATH, &error);
+	if (policy == NULL) {
+		g_warning ("Error parsing config file:\n%s",
 			   error->message);
 		g_error_free (error);
 		return;
 	}
-	dbus_g_connection_ref (priv->connection);
 
+	if (priv->policy) {
+		gypsy_policy_free (priv->policy);
+	}
+	priv->policy = policy;
+
+	g_hash_table_iter_init (&iter, priv->devices);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		GypsyServerDevice *device = value;
+		char *device_path;
+
+		g_object_get (device->client, "device_path", &device_path,
+			      NULL);
+		apply_device_config (gps, device->client, device_path);
+		g_free (device_path);
+	}
+}
+
+static gboolean
+reload_config (gpointer userdata)
+{
+	GypsyServerPrivate *priv = GET_PRIVATE (userdata);
+
+	priv->reload_id = 0;
+
+	GYPSY_NOTE (SERVER, "Reloading %s", CONFIG_FILE_PATH);
+	load_config (userdata);
+
+	return FALSE;
+}
+
+static void
+config_changed (GFileMonitor      *monitor,
+		GFile             *file,
+		GFile             *other_file,
+		GFileMonitorEvent  event,
+		gpointer           userdata)
+{
+	GypsyServerPrivate *priv = GET_PRIVATE (userdata);
+
+	/* Keep the last policy if the file goes away */
+	if (event == G_FILE_MONITOR_EVENT_DELETED) {
+		return;
+	}
+
+	if (priv->reload_id > 0) {
+		g_source_remove (priv->reload_id);
+	}
+	priv->reload_id = g_timeout_add (RELOAD_DELAY, reload_config,
+					 userdata);
+}
+
+static void
+gypsy_server_init (GypsyServer *gps)
+{
+	GypsyServerPrivate *priv = GET_PRIVATE (gps);
+	GError *error = NULL;
+	GFile *file;
+
+	priv->devices = g_hash_table_new_full (g_str_hash, g_str_equal,
+					       NULL, server_device_free);
 	priv->connections = g_hash_table_new_full (g_str_hash, g_str_equal,
-						   g_free, NULL);
+						   g_free,
+						   (GDestroyNotify) g_hash_table_destroy);
 
-	priv->client_count = 0;
 	priv->terminate_id = 0;
 
-	key_file = g_key_file_new();
-	if (!g_key_file_load_from_file (key_file, CONFIG_FILE_PATH,
-				       G_KEY_FILE_NONE, &error))
-		goto error;
-
-	priv->allowed_device_globs = g_key_file_get_string_list (key_file,
-								 GYPSY_CONF_GROUP,
-								 GYPSY_CONF_GLOB_KEY,
-								 &(priv->allowed_device_glob_count),
-								 &error);
-	if (!priv->allowed_device_globs)
-		goto error;
-
-	return;
-
-error:
-	g_warning ("Error parsing config file:\n%s",
-		   error->message);
-	g_error_free (error);
-	g_key_file_free (key_file);
+	load_config (gps);
+
+	file = g_file_new_for_path (CONFIG_FILE_PATH);
+	priv->config_monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE,
+						    NULL, &error);
+	if (priv->config_monitor) {
+		g_signal_connect (priv->config_monitor, "changed",
+				  G_CALLBACK (config_changed), gps);
+	} else {
+		g_warning ("Unable to watch %s for changes: %s",
+			   CONFIG_FILE_PATH, error->message);
+		g_error_free (error);
+	}
+	g_object_unref (file);
 }
 
 void
@@ -343,27 +685,56 @@ gypsy_server_remove_clients (GypsyServer *gps,
 			     const char  *prev_owner)
 {
 	GypsyServerPrivate *priv = GET_PRIVATE (gps);
-	char *key;
-	GList *list = NULL;
-
-	if (g_hash_table_lookup_extended (priv->connections, prev_owner,
-					  (gpointer) &key, (gpointer) &list)) {
-		GList *l;
-
-		for (l = list; l; l = l->next) {
-			g_object_unref (l->data);
-			if (--priv->client_count == 0) {
-				if (priv->terminate_id == 0) {
-					priv->terminate_id = 
-						g_timeout_add (TERMINATE_TIMEOUT,
-							       gypsy_terminate,
-							       gps);
-				}
-			}
-		}
-		g_list_free (list);
-		g_hash_table_remove (priv->connections, prev_owner);
+	GHashTableIter iter;
+	GHashTable *held;
+	GList *devices, *l;
+	gpointer value;
+
+	/* Anyone can subscribe to a device without having created it */
+	g_hash_table_iter_init (&iter, priv->devices);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		GypsyServerDevice *device = value;
+
+		gypsy_client_remove_subscriber (device->client, prev_owner);
+	}
+
+	held = g_hash_table_lookup (priv->connections, prev_owner);
+	if (held == NULL) {
+		return;
+	}
+
+	/* release_device removes each one from held as it goes */
+	devices = g_hash_table_get_keys (held);
+	for (l = devices; l; l = l->next) {
+		guint holds;
+
+		holds = GPOINTER_TO_UINT (g_hash_table_lookup (held, l->data));
+		release_device (gps, prev_owner, held, l->data, holds);
+	}
+	g_list_free (devices);
+
+	g_hash_table_remove (priv->connections, prev_owner);
+}
+
+gboolean
+gypsy_server_register (GypsyServer     *gps,
+		       GDBusConnection *connection,
+		       const char      *object_path,
+		       GError         **error)
+{
+	GypsyServerPrivate *priv = GET_PRIVATE (gps);
+
+	g_return_val_if_fail (priv->registration_id == 0, FALSE);
+
+	priv->registration_id = g_dbus_connection_register_object
+		(connection, object_path, introspection_data->interfaces[0],
+		 &interface_vtable, gps, NULL, error);
+	if (priv->registration_id == 0) {
+		return FALSE;
 	}
+
+	priv->connection = g_object_ref (connection);
+	return TRUE;
 }
 
 GypsyServer *
@@ -376,3 +747,105 @@ gypsy_server_new (gboolean auto_terminate)
 
 	return server;
 }
+
+/* Whether a scan has to leave device_path alone: either a device has
+   been created for it, which a scan mustn't change the settings of
+   under it, or Create would refuse it anyway */
+static gboolean
+device_ignored (const char *device_path,
+		gpointer    userdata)
+{
+	GypsyServerPrivate *priv = GET_PRIVATE (userdata);
+	char *path;
+	gboolean ret;
+
+	if (priv->policy == NULL ||
+	    !gypsy_policy_allows (priv->policy, device_path)) {
+		GYPSY_NOTE (SERVER, "Not probing %s, it is not allowed",
+			    device_path);
+		return TRUE;
+	}
+
+	path = device_object_path (device_path);
+	ret = (g_hash_table_lookup (priv->devices, path) != NULL);
+	g_free (path);
+
+	if (ret) {
+		GYPSY_NOTE (SERVER, "Not probing %s, it is open", device_path);
+	}
+
+	return ret;
+}
+
+/* Lets Create start receivers in the device database without probing */
+void
+gypsy_server_set_discovery (GypsyServer    *gps,
+			    GypsyDiscovery *discovery)
+{
+	GypsyServerPrivate *priv = GET_PRIVATE (gps);
+
+	if (priv->discovery) {
+		gypsy_discovery_set_ignore_func (priv->discovery, NULL, NULL);
+		g_object_unref (priv->discovery);
+	}
+	priv->discovery = discovery ? g_object_ref (discovery) : NULL;
+
+	if (priv->discovery) {
+		gypsy_discovery_set_ignore_func (priv->discovery,
+						 device_ignored, gps);
+	}
+}
+
+static GypsyServerDevice *
+find_device_for_client (GypsyServer *gps,
+			GObject     *client)
+{
+	GypsyServerPrivate *priv = GET_PRIVATE (gps);
+	GHashTableIter iter;
+	gpointer value;
+
+	g_hash_table_iter_init (&iter, priv->devices);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		GypsyServerDevice *device = value;
+
+		if ((GObject *) device->client == client) {
+			return device;
+		}
+	}
+
+	return NULL;
+}
+
+/* Keeps client from going idle for a user outside D-Bus, such as a
+   gpsd watcher, the way a Create does. holder must not be a bus name */
+void
+gypsy_server_hold_client (GypsyServer *gps,
+			  GObject     *client,
+			  const char  *holder)
+{
+	GypsyServerDevice *device;
+
+	device = find_device_for_client (gps, client);
+	if (device) {
+		hold_device (gps, holder, device);
+	}
+}
+
+void
+gypsy_server_release_client (GypsyServer *gps,
+			     GObject     *client,
+			     const char  *holder)
+{
+	GypsyServerPrivate *priv = GET_PRIVATE (gps);
+	GypsyServerDevice *device;
+	GHashTable *held;
+
+	device = find_device_for_client (gps, client);
+	held = g_hash_table_lookup (priv->connections, holder);
+	if (device == NULL || held == NULL ||
+	    g_hash_table_lookup (held, device) == NULL) {
+		return;
+	}
+
+	release_device (gps, holder, held, device, 1);
+}
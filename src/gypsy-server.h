@@ -28,6 +28,9 @@
 #define __GYPSY_SERVER_H__
 
 #include <glib-object.h>
+#include <gio/gio.h>
+
+#include "gypsy-discovery.h"
 
 G_BEGIN_DECLS
 
@@ -48,12 +51,26 @@ typedef struct _GypsyServerClass {
 	GObjectClass parent_class;
 
 	void (*terminate) (GypsyServer *server);
+	void (*client_added) (GypsyServer *server,
+			      GObject     *client);
 } GypsyServerClass;
 
 GType gypsy_server_get_type (void);
 GypsyServer *gypsy_server_new (gboolean auto_terminate);
+gboolean gypsy_server_register (GypsyServer     *gps,
+				GDBusConnection *connection,
+				const char      *object_path,
+				GError         **error);
 void gypsy_server_remove_clients (GypsyServer *gps,
 				  const char  *prev_owner);
+void gypsy_server_set_discovery (GypsyServer    *gps,
+				 GypsyDiscovery *discovery);
+void gypsy_server_hold_client (GypsyServer *gps,
+			       GObject     *client,
+			       const char  *holder);
+void gypsy_server_release_client (GypsyServer *gps,
+				  GObject     *client,
+				  const char  *holder);
 G_END_DECLS
 
 #endif
@@ -0,0 +1,166 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * GypsyShmPublisher - Keeps the latest fix of a device in POSIX shared
+ *                     memory for gypsy_shm_read() in libgypsy.
+ *
+ * Updates are guarded by a sequence count which is odd while one is in
+ * progress. Readers copy the fix and retry if the count changed, so the
+ * daemon never waits for them and they never see half an update.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "gypsy-debug.h"
+#include "gypsy-shm-publisher.h"
+
+struct _GypsyShmPublisher {
+	char *name;
+	GypsyShmSegment *segment;
+};
+
+GypsyShmPublisher *
+gypsy_shm_publisher_new (const char *device_name,
+			 GError    **error)
+{
+	GypsyShmPublisher *publisher;
+	struct stat st;
+	void *segment;
+	char *name;
+	int fd;
+
+	name = g_strconcat (GYPSY_SHM_PREFIX, device_name, NULL);
+
+	/* Anyone can read positions over D-Bus, so anyone can read this.
+	   A segment left by a previous run may still be mapped by readers,
+	   so it is reused as it is rather than truncated under them */
+	fd = shm_open (name, O_RDWR | O_CREAT, 0644);
+	if (fd == -1) {
+		goto error;
+	}
+
+	if (fstat (fd, &st) == -1) {
+		close (fd);
+		goto error;
+	}
+
+	if (st.st_size != sizeof (GypsyShmSegment)) {
+		/* The wrong size for this version. Readers of the old one
+		   keep it, and a new one is made in its place */
+		if (st.st_size != 0) {
+			close (fd);
+			shm_unlink (name);
+			fd = shm_open (name, O_RDWR | O_CREAT | O_EXCL, 0644);
+			if (fd == -1) {
+				goto error;
+			}
+		}
+
+		if (ftruncate (fd, sizeof (GypsyShmSegment)) == -1) {
+			close (fd);
+			shm_unlink (name);
+			goto error;
+		}
+	}
+
+	segment = mmap (NULL, sizeof (GypsyShmSegment),
+			PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close (fd);
+
+	if (segment == MAP_FAILED) {
+		shm_unlink (name);
+		goto error;
+	}
+
+	publisher = g_slice_new (GypsyShmPublisher);
+	publisher->name = name;
+	publisher->segment = segment;
+
+	/* A new segment is zeroed, and a sequence of 0 tells readers
+	   nothing is published yet. One reused from a run that stopped
+	   in the middle of an update is left with an odd sequence, which
+	   would have readers retrying for ever */
+	publisher->segment->magic = GYPSY_SHM_MAGIC;
+	publisher->segment->version = GYPSY_SHM_VERSION;
+	if (publisher->segment->sequence & 1) {
+		g_atomic_int_inc (&publisher->segment->sequence);
+	}
+	g_atomic_int_set (&publisher->segment->closed, 0);
+
+	GYPSY_NOTE (CLIENT, "Publishing fix in %s", name);
+	return publisher;
+
+ error:
+	g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+		     "Error creating %s: %s", name, g_strerror (errno));
+	g_free (name);
+
+	return NULL;
+}
+
+/* Starts an update, returning the fix to fill in */
+GypsyShmFix *
+gypsy_shm_publisher_begin (GypsyShmPublisher *publisher)
+{
+	/* Both increments are full barriers, so the
+	   fix is written between them */
+	if (publisher->segment->sequence == -2) {
+		/* Step over 0, which means nothing is published */
+		g_atomic_int_add (&publisher->segment->sequence, 3);
+	} else {
+		g_atomic_int_inc (&publisher->segment->sequence);
+	}
+
+	return &publisher->segment->fix;
+}
+
+void
+gypsy_shm_publisher_commit (GypsyShmPublisher *publisher)
+{
+	g_atomic_int_inc (&publisher->segment->sequence);
+}
+
+void
+gypsy_shm_publisher_free (GypsyShmPublisher *publisher)
+{
+	/* Readers keep their mapping after the unlink, and would
+	   otherwise go on seeing the last fix as the latest */
+	g_atomic_int_set (&publisher->segment->closed, 1);
+
+	munmap (publisher->segment, sizeof (GypsyShmSegment));
+	shm_unlink (publisher->name);
+
+	g_free (publisher->name);
+	g_slice_free (GypsyShmPublisher, publisher);
+}
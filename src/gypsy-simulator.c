@@ -0,0 +1,771 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * GypsySimulator - Generates NMEA or Garmin PVT data for a receiver moving
+ *                  along a simple trajectory, for benchmarks and testing.
+ *
+ * The options are a query string, key=value pairs separated by &:
+ *   rate=N      Epochs per second, 1 to 50 (default 1)
+ *   sats=N      Satellites in view, 0 to 12 (default 8)
+ *   talkers=L   Comma separated NMEA talkers (default GP). Position
+ *               sentences use the first, satellites are shared out
+ *               between all of them in their own GSV sentences.
+ *   format=F    nmea (default) or garmin
+ *   lat=D lon=D alt=M   Start, or the centre of the circle (degrees, metres)
+ *   radius=M    Drive round a circle of radius M, or 0 for a straight line
+ *   heading=D   Direction of the straight line
+ *   speed=M     Metres per second (default 10)
+ *   climb=M     Metres per second of climb (default 0)
+ *   pty=1       Write to a pseudo terminal rather than calling output
+ *   stamp=1     Put the fraction of the second the epoch was generated in
+ *               the altitude, so clients can measure latency
+ *   ack=0       With pty=1, don't acknowledge PMTK721, UBX-CFG and
+ *               UBX-MGA commands like a real receiver does
+ * Other keys are ignored.
+ */
+
+#define _GNU_SOURCE /* posix_openpt */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "garmin.h"
+#include "gypsy-debug.h"
+#include "gypsy-simulator.h"
+
+#define EARTH_RADIUS 6378137.0 /* WGS84, metres */
+#define MPS_TO_KNOTS 1.943844
+#define deg2rad(x) ((x) * G_PI / 180.0)
+#define rad2deg(x) ((x) * 180.0 / G_PI)
+
+#define MAX_RATE 50
+
+/* More than any command the daemon sends */
+#define MAX_INPUT 4096
+
+#define UBX_CLASS_ACK 0x05
+#define UBX_ACK_ACK 0x01
+#define UBX_CLASS_CFG 0x06
+#define UBX_CLASS_MGA 0x13
+#define UBX_MGA_ACK 0x60
+
+/* Garmin time starts at 31-DEC-1989, and runs ahead of UTC */
+#define GARMIN_EPOCH 631065600
+#define LEAP_SECONDS 18
+#define SECONDS_PER_WEEK 604800
+
+struct _GypsySimulator {
+	/* Settings */
+	int rate;
+	int satellites;
+	char **talkers;
+	gboolean garmin;
+	double latitude, longitude, altitude;
+	double radius, heading, speed, climb;
+	gboolean stamp;
+	gboolean ack;
+
+	GypsySimulatorOutput output;
+	gpointer userdata;
+
+	/* For pty=1 */
+	int master, slave;
+	char *pty_path;
+	GIOChannel *master_channel;
+	guint32 drain_id;
+	GByteArray *input; /* Commands not yet read in full */
+
+	guint32 tick_id;
+	guint64 epoch;
+	GByteArray *buffer;
+	guint dropped_epochs;
+};
+
+typedef struct _SimulatedFix {
+	gint64 now; /* Microseconds since 1970 */
+	double latitude, longitude, altitude;
+	double north, east, up; /* Metres per second */
+} SimulatedFix;
+
+static gboolean
+parse_options (GypsySimulator *sim,
+	       const char     *options,
+	       gboolean       *pty,
+	       GError        **error)
+{
+	char **params;
+	int i;
+
+	params = g_strsplit (options ? options : "", "&", -1);
+	for (i = 0; params[i] != NULL; i++) {
+		char **param = g_strsplit (params[i], "=", 2);
+		const char *key = param[0], *value = param[1];
+
+		if (value == NULL) {
+			/* Nothing to do */
+		} else if (g_str_equal (key, "rate")) {
+			sim->rate = atoi (value);
+		} else if (g_str_equal (key, "sats")) {
+			sim->satellites = atoi (value);
+		} else if (g_str_equal (key, "talkers")) {
+			g_strfreev (sim->talkers);
+			sim->talkers = g_strsplit (value, ",", -1);
+		} else if (g_str_equal (key, "ack")) {
+			sim->ack = atoi (value) != 0;
+		} else if (g_str_equal (key, "format")) {
+			sim->garmin = g_str_equal (value, "garmin");
+		} else if (g_str_equal (key, "lat")) {
+			sim->latitude = g_ascii_strtod (value, NULL);
+		} else if (g_str_equal (key, "lon")) {
+			sim->longitude = g_ascii_strtod (value, NULL);
+		} else if (g_str_equal (key, "alt")) {
+			sim->altitude = g_ascii_strtod (value, NULL);
+		} else if (g_str_equal (key, "radius")) {
+			sim->radius = g_ascii_strtod (value, NULL);
+		} else if (g_str_equal (key, "heading")) {
+			sim->heading = g_ascii_strtod (value, NULL);
+		} else if (g_str_equal (key, "speed")) {
+			sim->speed = g_ascii_strtod (value, NULL);
+		} else if (g_str_equal (key, "climb")) {
+			sim->climb = g_ascii_strtod (value, NULL);
+		} else if (g_str_equal (key, "pty")) {
+			*pty = (atoi (value) != 0);
+		} else if (g_str_equal (key, "stamp")) {
+			sim->stamp = (atoi (value) != 0);
+		}
+		g_strfreev (param);
+	}
+	g_strfreev (params);
+
+	if (sim->rate < 1 || sim->rate > MAX_RATE ||
+	    sim->satellites < 0 || sim->satellites > SAT_MAX_COUNT ||
+	    sim->talkers[0] == NULL || fabs (sim->latitude) > 90.0) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+			     "Bad simulator options: %s", options);
+		return FALSE;
+	}
+
+	for (i = 0; sim->talkers[i] != NULL; i++) {
+		if (strlen (sim->talkers[i]) != 2) {
+			g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+				     "Bad NMEA talker: %s", sim->talkers[i]);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static void
+calculate_fix (GypsySimulator *sim,
+	       SimulatedFix   *fix)
+{
+	double t, north, east;
+
+	/* Motion follows simulated time so that it is smooth
+	   however late the timer runs */
+	t = (double) sim->epoch / sim->rate;
+
+	if (sim->radius > 0.0) {
+		double theta = sim->speed * t / sim->radius;
+
+		north = sim->radius * cos (theta);
+		east = sim->radius * sin (theta);
+		fix->north = -sim->speed * sin (theta);
+		fix->east = sim->speed * cos (theta);
+	} else {
+		double heading = deg2rad (sim->heading);
+
+		fix->north = sim->speed * cos (heading);
+		fix->east = sim->speed * sin (heading);
+		north = fix->north * t;
+		east = fix->east * t;
+	}
+
+	fix->now = g_get_real_time ();
+	fix->latitude = sim->latitude + rad2deg (north / EARTH_RADIUS);
+	fix->longitude = sim->longitude +
+		rad2deg (east / (EARTH_RADIUS * cos (deg2rad (sim->latitude))));
+	fix->up = sim->climb;
+
+	if (sim->stamp) {
+		fix->altitude = (fix->now % G_USEC_PER_SEC) /
+			(double) G_USEC_PER_SEC;
+	} else {
+		fix->altitude = sim->altitude + sim->climb * t;
+	}
+}
+
+/* Made up, but stable, sky positions */
+static void
+satellite_position (GypsySimulator *sim,
+		    int             n,
+		    int            *elevation,
+		    int            *azimuth,
+		    int            *snr)
+{
+	*elevation = 10 + (n * 37) % 75;
+	*azimuth = (n * 97 + (int) (sim->epoch / sim->rate) / 10) % 360;
+	*snr = 25 + (n * 7) % 20;
+}
+
+static int
+satellite_prn (const char *talker,
+	       int         n)
+{
+	/* GLONASS slots are numbered from 65 */
+	return (g_str_equal (talker, "GL") ? 65 : 1) + n;
+}
+
+static void
+append_sentence (GString    *epoch,
+		 const char *format,
+		 ...)
+{
+	va_list ap;
+	gsize start;
+	int sum = 0;
+	char *s;
+
+	g_string_append_c (epoch, '$');
+	start = epoch->len;
+
+	va_start (ap, format);
+	s = g_strdup_vprintf (format, ap);
+	va_end (ap);
+	g_string_append (epoch, s);
+	g_free (s);
+
+	for (s = epoch->str + start; *s; s++) {
+		sum ^= *s;
+	}
+	g_string_append_printf (epoch, "*%02X\r\n", sum);
+}
+
+static void
+format_coordinate (char   *buffer,
+		   gsize   length,
+		   double  value,
+		   int     degree_digits)
+{
+	double minutes;
+	int degrees;
+
+	value = fabs (value);
+	degrees = (int) value;
+	minutes = (value - degrees) * 60.0;
+
+	g_snprintf (buffer, length, "%0*d%07.4f", degree_digits, degrees,
+		    minutes);
+}
+
+static void
+generate_nmea (GypsySimulator *sim,
+	       SimulatedFix   *fix,
+	       GString        *epoch)
+{
+	const char *talker = sim->talkers[0];
+	char utc[16], date[8], lat[16], lon[16], sats[16 * 4];
+	double speed, course;
+	time_t seconds;
+	struct tm tm;
+	int talker_count, t, i;
+
+	seconds = fix->now / G_USEC_PER_SEC;
+	gmtime_r (&seconds, &tm);
+	g_snprintf (utc, sizeof (utc), "%02d%02d%02d.%02d", tm.tm_hour,
+		    tm.tm_min, tm.tm_sec,
+		    (int) (fix->now % G_USEC_PER_SEC) / 10000);
+	g_snprintf (date, sizeof (date), "%02d%02d%02d", tm.tm_mday,
+		    tm.tm_mon + 1, tm.tm_year % 100);
+
+	format_coordinate (lat, sizeof (lat), fix->latitude, 2);
+	format_coordinate (lon, sizeof (lon), fix->longitude, 3);
+
+	speed = sqrt (fix->north * fix->north + fix->east * fix->east);
+	course = rad2deg (atan2 (fix->east, fix->north));
+	if (course < 0) {
+		course += 360.0;
+	}
+
+	/* GGA first, as SiRF receivers do, so the new position arrives
+	   together with its altitude */
+	append_sentence (epoch, "%sGGA,%s,%s,%c,%s,%c,1,%02d,0.9,%.3f,M,0.0,M,,",
+			 talker, utc, lat, fix->latitude < 0 ? 'S' : 'N',
+			 lon, fix->longitude < 0 ? 'W' : 'E',
+			 sim->satellites, fix->altitude);
+	append_sentence (epoch, "%sRMC,%s,A,%s,%c,%s,%c,%.2f,%.1f,%s,,",
+			 talker, utc, lat, fix->latitude < 0 ? 'S' : 'N',
+			 lon, fix->longitude < 0 ? 'W' : 'E',
+			 speed * MPS_TO_KNOTS, course, date);
+
+	talker_count = g_strv_length (sim->talkers);
+
+	/* Everything in view is used for the fix */
+	sats[0] = '\0';
+	for (i = 0; i < SAT_MAX_COUNT; i++) {
+		char prn[8] = "";
+
+		if (i < sim->satellites) {
+			g_snprintf (prn, sizeof (prn), "%d",
+				    satellite_prn (sim->talkers[i % talker_count],
+						   i / talker_count));
+		}
+		g_strlcat (sats, prn, sizeof (sats));
+		g_strlcat (sats, ",", sizeof (sats));
+	}
+	append_sentence (epoch, "%sGSA,A,%d,%s1.5,0.9,1.2", talker,
+			 sim->satellites >= 4 ? 3 : 2, sats);
+
+	/* Each talker reports its share of the satellites */
+	for (t = 0; t < talker_count; t++) {
+		int in_view, messages, m;
+
+		in_view = sim->satellites / talker_count +
+			(t < sim->satellites % talker_count ? 1 : 0);
+		if (in_view == 0) {
+			continue;
+		}
+
+		messages = (in_view + 3) / 4;
+		for (m = 0; m < messages; m++) {
+			GString *sentence;
+			int s;
+
+			sentence = g_string_new (NULL);
+			g_string_append_printf (sentence, "%sGSV,%d,%d,%02d",
+						sim->talkers[t], messages,
+						m + 1, in_view);
+			for (s = m * 4; s < MIN (in_view, m * 4 + 4); s++) {
+				int elevation, azimuth, snr;
+
+				satellite_position (sim, s * talker_count + t,
+						    &elevation, &azimuth, &snr);
+				g_string_append_printf
+					(sentence, ",%02d,%02d,%03d,%02d",
+					 satellite_prn (sim->talkers[t], s),
+					 elevation, azimuth, snr);
+			}
+			append_sentence (epoch, "%s", sentence->str);
+			g_string_free (sentence, TRUE);
+		}
+	}
+}
+
+static void
+append_garmin_packet (GByteArray *buffer,
+		      guint16     id,
+		      gpointer    data,
+		      guint32     length)
+{
+	G_Packet_t header;
+
+	memset (&header, 0, sizeof (header));
+	header.mPacketType = LAYERID_APPL;
+	header.mPacketId = id;
+	header.mDataSize = length;
+
+	g_byte_array_append (buffer, (guint8 *) &header, GARMIN_HEADER_SIZE);
+	g_byte_array_append (buffer, data, length);
+}
+
+static void
+generate_garmin (GypsySimulator *sim,
+		 SimulatedFix   *fix,
+		 GByteArray     *epoch)
+{
+	D800_Pvt_Data_Type pvt;
+	double garmin_time;
+	gint64 weeks;
+
+	memset (&pvt, 0, sizeof (pvt));
+
+	garmin_time = (double) fix->now / G_USEC_PER_SEC - GARMIN_EPOCH +
+		LEAP_SECONDS;
+	weeks = (gint64) (garmin_time / SECONDS_PER_WEEK);
+
+	pvt.alt = fix->altitude;
+	pvt.epe = 5.0;
+	pvt.eph = 3.0;
+	pvt.epv = 4.0;
+	pvt.fix = sim->satellites >= 4 ? 3 : 2;
+	pvt.tow = garmin_time - weeks * SECONDS_PER_WEEK;
+	if (sim->stamp) {
+		/* The parser rounds to the nearest second, which
+		   would throw out the fraction in the altitude */
+		pvt.tow = floor (pvt.tow);
+	}
+	pvt.lat = deg2rad (fix->latitude);
+	pvt.lon = deg2rad (fix->longitude);
+	pvt.east = fix->east;
+	pvt.north = fix->north;
+	pvt.up = fix->up;
+	pvt.msl_hght = 0.0;
+	pvt.leap_scnds = LEAP_SECONDS;
+	pvt.wn_days = weeks * 7;
+
+	append_garmin_packet (epoch, Pid_Pvt_Data, &pvt, sizeof (pvt));
+
+	/* Receivers send the satellites once a second */
+	if (sim->epoch % sim->rate == 0) {
+		cpo_sat_data sats[SAT_MAX_COUNT];
+		int i;
+
+		memset (sats, 0, sizeof (sats));
+		for (i = 0; i < SAT_MAX_COUNT; i++) {
+			int elevation, azimuth, snr;
+
+			if (i >= sim->satellites) {
+				sats[i].svid = 0xff;
+				continue;
+			}
+
+			satellite_position (sim, i, &elevation, &azimuth, &snr);
+			sats[i].svid = i + 1;
+			sats[i].snr = snr * 100;
+			sats[i].elev = elevation;
+			sats[i].azmth = azimuth;
+			sats[i].status = SAT_STATUS_GOOD;
+		}
+
+		append_garmin_packet (epoch, Pid_SatData_Record,
+				      sats, sizeof (sats));
+	}
+}
+
+static void
+write_pty (GypsySimulator *sim,
+	   const char     *data,
+	   gsize           length)
+{
+	while (length > 0) {
+		ssize_t written;
+
+		written = write (sim->master, data, length);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			/* Nobody is reading fast enough, like a real
+			   serial line the rest of the epoch is lost */
+			sim->dropped_epochs++;
+			return;
+		}
+
+		data += written;
+		length -= written;
+	}
+}
+
+static gboolean
+simulator_tick (gpointer userdata)
+{
+	GypsySimulator *sim = userdata;
+	SimulatedFix fix;
+
+	calculate_fix (sim, &fix);
+
+	g_byte_array_set_size (sim->buffer, 0);
+	if (sim->garmin) {
+		generate_garmin (sim, &fix, sim->buffer);
+	} else {
+		GString *epoch = g_string_new (NULL);
+
+		generate_nmea (sim, &fix, epoch);
+		g_byte_array_append (sim->buffer, (guint8 *) epoch->str,
+				     epoch->len);
+		g_string_free (epoch, TRUE);
+	}
+	sim->epoch++;
+
+	if (sim->master != -1) {
+		write_pty (sim, (char *) sim->buffer->data, sim->buffer->len);
+	} else if (sim->output) {
+		sim->output (sim, (char *) sim->buffer->data,
+			     sim->buffer->len, sim->userdata);
+	}
+
+	return TRUE;
+}
+
+static void
+acknowledge_mga (GypsySimulator *sim,
+		 guint8          msg_id)
+{
+	guint8 ack[16] = { 0xb5, 0x62, UBX_CLASS_MGA, UBX_MGA_ACK, 8, 0,
+			   1, 0, 0, msg_id, 0, 0, 0, 0, 0, 0 };
+	guint8 ck_a = 0, ck_b = 0;
+	int i;
+
+	for (i = 2; i < 14; i++) {
+		ck_a += ack[i];
+		ck_b += ck_a;
+	}
+	ack[14] = ck_a;
+	ack[15] = ck_b;
+
+	write_pty (sim, (char *) ack, sizeof (ack));
+}
+
+/* Every configuration change is taken, UBX-ACK-ACK */
+static void
+acknowledge_cfg (GypsySimulator *sim,
+		 guint8          msg_id)
+{
+	guint8 ack[10] = { 0xb5, 0x62, UBX_CLASS_ACK, UBX_ACK_ACK, 2, 0,
+			   UBX_CLASS_CFG, msg_id, 0, 0 };
+	guint8 ck_a = 0, ck_b = 0;
+	int i;
+
+	for (i = 2; i < 8; i++) {
+		ck_a += ack[i];
+		ck_b += ck_a;
+	}
+	ack[8] = ck_a;
+	ack[9] = ck_b;
+
+	write_pty (sim, (char *) ack, sizeof (ack));
+}
+
+/* Answers the assistance and configuration commands in what the daemon has written,
+   keeping anything that hasn't been read in full yet */
+static void
+acknowledge_input (GypsySimulator *sim)
+{
+	guint8 *data = sim->input->data;
+	gsize length = sim->input->len, used = 0;
+
+	while (used < length) {
+		guint8 *p = data + used;
+		gsize left = length - used;
+
+		if (p[0] == '$') {
+			guint8 *end = memchr (p, '\n', left);
+
+			if (end == NULL) {
+				break;
+			}
+
+			if (left > 9 && strncmp ((char *) p, "$PMTK721,", 9) == 0) {
+				GString *ack = g_string_new (NULL);
+
+				append_sentence (ack, "PMTK001,721,3");
+				write_pty (sim, ack->str, ack->len);
+				g_string_free (ack, TRUE);
+			}
+			used = end - data + 1;
+		} else if (p[0] == 0xb5 && left > 1 && p[1] == 0x62) {
+			gsize packet;
+
+			if (left < 8) {
+				break;
+			}
+
+			packet = (p[4] | p[5] << 8) + 8;
+			if (left < packet) {
+				break;
+			}
+
+			if (p[2] == UBX_CLASS_MGA) {
+				acknowledge_mga (sim, p[3]);
+			} else if (p[2] == UBX_CLASS_CFG) {
+				acknowledge_cfg (sim, p[3]);
+			}
+			used += packet;
+		} else {
+			used++;
+		}
+	}
+
+	g_byte_array_remove_range (sim->input, 0, used);
+	if (sim->input->len > MAX_INPUT) {
+		g_byte_array_set_size (sim->input, 0);
+	}
+}
+
+/* Acknowledges commands and throws away
+   anything else the daemon writes to the device */
+static gboolean
+drain_pty (GIOChannel  *channel,
+	   GIOCondition condition,
+	   gpointer     userdata)
+{
+	GypsySimulator *sim = userdata;
+	char buffer[256];
+	ssize_t length;
+
+	while ((length = read (sim->master, buffer, sizeof (buffer))) > 0) {
+		if (sim->ack) {
+			g_byte_array_append (sim->input, (guint8 *) buffer,
+					     length);
+		}
+	}
+
+	if (sim->ack) {
+		acknowledge_input (sim);
+	}
+
+	return TRUE;
+}
+
+static gboolean
+open_pty (GypsySimulator *sim,
+	  GError        **error)
+{
+	struct termios term;
+
+	sim->master = posix_openpt (O_RDWR | O_NOCTTY);
+	if (sim->master == -1 || grantpt (sim->master) == -1 ||
+	    unlockpt (sim->master) == -1) {
+		g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+			     "Error opening pty: %s", g_strerror (errno));
+		return FALSE;
+	}
+
+	sim->pty_path = g_strdup (ptsname (sim->master));
+
+	/* Hold the slave open so the master never sees a hangup between
+	   the daemon opening and closing it, and make it raw so Garmin
+	   packets get through untouched */
+	sim->slave = open (sim->pty_path, O_RDWR | O_NOCTTY);
+	if (sim->slave == -1) {
+		g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+			     "Error opening %s: %s", sim->pty_path,
+			     g_strerror (errno));
+		return FALSE;
+	}
+
+	if (tcgetattr (sim->slave, &term) == 0) {
+		cfmakeraw (&term);
+		tcsetattr (sim->slave, TCSANOW, &term);
+	}
+
+	fcntl (sim->master, F_SETFL, fcntl (sim->master, F_GETFL) | O_NONBLOCK);
+
+	sim->master_channel = g_io_channel_unix_new (sim->master);
+	sim->drain_id = g_io_add_watch (sim->master_channel, G_IO_IN,
+					drain_pty, sim);
+
+	GYPSY_NOTE (CLIENT, "Simulator writing to %s", sim->pty_path);
+	return TRUE;
+}
+
+/* Starts generating straight away. With pty=1 the data goes to the pty
+   returned by gypsy_simulator_get_pty(), otherwise output is called with
+   each epoch. */
+GypsySimulator *
+gypsy_simulator_new (const char          *options,
+		     GypsySimulatorOutput output,
+		     gpointer             userdata,
+		     GError             **error)
+{
+	GypsySimulator *sim;
+	gboolean pty = FALSE;
+
+	sim = g_slice_new0 (GypsySimulator);
+	sim->rate = 1;
+	sim->satellites = 8;
+	sim->talkers = g_strsplit ("GP", ",", -1);
+	sim->latitude = 51.4769;
+	sim->longitude = 0.0;
+	sim->radius = 100.0;
+	sim->speed = 10.0;
+	sim->master = -1;
+	sim->slave = -1;
+	sim->output = output;
+	sim->userdata = userdata;
+	sim->buffer = g_byte_array_new ();
+	sim->input = g_byte_array_new ();
+	sim->ack = TRUE;
+
+	if (!parse_options (sim, options, &pty, error) ||
+	    (pty && !open_pty (sim, error))) {
+		gypsy_simulator_free (sim);
+		return NULL;
+	}
+
+	sim->tick_id = g_timeout_add (1000 / sim->rate, simulator_tick, sim);
+
+	return sim;
+}
+
+/* The pty to open in place of a device, or NULL if there isn't one */
+const char *
+gypsy_simulator_get_pty (GypsySimulator *simulator)
+{
+	return simulator->pty_path;
+}
+
+gboolean
+gypsy_simulator_is_garmin (GypsySimulator *simulator)
+{
+	return simulator->garmin;
+}
+
+void
+gypsy_simulator_free (GypsySimulator *simulator)
+{
+	if (simulator->tick_id > 0) {
+		g_source_remove (simulator->tick_id);
+	}
+
+	if (simulator->drain_id > 0) {
+		g_source_remove (simulator->drain_id);
+	}
+
+	if (simulator->master_channel) {
+		g_io_channel_unref (simulator->master_channel);
+	}
+
+	if (simulator->slave != -1) {
+		close (simulator->slave);
+	}
+
+	if (simulator->master != -1) {
+		close (simulator->master);
+	}
+
+	if (simulator->dropped_epochs > 0) {
+		GYPSY_NOTE (CLIENT, "Simulator dropped %d epochs",
+			    simulator->dropped_epochs);
+	}
+
+	g_free (simulator->pty_path);
+	g_strfreev (simulator->talkers);
+	g_byte_array_free (simulator->buffer, TRUE);
+	g_byte_array_free (simulator->input, TRUE);
+	g_slice_free (GypsySimulator, simulator);
+}
@@ -0,0 +1,188 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * GypsyWarmStart - Keeps each device's last position, time and satellites
+ *                  in a small key file under LOCALSTATEDIR/lib/gypsy, so
+ *                  the next start can tell the receiver roughly where and
+ *                  when it is.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "gypsy-warm-start.h"
+
+#define STATE_DIR LOCALSTATEDIR "/lib/gypsy"
+#define STATE_GROUP "Fix"
+
+static char *
+state_filename (const char *device_name)
+{
+	char *basename, *filename;
+
+	basename = g_strconcat (device_name, ".state", NULL);
+	filename = g_build_filename (STATE_DIR, basename, NULL);
+	g_free (basename);
+
+	return filename;
+}
+
+gboolean
+gypsy_warm_start_load (const char     *device_name,
+		       GypsyWarmStart *state,
+		       GError        **error)
+{
+	GKeyFile *key_file;
+	GError *key_error = NULL;
+	char *filename, **satellites;
+	int i;
+
+	memset (state, 0, sizeof (GypsyWarmStart));
+
+	filename = state_filename (device_name);
+	key_file = g_key_file_new ();
+	if (!g_key_file_load_from_file (key_file, filename,
+					G_KEY_FILE_NONE, error)) {
+		g_key_file_free (key_file);
+		g_free (filename);
+		return FALSE;
+	}
+	g_free (filename);
+
+	state->timestamp = g_key_file_get_integer (key_file, STATE_GROUP,
+						   "Time", &key_error);
+	if (key_error == NULL) {
+		state->latitude = g_key_file_get_double (key_file, STATE_GROUP,
+							 "Latitude",
+							 &key_error);
+	}
+	if (key_error == NULL) {
+		state->longitude = g_key_file_get_double (key_file,
+							  STATE_GROUP,
+							  "Longitude",
+							  &key_error);
+	}
+	if (key_error) {
+		g_propagate_error (error, key_error);
+		g_key_file_free (key_file);
+		return FALSE;
+	}
+	state->position_fields = POSITION_LATITUDE | POSITION_LONGITUDE;
+
+	if (g_key_file_has_key (key_file, STATE_GROUP, "Altitude", NULL)) {
+		state->altitude = g_key_file_get_double (key_file,
+							 STATE_GROUP,
+							 "Altitude", NULL);
+		state->position_fields |= POSITION_ALTITUDE;
+	}
+
+	/* Each satellite is ID:ELEVATION:AZIMUTH */
+	satellites = g_key_file_get_string_list (key_file, STATE_GROUP,
+						 "Satellites", NULL, NULL);
+	for (i = 0; satellites && satellites[i] &&
+		     state->sat_count < MAX_SAT_SVID; i++) {
+		GypsyClientSatellite *sat;
+
+		sat = &state->satellites[state->sat_count];
+		if (sscanf (satellites[i], "%d:%d:%d", &sat->satellite_id,
+			    &sat->elevation, &sat->azimuth) == 3) {
+			state->sat_count++;
+		}
+	}
+	g_strfreev (satellites);
+
+	g_key_file_free (key_file);
+	return TRUE;
+}
+
+gboolean
+gypsy_warm_start_save (const char           *device_name,
+		       const GypsyWarmStart *state,
+		       GError              **error)
+{
+	GKeyFile *key_file;
+	GPtrArray *satellites;
+	char *filename, *data;
+	gsize length;
+	gboolean ret;
+	int i;
+
+	if (g_mkdir_with_parents (STATE_DIR, 0755) < 0) {
+		g_set_error (error, G_FILE_ERROR,
+			     g_file_error_from_errno (errno),
+			     "Error creating %s: %s", STATE_DIR,
+			     g_strerror (errno));
+		return FALSE;
+	}
+
+	key_file = g_key_file_new ();
+	g_key_file_set_integer (key_file, STATE_GROUP, "Time",
+				state->timestamp);
+	g_key_file_set_double (key_file, STATE_GROUP, "Latitude",
+			       state->latitude);
+	g_key_file_set_double (key_file, STATE_GROUP, "Longitude",
+			       state->longitude);
+	if (state->position_fields & POSITION_ALTITUDE) {
+		g_key_file_set_double (key_file, STATE_GROUP, "Altitude",
+				       state->altitude);
+	}
+
+	satellites = g_ptr_array_new_with_free_func (g_free);
+	for (i = 0; i < state->sat_count; i++) {
+		const GypsyClientSatellite *sat = &state->satellites[i];
+
+		g_ptr_array_add (satellites,
+				 g_strdup_printf ("%d:%d:%d",
+						  sat->satellite_id,
+						  sat->elevation,
+						  sat->azimuth));
+	}
+	if (satellites->len > 0) {
+		g_key_file_set_string_list (key_file, STATE_GROUP,
+					    "Satellites",
+					    (const char * const *) satellites->pdata,
+					    satellites->len);
+	}
+	g_ptr_array_free (satellites, TRUE);
+
+	data = g_key_file_to_data (key_file, &length, NULL);
+	g_key_file_free (key_file);
+
+	/* Written to a temporary file and renamed, so a crash
+	   can't leave half a file */
+	filename = state_filename (device_name);
+	ret = g_file_set_contents (filename, data, length, error);
+	g_free (filename);
+	g_free (data);
+
+	return ret;
+}
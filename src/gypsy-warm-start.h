@@ -0,0 +1,57 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef __GYPSY_WARM_START_H__
+#define __GYPSY_WARM_START_H__
+
+#include <glib.h>
+
+#include "gypsy-client.h"
+#include "nmea.h"
+
+G_BEGIN_DECLS
+
+/* What is kept of a device's last fix between runs */
+typedef struct _GypsyWarmStart {
+	int timestamp; /* UTC time of the fix */
+	PositionFields position_fields;
+	double latitude;
+	double longitude;
+	double altitude;
+
+	int sat_count;
+	GypsyClientSatellite satellites[MAX_SAT_SVID];
+} GypsyWarmStart;
+
+gboolean gypsy_warm_start_load (const char     *device_name,
+				GypsyWarmStart *state,
+				GError        **error);
+gboolean gypsy_warm_start_save (const char           *device_name,
+				const GypsyWarmStart *state,
+				GError              **error);
+
+G_END_DECLS
+
+#endif
@@ -34,21 +34,34 @@
 #include <sys/stat.h>
 
 #include <glib.h>
+#include <gio/gio.h>
 
-#include <dbus/dbus-protocol.h>
-#include <dbus/dbus-glib.h>
-#include <dbus/dbus-glib-bindings.h>
-
+#include "gypsy-capture.h"
 #include "gypsy-debug.h"
 #include "gypsy-discovery.h"
+#include "gypsy-gpsd.h"
+#include "gypsy-nmea-log.h"
 #include "gypsy-server.h"
 
 #define GYPSY_NAME "org.freedesktop.Gypsy"
+#define GYPSY_PATH "/org/freedesktop/Gypsy"
+
+/* From the D-Bus specification */
+#define DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER 1
 #define DEFAULT_PID_FILE LOCALSTATEDIR"/run/Gypsy.pid"
 
 static GMainLoop *mainloop;
 /* This is a bit ugly, but it works */
 char* nmea_log = NULL;
+GypsyNmeaLogSettings nmea_log_settings = {
+	0,	/* max_size */
+	0,	/* max_age */
+	5,	/* segments */
+	FALSE,	/* compress */
+	256,	/* buffer_size */
+	FALSE,	/* capture */
+};
+char *raw_stream_dir = NULL;
 
 guint gypsy_debug_flags = 0; /* global gypsy debug flag */
 static const GDebugKey gypsy_debug_keys[] = {
@@ -84,12 +97,19 @@ write_pidfile (const char *pidfile)
 }
 
 static void
-name_owner_changed (DBusGProxy  *proxy,
-		    const char  *name,
-		    const char  *prev_owner,
-		    const char  *new_owner,
-		    GypsyServer *server)
+name_owner_changed (GDBusConnection *connection,
+		    const char      *sender_name,
+		    const char      *object_path,
+		    const char      *interface_name,
+		    const char      *signal_name,
+		    GVariant        *parameters,
+		    gpointer         userdata)
 {
+	GypsyServer *server = userdata;
+	const char *name, *prev_owner, *new_owner;
+
+	g_variant_get (parameters, "(&s&s&s)", &name, &prev_owner,
+		       &new_owner);
 	if (strcmp (new_owner, "") == 0 && strcmp (name, prev_owner) == 0) {
 		gypsy_server_remove_clients (server, prev_owner);
 	}
@@ -120,20 +140,30 @@ main (int    argc,
       char **argv)
 {
 	GOptionContext *context;
-	DBusGConnection *conn;
-	DBusGProxy *proxy;
+	GDBusConnection *conn;
+	GVariant *reply;
 	GError *error = NULL;
 	guint32 request_name_ret;
 	GypsyServer *gypsy;
 	GypsyDiscovery *discovery;
+	GypsyGpsd *gpsd = NULL;
 	gboolean become_daemon = FALSE;
 	gboolean auto_terminate = TRUE;
 	char *pidfile = NULL;
 	char *user_pidfile = NULL;
 	const char *env_string;
+	int gpsd_port = 0;
 
 	GOptionEntry entries[] = {
 		{ "nmea-log", 0, 0, G_OPTION_ARG_FILENAME, &nmea_log, "Log NMEA data to FILE.[device]", "FILE" },
+		{ "nmea-log-max-size", 0, 0, G_OPTION_ARG_INT, &nmea_log_settings.max_size, "Rotate the NMEA log after SIZE KiB", "SIZE" },
+		{ "nmea-log-max-age", 0, 0, G_OPTION_ARG_INT, &nmea_log_settings.max_age, "Rotate the NMEA log after SECONDS", "SECONDS" },
+		{ "nmea-log-segments", 0, 0, G_OPTION_ARG_INT, &nmea_log_settings.segments, "Keep N rotated NMEA logs (default 5)", "N" },
+		{ "nmea-log-compress", 0, 0, G_OPTION_ARG_NONE, &nmea_log_settings.compress, "Compress rotated NMEA logs with gzip", NULL },
+		{ "nmea-log-buffer", 0, 0, G_OPTION_ARG_INT, &nmea_log_settings.buffer_size, "Drop NMEA log data once SIZE KiB is waiting to be written (default 256)", "SIZE" },
+		{ "nmea-log-capture", 0, 0, G_OPTION_ARG_NONE, &nmea_log_settings.capture, "Write the NMEA log as timestamped " GYPSY_CAPTURE_SUFFIX " captures", NULL },
+		{ "raw-stream-dir", 0, 0, G_OPTION_ARG_FILENAME, &raw_stream_dir, "Serve the raw data of each device on a Unix socket in DIR", "DIR" },
+		{ "gpsd-port", 0, 0, G_OPTION_ARG_INT, &gpsd_port, "Serve the gpsd JSON protocol on localhost PORT (gpsd uses 2947)", "PORT" },
 		{ "no-daemon", 0, 0, G_OPTION_ARG_NONE, &become_daemon, "Don't become a daemon", NULL },
 		{ "pid-file", 0, 0, G_OPTION_ARG_FILENAME, &user_pidfile, "Specify the location of a PID file", "FILE" },
 		{ "gypsy-debug", 0, 0, G_OPTION_ARG_CALLBACK, gypsy_arg_debug_cb, "Gypsy debugging flags to set", "FLAGS" },
@@ -192,24 +222,31 @@ main (int    argc,
 
 	mainloop = g_main_loop_new (NULL, FALSE);
 
-	conn = dbus_g_bus_get (DBUS_BUS_SYSTEM, &error);
+	conn = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
 	if (!conn) {
 		g_error ("Error getting bus: %s", error->message);
 		return 1;
 	}
 
-	proxy = dbus_g_proxy_new_for_name (conn,
-					   DBUS_SERVICE_DBUS,
-					   DBUS_PATH_DBUS,
-					   DBUS_INTERFACE_DBUS);
-	if (!org_freedesktop_DBus_request_name (proxy, GYPSY_NAME,
-						0,  &request_name_ret,
-						&error)) {
+	reply = g_dbus_connection_call_sync (conn,
+					     "org.freedesktop.DBus",
+					     "/org/freedesktop/DBus",
+					     "org.freedesktop.DBus",
+					     "RequestName",
+					     g_variant_new ("(su)",
+							    GYPSY_NAME, 0),
+					     G_VARIANT_TYPE ("(u)"),
+					     G_DBUS_CALL_FLAGS_NONE,
+					     -1, NULL, &error);
+	if (reply == NULL) {
 		g_error ("Error registering D-Bus service %s: %s",
 			 GYPSY_NAME, error->message);
 		return 1;
 	}
 
+	g_variant_get (reply, "(u)", &request_name_ret);
+	g_variant_unref (reply);
+
 	/* Just quit if GPS is already running */
 	if (request_name_ret != DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
 		return 1;
@@ -219,20 +256,44 @@ main (int    argc,
 	g_signal_connect (G_OBJECT (gypsy), "terminate",
 			  G_CALLBACK (gypsy_terminate), NULL);
 
-	dbus_g_proxy_add_signal (proxy, "NameOwnerChanged",
-				 G_TYPE_STRING, G_TYPE_STRING,
-				 G_TYPE_STRING, G_TYPE_INVALID);
-	dbus_g_proxy_connect_signal (proxy, "NameOwnerChanged",
-				     G_CALLBACK (name_owner_changed),
-				     gypsy, NULL);
+	if (!gypsy_server_register (gypsy, conn, GYPSY_PATH, &error)) {
+		g_error ("Error registering %s: %s", GYPSY_PATH,
+			 error->message);
+		return 1;
+	}
 
-	dbus_g_connection_register_g_object (conn, "/org/freedesktop/Gypsy", G_OBJECT (gypsy));
+	g_dbus_connection_signal_subscribe (conn,
+					    "org.freedesktop.DBus",
+					    "org.freedesktop.DBus",
+					    "NameOwnerChanged",
+					    "/org/freedesktop/DBus",
+					    NULL,
+					    G_DBUS_SIGNAL_FLAGS_NONE,
+					    name_owner_changed,
+					    gypsy, NULL);
+
+	if (gpsd_port > 0) {
+		gpsd = gypsy_gpsd_new (gypsy, gpsd_port, &error);
+		if (gpsd == NULL) {
+			g_warning ("Error starting gpsd listener: %s",
+				   error->message);
+			g_clear_error (&error);
+		}
+	}
 
 	discovery = g_object_new (GYPSY_TYPE_DISCOVERY, NULL);
-	dbus_g_connection_register_g_object (conn,
-					     "/org/freedesktop/Gypsy/Discovery",
-					     G_OBJECT (discovery));
+	if (!gypsy_discovery_register (discovery, conn, &error)) {
+		g_warning ("Error registering %s: %s", GYPSY_DISCOVERY_PATH,
+			   error->message);
+		g_clear_error (&error);
+	}
+	gypsy_server_set_discovery (gypsy, discovery);
+
 	g_main_loop_run (mainloop);
 
+	if (gpsd) {
+		gypsy_gpsd_free (gpsd);
+	}
+
 	return 0;
 }
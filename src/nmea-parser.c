@@ -232,6 +232,18 @@ calculate_timestamp (NMEAParseContext *ctxt,
 	return ctxt->datestamp + (hours * SECS_IN_HOURS) + (minutes * SECS_IN_MINS) + seconds;
 }
 
+/* The fraction of a second after hhmmss, which
+   receivers sending more than once a second fill in */
+static double
+calculate_fraction (const char *utc_time)
+{
+	if (strlen (utc_time) < 7 || utc_time[6] != '.') {
+		return 0.0;
+	}
+
+	return g_ascii_strtod (utc_time + 6, NULL);
+}
+
 #define BASE_CENTURY 2000
 #define SECONDS_PER_DAY (60 * 60 * 24)
 static int
@@ -277,10 +289,115 @@ calculate_datestamp (NMEAParseContext *ctxt,
 #define GSV_FIELD(x) (ctxt->fields.gsv_fields[x])
 #define GSV_FIRST_SAT 3
 #define GSV_LAST_SAT 15
+
+static NMEAGsvSequence *
+find_gsv_sequence (NMEAParseContext *ctxt)
+{
+	NMEAGsvSequence *seq;
+	int i;
+
+	for (i = 0; i < ctxt->gsv_count; i++) {
+		if (strcmp (ctxt->gsv[i].talker, ctxt->talker) == 0) {
+			return &ctxt->gsv[i];
+		}
+	}
+
+	if (ctxt->gsv_count == NMEA_MAX_TALKERS) {
+		return NULL;
+	}
+
+	seq = &ctxt->gsv[ctxt->gsv_count];
+	ctxt->gsv_count++;
+
+	memset (seq, 0, sizeof (NMEAGsvSequence));
+	strcpy (seq->talker, ctxt->talker);
+
+	return seq;
+}
+
+static gboolean
+is_in_use (NMEAParseContext *ctxt,
+	   int               id)
+{
+	int i;
+
+	for (i = 0; i < ctxt->in_use_count; i++) {
+		if (id == ctxt->in_use[i]) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/* Gives the client the satellites of every talker whose GSV
+   have all been seen, as one set */
+static void
+commit_satellites (NMEAParseContext *ctxt)
+{
+	int i, j;
+
+	gypsy_client_clear_satellites (ctxt->client);
+
+	for (i = 0; i < ctxt->gsv_count; i++) {
+		NMEAGsvSequence *seq = &ctxt->gsv[i];
+
+		if (!seq->complete) {
+			continue;
+		}
+
+		for (j = 0; j < seq->sat_count; j++) {
+			NMEASatellite *sat = &seq->satellites[j];
+
+			gypsy_client_add_satellite (ctxt->client, sat->id,
+						    is_in_use (ctxt, sat->id),
+						    sat->elevation,
+						    sat->azimuth, sat->snr);
+		}
+		seq->complete = FALSE;
+	}
+
+	gypsy_client_set_satellites (ctxt->client);
+}
+
+/* Called at the start of an epoch, with RMC or GGA. Whatever has been
+   seen is committed, and talkers that sent nothing since the last time
+   are forgotten, so nothing waits on them again */
+static void
+end_satellite_epoch (NMEAParseContext *ctxt)
+{
+	gboolean any = FALSE;
+	int i, kept;
+
+	for (i = 0; i < ctxt->gsv_count; i++) {
+		if (ctxt->gsv[i].complete) {
+			any = TRUE;
+			break;
+		}
+	}
+
+	if (!any) {
+		return;
+	}
+
+	for (i = 0, kept = 0; i < ctxt->gsv_count; i++) {
+		if (ctxt->gsv[i].complete || ctxt->gsv[i].message_count > 0) {
+			if (kept != i) {
+				ctxt->gsv[kept] = ctxt->gsv[i];
+			}
+			kept++;
+		}
+	}
+	ctxt->gsv_count = kept;
+
+	commit_satellites (ctxt);
+}
+
 static gboolean
 parse_gsv (NMEAParseContext *ctxt,
 	   const char       *data)
 {
+	NMEAGsvSequence *seq;
 	int field_count, message_number, i;
 
 	field_count = split_sentence (data, ctxt->fields.gsv_fields,
@@ -303,32 +420,43 @@ parse_gsv (NMEAParseContext *ctxt,
 	if ((field_count - 3) % 4 != 0)
 		return FALSE;
 
+	seq = find_gsv_sequence (ctxt);
+	if (seq == NULL) {
+		GYPSY_NOTE (NMEA, "Too many talkers, ignoring %s",
+			    ctxt->talker);
+		return TRUE;
+	}
+
 	message_number = atoi (GSV_FIELD (1));
 
-	if (message_number != ctxt->message_count + 1) {
-		GYPSY_NOTE (NMEA, "Missed message %d - got %d",
-			    ctxt->message_count + 1,
+	/* The talker has started on its next epoch, so the
+	   others aren't going to finish this one */
+	if (message_number == 1 && seq->complete) {
+		commit_satellites (ctxt);
+	}
+
+	if (message_number != seq->message_count + 1) {
+		GYPSY_NOTE (NMEA, "Missed %s message %d - got %d",
+			    seq->talker, seq->message_count + 1,
 			    message_number);
-		/* We've missed a message, so clear the satellites */
-		gypsy_client_clear_satellites (ctxt->client);
 
 		/* If the message received was #1 then we can continue
 		   otherwise we need to skip until we find #1 */
-		ctxt->message_count = 0;
-		ctxt->number_of_messages = 0;
+		seq->message_count = 0;
+		seq->number_of_messages = 0;
+		seq->sat_count = 0;
 		if (message_number != 1) {
 			return FALSE;
 		}
 	}
 
 	if (message_number == 1) {
-		ctxt->number_of_messages = atoi (GSV_FIELD (0));
+		seq->number_of_messages = atoi (GSV_FIELD (0));
+		seq->sat_count = 0;
 	}
 
 	for (i = GSV_FIRST_SAT; i <= GSV_LAST_SAT && i < field_count; i += 4) {
-		int id, elevation, azimuth, snr;
-		int j;
-		gboolean in_use = FALSE;
+		NMEASatellite *sat;
 
 		/* If the ID field is empty, then we've finished the
 		   satellites in this sentence */
@@ -336,30 +464,33 @@ parse_gsv (NMEAParseContext *ctxt,
 			break;
 		}
 
-		id = atoi (GSV_FIELD (i));
-		elevation = IS_EMPTY (GSV_FIELD (i + 1)) ? 0 :
+		if (seq->sat_count == MAX_SAT_SVID) {
+			break;
+		}
+
+		sat = &seq->satellites[seq->sat_count];
+		sat->id = atoi (GSV_FIELD (i));
+		sat->elevation = IS_EMPTY (GSV_FIELD (i + 1)) ? 0 :
 			atoi (GSV_FIELD (i + 1));
-		azimuth = IS_EMPTY (GSV_FIELD (i + 2)) ? 0 :
+		sat->azimuth = IS_EMPTY (GSV_FIELD (i + 2)) ? 0 :
 			atoi (GSV_FIELD (i + 2));
-		snr = IS_EMPTY (GSV_FIELD (i + 3)) ? 0 :
+		sat->snr = IS_EMPTY (GSV_FIELD (i + 3)) ? 0 :
 			atoi (GSV_FIELD (i + 3));
+		seq->sat_count++;
+	}
+
+	seq->message_count++;
+	if (seq->message_count == seq->number_of_messages) {
+		seq->message_count = 0;
+		seq->complete = TRUE;
 
-		/* Check all the in use satellite ids */
-		for (j = 0; j < ctxt->in_use_count; j++) {
-			if (id == ctxt->in_use[j]) {
-				in_use = TRUE;
-				break;
+		/* Send them as soon as every talker has finished */
+		for (i = 0; i < ctxt->gsv_count; i++) {
+			if (!ctxt->gsv[i].complete) {
+				return TRUE;
 			}
 		}
-
-		gypsy_client_add_satellite (ctxt->client, id, in_use,
-					    elevation, azimuth, snr);
-	}
-
-	ctxt->message_count++;
-	if (ctxt->message_count == ctxt->number_of_messages) {
-		gypsy_client_set_satellites (ctxt->client);
-		ctxt->message_count = 0;
+		commit_satellites (ctxt);
 	}
 
 	return TRUE;
@@ -402,11 +533,18 @@ parse_gsa (NMEAParseContext *ctxt,
 	/* We actually have a real fix type now */
 	gypsy_client_set_fix_type (ctxt->client, atoi (GSA_FIELD(1)), FALSE);
 
-	sat_count = 0;
+	/* The first of a run of GSA starts the epoch's set */
+	if (!ctxt->in_gsa_run) {
+		ctxt->in_use_count = 0;
+		ctxt->in_gsa_run = TRUE;
+	}
+
+	sat_count = ctxt->in_use_count;
 	for (i = GSA_FIRST_SAT; i <= GSA_LAST_SAT; i++) {
 		char *sat = GSA_FIELD(i);
 
-		if (sat == NULL || *sat == '\0') {
+		if (sat == NULL || *sat == '\0' ||
+		    sat_count == NMEA_MAX_IN_USE) {
 			break;
 		}
 
@@ -452,7 +590,8 @@ parse_gga (NMEAParseContext *ctxt,
 	float latitude, longitude, altitude;
 	PositionFields fields;
 	FixType fix_type;
-	int timestamp;
+	double dgps_age;
+	int timestamp, dgps_station;
 
 	field_count = split_sentence (data, ctxt->fields.gga_fields,
 				      GGA_FIELDS);
@@ -470,9 +609,13 @@ parse_gga (NMEAParseContext *ctxt,
 	if (field_count < GGA_FIELDS)
 		return FALSE;
 
+	end_satellite_epoch (ctxt);
+
 	timestamp = calculate_timestamp (ctxt, GGA_FIELD(0));
 	if (timestamp > 0) {
-		gypsy_client_set_timestamp (ctxt->client, timestamp);
+		gypsy_client_set_precise_timestamp
+			(ctxt->client, timestamp,
+			 calculate_fraction (GGA_FIELD(0)));
 	}
 
 	fields = POSITION_NONE;
@@ -499,6 +642,13 @@ parse_gga (NMEAParseContext *ctxt,
 	gypsy_client_set_accuracy (ctxt->client, ACCURACY_HORIZONTAL,
 				   0, g_strtod (GGA_FIELD(7), NULL), 0);
 
+	/* The quality says whether corrections are being used,
+	   and for RTK whether the solution is fixed or float */
+	dgps_age = *GGA_FIELD(12) ? g_ascii_strtod (GGA_FIELD(12), NULL) : -1.0;
+	dgps_station = *GGA_FIELD(13) ? atoi (GGA_FIELD(13)) : -1;
+	gypsy_client_set_fix_quality (ctxt->client, atoi (GGA_FIELD(5)),
+				      dgps_age, dgps_station);
+
 	return TRUE;
 }
 
@@ -546,12 +696,15 @@ parse_rmc (NMEAParseContext *ctxt,
 	if (field_count < RMC_FIELDS)
 		return FALSE;
 
+	end_satellite_epoch (ctxt);
+
 	/* We can store the datestamp now */
 	ctxt->datestamp = calculate_datestamp (ctxt, RMC_FIELD(8));
 
 	/* Calculate the timestamp first */
-	gypsy_client_set_timestamp (ctxt->client,
-				    calculate_timestamp (ctxt, RMC_FIELD(0)));
+	gypsy_client_set_precise_timestamp
+		(ctxt->client, calculate_timestamp (ctxt, RMC_FIELD(0)),
+		 calculate_fraction (RMC_FIELD(0)));
 
 	/* RMC gives us Latitude and Longitude so we check them as well */
 	position_fields = POSITION_NONE;
@@ -579,14 +732,59 @@ parse_rmc (NMEAParseContext *ctxt,
 	return TRUE;
 }
 
+/* u-blox's PUBX,00 position sentence has the vertical velocity the
+   standard sentences leave out. Only that is taken from it:
+   0) Message ID, 00
+   1) UTC time
+   2-5) Latitude and longitude, as in GGA
+   6) Altitude above the ellipsoid
+   7) Navigation status
+   8) Horizontal accuracy estimate, metres
+   9) Vertical accuracy estimate, metres
+   10) Speed over the ground in km/h
+   11) Course over the ground, degrees true
+   12) Vertical velocity in m/s, positive downwards
+   13-19) DGPS age, HDOP, VDOP, TDOP, satellites, reserved, DR flag
+*/
+#define PUBX_FIELD(x) (ctxt->fields.pubx_fields[x])
+#define PUBX_VERTICAL_VELOCITY 12
+static gboolean
+parse_pubx (NMEAParseContext *ctxt,
+	    const char       *data)
+{
+	int field_count;
+
+	field_count = split_sentence (data, ctxt->fields.pubx_fields,
+				      PUBX_FIELDS);
+
+	/* The other PUBX messages aren't needed */
+	if (field_count < 1 || strcmp (PUBX_FIELD(0), "00") != 0) {
+		return TRUE;
+	}
+
+	if (field_count <= PUBX_VERTICAL_VELOCITY) {
+		return FALSE;
+	}
+
+	if (!IS_EMPTY (PUBX_FIELD(PUBX_VERTICAL_VELOCITY))) {
+		gypsy_client_set_course
+			(ctxt->client, COURSE_CLIMB, 0.0, 0.0,
+			 -g_ascii_strtod (PUBX_FIELD(PUBX_VERTICAL_VELOCITY),
+					  NULL));
+	}
+
+	return TRUE;
+}
+
 static struct _tag_parser parsers[] = {
-	/* Standard NMEA tags */
-	{ "GPRMC", parse_rmc },
-	{ "GPGGA", parse_gga },
-	{ "GPGSA", parse_gsa },
-	{ "GPGSV", parse_gsv },
+	/* Standard NMEA sentences, from any talker */
+	{ "RMC", parse_rmc },
+	{ "GGA", parse_gga },
+	{ "GSA", parse_gsa },
+	{ "GSV", parse_gsv },
 
 	/* Proprietry tags */
+	{ "PUBX", parse_pubx },
 	{ NULL, NULL }
 };
 
@@ -595,10 +793,27 @@ parse_tag (NMEAParseContext *ctxt,
 	   const char       *tag,
 	   const char       *data)
 {
+	const char *sentence = tag;
 	int i;
 
+	/* Standard tags are a two letter talker (GP, GL, GN...) and the
+	   sentence type. Proprietry ones start with P and are kept whole. */
+	if (tag[0] != 'P' && strlen (tag) == 5) {
+		sentence = tag + 2;
+		ctxt->talker[0] = tag[0];
+		ctxt->talker[1] = tag[1];
+		ctxt->talker[2] = '\0';
+	} else {
+		ctxt->talker[0] = '\0';
+	}
+
+	/* Anything else in between ends a run of GSA */
+	if (strcmp (sentence, "GSA") != 0) {
+		ctxt->in_gsa_run = FALSE;
+	}
+
 	for (i = 0; parsers[i].tag_name; i++) {
-		if (strcmp (parsers[i].tag_name, tag) == 0) {
+		if (strcmp (parsers[i].tag_name, sentence) == 0) {
 			return parsers[i].parser (ctxt, data);
 		}
 	}
@@ -32,14 +32,41 @@
 #include "nmea.h"
 #include "gypsy-client.h"
 
+/* The most talkers (GP, GL, GA, GB...) whose satellites
+   are merged into one set, and the most PRNs GSA can mark in use
+   across all of them in an epoch */
+#define NMEA_MAX_TALKERS 8
+#define NMEA_MAX_IN_USE 64
+
+typedef struct _NMEASatellite {
+	int id;
+	int elevation;
+	int azimuth;
+	int snr;
+} NMEASatellite;
+
+/* Each talker sends its own numbered run of GSV sentences */
+typedef struct _NMEAGsvSequence {
+	char talker[3];
+	int number_of_messages; /* How many GSV messages we'll get */
+	int message_count; /* Number of GSV messages seen */
+	gboolean complete; /* All of them seen since the last commit */
+	int sat_count;
+	NMEASatellite satellites[MAX_SAT_SVID];
+} NMEAGsvSequence;
+
 typedef struct _NMEAParseContext {
 	GypsyClient *client;
 
+	/* The talker of the sentence being parsed, empty for proprietry */
+	char talker[3];
+
 	union {
 		char *rmc_fields[RMC_FIELDS];
 		char *gga_fields[GGA_FIELDS];
 		char *gsa_fields[GSA_FIELDS];
 		char *gsv_fields[GSV_FIELDS];
+		char *pubx_fields[PUBX_FIELDS];
 	} fields;
 
 	/* This is stored as only RMC supplies it but other sentences
@@ -48,13 +75,17 @@ typedef struct _NMEAParseContext {
 	GDate *date; /* The date from the most recent RMC */
 	guint32 datestamp; /* Time from epoch in seconds */
 
-	/* This is used to store the in use details between sentences */
+	/* This is used to store the in use details between sentences.
+	   A multi-GNSS receiver sends a GSA for each system one after
+	   the other, and the satellites in use are all of them */
 	int in_use_count;
-	int in_use[MAX_SAT_SVID]; /* The satellites that are in use */
+	int in_use[NMEA_MAX_IN_USE]; /* The satellites that are in use */
+	gboolean in_gsa_run; /* The last sentence was a GSA too */
 
-	/* This is used to store the satellite details between sentences */
-	int number_of_messages; /* How many GSV messages we'll get */
-	int message_count; /* Number of GSV messages seen */
+	/* This is used to store the satellite details between sentences,
+	   until every talker's GSV have been seen for the epoch */
+	int gsv_count;
+	NMEAGsvSequence gsv[NMEA_MAX_TALKERS];
 } NMEAParseContext;
 
 gboolean nmea_parse_sentence (NMEAParseContext *ctxt,
@@ -0,0 +1,407 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+/*
+ * NMEA Profile - builds the vendor commands that select which NMEA
+ *                sentences a receiver emits, how often, and what it
+ *                is told about its time and position when it starts.
+ */
+
+#include <string.h>
+
+#include "nmea-profile.h"
+
+/* Appends the *XX checksum and <CR><LF> to a $-prefixed sentence */
+static char *
+finish_sentence (GString *sentence)
+{
+	const char *s;
+	int sum = 0;
+
+	/* The checksum covers everything between the $ and the * */
+	for (s = sentence->str + 1; *s; s++) {
+		sum ^= *s;
+	}
+
+	g_string_append_printf (sentence, "*%02X\r\n", sum);
+	return g_string_free (sentence, FALSE);
+}
+
+/* PMTK314 has 19 fields, each is the number of fixes between emissions
+   of that sentence, 0 disables it:
+   0) GLL
+   1) RMC
+   2) VTG
+   3) GGA
+   4) GSA
+   5) GSV
+   6) GRS
+   7) GST
+   8 - 12) Reserved
+   13) MALM
+   14) MEPH
+   15) MDGP
+   16) MDBG
+   17) ZDA
+   18) MCHN
+*/
+#define PMTK314_FIELDS 19
+char *
+nmea_profile_build_pmtk314 (NMEASentences sentences)
+{
+	GString *sentence;
+	int rates[PMTK314_FIELDS];
+	int i;
+
+	memset (rates, 0, sizeof (rates));
+	rates[0] = (sentences & NMEA_SENTENCE_GLL) ? 1 : 0;
+	rates[1] = (sentences & NMEA_SENTENCE_RMC) ? 1 : 0;
+	rates[2] = (sentences & NMEA_SENTENCE_VTG) ? 1 : 0;
+	rates[3] = (sentences & NMEA_SENTENCE_GGA) ? 1 : 0;
+	rates[4] = (sentences & NMEA_SENTENCE_GSA) ? 1 : 0;
+	rates[5] = (sentences & NMEA_SENTENCE_GSV) ? 1 : 0;
+	rates[17] = (sentences & NMEA_SENTENCE_ZDA) ? 1 : 0;
+
+	sentence = g_string_new ("$PMTK314");
+	for (i = 0; i < PMTK314_FIELDS; i++) {
+		g_string_append_printf (sentence, ",%d", rates[i]);
+	}
+
+	return finish_sentence (sentence);
+}
+
+/* PMTK314 with a single -1 restores the receiver's own defaults */
+char *
+nmea_profile_build_pmtk314_default (void)
+{
+	return finish_sentence (g_string_new ("$PMTK314,-1"));
+}
+
+/* PMTK220 sets the time between fixes in ms */
+char *
+nmea_profile_build_pmtk220 (guint period)
+{
+	GString *sentence;
+
+	sentence = g_string_new (NULL);
+	g_string_printf (sentence, "$PMTK220,%u", period);
+
+	return finish_sentence (sentence);
+}
+
+/* PMTK740 gives the receiver the current UTC time */
+char *
+nmea_profile_build_pmtk740 (GDateTime *time)
+{
+	GString *sentence;
+
+	sentence = g_string_new ("$PMTK740");
+	g_string_append_printf (sentence, ",%d,%d,%d,%d,%d,%d",
+				g_date_time_get_year (time),
+				g_date_time_get_month (time),
+				g_date_time_get_day_of_month (time),
+				g_date_time_get_hour (time),
+				g_date_time_get_minute (time),
+				g_date_time_get_second (time));
+
+	return finish_sentence (sentence);
+}
+
+/* PMTK741 gives the receiver a reference position, in degrees
+   and metres, along with the current UTC time */
+char *
+nmea_profile_build_pmtk741 (double     latitude,
+			    double     longitude,
+			    double     altitude,
+			    GDateTime *time)
+{
+	GString *sentence;
+	char lat[G_ASCII_DTOSTR_BUF_SIZE];
+	char lon[G_ASCII_DTOSTR_BUF_SIZE];
+	char alt[G_ASCII_DTOSTR_BUF_SIZE];
+
+	sentence = g_string_new ("$PMTK741");
+	g_string_append_printf (sentence, ",%s,%s,%s,%d,%d,%d,%d,%d,%d",
+				g_ascii_formatd (lat, sizeof (lat), "%.6f",
+						 latitude),
+				g_ascii_formatd (lon, sizeof (lon), "%.6f",
+						 longitude),
+				g_ascii_formatd (alt, sizeof (alt), "%.1f",
+						 altitude),
+				g_date_time_get_year (time),
+				g_date_time_get_month (time),
+				g_date_time_get_day_of_month (time),
+				g_date_time_get_hour (time),
+				g_date_time_get_minute (time),
+				g_date_time_get_second (time));
+
+	return finish_sentence (sentence);
+}
+
+/* PMTK161,0 puts the receiver in standby until it is sent anything */
+char *
+nmea_profile_build_pmtk161_standby (void)
+{
+	return finish_sentence (g_string_new ("$PMTK161,0"));
+}
+
+#define UBX_SYNC_1 0xb5
+#define UBX_SYNC_2 0x62
+#define UBX_CLASS_CFG 0x06
+#define UBX_CFG_MSG 0x01
+#define UBX_CFG_RATE 0x08
+#define UBX_CFG_NAVX5 0x23
+#define UBX_CLASS_RXM 0x02
+#define UBX_RXM_PMREQ 0x41
+#define UBX_CLASS_MGA 0x13
+#define UBX_MGA_INI 0x40
+#define UBX_CLASS_NMEA 0xf0
+
+static const struct {
+	NMEASentences sentence;
+	guint8 ubx_id;
+} ubx_nmea_ids[] = {
+	{ NMEA_SENTENCE_GGA, 0x00 },
+	{ NMEA_SENTENCE_GLL, 0x01 },
+	{ NMEA_SENTENCE_GSA, 0x02 },
+	{ NMEA_SENTENCE_GSV, 0x03 },
+	{ NMEA_SENTENCE_RMC, 0x04 },
+	{ NMEA_SENTENCE_VTG, 0x05 },
+	{ NMEA_SENTENCE_ZDA, 0x08 },
+};
+
+/* Builds one UBX-CFG-MSG packet per NMEA sentence type, setting its rate
+   on the current port to 1 (every fix) or 0 (off). */
+GByteArray *
+nmea_profile_build_ubx_cfg_msg (NMEASentences sentences)
+{
+	GByteArray *packets;
+	int i;
+
+	packets = g_byte_array_new ();
+	for (i = 0; i < G_N_ELEMENTS (ubx_nmea_ids); i++) {
+		guint8 packet[11];
+		guint8 ck_a = 0, ck_b = 0;
+		int j;
+
+		packet[0] = UBX_SYNC_1;
+		packet[1] = UBX_SYNC_2;
+		packet[2] = UBX_CLASS_CFG;
+		packet[3] = UBX_CFG_MSG;
+		packet[4] = 3; /* Payload length, little endian */
+		packet[5] = 0;
+		packet[6] = UBX_CLASS_NMEA;
+		packet[7] = ubx_nmea_ids[i].ubx_id;
+		packet[8] = (sentences & ubx_nmea_ids[i].sentence) ? 1 : 0;
+
+		/* 8-bit Fletcher checksum over class, id, length and payload */
+		for (j = 2; j < 9; j++) {
+			ck_a += packet[j];
+			ck_b += ck_a;
+		}
+		packet[9] = ck_a;
+		packet[10] = ck_b;
+
+		g_byte_array_append (packets, packet, sizeof (packet));
+	}
+
+	return packets;
+}
+
+/* Builds a UBX-CFG-RATE packet setting the time between fixes
+   in ms, with a navigation solution for every measurement */
+GByteArray *
+nmea_profile_build_ubx_cfg_rate (guint period)
+{
+	GByteArray *packet;
+	guint8 data[14];
+	guint8 ck_a = 0, ck_b = 0;
+	int j;
+
+	data[0] = UBX_SYNC_1;
+	data[1] = UBX_SYNC_2;
+	data[2] = UBX_CLASS_CFG;
+	data[3] = UBX_CFG_RATE;
+	data[4] = 6; /* Payload length, little endian */
+	data[5] = 0;
+	data[6] = period & 0xff; /* measRate */
+	data[7] = (period >> 8) & 0xff;
+	data[8] = 1; /* navRate */
+	data[9] = 0;
+	data[10] = 1; /* timeRef, GPS time */
+	data[11] = 0;
+
+	for (j = 2; j < 12; j++) {
+		ck_a += data[j];
+		ck_b += ck_a;
+	}
+	data[12] = ck_a;
+	data[13] = ck_b;
+
+	packet = g_byte_array_new ();
+	g_byte_array_append (packet, data, sizeof (data));
+
+	return packet;
+}
+
+/* Builds a UBX-RXM-PMREQ packet putting the receiver into backup mode
+   until it sees activity on its serial port. Ephemeris and almanac are
+   kept, so it comes back with a hot start */
+GByteArray *
+nmea_profile_build_ubx_rxm_pmreq (void)
+{
+	GByteArray *packet;
+	guint8 data[16];
+	guint8 ck_a = 0, ck_b = 0;
+	int j;
+
+	memset (data, 0, sizeof (data));
+	data[0] = UBX_SYNC_1;
+	data[1] = UBX_SYNC_2;
+	data[2] = UBX_CLASS_RXM;
+	data[3] = UBX_RXM_PMREQ;
+	data[4] = 8; /* Payload length, little endian */
+	data[5] = 0;
+	/* data[6-9] is the duration, 0 for until woken */
+	data[10] = 0x02; /* flags, backup */
+
+	for (j = 2; j < 14; j++) {
+		ck_a += data[j];
+		ck_b += ck_a;
+	}
+	data[14] = ck_a;
+	data[15] = ck_b;
+
+	packet = g_byte_array_new ();
+	g_byte_array_append (packet, data, sizeof (data));
+
+	return packet;
+}
+
+/* Wraps payload in the UBX sync characters, header and checksum */
+static GByteArray *
+build_ubx_packet (guint8        class_id,
+		  guint8        message_id,
+		  const guint8 *payload,
+		  guint16       length)
+{
+	GByteArray *packet;
+	guint8 header[6], checksum[2] = { 0, 0 };
+	guint i;
+
+	header[0] = UBX_SYNC_1;
+	header[1] = UBX_SYNC_2;
+	header[2] = class_id;
+	header[3] = message_id;
+	header[4] = length & 0xff;
+	header[5] = length >> 8;
+
+	packet = g_byte_array_sized_new (length + 8);
+	g_byte_array_append (packet, header, sizeof (header));
+	g_byte_array_append (packet, payload, length);
+
+	for (i = 2; i < packet->len; i++) {
+		checksum[0] += packet->data[i];
+		checksum[1] += checksum[0];
+	}
+	g_byte_array_append (packet, checksum, sizeof (checksum));
+
+	return packet;
+}
+
+static void
+put_u16 (guint8 *data,
+	 guint16 value)
+{
+	data[0] = value & 0xff;
+	data[1] = value >> 8;
+}
+
+static void
+put_u32 (guint8 *data,
+	 guint32 value)
+{
+	data[0] = value & 0xff;
+	data[1] = (value >> 8) & 0xff;
+	data[2] = (value >> 16) & 0xff;
+	data[3] = value >> 24;
+}
+
+/* UBX-MGA-INI-TIME_UTC, with the time only trusted to a couple of seconds
+   as it comes from the system clock */
+GByteArray *
+nmea_profile_build_ubx_mga_ini_time (GDateTime *time)
+{
+	guint8 payload[24];
+
+	memset (payload, 0, sizeof (payload));
+	payload[0] = 0x10; /* type, TIME_UTC */
+	payload[3] = 0x80; /* leapSecs, unknown */
+	put_u16 (payload + 4, g_date_time_get_year (time));
+	payload[6] = g_date_time_get_month (time);
+	payload[7] = g_date_time_get_day_of_month (time);
+	payload[8] = g_date_time_get_hour (time);
+	payload[9] = g_date_time_get_minute (time);
+	payload[10] = g_date_time_get_second (time);
+	put_u16 (payload + 16, 2); /* tAccS */
+
+	return build_ubx_packet (UBX_CLASS_MGA, UBX_MGA_INI,
+				 payload, sizeof (payload));
+}
+
+/* UBX-MGA-INI-POS_LLH, accuracy is in metres */
+GByteArray *
+nmea_profile_build_ubx_mga_ini_pos (double latitude,
+				    double longitude,
+				    double altitude,
+				    guint  accuracy)
+{
+	guint8 payload[20];
+
+	memset (payload, 0, sizeof (payload));
+	payload[0] = 0x01; /* type, POS_LLH */
+	put_u32 (payload + 4, (gint32) (latitude * 1e7));
+	put_u32 (payload + 8, (gint32) (longitude * 1e7));
+	put_u32 (payload + 12, (gint32) (altitude * 100));
+	put_u32 (payload + 16, accuracy * 100);
+
+	return build_ubx_packet (UBX_CLASS_MGA, UBX_MGA_INI,
+				 payload, sizeof (payload));
+}
+
+/* UBX-CFG-NAVX5 changing only ackAiding, so the receiver answers each
+   MGA message with UBX-MGA-ACK-DATA0. It is off out of the box */
+GByteArray *
+nmea_profile_build_ubx_cfg_navx5_ack_aiding (void)
+{
+	guint8 payload[40];
+
+	memset (payload, 0, sizeof (payload));
+	put_u16 (payload + 2, 1 << 10); /* mask1, ackAid */
+	payload[17] = 1; /* ackAiding */
+
+	return build_ubx_packet (UBX_CLASS_CFG, UBX_CFG_NAVX5,
+				 payload, sizeof (payload));
+}
@@ -0,0 +1,74 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * Gypsy
+ *
+ * A simple to use and understand GPSD replacement
+ * that uses D-Bus, GLib and memory allocations
+ *
+ * Copyright (C) 2026
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef __NMEA_PROFILE_H__
+#define __NMEA_PROFILE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* The NMEA sentences a receiver can be asked to emit */
+typedef enum {
+	NMEA_SENTENCE_NONE	= 0,
+	NMEA_SENTENCE_GGA	= 1 << 0,
+	NMEA_SENTENCE_GLL	= 1 << 1,
+	NMEA_SENTENCE_GSA	= 1 << 2,
+	NMEA_SENTENCE_GSV	= 1 << 3,
+	NMEA_SENTENCE_RMC	= 1 << 4,
+	NMEA_SENTENCE_VTG	= 1 << 5,
+	NMEA_SENTENCE_ZDA	= 1 << 6
+} NMEASentences;
+
+/* What receivers emit out of the box */
+#define NMEA_SENTENCE_DEFAULT (NMEA_SENTENCE_GGA | NMEA_SENTENCE_GLL | \
+			       NMEA_SENTENCE_GSA | NMEA_SENTENCE_GSV | \
+			       NMEA_SENTENCE_RMC | NMEA_SENTENCE_VTG)
+
+char *nmea_profile_build_pmtk314 (NMEASentences sentences);
+char *nmea_profile_build_pmtk314_default (void);
+GByteArray *nmea_profile_build_ubx_cfg_msg (NMEASentences sentences);
+
+char *nmea_profile_build_pmtk220 (guint period);
+GByteArray *nmea_profile_build_ubx_cfg_rate (guint period);
+
+char *nmea_profile_build_pmtk161_standby (void);
+GByteArray *nmea_profile_build_ubx_rxm_pmreq (void);
+
+char *nmea_profile_build_pmtk740 (GDateTime *time);
+char *nmea_profile_build_pmtk741 (double     latitude,
+				  double     longitude,
+				  double     altitude,
+				  GDateTime *time);
+GByteArray *nmea_profile_build_ubx_mga_ini_time (GDateTime *time);
+GByteArray *nmea_profile_build_ubx_mga_ini_pos (double latitude,
+						double longitude,
+						double altitude,
+						guint  accuracy);
+GByteArray *nmea_profile_build_ubx_cfg_navx5_ack_aiding (void);
+
+G_END_DECLS
+
+#endif
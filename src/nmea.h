@@ -14,12 +14,14 @@
 #define GSA_FIELDS 17
 #define GGA_FIELDS 14
 #define RMC_FIELDS 11
+#define PUBX_FIELDS 20
 
 typedef enum {
 	POSITION_NONE		= 0,
 	POSITION_LATITUDE	= 1 << 0,
 	POSITION_LONGITUDE	= 1 << 1,
-	POSITION_ALTITUDE	= 1 << 2
+	POSITION_ALTITUDE	= 1 << 2,
+	POSITION_PREDICTED	= 1 << 3
 } PositionFields;
 
 typedef enum {
@@ -36,6 +38,19 @@ typedef enum {
 	FIX_3D
 } FixType;
 
+/* The quality field of GGA */
+typedef enum {
+	FIX_QUALITY_INVALID = 0,
+	FIX_QUALITY_GPS,
+	FIX_QUALITY_DGPS,
+	FIX_QUALITY_PPS,
+	FIX_QUALITY_RTK_FIXED,
+	FIX_QUALITY_RTK_FLOAT,
+	FIX_QUALITY_ESTIMATED,
+	FIX_QUALITY_MANUAL,
+	FIX_QUALITY_SIMULATION
+} FixQuality;
+
 typedef enum {
 	ACCURACY_NONE		= 0,
 	ACCURACY_POSITION	= 1 << 0, /* 3D */